@@ -0,0 +1,280 @@
+#include "CascadedShadows.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+namespace Helpers
+{
+	// Light space bounds of a world space box
+	static void LightSpaceBounds(const glm::mat4& lightView, const glm::vec3& minExtents, const glm::vec3& maxExtents, glm::vec3& lightMin, glm::vec3& lightMax)
+	{
+		lightMin = glm::vec3(FLT_MAX);
+		lightMax = glm::vec3(-FLT_MAX);
+		for (int i = 0; i < 8; i++)
+		{
+			const glm::vec3 corner{ (i & 1) ? maxExtents.x : minExtents.x, (i & 2) ? maxExtents.y : minExtents.y, (i & 4) ? maxExtents.z : minExtents.z };
+			const glm::vec3 light{ lightView * glm::vec4(corner, 1.0f) };
+			lightMin = glm::min(lightMin, light);
+			lightMax = glm::max(lightMax, light);
+		}
+	}
+
+	static const char* RedrawName(ShadowRedraw redraw)
+	{
+		switch (redraw)
+		{
+		case ShadowRedraw::EveryFrame:
+			return "every frame";
+		case ShadowRedraw::FirstFrame:
+			return "first frame";
+		case ShadowRedraw::Invalidated:
+			return "invalidated";
+		case ShadowRedraw::Sun:
+			return "sun moved";
+		case ShadowRedraw::View:
+			return "view moved";
+		default:
+			return "cached";
+		}
+	}
+
+	bool CascadedShadows::Initialise(GpuResourceRegistry& resources)
+	{
+		m_atlas = resources.CreateRenderTarget("Shadow atlas", KAtlasSize, KAtlasSize, KAtlasFormat);
+		if (!m_atlas)
+		{
+			std::cout << "ERROR: could not make the shadow atlas" << std::endl;
+			return false;
+		}
+		for (Cascade& cascade : m_cascades)
+			cascade = Cascade();
+		m_invalidated = true;
+		return true;
+	}
+
+	// The sides are moved out to whole texels, so a box fitted again after a small move covers the same texels
+	void CascadedShadows::SnapBox(float extent, glm::vec3& boxMin, glm::vec3& boxMax)
+	{
+		const float texel{ extent / KCascadeSize };
+		const glm::vec2 centre{ (glm::vec2(boxMin) + glm::vec2(boxMax)) * 0.5f };
+		const glm::vec2 origin{ glm::floor((centre - extent * 0.5f) / texel) * texel };
+		boxMin = glm::vec3(origin, boxMin.z);
+		boxMax = glm::vec3(origin + extent, boxMax.z);
+	}
+
+	// The range's corners in light space clipped to the receivers, reaching back to the casters nearest the sun. The
+	// square is grown in steps of a quarter of the range's diagonal, which does not change as the camera turns, so it
+	// keeps its size and texel size over small moves.
+	void CascadedShadows::FitCascade(const glm::mat4& inverseView, const ShadowView& view, float splitNear, float splitFar, bool withCasters,
+		glm::vec3& boxMin, glm::vec3& boxMax) const
+	{
+		const float tanHalfFovY{ std::tan(view.fovY * 0.5f) };
+		glm::vec3 corners[8];
+		glm::vec3 cornersMin{ FLT_MAX }, cornersMax{ -FLT_MAX };
+		for (int i = 0; i < 8; i++)
+		{
+			const float depth{ (i & 4) ? splitFar : splitNear };
+			const glm::vec4 corner{ ((i & 1) ? 1.0f : -1.0f) * depth * tanHalfFovY * view.aspect, ((i & 2) ? 1.0f : -1.0f) * depth * tanHalfFovY, -depth, 1.0f };
+			corners[i] = glm::vec3(m_lightView * (inverseView * corner));
+			cornersMin = glm::min(cornersMin, corners[i]);
+			cornersMax = glm::max(cornersMax, corners[i]);
+		}
+
+		glm::vec3 receiversMin, receiversMax;
+		LightSpaceBounds(m_lightView, view.receiversMin, view.receiversMax, receiversMin, receiversMax);
+		float nearestSun{ receiversMax.z };
+		if (withCasters)
+		{
+			glm::vec3 castersMin, castersMax;
+			LightSpaceBounds(m_lightView, view.castersMin, view.castersMax, castersMin, castersMax);
+			nearestSun = std::max(nearestSun, castersMax.z);
+		}
+
+		boxMin = glm::max(cornersMin, receiversMin);
+		boxMax = glm::vec3(glm::min(glm::vec2(cornersMax), glm::vec2(receiversMax)), nearestSun);
+		if (boxMin.x >= boxMax.x || boxMin.y >= boxMax.y || boxMin.z >= boxMax.z)
+		{
+			// Nothing in the range to shadow, the receivers' box keeps the cascade usable
+			boxMin = receiversMin;
+			boxMax = glm::vec3(glm::vec2(receiversMax), nearestSun);
+		}
+
+		const float step{ std::max(glm::length(corners[7] - corners[0]) * 0.25f, 1.0f) };
+		const float tight{ std::max(boxMax.x - boxMin.x, boxMax.y - boxMin.y) };
+		float extent{ std::max(std::ceil(tight / step), 1.0f) * step };
+		if (extent - tight < 2.0f * extent / KCascadeSize)
+			extent += step;
+		SnapBox(extent, boxMin, boxMax);
+	}
+
+	// Splits blend between even steps and steps of the same ratio. The cascades that are not cached are fitted
+	// every frame, a cached one is fitted with its margin only when it has to be drawn again.
+	void CascadedShadows::Update(const ShadowView& view)
+	{
+		const glm::vec3 sun{ glm::normalize(view.sunDirection) };
+		const bool sunMoved{ glm::dot(sun, m_sunDirection) < 0.99999f };
+		if (sunMoved)
+		{
+			m_sunDirection = sun;
+			const glm::vec3 up{ std::abs(sun.y) > 0.99f ? glm::vec3(0, 0, 1) : glm::vec3(0, 1, 0) };
+			m_lightView = glm::lookAt(glm::vec3(0), sun, up);
+		}
+
+		const glm::mat4 inverseView{ glm::inverse(view.view) };
+		m_depthPlane = -glm::vec4(view.view[0][2], view.view[1][2], view.view[2][2], view.view[3][2]);
+		m_drawCascades = 0;
+
+		float splitNear{ view.nearZ };
+		for (int c = 0; c < KNumCascades; c++)
+		{
+			const double start{ glfwGetTime() };
+			Cascade& cascade{ m_cascades[c] };
+			const float t{ (c + 1) / (float)KNumCascades };
+			const float splitFar{ glm::mix(view.nearZ + (m_shadowDistance - view.nearZ) * t, view.nearZ * std::pow(m_shadowDistance / view.nearZ, t), m_splitBlend) };
+			const bool cached{ c >= KFirstCachedCascade };
+
+			glm::vec3 boxMin, boxMax;
+			FitCascade(inverseView, view, splitNear, splitFar, !cached, boxMin, boxMax);
+
+			ShadowCascadeStats& stats{ cascade.stats };
+			stats.splitNear = splitNear;
+			stats.splitFar = splitFar;
+			stats.cached = cached;
+			stats.redraw = cached ? ShadowRedraw::None : ShadowRedraw::EveryFrame;
+			if (cached)
+			{
+				const float extent{ boxMax.x - boxMin.x };
+				const float cachedExtent{ cascade.boxMax.x - cascade.boxMin.x };
+				const bool inside{ glm::all(glm::greaterThanEqual(boxMin, cascade.boxMin)) && glm::all(glm::lessThanEqual(boxMax, cascade.boxMax)) };
+				if (!cascade.fitted)
+					stats.redraw = ShadowRedraw::FirstFrame;
+				else if (m_invalidated)
+					stats.redraw = ShadowRedraw::Invalidated;
+				else if (sunMoved)
+					stats.redraw = ShadowRedraw::Sun;
+				else if (!inside || cachedExtent > 2.0f * (1.0f + 2.0f * m_cacheMargin) * extent)
+					stats.redraw = ShadowRedraw::View;
+
+				if (stats.redraw != ShadowRedraw::None)
+				{
+					const float margin{ extent * m_cacheMargin };
+					boxMin -= glm::vec3(margin);
+					boxMax += glm::vec3(margin, margin, 0.0f);
+					SnapBox(extent + 2.0f * margin, boxMin, boxMax);
+				}
+			}
+
+			if (stats.redraw != ShadowRedraw::None)
+			{
+				cascade.boxMin = boxMin;
+				cascade.boxMax = boxMax;
+				cascade.fitted = true;
+				stats.redraws++;
+				stats.casters = 0;
+				stats.castersDrawn = 0;
+				stats.triangles = 0;
+				m_drawCascades |= 1u << c;
+			}
+			stats.extent = cascade.boxMax.x - cascade.boxMin.x;
+			stats.texelSize = stats.extent / KCascadeSize;
+			stats.milliseconds = (float)((glfwGetTime() - start) * 1000.0);
+			splitNear = splitFar;
+		}
+		m_invalidated = false;
+	}
+
+	// Touching the cascade's sides and not wholly beyond its far side
+	GLuint CascadedShadows::CullCaster(const glm::vec3& minExtents, const glm::vec3& maxExtents, GLuint cascades)
+	{
+		glm::vec3 lightMin, lightMax;
+		LightSpaceBounds(m_lightView, minExtents, maxExtents, lightMin, lightMax);
+
+		GLuint touched{ 0 };
+		for (int c = 0; c < KNumCascades; c++)
+		{
+			if (!(cascades & (1u << c)))
+				continue;
+			Cascade& cascade{ m_cascades[c] };
+			cascade.stats.casters++;
+			if (lightMax.x > cascade.boxMin.x && lightMin.x < cascade.boxMax.x && lightMax.y > cascade.boxMin.y && lightMin.y < cascade.boxMax.y &&
+				lightMax.z > cascade.boxMin.z)
+				touched |= 1u << c;
+		}
+		return touched;
+	}
+
+	void CascadedShadows::CountDraw(GLuint cascades, size_t triangles)
+	{
+		for (int c = 0; c < KNumCascades; c++)
+		{
+			if (!(cascades & (1u << c)))
+				continue;
+			m_cascades[c].stats.castersDrawn++;
+			m_cascades[c].stats.triangles += triangles;
+		}
+	}
+
+	glm::mat4 CascadedShadows::CascadeXform(int cascade) const
+	{
+		const Cascade& fitted{ m_cascades[cascade] };
+		return glm::ortho(fitted.boxMin.x, fitted.boxMax.x, fitted.boxMin.y, fitted.boxMax.y, -fitted.boxMax.z, -fitted.boxMin.z) * m_lightView;
+	}
+
+	// Cascade c is the quarter at column c % 2 and row c / 2 of the atlas
+	ShadowCasterData CascadedShadows::GetCasterData(GLuint cascades, GLsizei& instances) const
+	{
+		ShadowCasterData data;
+		instances = 0;
+		for (int c = 0; c < KNumCascades; c++)
+		{
+			data.cascadeXform[c] = CascadeXform(c);
+			data.cascadeAtlas[c] = glm::vec4(0.5f, 0.5f, (c & 1) ? 0.5f : -0.5f, (c >> 1) ? 0.5f : -0.5f);
+			if (cascades & (1u << c))
+				data.drawCascades[instances++] = c;
+		}
+		return data;
+	}
+
+	// Clip space to the cascade's quarter of the atlas's texture coordinates, depth to 0 to 1
+	ShadowReceiverData CascadedShadows::GetReceiverData() const
+	{
+		ShadowReceiverData data;
+		for (int c = 0; c < KNumCascades; c++)
+		{
+			const Cascade& cascade{ m_cascades[c] };
+			const glm::mat4 toAtlas{ glm::scale(glm::translate(glm::mat4(1), glm::vec3((c & 1) * 0.5f + 0.25f, (c >> 1) * 0.5f + 0.25f, 0.5f)),
+				glm::vec3(0.25f, 0.25f, 0.5f)) };
+			data.shadowXform[c] = toAtlas * CascadeXform(c);
+			data.splitDepths[c] = cascade.stats.splitFar;
+			data.texelWorld[c] = cascade.stats.texelSize;
+			data.depthBias[c] = 1.5f * cascade.stats.texelSize / std::max(cascade.boxMax.z - cascade.boxMin.z, 0.001f);
+		}
+		data.depthPlane = m_depthPlane;
+		return data;
+	}
+
+	glm::ivec4 CascadedShadows::GetCascadeRect(int cascade) const
+	{
+		return glm::ivec4((cascade & 1) * KCascadeSize, (cascade >> 1) * KCascadeSize, KCascadeSize, KCascadeSize);
+	}
+
+	void CascadedShadows::DefineGUI()
+	{
+		bool changed{ false };
+		changed |= ImGui::SliderFloat("Shadow distance", &m_shadowDistance, 500.0f, 10000.0f, "%.0f");
+		changed |= ImGui::SliderFloat("Splits even to by ratio", &m_splitBlend, 0.0f, 1.0f, "%.2f");
+		changed |= ImGui::SliderFloat("Cached cascade margin", &m_cacheMargin, 0.0f, 1.0f, "%.2f");
+		changed |= ImGui::Button("Draw cached cascades again");
+		if (changed)
+			Invalidate();
+
+		ImGui::Text("%d cascades of %dx%d in a %dx%d atlas, from cascade %d cached", KNumCascades, KCascadeSize, KCascadeSize, KAtlasSize, KAtlasSize, KFirstCachedCascade);
+		for (int c = 0; c < KNumCascades; c++)
+		{
+			const ShadowCascadeStats& stats{ m_cascades[c].stats };
+			ImGui::Text("%d  %6.0f to %6.0f  %6.0f across, %.2f per texel, fit in %.3f ms", c, stats.splitNear, stats.splitFar, stats.extent, stats.texelSize, stats.milliseconds);
+			ImGui::Text("   %s, %zu redraws, %zu of %zu casters drawn, %zu triangles", RedrawName(stats.redraw), stats.redraws, stats.castersDrawn, stats.casters, stats.triangles);
+		}
+	}
+}
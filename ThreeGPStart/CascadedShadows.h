@@ -0,0 +1,148 @@
+#pragma once
+// Cascaded shadow maps for the sun. The view out to the shadow distance is split into KNumCascades ranges of depth,
+// the near ones shorter, and each range gets an orthographic view along the sun fitted to the part of it that holds
+// something to shadow: the range's corners clipped to the receivers' bounds, reaching back to every caster towards
+// the sun, grown in steps and moved in whole texels so it does not shimmer as the camera moves. The cascades are the
+// quarters of one depth atlas. Those from KFirstCachedCascade on hold the static casters only and are fitted with a
+// margin, so they are drawn again only when the sun or the static casters change or the view leaves the margin.
+// A caster is drawn into every cascade it touches with one instanced draw, each instance clipped to its quarter,
+// see shadow_caster.vert.
+
+#include "ExternalLibraryHeaders.h"
+#include "GpuResources.h"
+
+namespace Helpers
+{
+	// The ShadowCaster uniform block of shadow_caster.vert, std140
+	struct ShadowCasterData
+	{
+		glm::mat4 cascadeXform[4];			// world to each cascade's clip space
+		glm::vec4 cascadeAtlas[4];			// xy scale, zw offset from a cascade's clip space to its quarter of the atlas
+		glm::ivec4 drawCascades{ 0 };		// instance i is drawn into cascade drawCascades[i]
+	};
+
+	// The ShadowReceiver uniform block of shadows.glsl, std140
+	struct ShadowReceiverData
+	{
+		glm::mat4 shadowXform[4];			// world to atlas texture coordinates and depth
+		glm::vec4 splitDepths{ 0 };			// view depth each cascade is used to
+		glm::vec4 texelWorld{ 0 };			// world size of a texel of each cascade
+		glm::vec4 depthBias{ 0 };			// of each cascade, in atlas depth
+		glm::vec4 depthPlane{ 0 };			// world position to view depth
+	};
+
+	// What the cascades are fitted to, all in world space
+	struct ShadowView
+	{
+		glm::mat4 view{ 1 };
+		float fovY{ 0 };					// radians
+		float aspect{ 1 };
+		float nearZ{ 0.1f };
+		glm::vec3 sunDirection{ 0, -1, 0 };	// the way the light travels
+		glm::vec3 receiversMin{ 0 };		// what shadows fall on, which also casts
+		glm::vec3 receiversMax{ 0 };
+		glm::vec3 castersMin{ 0 };			// the dynamic casters, only drawn into the cascades that are not cached
+		glm::vec3 castersMax{ 0 };
+	};
+
+	// Why a cascade was drawn this frame
+	enum class ShadowRedraw
+	{
+		None,
+		EveryFrame,
+		FirstFrame,
+		Invalidated,		// the static casters or the settings changed
+		Sun,
+		View				// the view left the margin, or it covers far too much
+	};
+
+	// One cascade in the last Update, and the draws counted into it the last time it was drawn
+	struct ShadowCascadeStats
+	{
+		float splitNear{ 0 };
+		float splitFar{ 0 };
+		float extent{ 0 };					// world units across
+		float texelSize{ 0 };
+		bool cached{ false };
+		ShadowRedraw redraw{ ShadowRedraw::None };
+		size_t redraws{ 0 };				// since Initialise
+		size_t casters{ 0 };				// culled against the cascade, and drawn into it
+		size_t castersDrawn{ 0 };
+		size_t triangles{ 0 };
+		float milliseconds{ 0 };			// fitting it
+	};
+
+	class CascadedShadows
+	{
+	public:
+		// Must match shadows.glsl and shadow_caster.vert
+		static constexpr int KNumCascades{ 4 };
+		static constexpr GLsizei KCascadeSize{ 1024 };		// texels across a cascade, the atlas is 2 x 2 of them
+		static constexpr GLsizei KAtlasSize{ 2 * KCascadeSize };
+		static constexpr GLenum KAtlasFormat{ GL_DEPTH_COMPONENT32F };
+		static constexpr int KFirstCachedCascade{ 2 };
+		static constexpr GLuint KAllCascades{ (1u << KNumCascades) - 1 };
+		static constexpr GLuint KCachedCascades{ KAllCascades & ~((1u << KFirstCachedCascade) - 1) };
+	private:
+		struct Cascade
+		{
+			glm::vec3 boxMin{ 0 };		// light space, xy the sides and z from the far side to the side nearest the sun
+			glm::vec3 boxMax{ 0 };
+			bool fitted{ false };
+			ShadowCascadeStats stats;
+		};
+
+		GpuRenderTarget m_atlas;
+		Cascade m_cascades[KNumCascades];
+		glm::mat4 m_lightView{ 1 };
+		glm::vec3 m_sunDirection{ 0 };
+		glm::vec4 m_depthPlane{ 0 };
+		GLuint m_drawCascades{ 0 };
+		bool m_invalidated{ true };
+
+		float m_shadowDistance{ 4000.0f };
+		float m_splitBlend{ 0.7f };			// 0 splits evenly, 1 by the same ratio
+		float m_cacheMargin{ 0.25f };		// cached cascades are fitted this fraction of their size larger each side
+
+		// The snapped light space box the range of depths needs
+		void FitCascade(const glm::mat4& inverseView, const ShadowView& view, float splitNear, float splitFar, bool withCasters,
+			glm::vec3& boxMin, glm::vec3& boxMax) const;
+
+		// Move a box's sides out to whole texels of a square of extent
+		static void SnapBox(float extent, glm::vec3& boxMin, glm::vec3& boxMax);
+
+		// World to the cascade's clip space
+		glm::mat4 CascadeXform(int cascade) const;
+	public:
+		// The atlas is made through resources, which must outlive this. False on error.
+		bool Initialise(GpuResourceRegistry& resources);
+
+		// Fit the cascades for this frame's view and choose which are drawn
+		void Update(const ShadowView& view);
+
+		// Draw the cached cascades again next Update, e.g. when a static caster moves
+		void Invalidate() { m_invalidated = true; }
+
+		// Those of cascades that a caster with these world bounds shadows into, counted into their stats
+		GLuint CullCaster(const glm::vec3& minExtents, const glm::vec3& maxExtents, GLuint cascades);
+
+		// Count a caster drawn into cascades, with triangles in each
+		void CountDraw(GLuint cascades, size_t triangles);
+
+		// Cascades to draw this frame, those not cached and any cached ones that changed
+		GLuint GetDrawCascades() const { return m_drawCascades; }
+
+		// The casters' block for an instanced draw into cascades, instances is how many it holds
+		ShadowCasterData GetCasterData(GLuint cascades, GLsizei& instances) const;
+		ShadowReceiverData GetReceiverData() const;
+
+		// x, y, width, height of the cascade in the atlas, e.g. for clearing it alone
+		glm::ivec4 GetCascadeRect(int cascade) const;
+
+		GLuint GetAtlas() const { return m_atlas.Get(); }
+		const ShadowCascadeStats& GetCascadeStats(int cascade) const { return m_cascades[cascade].stats; }
+
+		// Settings, which invalidate the cached cascades when changed, and the last frame's cascades
+		void DefineGUI();
+	};
+}
@@ -0,0 +1,274 @@
+#include "ClusteredLighting.h"
+
+#include <algorithm>
+#include <cmath>
+#include <emmintrin.h>
+
+namespace Helpers
+{
+	Light Light::Point(const glm::vec3& position, float radius, const glm::vec3& colour)
+	{
+		Light light;
+		light.positionRadius = glm::vec4(position, radius);
+		light.colourCosInner = glm::vec4(colour, -1.0f);
+		return light;
+	}
+
+	// The inner cosine is kept above the outer so the shader's smoothstep has a range
+	Light Light::Spot(const glm::vec3& position, const glm::vec3& direction, float radius, const glm::vec3& colour, float innerAngle, float outerAngle)
+	{
+		const float cosOuter{ std::cos(outerAngle) };
+		Light light;
+		light.positionRadius = glm::vec4(position, radius);
+		light.colourCosInner = glm::vec4(colour, std::max(std::cos(innerAngle), cosOuter + 0.0001f));
+		light.directionCosOuter = glm::vec4(glm::normalize(direction), cosOuter);
+		return light;
+	}
+
+	// A cone narrower than 45 degrees fits a sphere through its apex and rim, a wider one the sphere around its rim,
+	// and one of 90 degrees or more the light's own sphere
+	glm::vec4 Light::BoundingSphere() const
+	{
+		const glm::vec3 position{ positionRadius };
+		const float radius{ positionRadius.w };
+		const float cosOuter{ directionCosOuter.w };
+		if (!IsSpot() || cosOuter <= 0.0f)
+			return positionRadius;
+
+		const glm::vec3 direction{ directionCosOuter };
+		if (cosOuter > 0.70710678f)
+		{
+			const float sphereRadius{ radius / (2.0f * cosOuter) };
+			return glm::vec4(position + direction * sphereRadius, sphereRadius);
+		}
+		return glm::vec4(position + direction * (cosOuter * radius), std::sqrt(1.0f - cosOuter * cosOuter) * radius);
+	}
+
+	// Tile edges are planes through the eye at even steps across the screen, slices even steps in log depth
+	void ClusteredLighting::SetView(const glm::mat4& view, float fovY, float aspect, float nearZ, float farZ, const glm::ivec2& viewportSize)
+	{
+		m_view = view;
+		m_viewportSize = glm::vec2(std::max(viewportSize.x, 1), std::max(viewportSize.y, 1));
+		const float tanHalfFovY{ std::tan(fovY * 0.5f) };
+
+		// A point is right of the edge at x = t * depth, with depth = -z, when x + t * z > 0
+		auto edges = [](int tiles, float halfExtent, std::vector<float>& normalSide, std::vector<float>& normalZ)
+		{
+			const size_t padded{ ((size_t)tiles + 1 + 3) / 4 * 4 };
+			normalSide.assign(padded, 0.0f);
+			normalZ.assign(padded, 0.0f);
+			for (int i = 0; i <= tiles; i++)
+			{
+				const float t{ (-1.0f + 2.0f * i / tiles) * halfExtent };
+				const float length{ std::sqrt(1.0f + t * t) };
+				normalSide[i] = 1.0f / length;
+				normalZ[i] = t / length;
+			}
+		};
+		edges(KClustersX, tanHalfFovY * aspect, m_tileXNormalX, m_tileXNormalZ);
+		edges(KClustersY, tanHalfFovY, m_tileYNormalY, m_tileYNormalZ);
+
+		const float logRatio{ std::log(farZ / nearZ) };
+		for (int z = 0; z <= KClustersZ; z++)
+			m_sliceDepths[z] = nearZ * std::pow(farZ / nearZ, z / (float)KClustersZ);
+		m_sliceScale = KClustersZ / logRatio;
+		m_sliceBias = -KClustersZ * std::log(nearZ) / logRatio;
+	}
+
+	// Found from the logs then moved onto the exact slice depths, so it agrees with SphereInCluster
+	bool ClusteredLighting::SliceRange(float nearDepth, float farDepth, int& first, int& last) const
+	{
+		if (farDepth <= m_sliceDepths[0] || nearDepth >= m_sliceDepths[KClustersZ])
+			return false;
+
+		first = nearDepth <= m_sliceDepths[0] ? 0 : glm::clamp((int)std::floor(std::log(nearDepth) * m_sliceScale + m_sliceBias), 0, KClustersZ - 1);
+		last = glm::clamp((int)std::floor(std::log(farDepth) * m_sliceScale + m_sliceBias), 0, KClustersZ - 1);
+		while (first > 0 && m_sliceDepths[first] > nearDepth)
+			first--;
+		while (first < KClustersZ - 1 && m_sliceDepths[first + 1] <= nearDepth)
+			first++;
+		while (last < KClustersZ - 1 && m_sliceDepths[last + 1] < farDepth)
+			last++;
+		while (last > 0 && m_sliceDepths[last] >= farDepth)
+			last--;
+		return first <= last;
+	}
+
+	glm::vec4 ClusteredLighting::ViewSphere(const Light& light) const
+	{
+		const glm::vec4 sphere{ light.BoundingSphere() };
+		return glm::vec4(glm::vec3(m_view * glm::vec4(glm::vec3(sphere), 1.0f)), sphere.w);
+	}
+
+	// Within the radius of the left, right, bottom and top planes on their inner sides and of the slice's depths
+	bool ClusteredLighting::SphereInCluster(const glm::vec4& sphere, int x, int y, int z) const
+	{
+		const float radius{ sphere.w };
+		const float depth{ -sphere.z };
+		if (!(sphere.x * m_tileXNormalX[x] + sphere.z * m_tileXNormalZ[x] > -radius) || !(sphere.x * m_tileXNormalX[x + 1] + sphere.z * m_tileXNormalZ[x + 1] < radius))
+			return false;
+		if (!(sphere.y * m_tileYNormalY[y] + sphere.z * m_tileYNormalZ[y] > -radius) || !(sphere.y * m_tileYNormalY[y + 1] + sphere.z * m_tileYNormalZ[y + 1] < radius))
+			return false;
+		return depth + radius > m_sliceDepths[z] && depth - radius < m_sliceDepths[z + 1];
+	}
+
+	// Four lights at a time find the columns and rows they touch against every tile edge with SSE, each then finds
+	// its slices. The clusters count their lights, take their offsets and are filled in light order, so each
+	// cluster's indices are sorted.
+	void ClusteredLighting::Bin(const std::vector<Light>& lights)
+	{
+		const double start{ glfwGetTime() };
+		LightBinningStats stats;
+		stats.lights = lights.size();
+
+		// View space spheres as a structure of arrays, padding lights have no radius and touch nothing
+		const size_t padded{ (lights.size() + 3) / 4 * 4 };
+		std::vector<float> centreX(padded, 0.0f), centreY(padded, 0.0f), centreZ(padded, 0.0f), radius(padded, 0.0f);
+		for (size_t i = 0; i < lights.size(); i++)
+		{
+			const glm::vec4 sphere{ ViewSphere(lights[i]) };
+			centreX[i] = sphere.x;
+			centreY[i] = sphere.y;
+			centreZ[i] = sphere.z;
+			radius[i] = sphere.w;
+		}
+
+		m_ranges.assign(lights.size(), ClusterRange());
+		for (size_t i = 0; i < padded; i += 4)
+		{
+			const __m128 cx{ _mm_loadu_ps(&centreX[i]) };
+			const __m128 cy{ _mm_loadu_ps(&centreY[i]) };
+			const __m128 cz{ _mm_loadu_ps(&centreZ[i]) };
+			const __m128 r{ _mm_loadu_ps(&radius[i]) };
+			const __m128 negR{ _mm_sub_ps(_mm_setzero_ps(), r) };
+
+			// Tile t is touched when the sphere reaches right of (above) edge t and left of (below) edge t + 1
+			auto tileRange = [&](const __m128& side, const std::vector<float>& normalSide, const std::vector<float>& normalZ, int tiles, float first[4], float last[4])
+			{
+				__m128 firstTile{ _mm_set1_ps((float)tiles) };
+				__m128 lastTile{ _mm_set1_ps(-1.0f) };
+				__m128 pastLowEdge{ _mm_cmpgt_ps(_mm_add_ps(_mm_mul_ps(side, _mm_set1_ps(normalSide[0])), _mm_mul_ps(cz, _mm_set1_ps(normalZ[0]))), negR) };
+				for (int t = 0; t < tiles; t++)
+				{
+					const __m128 distance{ _mm_add_ps(_mm_mul_ps(side, _mm_set1_ps(normalSide[t + 1])), _mm_mul_ps(cz, _mm_set1_ps(normalZ[t + 1]))) };
+					const __m128 beforeHighEdge{ _mm_cmplt_ps(distance, r) };
+					const __m128 touched{ _mm_and_ps(pastLowEdge, beforeHighEdge) };
+					const __m128 tile{ _mm_set1_ps((float)t) };
+					firstTile = _mm_min_ps(firstTile, _mm_or_ps(_mm_and_ps(touched, tile), _mm_andnot_ps(touched, _mm_set1_ps((float)tiles))));
+					lastTile = _mm_max_ps(lastTile, _mm_or_ps(_mm_and_ps(touched, tile), _mm_andnot_ps(touched, _mm_set1_ps(-1.0f))));
+					pastLowEdge = _mm_cmpgt_ps(distance, negR);
+				}
+				_mm_storeu_ps(first, firstTile);
+				_mm_storeu_ps(last, lastTile);
+			};
+
+			float firstX[4], lastX[4], firstY[4], lastY[4];
+			tileRange(cx, m_tileXNormalX, m_tileXNormalZ, KClustersX, firstX, lastX);
+			tileRange(cy, m_tileYNormalY, m_tileYNormalZ, KClustersY, firstY, lastY);
+
+			for (size_t k = 0; k < 4 && i + k < lights.size(); k++)
+			{
+				ClusterRange& range{ m_ranges[i + k] };
+				const float depth{ -centreZ[i + k] };
+				int firstZ, lastZ;
+				if (lastX[k] < firstX[k] || lastY[k] < firstY[k] || !SliceRange(depth - radius[i + k], depth + radius[i + k], firstZ, lastZ))
+					continue;
+				range.first = glm::ivec3((int)firstX[k], (int)firstY[k], firstZ);
+				range.last = glm::ivec3((int)lastX[k], (int)lastY[k], lastZ);
+			}
+		}
+
+		// Count, then give each cluster its offset and as many lights as still fit
+		m_clusters.assign(KNumClusters, LightCluster());
+		for (const ClusterRange& range : m_ranges)
+		{
+			if (range.last.x < range.first.x)
+				continue;
+			stats.lightsBinned++;
+			for (int z = range.first.z; z <= range.last.z; z++)
+				for (int y = range.first.y; y <= range.last.y; y++)
+					for (int x = range.first.x; x <= range.last.x; x++)
+						m_clusters[((size_t)z * KClustersY + y) * KClustersX + x].count++;
+		}
+
+		size_t offset{ 0 };
+		for (LightCluster& cluster : m_clusters)
+		{
+			const size_t count{ std::min<size_t>(cluster.count, m_maxIndices - std::min(offset, m_maxIndices)) };
+			stats.indicesDropped += cluster.count - count;
+			stats.clustersLit += cluster.count ? 1 : 0;
+			stats.maxLightsPerCluster = std::max<size_t>(stats.maxLightsPerCluster, cluster.count);
+			cluster.offset = (GLuint)offset;
+			cluster.count = (GLuint)count;
+			offset += count;
+		}
+		m_indices.resize(offset);
+		stats.indices = offset;
+
+		std::vector<GLuint> filled(KNumClusters, 0);
+		for (size_t light = 0; light < m_ranges.size(); light++)
+		{
+			const ClusterRange& range{ m_ranges[light] };
+			for (int z = range.first.z; z <= range.last.z; z++)
+			{
+				for (int y = range.first.y; y <= range.last.y; y++)
+				{
+					for (int x = range.first.x; x <= range.last.x; x++)
+					{
+						const size_t index{ ((size_t)z * KClustersY + y) * KClustersX + x };
+						const LightCluster& cluster{ m_clusters[index] };
+						if (filled[index] < cluster.count)
+							m_indices[cluster.offset + filled[index]++] = (GLuint)light;
+					}
+				}
+			}
+		}
+
+		stats.milliseconds = (float)((glfwGetTime() - start) * 1000.0);
+		m_lastStats = stats;
+	}
+
+	// Every light against every cluster, each hit looked for in the cluster's sorted indices
+	LightBinningValidation ClusteredLighting::Validate(const std::vector<Light>& lights) const
+	{
+		const double start{ glfwGetTime() };
+		LightBinningValidation validation;
+		validation.pairsBinned = m_indices.size();
+		if (m_clusters.size() != (size_t)KNumClusters)
+			return validation;
+
+		std::vector<glm::vec4> spheres(lights.size());
+		for (size_t i = 0; i < lights.size(); i++)
+			spheres[i] = ViewSphere(lights[i]);
+
+		for (int z = 0; z < KClustersZ; z++)
+		{
+			for (int y = 0; y < KClustersY; y++)
+			{
+				for (int x = 0; x < KClustersX; x++)
+				{
+					const LightCluster& cluster{ m_clusters[((size_t)z * KClustersY + y) * KClustersX + x] };
+					const auto begin{ m_indices.begin() + cluster.offset };
+					const auto end{ begin + cluster.count };
+					for (size_t light = 0; light < spheres.size(); light++)
+					{
+						if (!SphereInCluster(spheres[light], x, y, z))
+							continue;
+						validation.pairs++;
+						if (!std::binary_search(begin, end, (GLuint)light))
+							validation.pairsMissing++;
+					}
+				}
+			}
+		}
+
+		validation.bruteForceMilliseconds = (float)((glfwGetTime() - start) * 1000.0);
+		return validation;
+	}
+
+	// Minus the third row of the view matrix, as the camera looks down -z
+	glm::vec4 ClusteredLighting::GetDepthPlane() const
+	{
+		return -glm::vec4(m_view[0][2], m_view[1][2], m_view[2][2], m_view[3][2]);
+	}
+}
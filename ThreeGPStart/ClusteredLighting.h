@@ -0,0 +1,131 @@
+#pragma once
+// Clustered forward lighting. The view frustum is split into a grid of clusters, KClustersX by KClustersY tiles of
+// the screen by KClustersZ slices of depth, each slice deeper than the last by the same ratio. Every frame each
+// light's bounding sphere is binned on the CPU into the clusters it may touch, four lights at a time with SSE,
+// giving each cluster a range of a list of light indices. The lights, the ranges and the indices go to the shaders
+// as shader storage blocks so each pixel loops over only the lights of its own cluster, see clustered_lighting.glsl.
+
+#include "ExternalLibraryHeaders.h"
+
+namespace Helpers
+{
+	// A point or spot light, a point light is a spot whose cone is the whole sphere. std430, must match clustered_lighting.glsl.
+	struct Light
+	{
+		glm::vec4 positionRadius{ 0, 0, 0, 1 };		// world space, w = distance at which it has faded out
+		glm::vec4 colourCosInner{ 1, 1, 1, -1 };		// colour times intensity, w = cosine of the cone's inner half angle
+		glm::vec4 directionCosOuter{ 0, -1, 0, -1 };	// unit direction, w = cosine of the outer half angle, -1 for a point light
+
+		static Light Point(const glm::vec3& position, float radius, const glm::vec3& colour);
+
+		// Angles are half angles in radians, full strength inside inner fading to nothing at outer
+		static Light Spot(const glm::vec3& position, const glm::vec3& direction, float radius, const glm::vec3& colour, float innerAngle, float outerAngle);
+
+		bool IsSpot() const { return directionCosOuter.w > -1.0f; }
+
+		// Smallest sphere around the lit volume, tighter than the radius for a narrow cone
+		glm::vec4 BoundingSphere() const;
+	};
+
+	// A cluster's lights are indices[offset] to indices[offset + count - 1], std430 uvec2
+	struct LightCluster
+	{
+		GLuint offset{ 0 };
+		GLuint count{ 0 };
+	};
+
+	// What the last Bin did
+	struct LightBinningStats
+	{
+		size_t lights{ 0 };
+		size_t lightsBinned{ 0 };		// touching at least one cluster
+		size_t indices{ 0 };
+		size_t indicesDropped{ 0 };		// over the index limit
+		size_t clustersLit{ 0 };		// with at least one light
+		size_t maxLightsPerCluster{ 0 };
+		float milliseconds{ 0 };
+	};
+
+	// Binned against testing every light against every cluster
+	struct LightBinningValidation
+	{
+		size_t pairs{ 0 };				// light in cluster by the brute force test
+		size_t pairsBinned{ 0 };			// including clusters the per axis ranges add, which is conservative
+		size_t pairsMissing{ 0 };		// by brute force but not binned, must be 0
+		float bruteForceMilliseconds{ 0 };
+
+		bool Passed() const { return pairsMissing == 0; }
+	};
+
+	class ClusteredLighting
+	{
+	public:
+		// Must match clustered_lighting.glsl
+		static constexpr int KClustersX{ 16 };
+		static constexpr int KClustersY{ 9 };
+		static constexpr int KClustersZ{ 24 };
+		static constexpr int KNumClusters{ KClustersX * KClustersY * KClustersZ };
+	private:
+		// The side planes of the tiles pass through the eye. A view space point c is right of the left edge of column i by
+		// c.x * m_tileXNormalX[i] + c.z * m_tileXNormalZ[i], and above the bottom edge of row j in the same way.
+		std::vector<float> m_tileXNormalX, m_tileXNormalZ;
+		std::vector<float> m_tileYNormalY, m_tileYNormalZ;
+
+		// Depth of the near side of each slice and one past the last
+		float m_sliceDepths[KClustersZ + 1]{};
+		float m_sliceScale{ 0 };
+		float m_sliceBias{ 0 };
+
+		glm::mat4 m_view{ 1 };
+		glm::vec2 m_viewportSize{ 1 };
+
+		std::vector<LightCluster> m_clusters;
+		std::vector<GLuint> m_indices;
+		size_t m_maxIndices{ 256 * 1024 };
+		LightBinningStats m_lastStats;
+
+		// Clusters a view space sphere may touch, empty when last < first on any axis
+		struct ClusterRange
+		{
+			glm::ivec3 first{ 0 };
+			glm::ivec3 last{ -1 };
+		};
+		std::vector<ClusterRange> m_ranges;
+
+		// The light's bounding sphere in view space
+		glm::vec4 ViewSphere(const Light& light) const;
+
+		// Slices a view space depth range overlaps, false if it is wholly in front of the near or beyond the far slice
+		bool SliceRange(float nearDepth, float farDepth, int& first, int& last) const;
+
+		// True if the sphere is inside all six planes of the cluster, the test the binning makes per axis
+		bool SphereInCluster(const glm::vec4& sphere, int x, int y, int z) const;
+	public:
+		// The view and projection this frame's clusters are made for, fovY in radians
+		void SetView(const glm::mat4& view, float fovY, float aspect, float nearZ, float farZ, const glm::ivec2& viewportSize);
+
+		// Bin the lights into the clusters of the current view
+		void Bin(const std::vector<Light>& lights);
+
+		// Test every light against every cluster of the current view with the same planes, for checking Bin
+		LightBinningValidation Validate(const std::vector<Light>& lights) const;
+
+		const std::vector<LightCluster>& GetClusters() const { return m_clusters; }
+		const std::vector<GLuint>& GetIndices() const { return m_indices; }
+
+		// Lights in clusters past this are dropped, so the indices fit the stream buffer
+		void SetMaxIndices(size_t maxIndices) { m_maxIndices = maxIndices; }
+
+		// For the shader, the slice of view depth d is floor(log(d) * scale + bias)
+		float GetSliceScale() const { return m_sliceScale; }
+		float GetSliceBias() const { return m_sliceBias; }
+
+		// For the shader, world position to view depth by dot(plane, vec4(position, 1))
+		glm::vec4 GetDepthPlane() const;
+
+		// For the shader, pixels to tiles
+		glm::vec2 GetTileScale() const { return glm::vec2(KClustersX, KClustersY) / m_viewportSize; }
+
+		const LightBinningStats& GetLastStats() const { return m_lastStats; }
+	};
+}
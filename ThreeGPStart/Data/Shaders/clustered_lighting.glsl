@@ -0,0 +1,67 @@
+// Clustered forward lighting, included by the lit fragment shaders. The lights are binned on the CPU into a grid
+// of clusters over the view frustum, see Helpers::ClusteredLighting, and a pixel loops over its cluster's lights only.
+
+// Must match Helpers::Light
+struct Light
+{
+	vec4 position_radius;		// w = distance at which it has faded out
+	vec4 colour_cos_inner;		// w = cosine of the cone's inner half angle
+	vec4 direction_cos_outer;	// w = cosine of the outer half angle, -1 for a point light
+};
+
+// Bindings must match Renderer.h
+layout (std430, binding = 2) readonly buffer ClusterLights
+{
+	Light lights[];
+};
+
+// Per cluster x = offset into light_indices, y = count, see Helpers::LightCluster
+layout (std430, binding = 3) readonly buffer Clusters
+{
+	uvec2 clusters[];
+};
+
+layout (std430, binding = 4) readonly buffer ClusterLightIndices
+{
+	uint light_indices[];
+};
+
+uniform bool clustered_lights_on;
+uniform vec4 cluster_depth_plane;	// world position to view depth
+uniform vec4 cluster_scale;			// xy = pixels to tiles, slice = floor(log(depth) * z + w)
+
+// Must match Helpers::ClusteredLighting
+const int KClustersX = 16;
+const int KClustersY = 9;
+const int KClustersZ = 24;
+
+// Diffuse light at pos with normal N from the lights of this pixel's cluster
+vec3 clustered_lights(vec3 pos, vec3 N)
+{
+	if (!clustered_lights_on)
+		return vec3(0.0);
+
+	float depth = max(dot(cluster_depth_plane, vec4(pos, 1.0)), 1e-4);
+	int slice = clamp(int(floor(log(depth) * cluster_scale.z + cluster_scale.w)), 0, KClustersZ - 1);
+	ivec2 tile = clamp(ivec2(gl_FragCoord.xy * cluster_scale.xy), ivec2(0), ivec2(KClustersX - 1, KClustersY - 1));
+	uvec2 cluster = clusters[(slice * KClustersY + tile.y) * KClustersX + tile.x];
+
+	vec3 result = vec3(0.0);
+	for (uint i = 0u; i < cluster.y; i++)
+	{
+		Light light = lights[light_indices[cluster.x + i]];
+		vec3 to_light = light.position_radius.xyz - pos;
+		float distance_sq = dot(to_light, to_light);
+		float radius_sq = light.position_radius.w * light.position_radius.w;
+		if (distance_sq >= radius_sq)
+			continue;
+
+		vec3 L = to_light * inversesqrt(max(distance_sq, 1e-8));
+		float fade = 1.0 - distance_sq / radius_sq;
+		float attenuation = fade * fade;
+		if (light.direction_cos_outer.w > -1.0)
+			attenuation *= smoothstep(light.direction_cos_outer.w, light.colour_cos_inner.w, dot(-L, light.direction_cos_outer.xyz));
+		result += light.colour_cos_inner.rgb * attenuation * max(dot(L, N), 0.0);
+	}
+	return result;
+}
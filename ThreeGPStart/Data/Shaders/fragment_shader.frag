@@ -1,36 +1,51 @@
-#version 330
+#version 430
 
 uniform vec4 diffuse_colour;
-uniform sampler2D sampler_tex;
+// The material's texture is a layer of a texture array, see Helpers::TexturePool
+uniform sampler2DArray sampler_tex;
 
-uniform vec3 lightPosition;
-uniform vec3 lightIntensity;
+#include "clustered_lighting.glsl"
+#include "shadows.glsl"
+
+// Level of detail cross fade: 0 = off, > 0 fading in to this amount, < 0 fading out
+uniform float lod_dither;
 
 in vec3 varying_normal;
 in vec2 varying_coord;
 in vec3 varying_pos;
+flat in float varying_layer;
 
 out vec4 fragment_colour;
 
+// 4x4 ordered dither threshold for this pixel in the range 0 to 1
+float dither_threshold()
+{
+	const float bayer[16] = float[16](0.0, 8.0, 2.0, 10.0, 12.0, 4.0, 14.0, 6.0, 3.0, 11.0, 1.0, 9.0, 15.0, 7.0, 13.0, 5.0);
+	ivec2 p = ivec2(gl_FragCoord.xy) & 3;
+	return (bayer[p.y * 4 + p.x] + 0.5) / 16.0;
+}
+
 void main(void)
 {
-	vec3 tex_colour = texture(sampler_tex, varying_coord).rgb;
+	// The two levels being faded use complementary halves of the pattern
+	if (lod_dither > 0.0 && dither_threshold() > lod_dither)
+		discard;
+	if (lod_dither < 0.0 && dither_threshold() <= -lod_dither)
+		discard;
+
+	vec3 tex_colour = texture(sampler_tex, vec3(varying_coord, varying_layer)).rgb;
 
 	vec3 N = normalize(varying_normal);
-	vec3 lightDirection = vec3(0,-1,-0.5);
+	vec3 lightDirection = sun_direction;
 	vec3 L = normalize(-lightDirection);
 	
 	float ambientIntensity = 0.05;
     vec3 ambientColour = tex_colour;
 
-	float lightIntensity = max(dot(L,N),0);
+	float lightIntensity = max(dot(L,N),0) * sun_shadow(varying_pos, N);
 	vec3 lightColour = vec3(1);
 
-	vec3 pointLightdirec = lightPosition - varying_pos;
-	L = normalize(pointLightdirec);
-	float pointLightIntensity = max(dot(L,N),0);
-
-    vec3 result = ambientIntensity * ambientColour + tex_colour * (lightIntensity + lightColour + pointLightIntensity * vec3(3,0,3));
+    vec3 result = ambientIntensity * ambientColour + tex_colour * (lightIntensity + lightColour + clustered_lights(varying_pos, N));
 
 	fragment_colour = vec4(result, 1.0);
 }
\ No newline at end of file
@@ -0,0 +1,9 @@
+#version 330
+
+// Only the samples passed matter, colour writes are masked off while testing
+out vec4 fragment_colour;
+
+void main(void)
+{
+	fragment_colour = vec4(1.0);
+}
\ No newline at end of file
@@ -0,0 +1,14 @@
+#version 330
+
+uniform mat4 combined_xform;
+
+// World space box, the vertices are a unit cube from 0 to 1
+uniform vec3 box_min;
+uniform vec3 box_max;
+
+layout (location=0) in vec3 vertex_position;
+
+void main(void)
+{
+	gl_Position = combined_xform * vec4(mix(box_min, box_max, vertex_position), 1.0);
+}
\ No newline at end of file
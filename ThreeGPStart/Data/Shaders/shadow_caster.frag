@@ -0,0 +1,6 @@
+#version 430
+
+// Only depth is written
+void main(void)
+{
+}
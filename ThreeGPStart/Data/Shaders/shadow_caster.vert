@@ -0,0 +1,41 @@
+#version 430
+
+// Draws a caster into the shadow atlas, one instance per cascade it touches, see Helpers::CascadedShadows
+
+// Per object data written to the stream buffer each frame, must match ObjectData in Renderer.h
+layout (std140, binding = 1) uniform ObjectData
+{
+	mat4 model_xform;
+	vec4 pos_dequant_offset; // w = texture array layer
+	vec4 pos_dequant_scale; // w unused
+	vec4 uv_dequant; // xy = offset, zw = scale
+};
+
+// Must match Helpers::ShadowCasterData, binding must match Renderer.h
+layout (std140, binding = 5) uniform ShadowCaster
+{
+	mat4 cascade_xform[4];		// world to each cascade's clip space
+	vec4 cascade_atlas[4];		// xy scale, zw offset from a cascade's clip space to its quarter of the atlas
+	ivec4 draw_cascades;		// instance i is drawn into cascade draw_cascades[i]
+};
+
+layout (location=0) in vec3 vertex_position;
+
+out float gl_ClipDistance[4];
+
+void main(void)
+{
+	int cascade = draw_cascades[gl_InstanceID];
+	vec3 position = pos_dequant_offset.xyz + pos_dequant_scale.xyz * vertex_position;
+	vec4 clip = cascade_xform[cascade] * model_xform * vec4(position, 1.0);
+
+	// Clipped to the cascade's own square before it is moved into its quarter, so it cannot spill into the others
+	gl_ClipDistance[0] = clip.w + clip.x;
+	gl_ClipDistance[1] = clip.w - clip.x;
+	gl_ClipDistance[2] = clip.w + clip.y;
+	gl_ClipDistance[3] = clip.w - clip.y;
+
+	vec4 atlas = cascade_atlas[cascade];
+	clip.xy = clip.xy * atlas.xy + atlas.zw * clip.w;
+	gl_Position = clip;
+}
@@ -0,0 +1,54 @@
+// Shadows from the sun, included by the lit fragment shaders. The view is split by depth into cascades, each a
+// quarter of one depth atlas, see Helpers::CascadedShadows.
+
+// Must match Helpers::ShadowReceiverData, binding must match Renderer.h
+layout (std140, binding = 6) uniform ShadowReceiver
+{
+	mat4 shadow_xform[4];		// world to atlas texture coordinates and depth
+	vec4 split_depths;			// view depth each cascade is used to
+	vec4 texel_world;			// world size of a texel of each cascade
+	vec4 depth_bias;			// of each cascade, in atlas depth
+	vec4 shadow_depth_plane;	// world position to view depth
+};
+
+uniform bool shadows_on;
+uniform sampler2D shadow_atlas;
+uniform vec3 sun_direction = vec3(0.0, -0.894427, -0.447214);	// the way the light travels
+
+// Must match Helpers::CascadedShadows
+const int KShadowCascades = 4;
+const int KShadowCascadeSize = 1024;
+
+// 1 lit by the sun to 0 in shadow, at pos with normal N
+float sun_shadow(vec3 pos, vec3 N)
+{
+	if (!shadows_on)
+		return 1.0;
+
+	float depth = dot(shadow_depth_plane, vec4(pos, 1.0));
+	int cascade = 0;
+	while (cascade < KShadowCascades && depth > split_depths[cascade])
+		cascade++;
+	if (cascade == KShadowCascades)
+		return 1.0;
+
+	// Moved off the surface along its normal by more than a texel so the surface does not shadow itself
+	vec3 offsetPos = pos + N * (1.5 * texel_world[cascade]);
+	vec3 atlasPos = (shadow_xform[cascade] * vec4(offsetPos, 1.0)).xyz;
+	if (atlasPos.z >= 1.0)
+		return 1.0;
+
+	// 3 x 3 texels around it, kept inside the cascade's quarter
+	ivec2 quarter = ivec2(cascade & 1, cascade >> 1) * KShadowCascadeSize;
+	ivec2 centre = ivec2(floor(atlasPos.xy * float(2 * KShadowCascadeSize)));
+	float lit = 0.0;
+	for (int y = -1; y <= 1; y++)
+	{
+		for (int x = -1; x <= 1; x++)
+		{
+			ivec2 texel = clamp(centre + ivec2(x, y), quarter, quarter + KShadowCascadeSize - 1);
+			lit += atlasPos.z - depth_bias[cascade] <= texelFetch(shadow_atlas, texel, 0).r ? 1.0 : 0.0;
+		}
+	}
+	return lit / 9.0;
+}
@@ -0,0 +1,128 @@
+#version 430
+
+// The terrain's materials are layers of splat_layers and their weights are four to a texel in the layers of
+// splat_weights, see Helpers::BuildSplatWeights. Only the materials with the largest weights are sampled.
+uniform sampler2DArray splat_layers;
+uniform sampler2DArray splat_weights;
+uniform float splat_uv_scale;		// mesh texture coordinates to 0 to 1 across the weights
+uniform int splat_samples;			// materials sampled, 1 to KMaxSamples
+uniform float splat_blend_depth;	// materials blend over this much height, smaller is sharper
+
+#include "clustered_lighting.glsl"
+#include "shadows.glsl"
+
+// Level of detail cross fade: 0 = off, > 0 fading in to this amount, < 0 fading out
+uniform float lod_dither;
+
+in vec3 varying_normal;
+in vec2 varying_coord;
+in vec3 varying_pos;
+flat in float varying_layer;
+
+out vec4 fragment_colour;
+
+// Must match Helpers::KMaxSplatLayers
+const int KMaxSplatLayers = 16;
+const int KMaxSamples = 4;
+
+// 4x4 ordered dither threshold for this pixel in the range 0 to 1
+float dither_threshold()
+{
+	const float bayer[16] = float[16](0.0, 8.0, 2.0, 10.0, 12.0, 4.0, 14.0, 6.0, 3.0, 11.0, 1.0, 9.0, 15.0, 7.0, 13.0, 5.0);
+	ivec2 p = ivec2(gl_FragCoord.xy) & 3;
+	return (bayer[p.y * 4 + p.x] + 0.5) / 16.0;
+}
+
+vec3 sample_splat()
+{
+	float weights[KMaxSplatLayers];
+	vec2 weight_uv = varying_coord * splat_uv_scale;
+	for (int i = 0; i < KMaxSplatLayers / 4; i++)
+	{
+		vec4 texel = texture(splat_weights, vec3(weight_uv, float(i)));
+		weights[i * 4] = texel.x;
+		weights[i * 4 + 1] = texel.y;
+		weights[i * 4 + 2] = texel.z;
+		weights[i * 4 + 3] = texel.w;
+	}
+
+	// The largest weights in order, each new weight pushing the smaller ones down
+	float top[KMaxSamples];
+	int layers[KMaxSamples];
+	for (int k = 0; k < KMaxSamples; k++)
+	{
+		top[k] = 0.0;
+		layers[k] = 0;
+	}
+	for (int i = 0; i < KMaxSplatLayers; i++)
+	{
+		float weight = weights[i];
+		int layer = i;
+		for (int k = 0; k < KMaxSamples; k++)
+		{
+			if (k < splat_samples && weight > top[k])
+			{
+				float swapWeight = top[k];
+				int swapLayer = layers[k];
+				top[k] = weight;
+				layers[k] = layer;
+				weight = swapWeight;
+				layer = swapLayer;
+			}
+		}
+	}
+
+	// Height blending, a material's height is its brightness raised by its weight and only those within
+	// splat_blend_depth of the highest show. Gradients are taken here as the loop below is not uniform.
+	vec2 dx = dFdx(varying_coord);
+	vec2 dy = dFdy(varying_coord);
+	vec3 colours[KMaxSamples];
+	float heights[KMaxSamples];
+	float highest = -1.0;
+	for (int k = 0; k < KMaxSamples; k++)
+	{
+		heights[k] = -1.0;
+		if (k >= splat_samples || top[k] <= 0.0)
+			continue;
+		colours[k] = textureGrad(splat_layers, vec3(varying_coord, float(layers[k])), dx, dy).rgb;
+		heights[k] = dot(colours[k], vec3(0.299, 0.587, 0.114)) + top[k];
+		highest = max(highest, heights[k]);
+	}
+
+	vec3 colour = vec3(0.0);
+	float total = 0.0;
+	for (int k = 0; k < KMaxSamples; k++)
+	{
+		float blend = max(heights[k] - (highest - splat_blend_depth), 0.0);
+		if (heights[k] < 0.0 || blend <= 0.0)
+			continue;
+		colour += colours[k] * blend;
+		total += blend;
+	}
+	return total > 0.0 ? colour / total : vec3(0.5);
+}
+
+void main(void)
+{
+	// The two levels being faded use complementary halves of the pattern
+	if (lod_dither > 0.0 && dither_threshold() > lod_dither)
+		discard;
+	if (lod_dither < 0.0 && dither_threshold() <= -lod_dither)
+		discard;
+
+	vec3 tex_colour = sample_splat();
+
+	vec3 N = normalize(varying_normal);
+	vec3 lightDirection = sun_direction;
+	vec3 L = normalize(-lightDirection);
+	
+	float ambientIntensity = 0.05;
+	vec3 ambientColour = tex_colour;
+
+	float lightIntensity = max(dot(L,N),0) * sun_shadow(varying_pos, N);
+	vec3 lightColour = vec3(1);
+
+	vec3 result = ambientIntensity * ambientColour + tex_colour * (lightIntensity + lightColour + clustered_lights(varying_pos, N));
+
+	fragment_colour = vec4(result, 1.0);
+}
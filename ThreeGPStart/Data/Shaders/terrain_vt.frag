@@ -0,0 +1,85 @@
+#version 430
+
+// The terrain's texture is virtual, see Helpers::VirtualTexture. The page table maps each page of each level to
+// the cache slot holding it, or to its nearest resident parent's, and the cache is sampled without mips.
+uniform sampler2D page_table;
+uniform sampler2D page_cache;
+uniform float vt_uv_scale;	// mesh texture coordinates to 0 to 1 across the virtual texture
+uniform float vt_lod_bias;
+
+#include "clustered_lighting.glsl"
+#include "shadows.glsl"
+
+// Level of detail cross fade: 0 = off, > 0 fading in to this amount, < 0 fading out
+uniform float lod_dither;
+
+in vec3 varying_normal;
+in vec2 varying_coord;
+in vec3 varying_pos;
+flat in float varying_layer;
+
+out vec4 fragment_colour;
+
+// Must match Helpers::VirtualTexture
+const float KPagesAcross = 128.0;
+const float KLevels = 8.0;
+const float KPageTexels = 128.0;
+const float KBorderTexels = 4.0;
+const float KSlotTexels = 136.0;
+const float KCacheTexels = 2176.0;
+
+// 4x4 ordered dither threshold for this pixel in the range 0 to 1
+float dither_threshold()
+{
+	const float bayer[16] = float[16](0.0, 8.0, 2.0, 10.0, 12.0, 4.0, 14.0, 6.0, 3.0, 11.0, 1.0, 9.0, 15.0, 7.0, 13.0, 5.0);
+	ivec2 p = ivec2(gl_FragCoord.xy) & 3;
+	return (bayer[p.y * 4 + p.x] + 0.5) / 16.0;
+}
+
+// The finer of the two mip levels the virtual texels under this pixel fall between
+int virtual_level(vec2 vuv)
+{
+	vec2 texels = vuv * KPagesAcross * KPageTexels;
+	vec2 dx = dFdx(texels);
+	vec2 dy = dFdy(texels);
+	float lod = 0.5 * log2(max(dot(dx, dx), dot(dy, dy))) + vt_lod_bias;
+	return int(clamp(floor(lod), 0.0, KLevels - 1.0));
+}
+
+vec3 sample_virtual(vec2 vuv)
+{
+	int level = virtual_level(vuv);
+	int across = int(KPagesAcross) >> level;
+	ivec2 page = clamp(ivec2(vuv * float(across)), ivec2(0), ivec2(across - 1));
+
+	// x and y of the slot, the level of the page in it and 255
+	vec4 entry = floor(texelFetch(page_table, page, level) * 255.0 + 0.5);
+	vec2 within = fract(vuv * KPagesAcross / exp2(entry.z));
+	vec2 uv = (entry.xy * KSlotTexels + KBorderTexels + within * KPageTexels) / KCacheTexels;
+	return textureLod(page_cache, uv, 0.0).rgb;
+}
+
+void main(void)
+{
+	// The two levels being faded use complementary halves of the pattern
+	if (lod_dither > 0.0 && dither_threshold() > lod_dither)
+		discard;
+	if (lod_dither < 0.0 && dither_threshold() <= -lod_dither)
+		discard;
+
+	vec3 tex_colour = sample_virtual(clamp(varying_coord * vt_uv_scale, 0.0, 1.0));
+
+	vec3 N = normalize(varying_normal);
+	vec3 lightDirection = sun_direction;
+	vec3 L = normalize(-lightDirection);
+	
+	float ambientIntensity = 0.05;
+	vec3 ambientColour = tex_colour;
+
+	float lightIntensity = max(dot(L,N),0) * sun_shadow(varying_pos, N);
+	vec3 lightColour = vec3(1);
+
+	vec3 result = ambientIntensity * ambientColour + tex_colour * (lightIntensity + lightColour + clustered_lights(varying_pos, N));
+
+	fragment_colour = vec4(result, 1.0);
+}
@@ -1,22 +1,44 @@
 #version 430
 
 uniform mat4 combined_xform;
-uniform mat4 model_xform;
+
+// Per object data written to the stream buffer each frame, must match ObjectData in Renderer.h
+// The dequantisation values are per mesh, see Helpers::MeshQuantisation
+layout (std140, binding = 1) uniform ObjectData
+{
+	mat4 model_xform;
+	vec4 pos_dequant_offset; // w = texture array layer
+	vec4 pos_dequant_scale; // w unused
+	vec4 uv_dequant; // xy = offset, zw = scale
+};
 
 layout (location=0) in vec3 vertex_position;
-layout (location=1) in vec3 vertex_normal;
+layout (location=1) in vec2 vertex_normal_oct;
 layout (location=2) in vec2 vertex_texcoord;
 
 
 out vec3 varying_normal;
 out vec2 varying_coord;
 out vec3 varying_pos;
+flat out float varying_layer;
+
+// Octahedral normal decode, must match Helpers::OctDecode
+vec3 oct_decode(vec2 e)
+{
+	vec3 n = vec3(e.xy, 1.0 - abs(e.x) - abs(e.y));
+	float t = clamp(-n.z, 0.0, 1.0);
+	n.xy += vec2(n.x >= 0.0 ? -t : t, n.y >= 0.0 ? -t : t);
+	return normalize(n);
+}
 
 void main(void)
 {	
-	varying_normal = mat3(model_xform) * vertex_normal;
-	varying_coord = vertex_texcoord;
-	varying_pos = mat4x3(model_xform) * vec4(vertex_position, 1.0f);
+	vec3 position = pos_dequant_offset.xyz + pos_dequant_scale.xyz * vertex_position;
+
+	varying_normal = mat3(model_xform) * oct_decode(vertex_normal_oct);
+	varying_coord = uv_dequant.xy + uv_dequant.zw * vertex_texcoord;
+	varying_pos = mat4x3(model_xform) * vec4(position, 1.0f);
+	varying_layer = pos_dequant_offset.w;
 
-	gl_Position = combined_xform * model_xform * vec4(vertex_position, 1.0);
-}
\ No newline at end of file
+	gl_Position = combined_xform * model_xform * vec4(position, 1.0);
+}
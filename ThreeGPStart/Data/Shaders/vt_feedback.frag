@@ -0,0 +1,33 @@
+#version 330
+
+// Writes the virtual texture page terrain_vt.frag would sample here, read back by Helpers::VirtualTexture.
+// Drawn smaller than the screen, vt_lod_bias makes up for the larger derivatives.
+uniform float vt_uv_scale;
+uniform float vt_lod_bias;
+
+in vec3 varying_normal;
+in vec2 varying_coord;
+in vec3 varying_pos;
+flat in float varying_layer;
+
+out vec4 fragment_colour;
+
+// Must match Helpers::VirtualTexture
+const float KPagesAcross = 128.0;
+const float KLevels = 8.0;
+const float KPageTexels = 128.0;
+
+void main(void)
+{
+	vec2 vuv = clamp(varying_coord * vt_uv_scale, 0.0, 1.0);
+	vec2 texels = vuv * KPagesAcross * KPageTexels;
+	vec2 dx = dFdx(texels);
+	vec2 dy = dFdy(texels);
+	float lod = 0.5 * log2(max(dot(dx, dx), dot(dy, dy))) + vt_lod_bias;
+	int level = int(clamp(floor(lod), 0.0, KLevels - 1.0));
+
+	// Page x, y and level, alpha marks the pixel as sampling the texture
+	int across = int(KPagesAcross) >> level;
+	ivec2 page = clamp(ivec2(vuv * float(across)), ivec2(0), ivec2(across - 1));
+	fragment_colour = vec4(vec2(page), float(level), 255.0) / 255.0;
+}
@@ -0,0 +1,984 @@
+#include "FrameCapture.h"
+
+#include <fstream>
+#include <unordered_map>
+
+namespace Helpers
+{
+	// "3GPC" then the version, bumped whenever the layout changes
+	static constexpr GLuint KCaptureMagic{ 0x43504733 };
+	static constexpr GLuint KCaptureVersion{ 4 };
+
+	template<typename T>
+	static void Put(std::vector<GLubyte>& out, const T& value)
+	{
+		static_assert(std::is_trivially_copyable<T>::value, "only plain values can be written");
+		const GLubyte* bytes{ reinterpret_cast<const GLubyte*>(&value) };
+		out.insert(out.end(), bytes, bytes + sizeof(T));
+	}
+
+	static void PutBytes(std::vector<GLubyte>& out, const void* data, size_t size)
+	{
+		Put(out, (GLuint64)size);
+		const GLubyte* bytes{ static_cast<const GLubyte*>(data) };
+		out.insert(out.end(), bytes, bytes + size);
+	}
+
+	static void PutString(std::vector<GLubyte>& out, const std::string& text)
+	{
+		PutBytes(out, text.data(), text.size());
+	}
+
+	// Reads what Put wrote, once anything runs past the end every read gives zeros and Failed is true
+	class CaptureReader
+	{
+	private:
+		const std::vector<GLubyte>& m_data;
+		size_t m_offset{ 0 };
+		bool m_failed{ false };
+
+		const GLubyte* Take(size_t size)
+		{
+			if (m_failed || size > m_data.size() - m_offset)
+			{
+				m_failed = true;
+				return nullptr;
+			}
+			const GLubyte* bytes{ m_data.data() + m_offset };
+			m_offset += size;
+			return bytes;
+		}
+	public:
+		explicit CaptureReader(const std::vector<GLubyte>& data) : m_data(data) {}
+
+		template<typename T>
+		T Get()
+		{
+			T value{};
+			if (const GLubyte* bytes = Take(sizeof(T)))
+				memcpy(&value, bytes, sizeof(T));
+			return value;
+		}
+
+		std::vector<GLubyte> GetBytes()
+		{
+			const size_t size{ (size_t)Get<GLuint64>() };
+			const GLubyte* bytes{ Take(size) };
+			return bytes ? std::vector<GLubyte>(bytes, bytes + size) : std::vector<GLubyte>();
+		}
+
+		std::string GetString()
+		{
+			const std::vector<GLubyte> bytes{ GetBytes() };
+			return std::string(bytes.begin(), bytes.end());
+		}
+
+		bool Failed() const { return m_failed; }
+	};
+
+	// Number of floats or ints a uniform command holds
+	static size_t UniformValues(GLenum uniformType)
+	{
+		switch (uniformType)
+		{
+		case GL_FLOAT_VEC3: return 3;
+		case GL_FLOAT_VEC4: return 4;
+		case GL_FLOAT_MAT4: return 16;
+		default: return 1;
+		}
+	}
+
+	// The type then only the fields that matter, handles are the capturing backend's
+	static void PutCommand(std::vector<GLubyte>& out, const Command& command)
+	{
+		Put(out, command.type);
+		switch (command.type)
+		{
+		case CommandType::SetState:
+			Put(out, static_cast<const SetStateCommand&>(command).state);
+			break;
+		case CommandType::Clear:
+			Put(out, static_cast<const ClearCommand&>(command).mask);
+			break;
+		case CommandType::BindProgram:
+			Put(out, static_cast<const BindProgramCommand&>(command).program);
+			break;
+		case CommandType::SetUniform:
+		{
+			const SetUniformCommand& uniform{ static_cast<const SetUniformCommand&>(command) };
+			Put(out, uniform.location);
+			Put(out, uniform.uniformType);
+			const GLubyte* value{ reinterpret_cast<const GLubyte*>(&uniform.value) };
+			out.insert(out.end(), value, value + UniformValues(uniform.uniformType) * 4);
+			break;
+		}
+		case CommandType::BindTexture:
+		{
+			const BindTextureCommand& bind{ static_cast<const BindTextureCommand&>(command) };
+			Put(out, bind.unit);
+			Put(out, bind.target);
+			Put(out, bind.texture);
+			break;
+		}
+		case CommandType::BindVertexArray:
+			Put(out, static_cast<const BindVertexArrayCommand&>(command).vao);
+			break;
+		case CommandType::DrawElements:
+		{
+			const DrawElementsCommand& draw{ static_cast<const DrawElementsCommand&>(command) };
+			Put(out, draw.mode);
+			Put(out, draw.count);
+			Put(out, draw.indexType);
+			Put(out, (GLuint64)draw.byteOffset);
+			break;
+		}
+		case CommandType::MultiDrawElementsIndirect:
+		{
+			const MultiDrawElementsIndirectCommand& draw{ static_cast<const MultiDrawElementsIndirectCommand&>(command) };
+			Put(out, draw.mode);
+			Put(out, draw.indexType);
+			Put(out, draw.buffer);
+			Put(out, (GLuint64)draw.offset);
+			Put(out, draw.drawCount);
+			break;
+		}
+		case CommandType::UpdateBuffer:
+		{
+			const UpdateBufferCommand& update{ static_cast<const UpdateBufferCommand&>(command) };
+			Put(out, update.target);
+			Put(out, update.buffer);
+			PutBytes(out, update.data, (size_t)update.size);
+			break;
+		}
+		case CommandType::BindBufferRange:
+		{
+			const BindBufferRangeCommand& bind{ static_cast<const BindBufferRangeCommand&>(command) };
+			Put(out, bind.target);
+			Put(out, bind.index);
+			Put(out, bind.buffer);
+			Put(out, (GLuint64)bind.offset);
+			Put(out, (GLuint64)bind.size);
+			break;
+		}
+		case CommandType::BindFramebuffer:
+		{
+			const BindFramebufferCommand& bind{ static_cast<const BindFramebufferCommand&>(command) };
+			Put(out, bind.drawFramebuffer);
+			Put(out, bind.readFramebuffer);
+			Put(out, bind.viewport);
+			break;
+		}
+		case CommandType::BlitFramebuffer:
+		{
+			const BlitFramebufferCommand& blit{ static_cast<const BlitFramebufferCommand&>(command) };
+			Put(out, blit.source);
+			Put(out, blit.destination);
+			Put(out, blit.mask);
+			Put(out, blit.filter);
+			break;
+		}
+		case CommandType::Barrier:
+			Put(out, static_cast<const BarrierCommand&>(command).barriers);
+			break;
+		case CommandType::BeginQuery:
+		case CommandType::EndQuery:
+		case CommandType::BeginConditionalRender:
+		case CommandType::EndConditionalRender:
+		case CommandType::Timestamp:
+		{
+			const QueryCommand& query{ static_cast<const QueryCommand&>(command) };
+			Put(out, query.target);
+			Put(out, query.query);
+			break;
+		}
+		case CommandType::ReadPixels:
+		{
+			const ReadPixelsCommand& read{ static_cast<const ReadPixelsCommand&>(command) };
+			Put(out, read.rect);
+			Put(out, read.buffer);
+			Put(out, (GLuint64)read.offset);
+			break;
+		}
+		}
+	}
+
+	CaptureRenderBackend::CaptureRenderBackend(std::unique_ptr<RenderBackend> backend, const std::string& filename) :
+		m_backend(std::move(backend)), m_filename(filename)
+	{
+
+	}
+
+	CaptureRenderBackend::Resource* CaptureRenderBackend::Find(CaptureResourceType type, GLuint handle)
+	{
+		for (Resource& resource : m_resources)
+		{
+			if (resource.handle == handle && resource.type == type)
+				return &resource;
+		}
+		return nullptr;
+	}
+
+	// Names are reused once deleted, so the record goes with the resource
+	void CaptureRenderBackend::Remove(CaptureResourceType type, GLuint handle)
+	{
+		for (auto it = m_resources.begin(); it != m_resources.end(); ++it)
+		{
+			if (it->handle == handle && it->type == type)
+			{
+				m_resources.erase(it);
+				return;
+			}
+		}
+	}
+
+	GLuint CaptureRenderBackend::CreateProgram(const std::string& vertexPath, const std::string& fragmentPath)
+	{
+		const GLuint program{ m_backend->CreateProgram(vertexPath, fragmentPath) };
+		if (program)
+		{
+			Resource resource;
+			resource.type = CaptureResourceType::Program;
+			resource.handle = program;
+			resource.vertexPath = vertexPath;
+			resource.fragmentPath = fragmentPath;
+			m_resources.push_back(std::move(resource));
+		}
+		return program;
+	}
+
+	void CaptureRenderBackend::DeleteProgram(GLuint program)
+	{
+		Remove(CaptureResourceType::Program, program);
+		m_backend->DeleteProgram(program);
+	}
+
+	// Called from recording threads too
+	GLint CaptureRenderBackend::GetUniformLocation(GLuint program, const std::string& name) const
+	{
+		const GLint location{ m_backend->GetUniformLocation(program, name) };
+		if (location >= 0)
+		{
+			std::lock_guard<std::mutex> lock(m_uniformNamesMutex);
+			m_uniformNames.emplace(std::make_pair(program, location), name);
+		}
+		return location;
+	}
+
+	GLuint CaptureRenderBackend::CreateBuffer(GLenum target, const void* data, size_t size, GLenum usage)
+	{
+		const GLuint buffer{ m_backend->CreateBuffer(target, data, size, usage) };
+		if (buffer)
+		{
+			Resource resource;
+			resource.type = CaptureResourceType::Buffer;
+			resource.handle = buffer;
+			resource.target = target;
+			resource.usage = usage;
+			resource.size = size;
+			if (data)
+				resource.data.assign(static_cast<const GLubyte*>(data), static_cast<const GLubyte*>(data) + size);
+			m_resources.push_back(std::move(resource));
+		}
+		return buffer;
+	}
+
+	void CaptureRenderBackend::DeleteBuffer(GLuint buffer)
+	{
+		Remove(CaptureResourceType::Buffer, buffer);
+		Remove(CaptureResourceType::PersistentBuffer, buffer);
+		m_backend->DeleteBuffer(buffer);
+	}
+
+	GLuint CaptureRenderBackend::CreatePersistentBuffer(size_t size, void*& mapped)
+	{
+		const GLuint buffer{ m_backend->CreatePersistentBuffer(size, mapped) };
+		if (buffer)
+		{
+			Resource resource;
+			resource.type = CaptureResourceType::PersistentBuffer;
+			resource.handle = buffer;
+			resource.size = size;
+			resource.mapped = mapped;
+			m_resources.push_back(std::move(resource));
+		}
+		return buffer;
+	}
+
+	GLuint CaptureRenderBackend::CreateReadbackBuffer(size_t size, const void*& mapped)
+	{
+		const GLuint buffer{ m_backend->CreateReadbackBuffer(size, mapped) };
+		if (buffer)
+		{
+			Resource resource;
+			resource.type = CaptureResourceType::Buffer;
+			resource.handle = buffer;
+			resource.target = GL_PIXEL_PACK_BUFFER;
+			resource.usage = GL_STREAM_READ;
+			resource.size = size;
+			m_resources.push_back(std::move(resource));
+		}
+		return buffer;
+	}
+
+	GLuint CaptureRenderBackend::CreateVertexArray(GLuint vertexBuffer, GLsizei stride, const std::vector<VertexAttribute>& attributes, GLuint elementBuffer)
+	{
+		const GLuint vertexArray{ m_backend->CreateVertexArray(vertexBuffer, stride, attributes, elementBuffer) };
+		if (vertexArray)
+		{
+			Resource resource;
+			resource.type = CaptureResourceType::VertexArray;
+			resource.handle = vertexArray;
+			resource.vertexBuffer = vertexBuffer;
+			resource.stride = stride;
+			resource.attributes = attributes;
+			resource.elementBuffer = elementBuffer;
+			m_resources.push_back(std::move(resource));
+		}
+		return vertexArray;
+	}
+
+	void CaptureRenderBackend::DeleteVertexArray(GLuint vertexArray)
+	{
+		Remove(CaptureResourceType::VertexArray, vertexArray);
+		m_backend->DeleteVertexArray(vertexArray);
+	}
+
+	GLuint CaptureRenderBackend::CreateTexture2D(GLsizei width, GLsizei height, const void* rgba, GLint wrap)
+	{
+		const GLuint texture{ m_backend->CreateTexture2D(width, height, rgba, wrap) };
+		if (texture)
+		{
+			Resource resource;
+			resource.type = CaptureResourceType::Texture;
+			resource.handle = texture;
+			resource.width = width;
+			resource.height = height;
+			resource.wrap = wrap;
+			if (rgba)
+				resource.data.assign(static_cast<const GLubyte*>(rgba), static_cast<const GLubyte*>(rgba) + (size_t)width * (size_t)height * 4);
+			m_resources.push_back(std::move(resource));
+		}
+		return texture;
+	}
+
+	void CaptureRenderBackend::DeleteTexture(GLuint texture)
+	{
+		Remove(CaptureResourceType::Texture, texture);
+		Remove(CaptureResourceType::TextureArray, texture);
+		Remove(CaptureResourceType::RenderTarget, texture);
+		m_backend->DeleteTexture(texture);
+	}
+
+	// Level 0 is the copy made with the texture, a higher level starts as zeros the first time it is written
+	void CaptureRenderBackend::UpdateTexture2D(GLuint texture, GLint level, GLint x, GLint y, GLsizei width, GLsizei height, const void* rgba)
+	{
+		m_backend->UpdateTexture2D(texture, level, x, y, width, height, rgba);
+
+		Resource* resource{ Find(CaptureResourceType::Texture, texture) };
+		if (!resource || !rgba || level < 0 || level > 31)
+			return;
+
+		const GLsizei levelWidth{ std::max(resource->width >> level, 1) };
+		const GLsizei levelHeight{ std::max(resource->height >> level, 1) };
+		if (x < 0 || y < 0 || x + width > levelWidth || y + height > levelHeight)
+			return;
+
+		std::vector<GLubyte>& pixels{ level ? resource->levels[level] : resource->data };
+		pixels.resize((size_t)levelWidth * (size_t)levelHeight * 4);
+		const GLubyte* source{ static_cast<const GLubyte*>(rgba) };
+		for (GLsizei row = 0; row < height; row++)
+			memcpy(&pixels[((size_t)(y + row) * levelWidth + x) * 4], source + (size_t)row * width * 4, (size_t)width * 4);
+	}
+
+	GLuint CaptureRenderBackend::CreateTextureArray(GLsizei width, GLsizei height, GLsizei layers, const void* rgba, GLint wrap)
+	{
+		const GLuint texture{ m_backend->CreateTextureArray(width, height, layers, rgba, wrap) };
+		if (texture)
+		{
+			Resource resource;
+			resource.type = CaptureResourceType::TextureArray;
+			resource.handle = texture;
+			resource.width = width;
+			resource.height = height;
+			resource.layers = layers;
+			resource.wrap = wrap;
+			if (rgba)
+				resource.data.assign(static_cast<const GLubyte*>(rgba), static_cast<const GLubyte*>(rgba) + (size_t)width * (size_t)height * (size_t)layers * 4);
+			m_resources.push_back(std::move(resource));
+		}
+		return texture;
+	}
+
+	GLuint CaptureRenderBackend::CreateRenderTarget(GLsizei width, GLsizei height, GLenum format)
+	{
+		const GLuint texture{ m_backend->CreateRenderTarget(width, height, format) };
+		if (texture)
+		{
+			Resource resource;
+			resource.type = CaptureResourceType::RenderTarget;
+			resource.handle = texture;
+			resource.width = width;
+			resource.height = height;
+			resource.target = format;
+			m_resources.push_back(std::move(resource));
+		}
+		return texture;
+	}
+
+	GLuint CaptureRenderBackend::CreateFramebuffer(const std::vector<GLuint>& colourTargets, GLuint depthTarget)
+	{
+		const GLuint framebuffer{ m_backend->CreateFramebuffer(colourTargets, depthTarget) };
+		if (framebuffer)
+		{
+			Resource resource;
+			resource.type = CaptureResourceType::Framebuffer;
+			resource.handle = framebuffer;
+			resource.colourTargets = colourTargets;
+			resource.depthTarget = depthTarget;
+			m_resources.push_back(std::move(resource));
+		}
+		return framebuffer;
+	}
+
+	void CaptureRenderBackend::DeleteFramebuffer(GLuint framebuffer)
+	{
+		Remove(CaptureResourceType::Framebuffer, framebuffer);
+		m_backend->DeleteFramebuffer(framebuffer);
+	}
+
+	GLuint CaptureRenderBackend::CreateQuery()
+	{
+		const GLuint query{ m_backend->CreateQuery() };
+		if (query)
+		{
+			Resource resource;
+			resource.type = CaptureResourceType::Query;
+			resource.handle = query;
+			m_resources.push_back(std::move(resource));
+		}
+		return query;
+	}
+
+	void CaptureRenderBackend::DeleteQuery(GLuint query)
+	{
+		Remove(CaptureResourceType::Query, query);
+		m_backend->DeleteQuery(query);
+	}
+
+	// Writes the capture once the frame being captured is over, the counts are the wrapped backend's
+	void CaptureRenderBackend::BeginFrame()
+	{
+		if (m_capturing)
+		{
+			m_capturing = false;
+			if (WriteCapture())
+				m_capturesWritten++;
+			m_frameLists.clear();
+		}
+		if (m_capturePending)
+		{
+			m_capturePending = false;
+			m_capturing = true;
+		}
+
+		m_backend->BeginFrame();
+		m_lastFrameStats = m_backend->GetStats();
+	}
+
+	// Buffer copies follow UpdateBuffer so a capture has what the buffer held at the time
+	void CaptureRenderBackend::Execute(const CommandList& list)
+	{
+		std::vector<GLubyte> serialised;
+		if (m_capturing)
+			Put(serialised, (GLuint64)list.NumCommands());
+
+		for (const Command* command = list.First(); command; command = command->next)
+		{
+			if (command->type == CommandType::UpdateBuffer)
+			{
+				const UpdateBufferCommand* update{ static_cast<const UpdateBufferCommand*>(command) };
+				if (Resource* buffer = Find(CaptureResourceType::Buffer, update->buffer))
+				{
+					const GLubyte* data{ static_cast<const GLubyte*>(update->data) };
+					buffer->data.assign(data, data + update->size);
+					buffer->size = (size_t)update->size;
+				}
+			}
+			if (m_capturing)
+				PutCommand(serialised, *command);
+		}
+
+		if (m_capturing)
+			m_frameLists.push_back(std::move(serialised));
+		m_backend->Execute(list);
+	}
+
+	// Resources in the order made, then the uniform names, then the lists
+	bool CaptureRenderBackend::WriteCapture()
+	{
+		std::vector<GLubyte> out;
+		Put(out, KCaptureMagic);
+		Put(out, KCaptureVersion);
+		Put(out, GetViewport());
+
+		Put(out, (GLuint64)m_resources.size());
+		for (const Resource& resource : m_resources)
+		{
+			Put(out, resource.type);
+			Put(out, resource.handle);
+			switch (resource.type)
+			{
+			case CaptureResourceType::Program:
+				PutString(out, resource.vertexPath);
+				PutString(out, resource.fragmentPath);
+				break;
+			case CaptureResourceType::Buffer:
+				Put(out, resource.target);
+				Put(out, resource.usage);
+				Put(out, (GLuint64)resource.size);
+				PutBytes(out, resource.data.data(), resource.data.size());
+				break;
+			case CaptureResourceType::PersistentBuffer:
+				PutBytes(out, resource.mapped, resource.size);
+				break;
+			case CaptureResourceType::VertexArray:
+				Put(out, resource.vertexBuffer);
+				Put(out, resource.stride);
+				Put(out, resource.elementBuffer);
+				Put(out, (GLuint64)resource.attributes.size());
+				for (const VertexAttribute& attribute : resource.attributes)
+				{
+					Put(out, attribute.location);
+					Put(out, attribute.components);
+					Put(out, attribute.type);
+					Put(out, attribute.normalised);
+					Put(out, (GLuint64)attribute.offset);
+				}
+				break;
+			case CaptureResourceType::Texture:
+				Put(out, resource.width);
+				Put(out, resource.height);
+				Put(out, resource.wrap);
+				PutBytes(out, resource.data.data(), resource.data.size());
+				Put(out, (GLuint64)resource.levels.size());
+				for (const auto& level : resource.levels)
+				{
+					Put(out, level.first);
+					PutBytes(out, level.second.data(), level.second.size());
+				}
+				break;
+			case CaptureResourceType::TextureArray:
+				Put(out, resource.width);
+				Put(out, resource.height);
+				Put(out, resource.layers);
+				Put(out, resource.wrap);
+				PutBytes(out, resource.data.data(), resource.data.size());
+				break;
+			case CaptureResourceType::RenderTarget:
+				Put(out, resource.width);
+				Put(out, resource.height);
+				Put(out, resource.target);
+				break;
+			case CaptureResourceType::Framebuffer:
+				Put(out, resource.depthTarget);
+				Put(out, (GLuint64)resource.colourTargets.size());
+				for (GLuint colour : resource.colourTargets)
+					Put(out, colour);
+				break;
+			case CaptureResourceType::Query:
+				break;
+			}
+		}
+
+		{
+			std::lock_guard<std::mutex> lock(m_uniformNamesMutex);
+			Put(out, (GLuint64)m_uniformNames.size());
+			for (const auto& uniform : m_uniformNames)
+			{
+				Put(out, uniform.first.first);
+				Put(out, uniform.first.second);
+				PutString(out, uniform.second);
+			}
+		}
+
+		Put(out, (GLuint64)m_frameLists.size());
+		for (const std::vector<GLubyte>& list : m_frameLists)
+			out.insert(out.end(), list.begin(), list.end());
+
+		std::ofstream file(m_filename, std::ios::binary | std::ios::trunc);
+		file.write(reinterpret_cast<const char*>(out.data()), out.size());
+		if (!file)
+		{
+			std::cout << "ERROR: could not write capture " << m_filename << std::endl;
+			return false;
+		}
+		std::cout << "Capture: " << m_frameLists.size() << " command lists and " << m_resources.size() << " resources, "
+			<< out.size() / 1024 << " KB written to " << m_filename << std::endl;
+		return true;
+	}
+
+	// Read a capture and make its resources and command lists, false on error
+	bool CaptureReplay::Load(const std::string& filename, RenderBackend& backend)
+	{
+		Release();
+		m_backend = &backend;
+
+		std::ifstream file(filename, std::ios::binary);
+		if (!file)
+		{
+			std::cout << "ERROR: could not open capture " << filename << std::endl;
+			return false;
+		}
+		const std::vector<GLubyte> data{ std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>() };
+		CaptureReader reader(data);
+		if (reader.Get<GLuint>() != KCaptureMagic || reader.Get<GLuint>() != KCaptureVersion)
+		{
+			std::cout << "ERROR: " << filename << " is not a capture of this version" << std::endl;
+			return false;
+		}
+		reader.Get<glm::ivec4>();
+
+		// Captured handles to the ones made here, 0 stays 0 so the window is still framebuffer 0
+		std::unordered_map<GLuint, GLuint> programs{ { 0, 0 } };
+		std::unordered_map<GLuint, GLuint> buffers{ { 0, 0 } };
+		std::unordered_map<GLuint, GLuint> vertexArrays{ { 0, 0 } };
+		std::unordered_map<GLuint, GLuint> textures{ { 0, 0 } };
+		std::unordered_map<GLuint, GLuint> framebuffers{ { 0, 0 } };
+		std::unordered_map<GLuint, GLuint> queries{ { 0, 0 } };
+		const auto map = [](const std::unordered_map<GLuint, GLuint>& handles, GLuint handle)
+		{
+			const auto it{ handles.find(handle) };
+			return it == handles.end() ? 0 : it->second;
+		};
+
+		const size_t numResources{ (size_t)reader.Get<GLuint64>() };
+		for (size_t i = 0; i < numResources && !reader.Failed(); i++)
+		{
+			const CaptureResourceType type{ reader.Get<CaptureResourceType>() };
+			const GLuint handle{ reader.Get<GLuint>() };
+			switch (type)
+			{
+			case CaptureResourceType::Program:
+			{
+				const std::string vertexPath{ reader.GetString() };
+				const std::string fragmentPath{ reader.GetString() };
+				const GLuint program{ m_backend->CreateProgram(vertexPath, fragmentPath) };
+				programs[handle] = program;
+				m_programs.push_back(program);
+				break;
+			}
+			case CaptureResourceType::Buffer:
+			{
+				const GLenum target{ reader.Get<GLenum>() };
+				const GLenum usage{ reader.Get<GLenum>() };
+				const size_t size{ (size_t)reader.Get<GLuint64>() };
+				const std::vector<GLubyte> contents{ reader.GetBytes() };
+				const GLuint buffer{ m_backend->CreateBuffer(target, contents.empty() ? nullptr : contents.data(), size, usage) };
+				buffers[handle] = buffer;
+				m_buffers.push_back(buffer);
+				break;
+			}
+			case CaptureResourceType::PersistentBuffer:
+			{
+				const std::vector<GLubyte> contents{ reader.GetBytes() };
+				void* mapped{ nullptr };
+				const GLuint buffer{ m_backend->CreatePersistentBuffer(contents.size(), mapped) };
+				if (mapped)
+					memcpy(mapped, contents.data(), contents.size());
+				buffers[handle] = buffer;
+				m_buffers.push_back(buffer);
+				break;
+			}
+			case CaptureResourceType::VertexArray:
+			{
+				const GLuint vertexBuffer{ map(buffers, reader.Get<GLuint>()) };
+				const GLsizei stride{ reader.Get<GLsizei>() };
+				const GLuint elementBuffer{ map(buffers, reader.Get<GLuint>()) };
+				std::vector<VertexAttribute> attributes((size_t)reader.Get<GLuint64>());
+				for (VertexAttribute& attribute : attributes)
+				{
+					attribute.location = reader.Get<GLuint>();
+					attribute.components = reader.Get<GLint>();
+					attribute.type = reader.Get<GLenum>();
+					attribute.normalised = reader.Get<GLboolean>();
+					attribute.offset = (size_t)reader.Get<GLuint64>();
+				}
+				const GLuint vertexArray{ m_backend->CreateVertexArray(vertexBuffer, stride, attributes, elementBuffer) };
+				vertexArrays[handle] = vertexArray;
+				m_vertexArrays.push_back(vertexArray);
+				break;
+			}
+			case CaptureResourceType::Texture:
+			{
+				const GLsizei width{ reader.Get<GLsizei>() };
+				const GLsizei height{ reader.Get<GLsizei>() };
+				const GLint wrap{ reader.Get<GLint>() };
+				const std::vector<GLubyte> pixels{ reader.GetBytes() };
+				const GLuint texture{ m_backend->CreateTexture2D(width, height, pixels.empty() ? nullptr : pixels.data(), wrap) };
+				const size_t numLevels{ (size_t)reader.Get<GLuint64>() };
+				for (size_t l = 0; l < numLevels && !reader.Failed(); l++)
+				{
+					const GLint level{ reader.Get<GLint>() };
+					const std::vector<GLubyte> levelPixels{ reader.GetBytes() };
+					if (texture && level > 0 && level <= 31 && levelPixels.size() == (size_t)std::max(width >> level, 1) * (size_t)std::max(height >> level, 1) * 4)
+						m_backend->UpdateTexture2D(texture, level, 0, 0, std::max(width >> level, 1), std::max(height >> level, 1), levelPixels.data());
+				}
+				textures[handle] = texture;
+				m_textures.push_back(texture);
+				break;
+			}
+			case CaptureResourceType::TextureArray:
+			{
+				const GLsizei width{ reader.Get<GLsizei>() };
+				const GLsizei height{ reader.Get<GLsizei>() };
+				const GLsizei layers{ reader.Get<GLsizei>() };
+				const GLint wrap{ reader.Get<GLint>() };
+				const std::vector<GLubyte> pixels{ reader.GetBytes() };
+				const GLuint texture{ m_backend->CreateTextureArray(width, height, layers, pixels.empty() ? nullptr : pixels.data(), wrap) };
+				textures[handle] = texture;
+				m_textures.push_back(texture);
+				break;
+			}
+			case CaptureResourceType::RenderTarget:
+			{
+				const GLsizei width{ reader.Get<GLsizei>() };
+				const GLsizei height{ reader.Get<GLsizei>() };
+				const GLenum format{ reader.Get<GLenum>() };
+				const GLuint texture{ m_backend->CreateRenderTarget(width, height, format) };
+				textures[handle] = texture;
+				m_textures.push_back(texture);
+				break;
+			}
+			case CaptureResourceType::Framebuffer:
+			{
+				const GLuint depthTarget{ map(textures, reader.Get<GLuint>()) };
+				std::vector<GLuint> colourTargets((size_t)reader.Get<GLuint64>());
+				for (GLuint& colour : colourTargets)
+					colour = map(textures, reader.Get<GLuint>());
+				const GLuint framebuffer{ m_backend->CreateFramebuffer(colourTargets, depthTarget) };
+				framebuffers[handle] = framebuffer;
+				m_framebuffers.push_back(framebuffer);
+				break;
+			}
+			case CaptureResourceType::Query:
+			{
+				const GLuint query{ m_backend->CreateQuery() };
+				queries[handle] = query;
+				m_queries.push_back(query);
+				break;
+			}
+			default:
+				std::cout << "ERROR: unknown resource type " << (int)type << " in " << filename << std::endl;
+				return false;
+			}
+		}
+
+		// Locations are looked up again by name as another driver may number them differently
+		std::map<std::pair<GLuint, GLint>, GLint> locations;
+		const size_t numUniformNames{ (size_t)reader.Get<GLuint64>() };
+		for (size_t i = 0; i < numUniformNames && !reader.Failed(); i++)
+		{
+			const GLuint program{ reader.Get<GLuint>() };
+			const GLint location{ reader.Get<GLint>() };
+			const std::string name{ reader.GetString() };
+			locations[std::make_pair(program, location)] = m_backend->GetUniformLocation(map(programs, program), name);
+		}
+
+		GLuint program{ 0 };
+		const size_t numLists{ (size_t)reader.Get<GLuint64>() };
+		for (size_t i = 0; i < numLists && !reader.Failed(); i++)
+		{
+			m_lists.emplace_back(m_allocator);
+			CommandList& list{ m_lists.back() };
+			const size_t numCommands{ (size_t)reader.Get<GLuint64>() };
+			for (size_t c = 0; c < numCommands && !reader.Failed(); c++)
+			{
+				switch (reader.Get<CommandType>())
+				{
+				case CommandType::SetState:
+					list.SetState(reader.Get<RenderState>());
+					break;
+				case CommandType::Clear:
+					list.Clear(reader.Get<GLbitfield>());
+					break;
+				case CommandType::BindProgram:
+					program = reader.Get<GLuint>();
+					list.BindProgram(map(programs, program));
+					break;
+				case CommandType::SetUniform:
+				{
+					GLint location{ reader.Get<GLint>() };
+					const GLenum uniformType{ reader.Get<GLenum>() };
+					const auto it{ locations.find(std::make_pair(program, location)) };
+					if (it != locations.end())
+						location = it->second;
+
+					if (uniformType == GL_INT)
+					{
+						list.SetUniform(location, reader.Get<GLint>());
+						break;
+					}
+					GLfloat values[16]{};
+					for (size_t v = 0; v < UniformValues(uniformType); v++)
+						values[v] = reader.Get<GLfloat>();
+					if (uniformType == GL_FLOAT_VEC3)
+						list.SetUniform(location, glm::vec3(values[0], values[1], values[2]));
+					else if (uniformType == GL_FLOAT_VEC4)
+						list.SetUniform(location, glm::vec4(values[0], values[1], values[2], values[3]));
+					else if (uniformType == GL_FLOAT_MAT4)
+						list.SetUniform(location, glm::make_mat4(values));
+					else
+						list.SetUniform(location, values[0]);
+					break;
+				}
+				case CommandType::BindTexture:
+				{
+					const GLuint unit{ reader.Get<GLuint>() };
+					const GLenum target{ reader.Get<GLenum>() };
+					list.BindTexture(unit, map(textures, reader.Get<GLuint>()), target);
+					break;
+				}
+				case CommandType::BindVertexArray:
+					list.BindVertexArray(map(vertexArrays, reader.Get<GLuint>()));
+					break;
+				case CommandType::DrawElements:
+				{
+					const GLenum mode{ reader.Get<GLenum>() };
+					const GLsizei count{ reader.Get<GLsizei>() };
+					const GLenum indexType{ reader.Get<GLenum>() };
+					list.DrawElements(mode, count, indexType, (size_t)reader.Get<GLuint64>());
+					break;
+				}
+				case CommandType::MultiDrawElementsIndirect:
+				{
+					const GLenum mode{ reader.Get<GLenum>() };
+					const GLenum indexType{ reader.Get<GLenum>() };
+					const GLuint buffer{ map(buffers, reader.Get<GLuint>()) };
+					const size_t offset{ (size_t)reader.Get<GLuint64>() };
+					list.MultiDrawElementsIndirect(mode, indexType, buffer, offset, reader.Get<GLsizei>());
+					break;
+				}
+				case CommandType::UpdateBuffer:
+				{
+					const GLenum target{ reader.Get<GLenum>() };
+					const GLuint buffer{ map(buffers, reader.Get<GLuint>()) };
+					const std::vector<GLubyte> contents{ reader.GetBytes() };
+					list.UpdateBuffer(target, buffer, contents.data(), contents.size());
+					break;
+				}
+				case CommandType::BindBufferRange:
+				{
+					const GLenum target{ reader.Get<GLenum>() };
+					const GLuint index{ reader.Get<GLuint>() };
+					const GLuint buffer{ map(buffers, reader.Get<GLuint>()) };
+					const size_t offset{ (size_t)reader.Get<GLuint64>() };
+					list.BindBufferRange(target, index, buffer, offset, (size_t)reader.Get<GLuint64>());
+					break;
+				}
+				case CommandType::BindFramebuffer:
+				{
+					const GLuint draw{ map(framebuffers, reader.Get<GLuint>()) };
+					const GLuint read{ map(framebuffers, reader.Get<GLuint>()) };
+					list.BindFramebuffer(draw, read, reader.Get<glm::ivec4>());
+					break;
+				}
+				case CommandType::BlitFramebuffer:
+				{
+					const glm::ivec4 source{ reader.Get<glm::ivec4>() };
+					const glm::ivec4 destination{ reader.Get<glm::ivec4>() };
+					const GLbitfield mask{ reader.Get<GLbitfield>() };
+					list.BlitFramebuffer(source, destination, mask, reader.Get<GLenum>());
+					break;
+				}
+				case CommandType::Barrier:
+					list.Barrier(reader.Get<GLbitfield>());
+					break;
+				case CommandType::BeginQuery:
+				{
+					const GLenum target{ reader.Get<GLenum>() };
+					list.BeginQuery(target, map(queries, reader.Get<GLuint>()));
+					break;
+				}
+				case CommandType::EndQuery:
+				{
+					const GLenum target{ reader.Get<GLenum>() };
+					reader.Get<GLuint>();
+					list.EndQuery(target);
+					break;
+				}
+				case CommandType::BeginConditionalRender:
+				{
+					const GLenum mode{ reader.Get<GLenum>() };
+					list.BeginConditionalRender(map(queries, reader.Get<GLuint>()), mode);
+					break;
+				}
+				case CommandType::EndConditionalRender:
+					reader.Get<GLenum>();
+					reader.Get<GLuint>();
+					list.EndConditionalRender();
+					break;
+				case CommandType::Timestamp:
+					reader.Get<GLenum>();
+					list.Timestamp(map(queries, reader.Get<GLuint>()));
+					break;
+				case CommandType::ReadPixels:
+				{
+					const glm::ivec4 rect{ reader.Get<glm::ivec4>() };
+					const GLuint buffer{ map(buffers, reader.Get<GLuint>()) };
+					list.ReadPixels(rect, buffer, (size_t)reader.Get<GLuint64>());
+					break;
+				}
+				default:
+					std::cout << "ERROR: unknown command in " << filename << std::endl;
+					return false;
+				}
+			}
+			m_numCommands += list.NumCommands();
+		}
+
+		if (reader.Failed())
+		{
+			std::cout << "ERROR: capture " << filename << " is cut short" << std::endl;
+			return false;
+		}
+		return true;
+	}
+
+	// Execute the frame's lists in order
+	void CaptureReplay::Execute()
+	{
+		for (const CommandList& list : m_lists)
+			m_backend->Execute(list);
+	}
+
+	// Delete what Load made
+	void CaptureReplay::Release()
+	{
+		if (!m_backend)
+			return;
+
+		for (GLuint framebuffer : m_framebuffers)
+			m_backend->DeleteFramebuffer(framebuffer);
+		for (GLuint vertexArray : m_vertexArrays)
+			m_backend->DeleteVertexArray(vertexArray);
+		for (GLuint buffer : m_buffers)
+			m_backend->DeleteBuffer(buffer);
+		for (GLuint texture : m_textures)
+			m_backend->DeleteTexture(texture);
+		for (GLuint program : m_programs)
+			m_backend->DeleteProgram(program);
+		for (GLuint query : m_queries)
+			m_backend->DeleteQuery(query);
+
+		m_framebuffers.clear();
+		m_vertexArrays.clear();
+		m_buffers.clear();
+		m_textures.clear();
+		m_programs.clear();
+		m_queries.clear();
+		m_lists.clear();
+		m_allocator.Reset();
+		m_numCommands = 0;
+		m_backend = nullptr;
+	}
+}
@@ -0,0 +1,167 @@
+#pragma once
+// Capture of one frame's command lists, with every resource they use, to a binary file that can be replayed
+// on its own. CaptureRenderBackend sits in front of another backend, passing every call on and keeping a copy
+// of what each live resource was made from. CaptureReplay makes the resources again on any backend and runs
+// the frame as many times as wanted, so the driver's cost of a frame can be measured away from the simulation
+// and loading.
+
+#include "RenderBackend.h"
+
+#include <mutex>
+
+namespace Helpers
+{
+	// Kinds of resource in a capture file
+	enum class CaptureResourceType : GLubyte
+	{
+		Program,
+		Buffer,
+		PersistentBuffer,
+		VertexArray,
+		Texture,
+		RenderTarget,
+		Framebuffer,
+		Query,
+		TextureArray
+	};
+
+	class CaptureRenderBackend : public RenderBackend
+	{
+	private:
+		// What a resource was made from, only the fields of its type are used
+		struct Resource
+		{
+			CaptureResourceType type{ CaptureResourceType::Buffer };
+			GLuint handle{ 0 };
+			std::string vertexPath;
+			std::string fragmentPath;
+			GLenum target{ 0 };			// buffer target or render target format
+			GLenum usage{ 0 };
+			std::vector<GLubyte> data;	// buffer contents, kept up to date with UpdateBuffer, or texture pixels
+			std::map<GLint, std::vector<GLubyte>> levels;	// texture levels above 0 written by UpdateTexture2D, the rest is zeros
+			void* mapped{ nullptr };	// persistent buffers are copied when the capture is written
+			size_t size{ 0 };
+			GLsizei width{ 0 };
+			GLsizei height{ 0 };
+			GLsizei layers{ 0 };
+			GLint wrap{ 0 };
+			GLuint vertexBuffer{ 0 };
+			GLuint elementBuffer{ 0 };
+			GLsizei stride{ 0 };
+			std::vector<VertexAttribute> attributes;
+			std::vector<GLuint> colourTargets;
+			GLuint depthTarget{ 0 };
+		};
+
+		std::unique_ptr<RenderBackend> m_backend;
+		std::string m_filename;
+
+		// Live resources in the order they were made, so each only refers to earlier ones
+		std::vector<Resource> m_resources;
+
+		// Names of the uniform locations looked up, so a replay can find them in its own programs
+		mutable std::mutex m_uniformNamesMutex;
+		mutable std::map<std::pair<GLuint, GLint>, std::string> m_uniformNames;
+
+		bool m_capturePending{ false };
+		bool m_capturing{ false };
+		std::vector<std::vector<GLubyte>> m_frameLists;	// serialised as they are executed
+		size_t m_capturesWritten{ 0 };
+
+		void Remove(CaptureResourceType type, GLuint handle);
+		Resource* Find(CaptureResourceType type, GLuint handle);
+		bool WriteCapture();
+	public:
+		// The capture is written to filename
+		CaptureRenderBackend(std::unique_ptr<RenderBackend> backend, const std::string& filename);
+
+		const char* Name() const override { return m_backend->Name(); }
+
+		GLuint CreateProgram(const std::string& vertexPath, const std::string& fragmentPath) override;
+		void DeleteProgram(GLuint program) override;
+		GLint GetUniformLocation(GLuint program, const std::string& name) const override;
+
+		GLuint CreateBuffer(GLenum target, const void* data, size_t size, GLenum usage) override;
+		void DeleteBuffer(GLuint buffer) override;
+		GLuint CreatePersistentBuffer(size_t size, void*& mapped) override;
+
+		// Captured as an empty buffer, as nothing the CPU does depends on its contents in a replay
+		GLuint CreateReadbackBuffer(size_t size, const void*& mapped) override;
+		size_t GetUniformBufferAlignment() const override { return m_backend->GetUniformBufferAlignment(); }
+		size_t GetStorageBufferAlignment() const override { return m_backend->GetStorageBufferAlignment(); }
+
+		GLuint CreateVertexArray(GLuint vertexBuffer, GLsizei stride, const std::vector<VertexAttribute>& attributes, GLuint elementBuffer) override;
+		void DeleteVertexArray(GLuint vertexArray) override;
+
+		GLuint CreateTexture2D(GLsizei width, GLsizei height, const void* rgba, GLint wrap) override;
+		void DeleteTexture(GLuint texture) override;
+
+		// The copy of the pixels is patched, so a capture has what the texture held at the time
+		void UpdateTexture2D(GLuint texture, GLint level, GLint x, GLint y, GLsizei width, GLsizei height, const void* rgba) override;
+		GLuint CreateTextureArray(GLsizei width, GLsizei height, GLsizei layers, const void* rgba, GLint wrap) override;
+
+		GLuint CreateRenderTarget(GLsizei width, GLsizei height, GLenum format) override;
+		GLuint CreateFramebuffer(const std::vector<GLuint>& colourTargets, GLuint depthTarget) override;
+		void DeleteFramebuffer(GLuint framebuffer) override;
+
+		GLuint CreateQuery() override;
+		void DeleteQuery(GLuint query) override;
+		bool GetQueryResult(GLuint query, GLuint& result) override { return m_backend->GetQueryResult(query, result); }
+		bool GetTimestamp(GLuint query, GLuint64& nanoseconds) override { return m_backend->GetTimestamp(query, nanoseconds); }
+		GLuint64 GetGpuTime() override { return m_backend->GetGpuTime(); }
+
+		GLsync InsertFence() override { return m_backend->InsertFence(); }
+		void WaitFence(GLsync fence) override { m_backend->WaitFence(fence); }
+		void DeleteFence(GLsync fence) override { m_backend->DeleteFence(fence); }
+
+		glm::ivec4 GetViewport() const override { return m_backend->GetViewport(); }
+
+		// Writes the capture once the frame being captured is over, the counts are the wrapped backend's
+		void BeginFrame() override;
+
+		void Execute(const CommandList& list) override;
+		void Finish() override { m_backend->Finish(); }
+
+		// Capture the frame after this one
+		void CaptureNextFrame() { m_capturePending = true; }
+		bool IsCapturing() const { return m_capturePending || m_capturing; }
+
+		const std::string& GetFilename() const { return m_filename; }
+		size_t CapturesWritten() const { return m_capturesWritten; }
+	};
+
+	// A captured frame made again on a backend
+	class CaptureReplay
+	{
+	private:
+		RenderBackend* m_backend{ nullptr };
+		LinearAllocator m_allocator;
+		std::vector<CommandList> m_lists;
+		size_t m_numCommands{ 0 };
+
+		// Everything made, to delete afterwards
+		std::vector<GLuint> m_programs;
+		std::vector<GLuint> m_buffers;
+		std::vector<GLuint> m_vertexArrays;
+		std::vector<GLuint> m_textures;
+		std::vector<GLuint> m_framebuffers;
+		std::vector<GLuint> m_queries;
+	public:
+		CaptureReplay() = default;
+		CaptureReplay(const CaptureReplay&) = delete;
+		CaptureReplay& operator=(const CaptureReplay&) = delete;
+		~CaptureReplay() { Release(); }
+
+		// Read a capture and make its resources and command lists, false on error
+		bool Load(const std::string& filename, RenderBackend& backend);
+
+		// Execute the frame's lists in order
+		void Execute();
+
+		// Delete what Load made
+		void Release();
+
+		size_t NumLists() const { return m_lists.size(); }
+		size_t NumCommands() const { return m_numCommands; }
+	};
+}
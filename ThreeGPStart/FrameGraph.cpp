@@ -0,0 +1,564 @@
+#include "FrameGraph.h"
+
+namespace Helpers
+{
+	size_t FrameGraphTextureDesc::Bytes() const
+	{
+		return TextureBytes(width, height, format, false);
+	}
+
+	bool FrameGraphTextureDesc::IsDepth() const
+	{
+		return format == GL_DEPTH_COMPONENT16 || format == GL_DEPTH_COMPONENT24 || format == GL_DEPTH_COMPONENT32F ||
+			format == GL_DEPTH24_STENCIL8 || format == GL_DEPTH32F_STENCIL8;
+	}
+
+	// The barrier that makes an image store or shader storage write visible to a later use
+	static GLbitfield BarrierFor(FrameGraphAccess access, bool texture)
+	{
+		switch (access)
+		{
+		case FrameGraphAccess::Sampled:
+			return GL_TEXTURE_FETCH_BARRIER_BIT;
+		case FrameGraphAccess::StorageRead:
+		case FrameGraphAccess::StorageWrite:
+			return texture ? GL_SHADER_IMAGE_ACCESS_BARRIER_BIT : GL_SHADER_STORAGE_BARRIER_BIT;
+		case FrameGraphAccess::Uniform:
+			return GL_UNIFORM_BARRIER_BIT;
+		case FrameGraphAccess::Indirect:
+			return GL_COMMAND_BARRIER_BIT;
+		case FrameGraphAccess::VertexInput:
+			return GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT | GL_ELEMENT_ARRAY_BARRIER_BIT;
+		default:
+			return texture ? GL_FRAMEBUFFER_BARRIER_BIT : GL_BUFFER_UPDATE_BARRIER_BIT;
+		}
+	}
+
+	// A transient texture that lives from this pass to its last reader, its contents start undefined
+	FrameGraphResource FrameGraph::PassBuilder::CreateTexture(const std::string& name, const FrameGraphTextureDesc& desc, FrameGraphAccess access)
+	{
+		Resource resource;
+		resource.name = name;
+		resource.desc = desc;
+		m_graph.m_resources.push_back(resource);
+
+		const FrameGraphResource created{ m_graph.m_resources.size() - 1 };
+		Write(created, access);
+		return created;
+	}
+
+	void FrameGraph::PassBuilder::Read(FrameGraphResource resource, FrameGraphAccess access)
+	{
+		m_graph.m_passes[m_pass].accesses.push_back(Access{ resource, access, false });
+	}
+
+	// Writes keep what was there, e.g. drawing more into a colour target
+	void FrameGraph::PassBuilder::Write(FrameGraphResource resource, FrameGraphAccess access)
+	{
+		m_graph.m_passes[m_pass].accesses.push_back(Access{ resource, access, true });
+	}
+
+	void FrameGraph::PassBuilder::SideEffects()
+	{
+		m_graph.m_passes[m_pass].sideEffects = true;
+	}
+
+	void FrameGraph::PassBuilder::MainThread()
+	{
+		m_graph.m_passes[m_pass].mainThread = true;
+	}
+
+	// Pooled textures and framebuffers are made through the registry, which must outlive this
+	void FrameGraph::Initialise(GpuResourceRegistry& resources)
+	{
+		m_gpuResources = &resources;
+	}
+
+	// Forget last frame's passes and resources, the pooled textures are kept
+	void FrameGraph::Reset()
+	{
+		m_resources.clear();
+		m_passes.clear();
+		m_order.clear();
+		m_frame++;
+	}
+
+	FrameGraphResource FrameGraph::ImportTexture(const std::string& name, GLuint texture, const FrameGraphTextureDesc& desc)
+	{
+		Resource resource;
+		resource.name = name;
+		resource.imported = true;
+		resource.desc = desc;
+		resource.handle = texture;
+		m_resources.push_back(resource);
+		return m_resources.size() - 1;
+	}
+
+	FrameGraphResource FrameGraph::ImportBuffer(const std::string& name, GLuint buffer)
+	{
+		Resource resource;
+		resource.name = name;
+		resource.texture = false;
+		resource.imported = true;
+		resource.handle = buffer;
+		m_resources.push_back(resource);
+		return m_resources.size() - 1;
+	}
+
+	// The window's colour or depth, drawn to through framebuffer 0
+	FrameGraphResource FrameGraph::ImportBackbuffer(const std::string& name, const FrameGraphTextureDesc& desc)
+	{
+		const FrameGraphResource resource{ ImportTexture(name, 0, desc) };
+		m_resources[resource].backbuffer = true;
+		return resource;
+	}
+
+	void FrameGraph::MarkOutput(FrameGraphResource resource)
+	{
+		m_resources[resource].output = true;
+	}
+
+	// setup is called now to declare the resources, execute when the pass is recorded
+	void FrameGraph::AddPass(const std::string& name, const std::function<void(PassBuilder&)>& setup, std::function<void(CommandList&)> execute)
+	{
+		Pass pass;
+		pass.name = name;
+		pass.execute = std::move(execute);
+		m_passes.push_back(std::move(pass));
+
+		PassBuilder builder(*this, m_passes.size() - 1);
+		setup(builder);
+	}
+
+	// Working back from the last pass, a pass is needed if it has side effects or writes something that
+	// is output or used by a pass already found to be needed
+	void FrameGraph::CullPasses()
+	{
+		std::vector<bool> needed(m_resources.size(), false);
+		for (size_t r = 0; r < m_resources.size(); r++)
+			needed[r] = m_resources[r].output;
+
+		for (size_t p = m_passes.size(); p-- > 0; )
+		{
+			Pass& pass{ m_passes[p] };
+			pass.culled = !pass.sideEffects;
+			for (const Access& access : pass.accesses)
+			{
+				if (access.write && needed[access.resource])
+					pass.culled = false;
+			}
+
+			if (pass.culled)
+			{
+				m_stats.culledPasses++;
+				continue;
+			}
+			for (const Access& access : pass.accesses)
+				needed[access.resource] = true;
+		}
+	}
+
+	// A pass follows the last pass to write what it uses, and writes also follow the passes reading
+	// the previous contents. Of the passes ready to go the one drawing to the same targets as the last
+	// is taken first to save framebuffer changes, then the one declared first.
+	bool FrameGraph::OrderPasses()
+	{
+		std::vector<size_t> lastWriter(m_resources.size(), SIZE_MAX);
+		std::vector<std::vector<size_t>> readers(m_resources.size());
+		std::vector<std::vector<FrameGraphResource>> targets(m_passes.size());
+
+		for (size_t p = 0; p < m_passes.size(); p++)
+		{
+			Pass& pass{ m_passes[p] };
+			if (pass.culled)
+				continue;
+
+			for (const Access& access : pass.accesses)
+			{
+				const FrameGraphResource r{ access.resource };
+				if (!access.write && lastWriter[r] == SIZE_MAX && !m_resources[r].imported)
+				{
+					std::cout << "ERROR: frame graph pass " << pass.name << " reads " << m_resources[r].name << " before anything writes it" << std::endl;
+					return false;
+				}
+
+				if (lastWriter[r] != SIZE_MAX && lastWriter[r] != p)
+					pass.dependencies.push_back(lastWriter[r]);
+				if (access.write)
+				{
+					for (size_t reader : readers[r])
+					{
+						if (reader != p)
+							pass.dependencies.push_back(reader);
+					}
+				}
+
+				if (access.access == FrameGraphAccess::ColourTarget || access.access == FrameGraphAccess::DepthTarget || access.access == FrameGraphAccess::TransferDestination)
+					targets[p].push_back(r);
+			}
+
+			// Updated after all the pass's accesses so reading and writing one resource does not depend on itself
+			for (const Access& access : pass.accesses)
+			{
+				if (access.write)
+				{
+					lastWriter[access.resource] = p;
+					readers[access.resource].clear();
+				}
+				else
+				{
+					readers[access.resource].push_back(p);
+				}
+			}
+		}
+
+		std::vector<size_t> waitingOn(m_passes.size(), 0);
+		std::vector<std::vector<size_t>> dependants(m_passes.size());
+		for (size_t p = 0; p < m_passes.size(); p++)
+		{
+			std::vector<size_t>& dependencies{ m_passes[p].dependencies };
+			std::sort(dependencies.begin(), dependencies.end());
+			dependencies.erase(std::unique(dependencies.begin(), dependencies.end()), dependencies.end());
+			waitingOn[p] = dependencies.size();
+			for (size_t dependency : dependencies)
+				dependants[dependency].push_back(p);
+		}
+
+		std::vector<size_t> ready;
+		for (size_t p = 0; p < m_passes.size(); p++)
+		{
+			if (!m_passes[p].culled && waitingOn[p] == 0)
+				ready.push_back(p);
+		}
+
+		while (!ready.empty())
+		{
+			// ready is kept sorted so the first match is the earliest declared
+			size_t chosen{ 0 };
+			if (!m_order.empty())
+			{
+				for (size_t i = 0; i < ready.size(); i++)
+				{
+					if (!targets[ready[i]].empty() && targets[ready[i]] == targets[m_order.back()])
+					{
+						chosen = i;
+						break;
+					}
+				}
+			}
+
+			const size_t p{ ready[chosen] };
+			ready.erase(ready.begin() + chosen);
+			m_order.push_back(p);
+
+			for (size_t dependant : dependants[p])
+			{
+				if (--waitingOn[dependant] == 0)
+					ready.insert(std::upper_bound(ready.begin(), ready.end(), dependant), dependant);
+			}
+		}
+
+		return true;
+	}
+
+	// Lifetimes in the compiled order, and a barrier before the first use of anything written by image
+	// store or shader storage in an earlier pass, one barrier bit per kind of use
+	void FrameGraph::FindBarriers()
+	{
+		for (size_t position = 0; position < m_order.size(); position++)
+		{
+			Pass& pass{ m_passes[m_order[position]] };
+			for (const Access& access : pass.accesses)
+			{
+				Resource& resource{ m_resources[access.resource] };
+				resource.firstUse = std::min(resource.firstUse, position);
+				resource.lastUse = std::max(resource.lastUse, position);
+
+				if (resource.storageWritten)
+				{
+					const GLbitfield barrier{ BarrierFor(access.access, resource.texture) };
+					if (barrier & ~resource.barriersIssued)
+					{
+						pass.barriers |= barrier;
+						resource.barriersIssued |= barrier;
+					}
+				}
+			}
+
+			for (const Access& access : pass.accesses)
+			{
+				if (!access.write)
+					continue;
+				Resource& resource{ m_resources[access.resource] };
+				resource.storageWritten = access.access == FrameGraphAccess::StorageWrite;
+				resource.barriersIssued = 0;
+			}
+
+			if (pass.barriers)
+				m_stats.barriers++;
+		}
+	}
+
+	// Transients in order of first use take the first texture of their description that is free by then
+	void FrameGraph::AllocateTransients()
+	{
+		std::vector<FrameGraphResource> transients;
+		for (FrameGraphResource r = 0; r < m_resources.size(); r++)
+		{
+			if (!m_resources[r].imported && m_resources[r].firstUse != SIZE_MAX)
+				transients.push_back(r);
+		}
+		std::sort(transients.begin(), transients.end(), [&](FrameGraphResource a, FrameGraphResource b) { return m_resources[a].firstUse < m_resources[b].firstUse; });
+
+		struct Slot
+		{
+			FrameGraphTextureDesc desc;
+			size_t lastUse{ 0 };
+			GLuint texture{ 0 };
+		};
+		std::vector<Slot> slots;
+
+		for (FrameGraphResource r : transients)
+		{
+			Resource& resource{ m_resources[r] };
+			m_stats.transientTextures++;
+			m_stats.transientBytes += resource.desc.Bytes();
+
+			Slot* slot{ nullptr };
+			if (m_aliasing)
+			{
+				for (Slot& candidate : slots)
+				{
+					if (candidate.desc == resource.desc && candidate.lastUse < resource.firstUse)
+					{
+						slot = &candidate;
+						break;
+					}
+				}
+			}
+			if (!slot)
+			{
+				slots.push_back(Slot{ resource.desc, 0, AcquireTexture(resource.desc) });
+				slot = &slots.back();
+				m_stats.aliasedBytes += resource.desc.Bytes();
+			}
+
+			slot->lastUse = resource.lastUse;
+			resource.handle = slot->texture;
+		}
+
+		m_stats.physicalTextures = slots.size();
+	}
+
+	// Each pass draws into the framebuffer made of its targets, bound only when it differs from the last pass's
+	bool FrameGraph::CreateFramebuffers()
+	{
+		// A pass with no draw target leaves the window as the draw framebuffer, so gets the window's viewport
+		m_windowViewport = glm::ivec4(0);
+		for (const Resource& resource : m_resources)
+		{
+			if (resource.backbuffer)
+			{
+				m_windowViewport = glm::ivec4(0, 0, resource.desc.width, resource.desc.height);
+				break;
+			}
+		}
+
+		bool bound{ false };
+		GLuint boundDraw{ 0 };
+		GLuint boundRead{ 0 };
+		glm::ivec4 boundViewport{ 0 };
+		for (size_t index : m_order)
+		{
+			Pass& pass{ m_passes[index] };
+
+			std::vector<GLuint> colour;
+			GLuint depth{ 0 };
+			std::vector<const Resource*> drawTargets;
+			const Resource* readTarget{ nullptr };
+			for (const Access& access : pass.accesses)
+			{
+				const Resource& resource{ m_resources[access.resource] };
+				if (access.access == FrameGraphAccess::TransferSource)
+				{
+					readTarget = &resource;
+					continue;
+				}
+				if (access.access != FrameGraphAccess::ColourTarget && access.access != FrameGraphAccess::DepthTarget && access.access != FrameGraphAccess::TransferDestination)
+					continue;
+
+				drawTargets.push_back(&resource);
+				if (resource.desc.IsDepth())
+					depth = resource.handle;
+				else
+					colour.push_back(resource.handle);
+			}
+
+			if (drawTargets.empty() && !readTarget)
+				continue;
+
+			size_t windowTargets{ 0 };
+			for (const Resource* target : drawTargets)
+				windowTargets += target->backbuffer ? 1 : 0;
+			if (windowTargets && windowTargets != drawTargets.size())
+			{
+				std::cout << "ERROR: frame graph pass " << pass.name << " draws into the window and textures at once" << std::endl;
+				return false;
+			}
+
+			if (!windowTargets && !drawTargets.empty())
+			{
+				colour.push_back(depth);
+				pass.drawFramebuffer = AcquireFramebuffer(colour);
+			}
+			if (readTarget && !readTarget->backbuffer)
+			{
+				std::vector<GLuint> attachments;
+				if (!readTarget->desc.IsDepth())
+					attachments.push_back(readTarget->handle);
+				attachments.push_back(readTarget->desc.IsDepth() ? readTarget->handle : 0);
+				pass.readFramebuffer = AcquireFramebuffer(attachments);
+			}
+
+			if (!drawTargets.empty())
+				pass.viewport = glm::ivec4(0, 0, drawTargets[0]->desc.width, drawTargets[0]->desc.height);
+			else if (m_windowViewport.z > 0)
+				pass.viewport = m_windowViewport;
+			else
+				pass.viewport = glm::ivec4(0, 0, readTarget->desc.width, readTarget->desc.height);
+
+			// The viewport goes with the framebuffer so a change of target size also binds
+			pass.bindsFramebuffer = !bound || pass.drawFramebuffer != boundDraw || pass.readFramebuffer != boundRead || pass.viewport != boundViewport;
+			if (pass.bindsFramebuffer)
+				m_stats.framebufferChanges++;
+			bound = true;
+			boundDraw = pass.drawFramebuffer;
+			boundRead = pass.readFramebuffer;
+			boundViewport = pass.viewport;
+		}
+
+		m_rebindsWindow = m_windowViewport.z > 0 && bound && (boundDraw != 0 || boundRead != 0 || boundViewport != m_windowViewport);
+		return true;
+	}
+
+	GLuint FrameGraph::AcquireTexture(const FrameGraphTextureDesc& desc)
+	{
+		for (PooledTexture& pooled : m_texturePool)
+		{
+			if (pooled.desc == desc && pooled.lastUsedFrame != m_frame)
+			{
+				pooled.lastUsedFrame = m_frame;
+				return pooled.texture.Get();
+			}
+		}
+
+		PooledTexture pooled;
+		pooled.desc = desc;
+		pooled.texture = m_gpuResources->CreateRenderTarget("Frame graph", desc.width, desc.height, desc.format);
+		pooled.lastUsedFrame = m_frame;
+		const GLuint texture{ pooled.texture.Get() };
+		m_texturePool.push_back(std::move(pooled));
+		return texture;
+	}
+
+	GLuint FrameGraph::AcquireFramebuffer(const std::vector<GLuint>& attachments)
+	{
+		for (CachedFramebuffer& cached : m_framebuffers)
+		{
+			if (cached.attachments == attachments)
+			{
+				cached.lastUsedFrame = m_frame;
+				return cached.framebuffer.Get();
+			}
+		}
+
+		CachedFramebuffer cached;
+		cached.attachments = attachments;
+		cached.framebuffer = m_gpuResources->CreateFramebuffer("Frame graph", std::vector<GLuint>(attachments.begin(), attachments.end() - 1), attachments.back());
+		cached.lastUsedFrame = m_frame;
+		const GLuint framebuffer{ cached.framebuffer.Get() };
+		m_framebuffers.push_back(std::move(cached));
+		return framebuffer;
+	}
+
+	// Textures left unused for a while, e.g. from before the window was resized, and the framebuffers using them
+	void FrameGraph::ReleaseUnused()
+	{
+		std::vector<GLuint> released;
+		for (size_t i = 0; i < m_texturePool.size(); )
+		{
+			if (m_frame - m_texturePool[i].lastUsedFrame > KMaxUnusedFrames)
+			{
+				released.push_back(m_texturePool[i].texture.Get());
+				m_texturePool.erase(m_texturePool.begin() + i);
+			}
+			else
+			{
+				i++;
+			}
+		}
+
+		for (size_t i = 0; i < m_framebuffers.size(); )
+		{
+			const CachedFramebuffer& cached{ m_framebuffers[i] };
+			bool stale{ m_frame - cached.lastUsedFrame > KMaxUnusedFrames };
+			for (GLuint texture : released)
+				stale = stale || std::find(cached.attachments.begin(), cached.attachments.end(), texture) != cached.attachments.end();
+
+			if (stale)
+			{
+				m_framebuffers.erase(m_framebuffers.begin() + i);
+			}
+			else
+			{
+				i++;
+			}
+		}
+	}
+
+	// Cull, order, place barriers and allocate the transients
+	bool FrameGraph::Compile()
+	{
+		const double startTime{ glfwGetTime() };
+		m_stats = FrameGraphStats();
+		m_order.clear();
+
+		CullPasses();
+		if (!OrderPasses())
+		{
+			m_order.clear();
+			return false;
+		}
+		FindBarriers();
+		AllocateTransients();
+		if (!CreateFramebuffers())
+		{
+			m_order.clear();
+			return false;
+		}
+		ReleaseUnused();
+
+		m_stats.passes = m_order.size();
+		m_stats.compileMilliseconds = (float)((glfwGetTime() - startTime) * 1000.0);
+		return true;
+	}
+
+	// Nothing is recorded if the last pass drew into the window with its viewport
+	void FrameGraph::RecordWindowRebind(CommandList& list) const
+	{
+		if (m_rebindsWindow)
+			list.BindFramebuffer(0, 0, m_windowViewport);
+	}
+
+	// Record a compiled pass: its barriers, its framebuffer then the pass itself
+	void FrameGraph::RecordPass(size_t index, CommandList& list) const
+	{
+		const Pass& pass{ m_passes[m_order[index]] };
+		if (pass.barriers)
+			list.Barrier(pass.barriers);
+		if (pass.bindsFramebuffer)
+			list.BindFramebuffer(pass.drawFramebuffer, pass.readFramebuffer, pass.viewport);
+		if (pass.execute)
+			pass.execute(list);
+	}
+}
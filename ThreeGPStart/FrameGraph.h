@@ -0,0 +1,225 @@
+#pragma once
+// Frame graph. Every frame the passes are declared along with the resources they read and write, then
+// Compile culls the passes whose results are never used, orders the rest by their dependencies, works out
+// the memory barriers between them and gives transient render targets whose lifetimes do not overlap the
+// same texture. Recording a compiled pass binds its framebuffer and barriers first, so passes only record
+// their own drawing and can be recorded on any thread.
+
+#include "ExternalLibraryHeaders.h"
+#include "RenderBackend.h"
+#include "GpuResources.h"
+
+#include <functional>
+
+namespace Helpers
+{
+	// How a pass uses a resource
+	enum class FrameGraphAccess : GLubyte
+	{
+		ColourTarget,		// drawn into, part of the pass's framebuffer
+		DepthTarget,		// read only depth is still bound as the framebuffer's depth
+		Sampled,
+		StorageRead,		// image load or shader storage buffer read
+		StorageWrite,		// image store or shader storage buffer write, needs a barrier before other use
+		Uniform,
+		Indirect,
+		VertexInput,
+		TransferSource,		// read by a blit, bound as the read framebuffer
+		TransferDestination	// written by a blit, part of the pass's framebuffer
+	};
+
+	// A texture made by the graph, transients with equal descriptions can share one texture
+	struct FrameGraphTextureDesc
+	{
+		GLsizei width{ 0 };
+		GLsizei height{ 0 };
+		GLenum format{ GL_RGBA8 };	// sized internal format
+
+		size_t Bytes() const;
+		bool IsDepth() const;
+
+		bool operator==(const FrameGraphTextureDesc& other) const { return width == other.width && height == other.height && format == other.format; }
+	};
+
+	// Index of a resource declared this frame
+	using FrameGraphResource = size_t;
+
+	// Counts for the last compile, memory is for the transient textures
+	struct FrameGraphStats
+	{
+		size_t passes{ 0 };
+		size_t culledPasses{ 0 };
+		size_t barriers{ 0 };			// passes needing a barrier first
+		size_t framebufferChanges{ 0 };
+		size_t transientTextures{ 0 };
+		size_t physicalTextures{ 0 };
+		size_t transientBytes{ 0 };		// every transient in a texture of its own
+		size_t aliasedBytes{ 0 };		// transients sharing textures
+		float compileMilliseconds{ 0 };
+	};
+
+	class FrameGraph
+	{
+	public:
+		class PassBuilder;
+	private:
+		// Textures and framebuffers not used for this many frames are deleted
+		static constexpr unsigned int KMaxUnusedFrames{ 8 };
+
+		struct Resource
+		{
+			std::string name;
+			bool texture{ true };
+			bool imported{ false };
+			bool backbuffer{ false };	// the window, drawn to through framebuffer 0
+			bool output{ false };		// used after the graph so its writers are never culled
+			FrameGraphTextureDesc desc;
+			GLuint handle{ 0 };
+
+			// Set by Compile
+			size_t firstUse{ SIZE_MAX };	// positions in the compiled order
+			size_t lastUse{ 0 };
+			bool storageWritten{ false };	// written by image store or shader storage and not yet made visible to all uses
+			GLbitfield barriersIssued{ 0 };
+		};
+
+		struct Access
+		{
+			FrameGraphResource resource{ 0 };
+			FrameGraphAccess access{ FrameGraphAccess::Sampled };
+			bool write{ false };
+		};
+
+		struct Pass
+		{
+			std::string name;
+			std::vector<Access> accesses;
+			std::function<void(CommandList&)> execute;
+			bool sideEffects{ false };
+			bool mainThread{ false };
+
+			// Set by Compile
+			bool culled{ false };
+			std::vector<size_t> dependencies;
+			GLbitfield barriers{ 0 };
+			bool bindsFramebuffer{ false };
+			GLuint drawFramebuffer{ 0 };
+			GLuint readFramebuffer{ 0 };
+			glm::ivec4 viewport{ 0 };
+		};
+
+		struct PooledTexture
+		{
+			FrameGraphTextureDesc desc;
+			GpuRenderTarget texture;
+			unsigned int lastUsedFrame{ 0 };
+		};
+
+		// Colour attachments then the depth attachment, which may be 0
+		struct CachedFramebuffer
+		{
+			std::vector<GLuint> attachments;
+			GpuFramebuffer framebuffer;
+			unsigned int lastUsedFrame{ 0 };
+		};
+
+		GpuResourceRegistry* m_gpuResources{ nullptr };
+		std::vector<Resource> m_resources;
+		std::vector<Pass> m_passes;
+		std::vector<size_t> m_order;	// compiled passes, indices into m_passes
+
+		std::vector<PooledTexture> m_texturePool;
+		std::vector<CachedFramebuffer> m_framebuffers;
+		unsigned int m_frame{ 0 };
+
+		// The imported window's viewport, and whether the last compiled pass left something else bound
+		glm::ivec4 m_windowViewport{ 0 };
+		bool m_rebindsWindow{ false };
+
+		bool m_aliasing{ true };
+		FrameGraphStats m_stats;
+
+		void CullPasses();
+		bool OrderPasses();
+		void FindBarriers();
+		void AllocateTransients();
+		bool CreateFramebuffers();
+
+		GLuint AcquireTexture(const FrameGraphTextureDesc& desc);
+		GLuint AcquireFramebuffer(const std::vector<GLuint>& attachments);
+		void ReleaseUnused();
+	public:
+		// Declares the resources a pass uses, only valid inside the pass's setup function
+		class PassBuilder
+		{
+		private:
+			FrameGraph& m_graph;
+			size_t m_pass;
+		public:
+			PassBuilder(FrameGraph& graph, size_t pass) : m_graph(graph), m_pass(pass) {}
+
+			// A transient texture that lives from this pass to its last reader, its contents start undefined
+			FrameGraphResource CreateTexture(const std::string& name, const FrameGraphTextureDesc& desc, FrameGraphAccess access = FrameGraphAccess::ColourTarget);
+
+			void Read(FrameGraphResource resource, FrameGraphAccess access);
+
+			// Writes keep what was there, e.g. drawing more into a colour target
+			void Write(FrameGraphResource resource, FrameGraphAccess access);
+
+			// The pass does something outside the graph (e.g. queries read back later) so is never culled
+			void SideEffects();
+
+			// The pass must be recorded on the main thread, e.g. it may create GL objects while recording
+			void MainThread();
+		};
+
+		FrameGraph() = default;
+		FrameGraph(const FrameGraph&) = delete;
+		FrameGraph& operator=(const FrameGraph&) = delete;
+
+		// Pooled textures and framebuffers are made through the registry, which must outlive this
+		void Initialise(GpuResourceRegistry& resources);
+
+		// Forget last frame's passes and resources, the pooled textures are kept
+		void Reset();
+
+		// Resources made outside the graph. Textures are used as they are and never aliased.
+		FrameGraphResource ImportTexture(const std::string& name, GLuint texture, const FrameGraphTextureDesc& desc);
+		FrameGraphResource ImportBuffer(const std::string& name, GLuint buffer);
+
+		// The window's colour or depth, drawn to through framebuffer 0
+		FrameGraphResource ImportBackbuffer(const std::string& name, const FrameGraphTextureDesc& desc);
+
+		// Used after the graph has run, e.g. shown on screen
+		void MarkOutput(FrameGraphResource resource);
+
+		// setup is called now to declare the resources, execute when the pass is recorded
+		void AddPass(const std::string& name, const std::function<void(PassBuilder&)>& setup, std::function<void(CommandList&)> execute);
+
+		// Cull, order, place barriers and allocate the transients. Must be on the main thread as it may
+		// create textures and framebuffers. False if a pass reads something nothing wrote.
+		bool Compile();
+
+		// The compiled passes in the order to execute them
+		size_t NumPasses() const { return m_order.size(); }
+		const std::string& PassName(size_t index) const { return m_passes[m_order[index]].name; }
+		bool PassOnMainThread(size_t index) const { return m_passes[m_order[index]].mainThread; }
+		GLbitfield PassBarriers(size_t index) const { return m_passes[m_order[index]].barriers; }
+
+		// Record a compiled pass: its barriers, its framebuffer then the pass itself. Thread safe.
+		void RecordPass(size_t index, CommandList& list) const;
+
+		// Record binding the window again with its own viewport after the last pass, so what draws after the graph
+		// and the next frame's viewport see the window rather than the last pass's target
+		void RecordWindowRebind(CommandList& list) const;
+
+		// The texture or buffer behind a resource, valid once compiled so may be used while recording
+		GLuint GetHandle(FrameGraphResource resource) const { return m_resources[resource].handle; }
+
+		// Off gives every transient a texture of its own, to compare the memory used
+		void SetAliasing(bool aliasing) { m_aliasing = aliasing; }
+		bool IsAliasing() const { return m_aliasing; }
+
+		const FrameGraphStats& GetStats() const { return m_stats; }
+	};
+}
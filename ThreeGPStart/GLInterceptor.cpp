@@ -0,0 +1,386 @@
+#include "GLInterceptor.h"
+
+#include <algorithm>
+
+namespace Helpers
+{
+	namespace GL11
+	{
+		void (GLAPIENTRY* BindTexture)(GLenum target, GLuint texture){ &::glBindTexture };
+		void (GLAPIENTRY* Clear)(GLbitfield mask){ &::glClear };
+		void (GLAPIENTRY* ColorMask)(GLboolean red, GLboolean green, GLboolean blue, GLboolean alpha){ &::glColorMask };
+		void (GLAPIENTRY* DeleteTextures)(GLsizei n, const GLuint* textures){ &::glDeleteTextures };
+		void (GLAPIENTRY* DepthMask)(GLboolean flag){ &::glDepthMask };
+		void (GLAPIENTRY* Disable)(GLenum cap){ &::glDisable };
+		void (GLAPIENTRY* DrawBuffer)(GLenum buf){ &::glDrawBuffer };
+		void (GLAPIENTRY* DrawElements)(GLenum mode, GLsizei count, GLenum type, const void* indices){ &::glDrawElements };
+		void (GLAPIENTRY* Enable)(GLenum cap){ &::glEnable };
+		void (GLAPIENTRY* Finish)(){ &::glFinish };
+		void (GLAPIENTRY* GenTextures)(GLsizei n, GLuint* textures){ &::glGenTextures };
+		void (GLAPIENTRY* GetTexLevelParameteriv)(GLenum target, GLint level, GLenum pname, GLint* params){ &::glGetTexLevelParameteriv };
+		void (GLAPIENTRY* PolygonMode)(GLenum face, GLenum mode){ &::glPolygonMode };
+		void (GLAPIENTRY* ReadPixels)(GLint x, GLint y, GLsizei width, GLsizei height, GLenum format, GLenum type, void* pixels){ &::glReadPixels };
+		void (GLAPIENTRY* Scissor)(GLint x, GLint y, GLsizei width, GLsizei height){ &::glScissor };
+		void (GLAPIENTRY* TexImage2D)(GLenum target, GLint level, GLint internalformat, GLsizei width, GLsizei height, GLint border, GLenum format, GLenum type, const void* pixels){ &::glTexImage2D };
+		void (GLAPIENTRY* TexSubImage2D)(GLenum target, GLint level, GLint xoffset, GLint yoffset, GLsizei width, GLsizei height, GLenum format, GLenum type, const void* pixels){ &::glTexSubImage2D };
+		void (GLAPIENTRY* TexParameteri)(GLenum target, GLenum pname, GLint param){ &::glTexParameteri };
+		void (GLAPIENTRY* Viewport)(GLint x, GLint y, GLsizei width, GLsizei height){ &::glViewport };
+	}
+
+	// Bytes a call through Slot uploads, specialised for the upload functions
+	template<auto Slot>
+	struct UploadBytes
+	{
+		template<typename... Args>
+		static size_t Of(Args...) { return 0; }
+	};
+
+	template<>
+	struct UploadBytes<&glBufferData>
+	{
+		static size_t Of(GLenum, GLsizeiptr size, const void* data, GLenum) { return data ? (size_t)size : 0; }
+	};
+
+	template<>
+	struct UploadBytes<&glBufferSubData>
+	{
+		static size_t Of(GLenum, GLintptr, GLsizeiptr size, const void*) { return (size_t)size; }
+	};
+
+	template<>
+	struct UploadBytes<&glBufferStorage>
+	{
+		static size_t Of(GLenum, GLsizeiptr size, const void* data, GLbitfield) { return data ? (size_t)size : 0; }
+	};
+
+	template<>
+	struct UploadBytes<&glNamedBufferData>
+	{
+		static size_t Of(GLuint, GLsizeiptr size, const void* data, GLenum) { return data ? (size_t)size : 0; }
+	};
+
+	template<>
+	struct UploadBytes<&glNamedBufferSubData>
+	{
+		static size_t Of(GLuint, GLintptr, GLsizeiptr size, const void*) { return (size_t)size; }
+	};
+
+	template<>
+	struct UploadBytes<&glNamedBufferStorage>
+	{
+		static size_t Of(GLuint, GLsizeiptr size, const void* data, GLbitfield) { return data ? (size_t)size : 0; }
+	};
+
+	// Only the formats the renderer uploads are sized exactly, anything else is taken as 4 bytes a pixel
+	static size_t PixelBytes(GLsizei width, GLsizei height, GLenum format, GLenum type, const void* pixels)
+	{
+		if (!pixels)
+			return 0;
+		const size_t channels{ format == GL_RED ? 1u : format == GL_RG ? 2u : format == GL_RGB || format == GL_BGR ? 3u : 4u };
+		const size_t channelBytes{ type == GL_FLOAT ? 4u : type == GL_UNSIGNED_SHORT || type == GL_HALF_FLOAT ? 2u : 1u };
+		return (size_t)width * (size_t)height * channels * channelBytes;
+	}
+
+	template<>
+	struct UploadBytes<&GL11::TexImage2D>
+	{
+		static size_t Of(GLenum, GLint, GLint, GLsizei width, GLsizei height, GLint, GLenum format, GLenum type, const void* pixels)
+		{
+			return PixelBytes(width, height, format, type, pixels);
+		}
+	};
+
+	template<>
+	struct UploadBytes<&GL11::TexSubImage2D>
+	{
+		static size_t Of(GLenum, GLint, GLint, GLint, GLsizei width, GLsizei height, GLenum format, GLenum type, const void* pixels)
+		{
+			return PixelBytes(width, height, format, type, pixels);
+		}
+	};
+
+	template<>
+	struct UploadBytes<&glTextureSubImage2D>
+	{
+		static size_t Of(GLuint, GLint, GLint, GLint, GLsizei width, GLsizei height, GLenum format, GLenum type, const void* pixels)
+		{
+			return PixelBytes(width, height, format, type, pixels);
+		}
+	};
+
+	template<>
+	struct UploadBytes<&glTexImage3D>
+	{
+		static size_t Of(GLenum, GLint, GLint, GLsizei width, GLsizei height, GLsizei depth, GLint, GLenum format, GLenum type, const void* pixels)
+		{
+			return PixelBytes(width, height * depth, format, type, pixels);
+		}
+	};
+
+	template<>
+	struct UploadBytes<&glTextureSubImage3D>
+	{
+		static size_t Of(GLuint, GLint, GLint, GLint, GLint, GLsizei width, GLsizei height, GLsizei depth, GLenum format, GLenum type, const void* pixels)
+		{
+			return PixelBytes(width, height * depth, format, type, pixels);
+		}
+	};
+
+	// A function with the signature of the GL function called through Slot, which counts the call then calls the driver
+	template<typename Function, Function* Slot>
+	struct GLHook;
+
+	template<typename Result, typename... Args, Result(GLAPIENTRY** Slot)(Args...)>
+	struct GLHook<Result(GLAPIENTRY*)(Args...), Slot>
+	{
+		static inline size_t entry{ 0 };
+
+		static Result GLAPIENTRY Call(Args... args)
+		{
+			void* original{ GetGLInterceptor().Count(entry, UploadBytes<Slot>::Of(args...)) };
+			return reinterpret_cast<Result(GLAPIENTRY*)(Args...)>(original)(args...);
+		}
+	};
+
+	template<typename Function, Function* Slot>
+	void GLInterceptor::AddHook(const char* name, GLCallKind kind)
+	{
+		GLHook<Function, Slot>::entry = m_entries.size();
+
+		Entry entry;
+		entry.name = name;
+		entry.kind = kind;
+		entry.slot = reinterpret_cast<void**>(Slot);
+		entry.hook = reinterpret_cast<void*>(&GLHook<Function, Slot>::Call);
+		m_entries.push_back(entry);
+	}
+
+// glX is defined by GLEW as its pointer, so the name is the GL function's and the slot GLEW's pointer
+#define GL_HOOK(function, kind) AddHook<decltype(function), &function>(#function, GLCallKind::kind)
+#define GL11_HOOK(function, kind) AddHook<decltype(GL11::function), &GL11::function>("gl" #function, GLCallKind::kind)
+
+	// Every GL function the backends, shader loading and the GUI call each frame or when creating resources
+	GLInterceptor::GLInterceptor()
+	{
+		GL11_HOOK(DrawElements, Draw);
+		GL_HOOK(glDrawElementsBaseVertex, Draw);
+		GL_HOOK(glMultiDrawElementsIndirect, Draw);
+		GL11_HOOK(Clear, Draw);
+		GL_HOOK(glBlitFramebuffer, Draw);
+		GL11_HOOK(ReadPixels, Draw);
+
+		GL_HOOK(glUseProgram, State);
+		GL_HOOK(glBindVertexArray, State);
+		GL_HOOK(glBindBuffer, State);
+		GL_HOOK(glBindBufferRange, State);
+		GL_HOOK(glActiveTexture, State);
+		GL11_HOOK(BindTexture, State);
+		GL_HOOK(glBindTextureUnit, State);
+		GL_HOOK(glBindSampler, State);
+		GL_HOOK(glBindFramebuffer, State);
+		GL_HOOK(glDrawBuffers, State);
+		GL11_HOOK(DrawBuffer, State);
+		GL11_HOOK(Enable, State);
+		GL11_HOOK(Disable, State);
+		GL11_HOOK(DepthMask, State);
+		GL11_HOOK(ColorMask, State);
+		GL11_HOOK(PolygonMode, State);
+		GL11_HOOK(Viewport, State);
+		GL11_HOOK(Scissor, State);
+		GL_HOOK(glBlendEquation, State);
+		GL_HOOK(glBlendFuncSeparate, State);
+		GL_HOOK(glMemoryBarrier, State);
+
+		GL_HOOK(glUniform1i, Uniform);
+		GL_HOOK(glUniform1f, Uniform);
+		GL_HOOK(glUniform3fv, Uniform);
+		GL_HOOK(glUniform4fv, Uniform);
+		GL_HOOK(glUniformMatrix4fv, Uniform);
+
+		GL_HOOK(glBufferData, Upload);
+		GL_HOOK(glBufferSubData, Upload);
+		GL_HOOK(glBufferStorage, Upload);
+		GL11_HOOK(TexImage2D, Upload);
+		GL11_HOOK(TexSubImage2D, Upload);
+		GL_HOOK(glTexStorage2D, Upload);
+		GL_HOOK(glTexImage3D, Upload);
+		GL_HOOK(glGenerateMipmap, Upload);
+		GL_HOOK(glMapBufferRange, Upload);
+		GL_HOOK(glNamedBufferData, Upload);
+		GL_HOOK(glNamedBufferSubData, Upload);
+		GL_HOOK(glNamedBufferStorage, Upload);
+		GL_HOOK(glMapNamedBufferRange, Upload);
+		GL_HOOK(glTextureStorage2D, Upload);
+		GL_HOOK(glTextureSubImage2D, Upload);
+		GL_HOOK(glTextureStorage3D, Upload);
+		GL_HOOK(glTextureSubImage3D, Upload);
+		GL_HOOK(glGenerateTextureMipmap, Upload);
+
+		GL_HOOK(glBeginQuery, Query);
+		GL_HOOK(glEndQuery, Query);
+		GL_HOOK(glQueryCounter, Query);
+		GL_HOOK(glBeginConditionalRender, Query);
+		GL_HOOK(glEndConditionalRender, Query);
+		GL_HOOK(glGetQueryObjectuiv, Query);
+		GL_HOOK(glGetQueryObjectui64v, Query);
+
+		GL_HOOK(glFenceSync, Sync);
+		GL_HOOK(glClientWaitSync, Sync);
+		GL_HOOK(glDeleteSync, Sync);
+		GL11_HOOK(Finish, Sync);
+
+		// Resources made by binding them to edit
+		GL_HOOK(glGenBuffers, Resource);
+		GL_HOOK(glDeleteBuffers, Resource);
+		GL_HOOK(glGenVertexArrays, Resource);
+		GL_HOOK(glDeleteVertexArrays, Resource);
+		GL_HOOK(glEnableVertexAttribArray, Resource);
+		GL_HOOK(glVertexAttribPointer, Resource);
+		GL11_HOOK(GenTextures, Resource);
+		GL11_HOOK(DeleteTextures, Resource);
+		GL11_HOOK(TexParameteri, Resource);
+		GL11_HOOK(GetTexLevelParameteriv, Resource);
+		GL_HOOK(glGenFramebuffers, Resource);
+		GL_HOOK(glDeleteFramebuffers, Resource);
+		GL_HOOK(glFramebufferTexture, Resource);
+		GL_HOOK(glCheckFramebufferStatus, Resource);
+		GL_HOOK(glGenQueries, Resource);
+		GL_HOOK(glDeleteQueries, Resource);
+		GL_HOOK(glCreateProgram, Resource);
+		GL_HOOK(glDeleteProgram, Resource);
+
+		// and with direct state access
+		GL_HOOK(glCreateBuffers, Resource);
+		GL_HOOK(glCreateVertexArrays, Resource);
+		GL_HOOK(glVertexArrayVertexBuffer, Resource);
+		GL_HOOK(glEnableVertexArrayAttrib, Resource);
+		GL_HOOK(glVertexArrayAttribFormat, Resource);
+		GL_HOOK(glVertexArrayAttribBinding, Resource);
+		GL_HOOK(glVertexArrayElementBuffer, Resource);
+		GL_HOOK(glCreateTextures, Resource);
+		GL_HOOK(glGetTextureLevelParameteriv, Resource);
+		GL_HOOK(glCreateSamplers, Resource);
+		GL_HOOK(glSamplerParameteri, Resource);
+		GL_HOOK(glDeleteSamplers, Resource);
+		GL_HOOK(glCreateFramebuffers, Resource);
+		GL_HOOK(glNamedFramebufferTexture, Resource);
+		GL_HOOK(glNamedFramebufferDrawBuffer, Resource);
+		GL_HOOK(glNamedFramebufferDrawBuffers, Resource);
+		GL_HOOK(glCheckNamedFramebufferStatus, Resource);
+	}
+
+#undef GL_HOOK
+#undef GL11_HOOK
+
+	// Swap in the counting wrappers, GLEW must be initialised. Functions the driver lacks are left alone.
+	void GLInterceptor::Install()
+	{
+		if (m_installed)
+			return;
+
+		for (Entry& entry : m_entries)
+		{
+			entry.original = *entry.slot;
+			entry.calls = 0;
+			if (entry.original)
+				*entry.slot = entry.hook;
+		}
+		m_uploadBytes = 0;
+		m_installed = true;
+	}
+
+	// Put the driver's functions back
+	void GLInterceptor::Uninstall()
+	{
+		if (!m_installed)
+			return;
+
+		for (Entry& entry : m_entries)
+		{
+			if (entry.original)
+				*entry.slot = entry.original;
+		}
+		m_lastFrameStats = GLFrameStats();
+		m_installed = false;
+	}
+
+	// Count the call to an entry and return the driver's function to call
+	void* GLInterceptor::Count(size_t entry, size_t uploadBytes)
+	{
+		m_entries[entry].calls++;
+		m_uploadBytes += uploadBytes;
+		return m_entries[entry].original;
+	}
+
+	// Close this frame's counts, on the GL thread at the start of each frame
+	void GLInterceptor::BeginFrame()
+	{
+		if (!m_installed)
+			return;
+
+		GLFrameStats stats;
+		stats.uploadBytes = m_uploadBytes;
+		for (Entry& entry : m_entries)
+		{
+			if (entry.calls == 0)
+				continue;
+
+			stats.calls += entry.calls;
+			if (entry.kind == GLCallKind::Draw)
+				stats.draws += entry.calls;
+			else if (entry.kind == GLCallKind::State)
+				stats.stateChanges += entry.calls;
+			else if (entry.kind == GLCallKind::Uniform)
+				stats.uniforms += entry.calls;
+			stats.functions.push_back(GLCallCount{ entry.name, entry.kind, entry.calls });
+			entry.calls = 0;
+		}
+		std::stable_sort(stats.functions.begin(), stats.functions.end(), [](const GLCallCount& a, const GLCallCount& b) { return a.calls > b.calls; });
+
+		m_lastFrameStats = std::move(stats);
+		m_uploadBytes = 0;
+	}
+
+	static const char* KindName(GLCallKind kind)
+	{
+		switch (kind)
+		{
+		case GLCallKind::Draw: return "draw";
+		case GLCallKind::State: return "state";
+		case GLCallKind::Uniform: return "uniform";
+		case GLCallKind::Upload: return "upload";
+		case GLCallKind::Query: return "query";
+		case GLCallKind::Sync: return "sync";
+		case GLCallKind::Resource: return "resource";
+		default: return "other";
+		}
+	}
+
+	// Install checkbox, the last frame's totals and a table of the functions called
+	void GLInterceptor::DefineGUI()
+	{
+		bool installed{ m_installed };
+		if (ImGui::Checkbox("Intercept GL calls", &installed))
+		{
+			if (installed)
+				Install();
+			else
+				Uninstall();
+		}
+		if (!m_installed)
+			return;
+
+		const GLFrameStats& stats{ m_lastFrameStats };
+		ImGui::Text("%zu calls: %zu draws, %zu state, %zu uniforms, %.1f KB uploaded", stats.calls, stats.draws, stats.stateChanges,
+			stats.uniforms, stats.uploadBytes / 1024.0f);
+		for (const GLCallCount& function : stats.functions)
+			ImGui::Text("%6zu  %-8s  %s", function.calls, KindName(function.kind), function.name);
+	}
+
+	// The interceptor shared by the whole program
+	GLInterceptor& GetGLInterceptor()
+	{
+		static GLInterceptor interceptor;
+		return interceptor;
+	}
+}
@@ -0,0 +1,137 @@
+#pragma once
+// Opt-in counting of the OpenGL calls actually made, per frame. Install swaps GLEW's function pointers for
+// wrappers that count the call, and any bytes it uploads, then call the driver. GL 1.1 functions are
+// exported by the driver rather than loaded by GLEW, so the ones GLRenderBackend uses are called through
+// pointers of our own that can be swapped the same way. Calls must be on the GL thread.
+
+#include "ExternalLibraryHeaders.h"
+
+namespace Helpers
+{
+	// What a GL function does, for the per frame totals
+	enum class GLCallKind : GLubyte
+	{
+		Draw,		// draws, clears, blits and pixel reads
+		State,		// binds and fixed function state
+		Uniform,
+		Upload,
+		Query,
+		Sync,
+		Resource,	// creating and deleting objects
+		Other
+	};
+
+	struct GLCallCount
+	{
+		const char* name{ nullptr };
+		GLCallKind kind{ GLCallKind::Other };
+		size_t calls{ 0 };
+	};
+
+	// Counts for one frame, functions are those called, most called first
+	struct GLFrameStats
+	{
+		size_t calls{ 0 };
+		size_t draws{ 0 };
+		size_t stateChanges{ 0 };
+		size_t uniforms{ 0 };
+		size_t uploadBytes{ 0 };
+		std::vector<GLCallCount> functions;
+	};
+
+	// Pointers to the GL 1.1 functions GLRenderBackend calls, like GLEW's pointers for later versions
+	namespace GL11
+	{
+		extern void (GLAPIENTRY* BindTexture)(GLenum target, GLuint texture);
+		extern void (GLAPIENTRY* Clear)(GLbitfield mask);
+		extern void (GLAPIENTRY* ColorMask)(GLboolean red, GLboolean green, GLboolean blue, GLboolean alpha);
+		extern void (GLAPIENTRY* DeleteTextures)(GLsizei n, const GLuint* textures);
+		extern void (GLAPIENTRY* DepthMask)(GLboolean flag);
+		extern void (GLAPIENTRY* Disable)(GLenum cap);
+		extern void (GLAPIENTRY* DrawBuffer)(GLenum buf);
+		extern void (GLAPIENTRY* DrawElements)(GLenum mode, GLsizei count, GLenum type, const void* indices);
+		extern void (GLAPIENTRY* Enable)(GLenum cap);
+		extern void (GLAPIENTRY* Finish)();
+		extern void (GLAPIENTRY* GenTextures)(GLsizei n, GLuint* textures);
+		extern void (GLAPIENTRY* GetTexLevelParameteriv)(GLenum target, GLint level, GLenum pname, GLint* params);
+		extern void (GLAPIENTRY* PolygonMode)(GLenum face, GLenum mode);
+		extern void (GLAPIENTRY* ReadPixels)(GLint x, GLint y, GLsizei width, GLsizei height, GLenum format, GLenum type, void* pixels);
+		extern void (GLAPIENTRY* Scissor)(GLint x, GLint y, GLsizei width, GLsizei height);
+		extern void (GLAPIENTRY* TexImage2D)(GLenum target, GLint level, GLint internalformat, GLsizei width, GLsizei height, GLint border, GLenum format, GLenum type, const void* pixels);
+		extern void (GLAPIENTRY* TexSubImage2D)(GLenum target, GLint level, GLint xoffset, GLint yoffset, GLsizei width, GLsizei height, GLenum format, GLenum type, const void* pixels);
+		extern void (GLAPIENTRY* TexParameteri)(GLenum target, GLenum pname, GLint param);
+		extern void (GLAPIENTRY* Viewport)(GLint x, GLint y, GLsizei width, GLsizei height);
+	}
+
+	class GLInterceptor
+	{
+	private:
+		struct Entry
+		{
+			const char* name{ nullptr };
+			GLCallKind kind{ GLCallKind::Other };
+			void** slot{ nullptr };		// the pointer GL is called through
+			void* original{ nullptr };
+			void* hook{ nullptr };
+			size_t calls{ 0 };
+		};
+
+		std::vector<Entry> m_entries;
+		bool m_installed{ false };
+		size_t m_uploadBytes{ 0 };
+		GLFrameStats m_lastFrameStats;
+
+		template<typename Function, Function* Slot>
+		void AddHook(const char* name, GLCallKind kind);
+	public:
+		GLInterceptor();
+		GLInterceptor(const GLInterceptor&) = delete;
+		GLInterceptor& operator=(const GLInterceptor&) = delete;
+
+		// Swap in the counting wrappers, GLEW must be initialised. Functions the driver lacks are left alone.
+		void Install();
+
+		// Put the driver's functions back
+		void Uninstall();
+
+		bool IsInstalled() const { return m_installed; }
+
+		// Close this frame's counts, on the GL thread at the start of each frame
+		void BeginFrame();
+
+		// Used by the wrappers, counts the call to an entry and returns the driver's function to call
+		void* Count(size_t entry, size_t uploadBytes);
+
+		// Counts for the last full frame, empty until installed
+		const GLFrameStats& GetLastFrameStats() const { return m_lastFrameStats; }
+
+		// Install checkbox, the last frame's totals and a table of the functions called
+		void DefineGUI();
+	};
+
+	// The interceptor shared by the whole program
+	GLInterceptor& GetGLInterceptor();
+}
+
+// GLRenderBackend defines this before including the header so its GL 1.1 calls can be intercepted
+#if defined(GL_INTERCEPT_GL11)
+#define glBindTexture Helpers::GL11::BindTexture
+#define glClear Helpers::GL11::Clear
+#define glColorMask Helpers::GL11::ColorMask
+#define glDeleteTextures Helpers::GL11::DeleteTextures
+#define glDepthMask Helpers::GL11::DepthMask
+#define glDisable Helpers::GL11::Disable
+#define glDrawBuffer Helpers::GL11::DrawBuffer
+#define glDrawElements Helpers::GL11::DrawElements
+#define glEnable Helpers::GL11::Enable
+#define glFinish Helpers::GL11::Finish
+#define glGenTextures Helpers::GL11::GenTextures
+#define glGetTexLevelParameteriv Helpers::GL11::GetTexLevelParameteriv
+#define glPolygonMode Helpers::GL11::PolygonMode
+#define glReadPixels Helpers::GL11::ReadPixels
+#define glScissor Helpers::GL11::Scissor
+#define glTexImage2D Helpers::GL11::TexImage2D
+#define glTexSubImage2D Helpers::GL11::TexSubImage2D
+#define glTexParameteri Helpers::GL11::TexParameteri
+#define glViewport Helpers::GL11::Viewport
+#endif
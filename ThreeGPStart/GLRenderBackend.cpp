@@ -0,0 +1,689 @@
+#include "GLRenderBackend.h"
+#include "Helper.h"
+
+// GL 1.1 calls go through pointers the GL interceptor can swap
+#define GL_INTERCEPT_GL11
+#include "GLInterceptor.h"
+
+namespace Helpers
+{
+	// Direct state access is used when asked for and the context supports it
+	GLRenderBackend::GLRenderBackend(bool directStateAccess) :
+		m_directStateAccess(directStateAccess && (GLEW_VERSION_4_5 || GLEW_ARB_direct_state_access))
+	{
+
+	}
+
+	GLRenderBackend::~GLRenderBackend()
+	{
+		for (const auto& sampler : m_mipmapSamplers)
+			glDeleteSamplers(1, &sampler.second);
+		if (m_nearestSampler)
+			glDeleteSamplers(1, &m_nearestSampler);
+	}
+
+	// A sampler made on first use and shared from then on
+	GLuint GLRenderBackend::Sampler(GLint minFilter, GLint magFilter, GLint wrap)
+	{
+		GLuint sampler;
+		glCreateSamplers(1, &sampler);
+		glSamplerParameteri(sampler, GL_TEXTURE_MIN_FILTER, minFilter);
+		glSamplerParameteri(sampler, GL_TEXTURE_MAG_FILTER, magFilter);
+		glSamplerParameteri(sampler, GL_TEXTURE_WRAP_S, wrap);
+		glSamplerParameteri(sampler, GL_TEXTURE_WRAP_T, wrap);
+		return sampler;
+	}
+
+	// Load, compile and link the shaders and look up the program's active uniforms
+	GLuint GLRenderBackend::CreateProgram(const std::string& vertexPath, const std::string& fragmentPath)
+	{
+		GLuint vertex_shader{ LoadAndCompileShader(GL_VERTEX_SHADER, vertexPath) };
+		GLuint fragment_shader{ LoadAndCompileShader(GL_FRAGMENT_SHADER, fragmentPath) };
+		if (vertex_shader == 0 || fragment_shader == 0)
+		{
+			glDeleteShader(vertex_shader);
+			glDeleteShader(fragment_shader);
+			return 0;
+		}
+
+		GLuint program{ glCreateProgram() };
+		glAttachShader(program, vertex_shader);
+		glAttachShader(program, fragment_shader);
+
+		// Done with the originals of these as the program has copies
+		glDeleteShader(vertex_shader);
+		glDeleteShader(fragment_shader);
+
+		if (!LinkProgramShaders(program))
+		{
+			glDeleteProgram(program);
+			return 0;
+		}
+
+		// Enumerate the active uniforms, arrays are stored under both "name" and "name[0]"
+		std::unordered_map<std::string, GLint>& locations{ m_uniforms[program] };
+
+		GLint numUniforms{ 0 };
+		glGetProgramiv(program, GL_ACTIVE_UNIFORMS, &numUniforms);
+
+		GLint maxLength{ 0 };
+		glGetProgramiv(program, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLength);
+		std::vector<GLchar> name(std::max(maxLength, 1));
+
+		for (GLint i = 0; i < numUniforms; i++)
+		{
+			GLsizei length{ 0 };
+			GLint size{ 0 };
+			GLenum type{ 0 };
+			glGetActiveUniform(program, (GLuint)i, (GLsizei)name.size(), &length, &size, &type, name.data());
+
+			const std::string uniformName(name.data(), length);
+			const GLint location{ glGetUniformLocation(program, uniformName.c_str()) };
+			if (location < 0)
+				continue;	// in a uniform block
+
+			locations[uniformName] = location;
+			const size_t bracket{ uniformName.find('[') };
+			if (bracket != std::string::npos)
+				locations[uniformName.substr(0, bracket)] = location;
+		}
+
+		return program;
+	}
+
+	void GLRenderBackend::DeleteProgram(GLuint program)
+	{
+		m_uniforms.erase(program);
+		glDeleteProgram(program);
+	}
+
+	// -1 if the program has no such active uniform
+	GLint GLRenderBackend::GetUniformLocation(GLuint program, const std::string& name) const
+	{
+		const auto programIt{ m_uniforms.find(program) };
+		if (programIt == m_uniforms.end())
+			return -1;
+		const auto it{ programIt->second.find(name) };
+		return it == programIt->second.end() ? -1 : it->second;
+	}
+
+	// Static buffers get immutable storage the GPU can place where it likes, others stay mutable for UpdateBuffer
+	GLuint GLRenderBackend::CreateBuffer(GLenum target, const void* data, size_t size, GLenum usage)
+	{
+		if (m_directStateAccess)
+		{
+			GLuint buffer;
+			glCreateBuffers(1, &buffer);
+			if (usage == GL_STATIC_DRAW)
+				glNamedBufferStorage(buffer, std::max<size_t>(size, 1), data, 0);
+			else
+				glNamedBufferData(buffer, size, data, usage);
+			return buffer;
+		}
+
+		GLuint buffer;
+		glGenBuffers(1, &buffer);
+		glBindBuffer(target, buffer);
+		glBufferData(target, size, data, usage);
+		glBindBuffer(target, 0);
+		return buffer;
+	}
+
+	void GLRenderBackend::DeleteBuffer(GLuint buffer)
+	{
+		glDeleteBuffers(1, &buffer);
+	}
+
+	// Immutable storage mapped once, coherent so writes need no flush
+	GLuint GLRenderBackend::CreatePersistentBuffer(size_t size, void*& mapped)
+	{
+		const GLbitfield flags{ GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT };
+
+		if (m_directStateAccess)
+		{
+			GLuint buffer;
+			glCreateBuffers(1, &buffer);
+			glNamedBufferStorage(buffer, size, nullptr, flags);
+			mapped = glMapNamedBufferRange(buffer, 0, size, flags);
+			return buffer;
+		}
+
+		GLuint buffer;
+		glGenBuffers(1, &buffer);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+		glBufferStorage(GL_COPY_WRITE_BUFFER, size, nullptr, flags);
+		mapped = glMapBufferRange(GL_COPY_WRITE_BUFFER, 0, size, flags);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+		return buffer;
+	}
+
+	// As a persistent buffer but mapped for reading, coherent so the GPU's writes are seen once fenced
+	GLuint GLRenderBackend::CreateReadbackBuffer(size_t size, const void*& mapped)
+	{
+		const GLbitfield flags{ GL_MAP_READ_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT };
+
+		if (m_directStateAccess)
+		{
+			GLuint buffer;
+			glCreateBuffers(1, &buffer);
+			glNamedBufferStorage(buffer, size, nullptr, flags);
+			mapped = glMapNamedBufferRange(buffer, 0, size, flags);
+			return buffer;
+		}
+
+		GLuint buffer;
+		glGenBuffers(1, &buffer);
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, buffer);
+		glBufferStorage(GL_PIXEL_PACK_BUFFER, size, nullptr, flags);
+		mapped = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, size, flags);
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+		return buffer;
+	}
+
+	size_t GLRenderBackend::GetUniformBufferAlignment() const
+	{
+		GLint alignment{ 256 };
+		glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+		return (size_t)std::max(alignment, 1);
+	}
+
+	size_t GLRenderBackend::GetStorageBufferAlignment() const
+	{
+		GLint alignment{ 256 };
+		glGetIntegerv(GL_SHADER_STORAGE_BUFFER_OFFSET_ALIGNMENT, &alignment);
+		return (size_t)std::max(alignment, 1);
+	}
+
+	// The element buffer binding is part of the VAO so is left bound to it
+	GLuint GLRenderBackend::CreateVertexArray(GLuint vertexBuffer, GLsizei stride, const std::vector<VertexAttribute>& attributes, GLuint elementBuffer)
+	{
+		// The attributes all read binding point 0
+		if (m_directStateAccess)
+		{
+			GLuint vertexArray;
+			glCreateVertexArrays(1, &vertexArray);
+			glVertexArrayVertexBuffer(vertexArray, 0, vertexBuffer, 0, stride);
+			for (const VertexAttribute& attribute : attributes)
+			{
+				glEnableVertexArrayAttrib(vertexArray, attribute.location);
+				glVertexArrayAttribFormat(vertexArray, attribute.location, attribute.components, attribute.type, attribute.normalised, (GLuint)attribute.offset);
+				glVertexArrayAttribBinding(vertexArray, attribute.location, 0);
+			}
+			if (elementBuffer)
+				glVertexArrayElementBuffer(vertexArray, elementBuffer);
+			return vertexArray;
+		}
+
+		GLuint vertexArray;
+		glGenVertexArrays(1, &vertexArray);
+		glBindVertexArray(vertexArray);
+
+		glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
+		for (const VertexAttribute& attribute : attributes)
+		{
+			glEnableVertexAttribArray(attribute.location);
+			glVertexAttribPointer(attribute.location, attribute.components, attribute.type, attribute.normalised, stride, (void*)attribute.offset);
+		}
+
+		if (elementBuffer)
+			glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, elementBuffer);
+		glBindVertexArray(0);
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+		return vertexArray;
+	}
+
+	void GLRenderBackend::DeleteVertexArray(GLuint vertexArray)
+	{
+		glDeleteVertexArrays(1, &vertexArray);
+	}
+
+	// Levels of a full mip chain down to 1x1
+	static GLsizei MipLevels(GLsizei width, GLsizei height)
+	{
+		GLsizei levels{ 1 };
+		while ((std::max(width, height) >> levels) > 0)
+			levels++;
+		return levels;
+	}
+
+	// A mipmapped RGBA8 texture with linear filtering
+	GLuint GLRenderBackend::CreateTexture2D(GLsizei width, GLsizei height, const void* rgba, GLint wrap)
+	{
+		if (m_directStateAccess)
+		{
+			GLuint tex;
+			glCreateTextures(GL_TEXTURE_2D, 1, &tex);
+			glTextureStorage2D(tex, MipLevels(width, height), GL_RGBA8, width, height);
+			if (rgba)
+			{
+				glTextureSubImage2D(tex, 0, 0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, rgba);
+				glGenerateTextureMipmap(tex);
+			}
+
+			GLuint& sampler{ m_mipmapSamplers[wrap] };
+			if (!sampler)
+				sampler = Sampler(GL_LINEAR_MIPMAP_LINEAR, GL_LINEAR, wrap);
+			m_textureSamplers[tex] = sampler;
+			return tex;
+		}
+
+		GLuint tex;
+		glGenTextures(1, &tex);
+		glBindTexture(GL_TEXTURE_2D, tex);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, wrap);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, wrap);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, rgba);
+		glGenerateMipmap(GL_TEXTURE_2D);
+		glBindTexture(GL_TEXTURE_2D, 0);
+		return tex;
+	}
+
+	void GLRenderBackend::DeleteTexture(GLuint texture)
+	{
+		m_textureSamplers.erase(texture);
+		glDeleteTextures(1, &texture);
+	}
+
+	// Levels are not made again from level 0, so callers updating a mipmapped texture update each level they sample
+	void GLRenderBackend::UpdateTexture2D(GLuint texture, GLint level, GLint x, GLint y, GLsizei width, GLsizei height, const void* rgba)
+	{
+		if (m_directStateAccess)
+		{
+			glTextureSubImage2D(texture, level, x, y, width, height, GL_RGBA, GL_UNSIGNED_BYTE, rgba);
+			return;
+		}
+
+		glBindTexture(GL_TEXTURE_2D, texture);
+		glTexSubImage2D(GL_TEXTURE_2D, level, x, y, width, height, GL_RGBA, GL_UNSIGNED_BYTE, rgba);
+		glBindTexture(GL_TEXTURE_2D, 0);
+	}
+
+	// Every layer's mip chain is made in one go, as with CreateTexture2D
+	GLuint GLRenderBackend::CreateTextureArray(GLsizei width, GLsizei height, GLsizei layers, const void* rgba, GLint wrap)
+	{
+		if (m_directStateAccess)
+		{
+			GLuint tex;
+			glCreateTextures(GL_TEXTURE_2D_ARRAY, 1, &tex);
+			glTextureStorage3D(tex, MipLevels(width, height), GL_RGBA8, width, height, layers);
+			if (rgba)
+			{
+				glTextureSubImage3D(tex, 0, 0, 0, 0, width, height, layers, GL_RGBA, GL_UNSIGNED_BYTE, rgba);
+				glGenerateTextureMipmap(tex);
+			}
+
+			GLuint& sampler{ m_mipmapSamplers[wrap] };
+			if (!sampler)
+				sampler = Sampler(GL_LINEAR_MIPMAP_LINEAR, GL_LINEAR, wrap);
+			m_textureSamplers[tex] = sampler;
+			return tex;
+		}
+
+		GLuint tex;
+		glGenTextures(1, &tex);
+		glBindTexture(GL_TEXTURE_2D_ARRAY, tex);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, wrap);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, wrap);
+		glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_RGBA8, width, height, layers, 0, GL_RGBA, GL_UNSIGNED_BYTE, rgba);
+		glGenerateMipmap(GL_TEXTURE_2D_ARRAY);
+		glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+		return tex;
+	}
+
+	// Immutable storage of one level, drawn into and then read texel for texel so nearest filtering
+	GLuint GLRenderBackend::CreateRenderTarget(GLsizei width, GLsizei height, GLenum format)
+	{
+		if (m_directStateAccess)
+		{
+			GLuint tex;
+			glCreateTextures(GL_TEXTURE_2D, 1, &tex);
+			glTextureStorage2D(tex, 1, format, width, height);
+
+			if (!m_nearestSampler)
+				m_nearestSampler = Sampler(GL_NEAREST, GL_NEAREST, GL_CLAMP_TO_EDGE);
+			m_textureSamplers[tex] = m_nearestSampler;
+			return tex;
+		}
+
+		GLuint tex;
+		glGenTextures(1, &tex);
+		glBindTexture(GL_TEXTURE_2D, tex);
+		glTexStorage2D(GL_TEXTURE_2D, 1, format, width, height);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+		glBindTexture(GL_TEXTURE_2D, 0);
+		return tex;
+	}
+
+	// The depth target may be a depth stencil format, in which case stencil is attached too
+	GLuint GLRenderBackend::CreateFramebuffer(const std::vector<GLuint>& colourTargets, GLuint depthTarget)
+	{
+		if (m_directStateAccess)
+		{
+			GLuint framebuffer;
+			glCreateFramebuffers(1, &framebuffer);
+
+			std::vector<GLenum> drawBuffers;
+			for (size_t i = 0; i < colourTargets.size(); i++)
+			{
+				glNamedFramebufferTexture(framebuffer, GL_COLOR_ATTACHMENT0 + (GLenum)i, colourTargets[i], 0);
+				drawBuffers.push_back(GL_COLOR_ATTACHMENT0 + (GLenum)i);
+			}
+			if (drawBuffers.empty())
+				glNamedFramebufferDrawBuffer(framebuffer, GL_NONE);
+			else
+				glNamedFramebufferDrawBuffers(framebuffer, (GLsizei)drawBuffers.size(), drawBuffers.data());
+
+			if (depthTarget)
+			{
+				GLint format{ 0 };
+				glGetTextureLevelParameteriv(depthTarget, 0, GL_TEXTURE_INTERNAL_FORMAT, &format);
+				const bool stencil{ format == GL_DEPTH24_STENCIL8 || format == GL_DEPTH32F_STENCIL8 };
+				glNamedFramebufferTexture(framebuffer, stencil ? GL_DEPTH_STENCIL_ATTACHMENT : GL_DEPTH_ATTACHMENT, depthTarget, 0);
+			}
+
+			const GLenum status{ glCheckNamedFramebufferStatus(framebuffer, GL_FRAMEBUFFER) };
+			if (status != GL_FRAMEBUFFER_COMPLETE)
+			{
+				std::cout << "ERROR: framebuffer incomplete, status 0x" << std::hex << status << std::dec << std::endl;
+				glDeleteFramebuffers(1, &framebuffer);
+				return 0;
+			}
+			return framebuffer;
+		}
+
+		GLuint framebuffer;
+		glGenFramebuffers(1, &framebuffer);
+		glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+
+		std::vector<GLenum> drawBuffers;
+		for (size_t i = 0; i < colourTargets.size(); i++)
+		{
+			glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0 + (GLenum)i, colourTargets[i], 0);
+			drawBuffers.push_back(GL_COLOR_ATTACHMENT0 + (GLenum)i);
+		}
+		if (drawBuffers.empty())
+			glDrawBuffer(GL_NONE);
+		else
+			glDrawBuffers((GLsizei)drawBuffers.size(), drawBuffers.data());
+
+		if (depthTarget)
+		{
+			GLint format{ 0 };
+			glBindTexture(GL_TEXTURE_2D, depthTarget);
+			glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_INTERNAL_FORMAT, &format);
+			glBindTexture(GL_TEXTURE_2D, 0);
+			const bool stencil{ format == GL_DEPTH24_STENCIL8 || format == GL_DEPTH32F_STENCIL8 };
+			glFramebufferTexture(GL_FRAMEBUFFER, stencil ? GL_DEPTH_STENCIL_ATTACHMENT : GL_DEPTH_ATTACHMENT, depthTarget, 0);
+		}
+
+		const GLenum status{ glCheckFramebufferStatus(GL_FRAMEBUFFER) };
+		glBindFramebuffer(GL_FRAMEBUFFER, 0);
+		if (status != GL_FRAMEBUFFER_COMPLETE)
+		{
+			std::cout << "ERROR: framebuffer incomplete, status 0x" << std::hex << status << std::dec << std::endl;
+			glDeleteFramebuffers(1, &framebuffer);
+			return 0;
+		}
+		return framebuffer;
+	}
+
+	void GLRenderBackend::DeleteFramebuffer(GLuint framebuffer)
+	{
+		glDeleteFramebuffers(1, &framebuffer);
+	}
+
+	GLuint GLRenderBackend::CreateQuery()
+	{
+		GLuint query;
+		glGenQueries(1, &query);
+		return query;
+	}
+
+	void GLRenderBackend::DeleteQuery(GLuint query)
+	{
+		glDeleteQueries(1, &query);
+	}
+
+	// Never waits, false if the result is not available yet
+	bool GLRenderBackend::GetQueryResult(GLuint query, GLuint& result)
+	{
+		GLuint available{ GL_FALSE };
+		glGetQueryObjectuiv(query, GL_QUERY_RESULT_AVAILABLE, &available);
+		if (!available)
+			return false;
+
+		glGetQueryObjectuiv(query, GL_QUERY_RESULT, &result);
+		return true;
+	}
+
+	bool GLRenderBackend::GetTimestamp(GLuint query, GLuint64& nanoseconds)
+	{
+		GLuint available{ GL_FALSE };
+		glGetQueryObjectuiv(query, GL_QUERY_RESULT_AVAILABLE, &available);
+		if (!available)
+			return false;
+
+		glGetQueryObjectui64v(query, GL_QUERY_RESULT, &nanoseconds);
+		return true;
+	}
+
+	GLuint64 GLRenderBackend::GetGpuTime()
+	{
+		GLint64 nanoseconds{ 0 };
+		glGetInteger64v(GL_TIMESTAMP, &nanoseconds);
+		return (GLuint64)nanoseconds;
+	}
+
+	GLsync GLRenderBackend::InsertFence()
+	{
+		return glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	}
+
+	// The first wait flushes so the fence is sure to reach the GPU
+	void GLRenderBackend::WaitFence(GLsync fence)
+	{
+		GLbitfield flags{ GL_SYNC_FLUSH_COMMANDS_BIT };
+		while (true)
+		{
+			const GLenum result{ glClientWaitSync(fence, flags, 1000000) };
+			if (result == GL_ALREADY_SIGNALED || result == GL_CONDITION_SATISFIED || result == GL_WAIT_FAILED)
+				return;
+			flags = 0;
+		}
+	}
+
+	void GLRenderBackend::DeleteFence(GLsync fence)
+	{
+		glDeleteSync(fence);
+	}
+
+	glm::ivec4 GLRenderBackend::GetViewport() const
+	{
+		GLint viewport[4];
+		glGetIntegerv(GL_VIEWPORT, viewport);
+		return glm::ivec4(viewport[0], viewport[1], viewport[2], viewport[3]);
+	}
+
+	static void SetEnabled(GLenum capability, bool enabled)
+	{
+		if (enabled)
+			glEnable(capability);
+		else
+			glDisable(capability);
+	}
+
+	// Issue a list's commands to OpenGL. Leaves the VAO and indirect buffer unbound.
+	void GLRenderBackend::Execute(const CommandList& list)
+	{
+		m_stats.commandLists++;
+		for (const Command* command = list.First(); command; command = command->next)
+		{
+			CountCommand(*command);
+			switch (command->type)
+			{
+			case CommandType::SetState:
+			{
+				const RenderState& state{ static_cast<const SetStateCommand*>(command)->state };
+				SetEnabled(GL_DEPTH_TEST, state.depthTest);
+				SetEnabled(GL_CULL_FACE, state.cullFace);
+				SetEnabled(GL_PRIMITIVE_RESTART_FIXED_INDEX, state.primitiveRestart);
+				glDepthMask(state.depthWrite ? GL_TRUE : GL_FALSE);
+				const GLboolean colour{ state.colourWrite ? (GLboolean)GL_TRUE : (GLboolean)GL_FALSE };
+				glColorMask(colour, colour, colour, colour);
+				glPolygonMode(GL_FRONT_AND_BACK, state.wireframe ? GL_LINE : GL_FILL);
+				for (GLuint i = 0; i < RenderState::KMaxClipDistances; i++)
+					SetEnabled(GL_CLIP_DISTANCE0 + i, i < state.clipDistances);
+				SetEnabled(GL_SCISSOR_TEST, state.scissor.z > 0);
+				if (state.scissor.z > 0)
+					glScissor(state.scissor.x, state.scissor.y, state.scissor.z, state.scissor.w);
+				break;
+			}
+			case CommandType::Clear:
+				glClear(static_cast<const ClearCommand*>(command)->mask);
+				break;
+			case CommandType::BindProgram:
+				glUseProgram(static_cast<const BindProgramCommand*>(command)->program);
+				break;
+			case CommandType::SetUniform:
+			{
+				const SetUniformCommand* uniform{ static_cast<const SetUniformCommand*>(command) };
+				switch (uniform->uniformType)
+				{
+				case GL_INT:
+					glUniform1i(uniform->location, uniform->value.i[0]);
+					break;
+				case GL_FLOAT:
+					glUniform1f(uniform->location, uniform->value.f[0]);
+					break;
+				case GL_FLOAT_VEC3:
+					glUniform3fv(uniform->location, 1, uniform->value.f);
+					break;
+				case GL_FLOAT_VEC4:
+					glUniform4fv(uniform->location, 1, uniform->value.f);
+					break;
+				case GL_FLOAT_MAT4:
+					glUniformMatrix4fv(uniform->location, 1, GL_FALSE, uniform->value.f);
+					break;
+				}
+				break;
+			}
+			case CommandType::BindTexture:
+			{
+				const BindTextureCommand* bind{ static_cast<const BindTextureCommand*>(command) };
+				if (m_directStateAccess)
+				{
+					// The unit's sampler goes with the texture, 0 for textures made elsewhere e.g. by the GUI
+					glBindTextureUnit(bind->unit, bind->texture);
+					const auto sampler{ m_textureSamplers.find(bind->texture) };
+					glBindSampler(bind->unit, sampler == m_textureSamplers.end() ? 0 : sampler->second);
+				}
+				else
+				{
+					glActiveTexture(GL_TEXTURE0 + bind->unit);
+					glBindTexture(bind->target, bind->texture);
+				}
+				break;
+			}
+			case CommandType::BindVertexArray:
+				glBindVertexArray(static_cast<const BindVertexArrayCommand*>(command)->vao);
+				break;
+			case CommandType::DrawElements:
+			{
+				const DrawElementsCommand* draw{ static_cast<const DrawElementsCommand*>(command) };
+				glDrawElements(draw->mode, draw->count, draw->indexType, (void*)draw->byteOffset);
+				break;
+			}
+			case CommandType::MultiDrawElementsIndirect:
+			{
+				const MultiDrawElementsIndirectCommand* draw{ static_cast<const MultiDrawElementsIndirectCommand*>(command) };
+				glBindBuffer(GL_DRAW_INDIRECT_BUFFER, draw->buffer);
+				glMultiDrawElementsIndirect(draw->mode, draw->indexType, (void*)draw->offset, draw->drawCount, 0);
+				glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+				break;
+			}
+			case CommandType::UpdateBuffer:
+			{
+				const UpdateBufferCommand* update{ static_cast<const UpdateBufferCommand*>(command) };
+				if (m_directStateAccess)
+				{
+					glNamedBufferData(update->buffer, update->size, update->data, GL_STREAM_DRAW);
+				}
+				else
+				{
+					glBindBuffer(update->target, update->buffer);
+					glBufferData(update->target, update->size, update->data, GL_STREAM_DRAW);
+					glBindBuffer(update->target, 0);
+				}
+				break;
+			}
+			case CommandType::BindBufferRange:
+			{
+				const BindBufferRangeCommand* bind{ static_cast<const BindBufferRangeCommand*>(command) };
+				glBindBufferRange(bind->target, bind->index, bind->buffer, (GLintptr)bind->offset, (GLsizeiptr)bind->size);
+				break;
+			}
+			case CommandType::BindFramebuffer:
+			{
+				const BindFramebufferCommand* bind{ static_cast<const BindFramebufferCommand*>(command) };
+				glBindFramebuffer(GL_DRAW_FRAMEBUFFER, bind->drawFramebuffer);
+				glBindFramebuffer(GL_READ_FRAMEBUFFER, bind->readFramebuffer);
+				glViewport(bind->viewport.x, bind->viewport.y, bind->viewport.z, bind->viewport.w);
+				break;
+			}
+			case CommandType::BlitFramebuffer:
+			{
+				const BlitFramebufferCommand* blit{ static_cast<const BlitFramebufferCommand*>(command) };
+				glBlitFramebuffer(blit->source.x, blit->source.y, blit->source.z, blit->source.w,
+					blit->destination.x, blit->destination.y, blit->destination.z, blit->destination.w, blit->mask, blit->filter);
+				break;
+			}
+			case CommandType::Barrier:
+				glMemoryBarrier(static_cast<const BarrierCommand*>(command)->barriers);
+				break;
+			case CommandType::BeginQuery:
+			{
+				const QueryCommand* query{ static_cast<const QueryCommand*>(command) };
+				glBeginQuery(query->target, query->query);
+				break;
+			}
+			case CommandType::EndQuery:
+				glEndQuery(static_cast<const QueryCommand*>(command)->target);
+				break;
+			case CommandType::BeginConditionalRender:
+			{
+				const QueryCommand* query{ static_cast<const QueryCommand*>(command) };
+				glBeginConditionalRender(query->query, query->target);
+				break;
+			}
+			case CommandType::EndConditionalRender:
+				glEndConditionalRender();
+				break;
+			case CommandType::Timestamp:
+				glQueryCounter(static_cast<const QueryCommand*>(command)->query, GL_TIMESTAMP);
+				break;
+			case CommandType::ReadPixels:
+			{
+				const ReadPixelsCommand* read{ static_cast<const ReadPixelsCommand*>(command) };
+				glBindBuffer(GL_PIXEL_PACK_BUFFER, read->buffer);
+				glReadPixels(read->rect.x, read->rect.y, read->rect.z, read->rect.w, GL_RGBA, GL_UNSIGNED_BYTE, (void*)read->offset);
+				glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+				break;
+			}
+			}
+		}
+
+		glBindVertexArray(0);
+	}
+
+	void GLRenderBackend::Finish()
+	{
+		glFinish();
+	}
+}
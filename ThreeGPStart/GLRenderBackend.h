@@ -0,0 +1,76 @@
+#pragma once
+// OpenGL render backend, all calls must be made on the thread owning the GL context except
+// GetUniformLocation which only reads locations looked up when the program was linked.
+// Resources are made with direct state access and immutable storage where the context has GL 4.5,
+// otherwise by binding them to edit. Textures are sampled through sampler objects shared by every
+// texture with the same filtering and wrapping.
+
+#include "RenderBackend.h"
+
+#include <unordered_map>
+
+namespace Helpers
+{
+	class GLRenderBackend : public RenderBackend
+	{
+	private:
+		// Active uniforms of each program by name, arrays under both "name" and "name[0]"
+		std::unordered_map<GLuint, std::unordered_map<std::string, GLint>> m_uniforms;
+
+		bool m_directStateAccess{ false };
+
+		// Shared samplers by wrap mode for mipmapped textures, one nearest clamped sampler for render
+		// targets, and the sampler each texture is bound with
+		std::unordered_map<GLint, GLuint> m_mipmapSamplers;
+		GLuint m_nearestSampler{ 0 };
+		std::unordered_map<GLuint, GLuint> m_textureSamplers;
+
+		GLuint Sampler(GLint minFilter, GLint magFilter, GLint wrap);
+	public:
+		// Direct state access is used when asked for and the context supports it
+		explicit GLRenderBackend(bool directStateAccess = true);
+		~GLRenderBackend();
+
+		const char* Name() const override { return m_directStateAccess ? "OpenGL" : "OpenGL (bind to edit)"; }
+		bool IsDirectStateAccess() const { return m_directStateAccess; }
+
+		GLuint CreateProgram(const std::string& vertexPath, const std::string& fragmentPath) override;
+		void DeleteProgram(GLuint program) override;
+		GLint GetUniformLocation(GLuint program, const std::string& name) const override;
+
+		GLuint CreateBuffer(GLenum target, const void* data, size_t size, GLenum usage) override;
+		void DeleteBuffer(GLuint buffer) override;
+		GLuint CreatePersistentBuffer(size_t size, void*& mapped) override;
+		GLuint CreateReadbackBuffer(size_t size, const void*& mapped) override;
+		size_t GetUniformBufferAlignment() const override;
+		size_t GetStorageBufferAlignment() const override;
+
+		GLuint CreateVertexArray(GLuint vertexBuffer, GLsizei stride, const std::vector<VertexAttribute>& attributes, GLuint elementBuffer) override;
+		void DeleteVertexArray(GLuint vertexArray) override;
+
+		GLuint CreateTexture2D(GLsizei width, GLsizei height, const void* rgba, GLint wrap) override;
+		void DeleteTexture(GLuint texture) override;
+		void UpdateTexture2D(GLuint texture, GLint level, GLint x, GLint y, GLsizei width, GLsizei height, const void* rgba) override;
+		GLuint CreateTextureArray(GLsizei width, GLsizei height, GLsizei layers, const void* rgba, GLint wrap) override;
+
+		GLuint CreateRenderTarget(GLsizei width, GLsizei height, GLenum format) override;
+		GLuint CreateFramebuffer(const std::vector<GLuint>& colourTargets, GLuint depthTarget) override;
+		void DeleteFramebuffer(GLuint framebuffer) override;
+
+		GLuint CreateQuery() override;
+		void DeleteQuery(GLuint query) override;
+		bool GetQueryResult(GLuint query, GLuint& result) override;
+		bool GetTimestamp(GLuint query, GLuint64& nanoseconds) override;
+		GLuint64 GetGpuTime() override;
+
+		GLsync InsertFence() override;
+		void WaitFence(GLsync fence) override;
+		void DeleteFence(GLsync fence) override;
+
+		glm::ivec4 GetViewport() const override;
+
+		// Leaves the VAO and indirect buffer unbound
+		void Execute(const CommandList& list) override;
+		void Finish() override;
+	};
+}
@@ -0,0 +1,294 @@
+#include "GpuResources.h"
+
+#include <algorithm>
+#include <fstream>
+
+namespace Helpers
+{
+	const char* GpuResourceTypeName(GpuResourceType type)
+	{
+		switch (type)
+		{
+		case GpuResourceType::Buffer: return "Buffers";
+		case GpuResourceType::VertexArray: return "Vertex arrays";
+		case GpuResourceType::Texture: return "Textures";
+		case GpuResourceType::TextureArray: return "Texture arrays";
+		case GpuResourceType::RenderTarget: return "Render targets";
+		case GpuResourceType::Framebuffer: return "Framebuffers";
+		case GpuResourceType::Program: return "Programs";
+		default: return "Unknown";
+		}
+	}
+
+	// Bytes of a texture of one level, or of its whole mip chain. Depth 24 is padded to 32 bits.
+	size_t TextureBytes(GLsizei width, GLsizei height, GLenum format, bool mipmapped)
+	{
+		size_t texelBytes{ 4 };
+		switch (format)
+		{
+		case GL_R8:
+			texelBytes = 1;
+			break;
+		case GL_RG8:
+		case GL_R16F:
+		case GL_DEPTH_COMPONENT16:
+			texelBytes = 2;
+			break;
+		case GL_RGBA16F:
+		case GL_RG32F:
+		case GL_DEPTH32F_STENCIL8:
+			texelBytes = 8;
+			break;
+		case GL_RGBA32F:
+			texelBytes = 16;
+			break;
+		default:
+			break;
+		}
+
+		size_t bytes{ (size_t)width * (size_t)height * texelBytes };
+		while (mipmapped && (width > 1 || height > 1))
+		{
+			width = std::max(width / 2, 1);
+			height = std::max(height / 2, 1);
+			bytes += (size_t)width * (size_t)height * texelBytes;
+		}
+		return bytes;
+	}
+
+	// Reports and deletes anything still alive
+	GpuResourceRegistry::~GpuResourceRegistry()
+	{
+		if (!m_backend)
+			return;
+
+		const size_t leaked{ CheckLeaks() };
+		if (leaked)
+			std::cout << "ERROR: " << leaked << " GPU resources leaked, " << m_bytes / 1024 << " KB" << std::endl;
+		else
+			std::cout << "GPU resources: no leaks, peak " << m_peakBytes / 1024 << " KB" << std::endl;
+
+		while (!m_resources.empty())
+			Release(m_resources.begin()->first.first, m_resources.begin()->first.second);
+	}
+
+	// The backend must outlive this
+	void GpuResourceRegistry::Initialise(RenderBackend& backend)
+	{
+		m_backend = &backend;
+	}
+
+	// Record a new object, 0 (failed) is not recorded
+	GLuint GpuResourceRegistry::Track(GpuResourceType type, GLuint handle, const std::string& asset, size_t bytes)
+	{
+		if (!handle)
+			return 0;
+
+		GpuResourceInfo info;
+		info.type = type;
+		info.handle = handle;
+		info.asset = asset;
+		info.bytes = bytes;
+		m_resources[std::make_pair(type, handle)] = info;
+
+		m_bytes += bytes;
+		m_peakBytes = std::max(m_peakBytes, m_bytes);
+		return handle;
+	}
+
+	GpuProgram GpuResourceRegistry::CreateProgram(const std::string& asset, const std::string& vertexPath, const std::string& fragmentPath)
+	{
+		const GLuint program{ m_backend->CreateProgram(vertexPath, fragmentPath) };
+		return GpuProgram(this, Track(GpuResourceType::Program, program, asset, 0));
+	}
+
+	GpuBuffer GpuResourceRegistry::CreateBuffer(const std::string& asset, GLenum target, const void* data, size_t size, GLenum usage)
+	{
+		const GLuint buffer{ m_backend->CreateBuffer(target, data, size, usage) };
+		return GpuBuffer(this, Track(GpuResourceType::Buffer, buffer, asset, size));
+	}
+
+	GpuBuffer GpuResourceRegistry::CreatePersistentBuffer(const std::string& asset, size_t size, void*& mapped)
+	{
+		const GLuint buffer{ m_backend->CreatePersistentBuffer(size, mapped) };
+		return GpuBuffer(this, Track(GpuResourceType::Buffer, buffer, asset, size));
+	}
+
+	GpuBuffer GpuResourceRegistry::CreateReadbackBuffer(const std::string& asset, size_t size, const void*& mapped)
+	{
+		const GLuint buffer{ m_backend->CreateReadbackBuffer(size, mapped) };
+		return GpuBuffer(this, Track(GpuResourceType::Buffer, buffer, asset, size));
+	}
+
+	GpuVertexArray GpuResourceRegistry::CreateVertexArray(const std::string& asset, GLuint vertexBuffer, GLsizei stride,
+		const std::vector<VertexAttribute>& attributes, GLuint elementBuffer)
+	{
+		const GLuint vertexArray{ m_backend->CreateVertexArray(vertexBuffer, stride, attributes, elementBuffer) };
+		return GpuVertexArray(this, Track(GpuResourceType::VertexArray, vertexArray, asset, 0));
+	}
+
+	// Counted with its mip chain, RGBA8
+	GpuTexture GpuResourceRegistry::CreateTexture2D(const std::string& asset, GLsizei width, GLsizei height, const void* rgba, GLint wrap)
+	{
+		const GLuint texture{ m_backend->CreateTexture2D(width, height, rgba, wrap) };
+		return GpuTexture(this, Track(GpuResourceType::Texture, texture, asset, TextureBytes(width, height, GL_RGBA8, true)));
+	}
+
+	// Counted as layers mipmapped RGBA8 textures
+	GpuTextureArray GpuResourceRegistry::CreateTextureArray(const std::string& asset, GLsizei width, GLsizei height, GLsizei layers, const void* rgba, GLint wrap)
+	{
+		const GLuint texture{ m_backend->CreateTextureArray(width, height, layers, rgba, wrap) };
+		return GpuTextureArray(this, Track(GpuResourceType::TextureArray, texture, asset, TextureBytes(width, height, GL_RGBA8, true) * (size_t)layers));
+	}
+
+	GpuRenderTarget GpuResourceRegistry::CreateRenderTarget(const std::string& asset, GLsizei width, GLsizei height, GLenum format)
+	{
+		const GLuint texture{ m_backend->CreateRenderTarget(width, height, format) };
+		return GpuRenderTarget(this, Track(GpuResourceType::RenderTarget, texture, asset, TextureBytes(width, height, format, false)));
+	}
+
+	GpuFramebuffer GpuResourceRegistry::CreateFramebuffer(const std::string& asset, const std::vector<GLuint>& colourTargets, GLuint depthTarget)
+	{
+		const GLuint framebuffer{ m_backend->CreateFramebuffer(colourTargets, depthTarget) };
+		return GpuFramebuffer(this, Track(GpuResourceType::Framebuffer, framebuffer, asset, 0));
+	}
+
+	// Delete an object through the backend, used by the handles
+	void GpuResourceRegistry::Release(GpuResourceType type, GLuint handle)
+	{
+		const auto it{ m_resources.find(std::make_pair(type, handle)) };
+		if (it == m_resources.end())
+		{
+			std::cout << "ERROR: releasing " << GpuResourceTypeName(type) << " " << handle << " which the registry does not own" << std::endl;
+			return;
+		}
+		m_bytes -= it->second.bytes;
+		m_resources.erase(it);
+
+		switch (type)
+		{
+		case GpuResourceType::Buffer: m_backend->DeleteBuffer(handle); break;
+		case GpuResourceType::VertexArray: m_backend->DeleteVertexArray(handle); break;
+		case GpuResourceType::Texture: m_backend->DeleteTexture(handle); break;
+		case GpuResourceType::TextureArray: m_backend->DeleteTexture(handle); break;
+		case GpuResourceType::RenderTarget: m_backend->DeleteTexture(handle); break;
+		case GpuResourceType::Framebuffer: m_backend->DeleteFramebuffer(handle); break;
+		case GpuResourceType::Program: m_backend->DeleteProgram(handle); break;
+		}
+	}
+
+	// Live objects and their memory by asset and by category
+	GpuMemoryReport GpuResourceRegistry::Report() const
+	{
+		GpuMemoryReport report;
+		std::map<std::string, GpuMemoryUsage> assets;
+		std::map<std::string, GpuMemoryUsage> categories;
+		for (const auto& entry : m_resources)
+		{
+			const GpuResourceInfo& info{ entry.second };
+			for (GpuMemoryUsage* usage : { &assets[info.asset], &categories[GpuResourceTypeName(info.type)] })
+			{
+				usage->resources++;
+				usage->bytes += info.bytes;
+			}
+			report.resources++;
+			report.bytes += info.bytes;
+		}
+		report.peakBytes = m_peakBytes;
+
+		const auto largestFirst = [](const GpuMemoryUsage& a, const GpuMemoryUsage& b) { return a.bytes > b.bytes; };
+		for (auto& asset : assets)
+		{
+			asset.second.name = asset.first;
+			report.byAsset.push_back(asset.second);
+		}
+		for (auto& category : categories)
+		{
+			category.second.name = category.first;
+			report.byCategory.push_back(category.second);
+		}
+		std::stable_sort(report.byAsset.begin(), report.byAsset.end(), largestFirst);
+		std::stable_sort(report.byCategory.begin(), report.byCategory.end(), largestFirst);
+		return report;
+	}
+
+	// Quoted with backslashes and quotes escaped, asset names are Windows paths
+	static std::string JsonString(const std::string& text)
+	{
+		std::string quoted{ "\"" };
+		for (char c : text)
+		{
+			if (c == '"' || c == '\\')
+				quoted += '\\';
+			quoted += c;
+		}
+		return quoted + "\"";
+	}
+
+	static void WriteUsage(std::ofstream& file, const std::vector<GpuMemoryUsage>& usages)
+	{
+		for (size_t i = 0; i < usages.size(); i++)
+		{
+			file << (i ? ",\n" : "\n") << "    {\"name\":" << JsonString(usages[i].name) << ",\"resources\":" << usages[i].resources
+				<< ",\"bytes\":" << usages[i].bytes << "}";
+		}
+	}
+
+	// The report plus every live object as JSON, false on error
+	bool GpuResourceRegistry::WriteReport(const std::string& filename) const
+	{
+		std::ofstream file(filename, std::ios::trunc);
+		if (!file)
+		{
+			std::cout << "ERROR: could not write the GPU memory report to " << filename << std::endl;
+			return false;
+		}
+
+		const GpuMemoryReport report{ Report() };
+		file << "{\n  \"resources\":" << report.resources << ",\n  \"bytes\":" << report.bytes << ",\n  \"peakBytes\":" << report.peakBytes;
+		file << ",\n  \"categories\":[";
+		WriteUsage(file, report.byCategory);
+		file << "\n  ],\n  \"assets\":[";
+		WriteUsage(file, report.byAsset);
+		file << "\n  ],\n  \"objects\":[";
+		bool first{ true };
+		for (const auto& entry : m_resources)
+		{
+			const GpuResourceInfo& info{ entry.second };
+			file << (first ? "\n" : ",\n") << "    {\"type\":" << JsonString(GpuResourceTypeName(info.type)) << ",\"handle\":" << info.handle
+				<< ",\"asset\":" << JsonString(info.asset) << ",\"bytes\":" << info.bytes << "}";
+			first = false;
+		}
+		file << "\n  ]\n}\n";
+		return (bool)file;
+	}
+
+	// Print every live object, returns how many there are
+	size_t GpuResourceRegistry::CheckLeaks() const
+	{
+		for (const auto& entry : m_resources)
+		{
+			const GpuResourceInfo& info{ entry.second };
+			std::cout << "ERROR: GPU resource leaked: " << GpuResourceTypeName(info.type) << " " << info.handle << " of " << info.asset
+				<< ", " << info.bytes << " bytes" << std::endl;
+		}
+		return m_resources.size();
+	}
+
+	// Totals, the largest assets and a button to write the report
+	void GpuResourceRegistry::DefineGUI()
+	{
+		const GpuMemoryReport report{ Report() };
+		ImGui::Text("%zu objects, %.2f MB, peak %.2f MB", report.resources, report.bytes / (1024.0f * 1024.0f), report.peakBytes / (1024.0f * 1024.0f));
+		if (ImGui::Button("Write gpu_memory.json"))
+			WriteReport("gpu_memory.json");
+
+		ImGui::Separator();
+		for (const GpuMemoryUsage& category : report.byCategory)
+			ImGui::Text("%-16s %4zu  %8.1f KB", category.name.c_str(), category.resources, category.bytes / 1024.0f);
+
+		ImGui::Separator();
+		for (const GpuMemoryUsage& asset : report.byAsset)
+			ImGui::Text("%8.1f KB  %4zu  %s", asset.bytes / 1024.0f, asset.resources, asset.name.c_str());
+	}
+}
@@ -0,0 +1,162 @@
+#pragma once
+// Ownership and memory accounting of GPU objects. Everything is created through a GpuResourceRegistry,
+// which records the object's size and the asset it belongs to, and handed out as a move only handle that
+// deletes it when destroyed. The registry reports what is left when it is destroyed, so anything the
+// owners forgot shows up at shutdown. GL thread only.
+
+#include "ExternalLibraryHeaders.h"
+#include "RenderBackend.h"
+
+#include <map>
+
+namespace Helpers
+{
+	enum class GpuResourceType : GLubyte
+	{
+		Buffer,
+		VertexArray,
+		Texture,
+		TextureArray,
+		RenderTarget,
+		Framebuffer,
+		Program
+	};
+
+	const char* GpuResourceTypeName(GpuResourceType type);
+
+	// One live object
+	struct GpuResourceInfo
+	{
+		GpuResourceType type{ GpuResourceType::Buffer };
+		GLuint handle{ 0 };
+		std::string asset;
+		size_t bytes{ 0 };
+	};
+
+	// Objects and bytes of one asset or one category
+	struct GpuMemoryUsage
+	{
+		std::string name;
+		size_t resources{ 0 };
+		size_t bytes{ 0 };
+	};
+
+	// Largest first
+	struct GpuMemoryReport
+	{
+		std::vector<GpuMemoryUsage> byAsset;
+		std::vector<GpuMemoryUsage> byCategory;
+		size_t resources{ 0 };
+		size_t bytes{ 0 };
+		size_t peakBytes{ 0 };
+	};
+
+	class GpuResourceRegistry;
+
+	// Owns one object of the registry, 0 when empty
+	template<GpuResourceType Type>
+	class GpuHandle
+	{
+	private:
+		GpuResourceRegistry* m_registry{ nullptr };
+		GLuint m_handle{ 0 };
+	public:
+		GpuHandle() = default;
+		GpuHandle(GpuResourceRegistry* registry, GLuint handle) : m_registry(registry), m_handle(handle) {}
+		GpuHandle(const GpuHandle&) = delete;
+		GpuHandle& operator=(const GpuHandle&) = delete;
+		GpuHandle(GpuHandle&& other) noexcept : m_registry(other.m_registry), m_handle(other.m_handle) { other.m_handle = 0; }
+		GpuHandle& operator=(GpuHandle&& other) noexcept
+		{
+			if (this != &other)
+			{
+				Reset();
+				m_registry = other.m_registry;
+				m_handle = other.m_handle;
+				other.m_handle = 0;
+			}
+			return *this;
+		}
+		~GpuHandle() { Reset(); }
+
+		// Delete the object now
+		void Reset();
+
+		GLuint Get() const { return m_handle; }
+		explicit operator bool() const { return m_handle != 0; }
+	};
+
+	using GpuBuffer = GpuHandle<GpuResourceType::Buffer>;
+	using GpuVertexArray = GpuHandle<GpuResourceType::VertexArray>;
+	using GpuTexture = GpuHandle<GpuResourceType::Texture>;
+	using GpuTextureArray = GpuHandle<GpuResourceType::TextureArray>;
+	using GpuRenderTarget = GpuHandle<GpuResourceType::RenderTarget>;
+	using GpuFramebuffer = GpuHandle<GpuResourceType::Framebuffer>;
+	using GpuProgram = GpuHandle<GpuResourceType::Program>;
+
+	class GpuResourceRegistry
+	{
+	private:
+		RenderBackend* m_backend{ nullptr };
+
+		// Keyed by type then handle, as a program and a buffer can share a name
+		std::map<std::pair<GpuResourceType, GLuint>, GpuResourceInfo> m_resources;
+		size_t m_bytes{ 0 };
+		size_t m_peakBytes{ 0 };
+
+		// Record a new object, 0 (failed) is not recorded
+		GLuint Track(GpuResourceType type, GLuint handle, const std::string& asset, size_t bytes);
+	public:
+		GpuResourceRegistry() = default;
+		GpuResourceRegistry(const GpuResourceRegistry&) = delete;
+		GpuResourceRegistry& operator=(const GpuResourceRegistry&) = delete;
+
+		// Reports and deletes anything still alive
+		~GpuResourceRegistry();
+
+		// The backend must outlive this
+		void Initialise(RenderBackend& backend);
+
+		RenderBackend& GetBackend() const { return *m_backend; }
+
+		// As the backend's functions, asset is what the object is counted against
+		GpuProgram CreateProgram(const std::string& asset, const std::string& vertexPath, const std::string& fragmentPath);
+		GpuBuffer CreateBuffer(const std::string& asset, GLenum target, const void* data, size_t size, GLenum usage);
+		GpuBuffer CreatePersistentBuffer(const std::string& asset, size_t size, void*& mapped);
+		GpuBuffer CreateReadbackBuffer(const std::string& asset, size_t size, const void*& mapped);
+		GpuVertexArray CreateVertexArray(const std::string& asset, GLuint vertexBuffer, GLsizei stride, const std::vector<VertexAttribute>& attributes, GLuint elementBuffer);
+		GpuTexture CreateTexture2D(const std::string& asset, GLsizei width, GLsizei height, const void* rgba, GLint wrap);
+		GpuTextureArray CreateTextureArray(const std::string& asset, GLsizei width, GLsizei height, GLsizei layers, const void* rgba, GLint wrap);
+		GpuRenderTarget CreateRenderTarget(const std::string& asset, GLsizei width, GLsizei height, GLenum format);
+		GpuFramebuffer CreateFramebuffer(const std::string& asset, const std::vector<GLuint>& colourTargets, GLuint depthTarget);
+
+		// Delete an object through the backend, used by the handles
+		void Release(GpuResourceType type, GLuint handle);
+
+		// Live objects and their memory by asset and by category
+		GpuMemoryReport Report() const;
+
+		// The report plus every live object as JSON, false on error
+		bool WriteReport(const std::string& filename) const;
+
+		// Print every live object, returns how many there are
+		size_t CheckLeaks() const;
+
+		size_t NumResources() const { return m_resources.size(); }
+		size_t Bytes() const { return m_bytes; }
+
+		// Totals, the largest assets and a button to write the report
+		void DefineGUI();
+	};
+
+	template<GpuResourceType Type>
+	void GpuHandle<Type>::Reset()
+	{
+		if (m_registry && m_handle)
+			m_registry->Release(Type, m_handle);
+		m_handle = 0;
+	}
+
+	// Bytes of a texture of one level, or of its whole mip chain
+	size_t TextureBytes(GLsizei width, GLsizei height, GLenum format, bool mipmapped);
+}
@@ -183,6 +183,52 @@ namespace Helpers
 		return ss.str();
 	}
 
+	// Included files may include others, up to a depth that catches a file including itself
+	static std::string ExpandShaderIncludes(const std::string& filepath, int depth)
+	{
+		const std::string source{ stringFromFile(filepath) };
+		if (source.empty())
+			return "";
+		if (depth > 8)
+		{
+			std::cout << "ERROR: shader includes nested too deeply at " << filepath << std::endl;
+			return "";
+		}
+
+		const size_t slash{ filepath.find_last_of("/\\") };
+		const std::string directory{ slash == std::string::npos ? "" : filepath.substr(0, slash + 1) };
+
+		std::stringstream lines(source);
+		std::string expanded;
+		std::string line;
+		while (std::getline(lines, line))
+		{
+			const size_t start{ line.find_first_not_of(" \t") };
+			const size_t open{ line.find('"') };
+			const size_t close{ open == std::string::npos ? std::string::npos : line.find('"', open + 1) };
+			if (start == std::string::npos || line.compare(start, 8, "#include") != 0 || close == std::string::npos)
+			{
+				expanded += line + "\n";
+				continue;
+			}
+
+			const std::string included{ ExpandShaderIncludes(directory + line.substr(open + 1, close - open - 1), depth + 1) };
+			if (included.empty())
+			{
+				std::cout << "ERROR: " << filepath << " could not include " << line.substr(open + 1, close - open - 1) << std::endl;
+				return "";
+			}
+			expanded += included;
+		}
+		return expanded;
+	}
+
+	// A shader's source with its #include lines replaced by the files they name
+	std::string ShaderSourceFromFile(const std::string& filepath)
+	{
+		return ExpandShaderIncludes(filepath, 0);
+	}
+
 	// Check shader with id compiled without error
 	bool DidShaderCompileOK(GLuint id)
 	{
@@ -225,7 +271,7 @@ namespace Helpers
 		// Create shaders
 		GLuint shaderId{ glCreateShader(shaderType) };
 
-		std::string vShaderString = stringFromFile(shaderFilename);
+		std::string vShaderString = ShaderSourceFromFile(shaderFilename);
 		if (vShaderString.empty())
 		{
 			std::cout << "Could not load " << shaderFilename << std::endl;
@@ -19,6 +19,10 @@ namespace Helpers
 	// Loads a whole file into a string e.g. for shader use
 	std::string stringFromFile(const std::string& filepath);
 
+	// A shader's source with each #include "file" line replaced by that file, found next to the including one.
+	// Empty if it or anything it includes could not be loaded.
+	std::string ShaderSourceFromFile(const std::string& filepath);
+
 	// Check program linked without error (i.e. no errors in the shaders)
 	bool LinkProgramShaders(GLuint shaderProgram);
 
@@ -1,4 +1,5 @@
 #include "ImageLoader.h"
+#include "Profiler.h"
 #include <filesystem>
 namespace fs = std::filesystem;
 
@@ -29,7 +30,8 @@ namespace Helpers
 	// Attempt to load an image from the file and path provided. Returns false on error.
 	bool ImageLoader::Load(const std::string& filepath)
 	{
-		
+		PROFILE_CPU("Load image");
+
 		// First check file exists
 		if (!exists(fs::path(filepath)))
 		{
@@ -56,7 +58,12 @@ namespace Helpers
 		}
 
 		// If we're here we have a known image format, so load the image into a bitmap
-		FIBITMAP* bitmap{ FreeImage_Load(format, filepath.c_str()) };
+		FIBITMAP* bitmap{ nullptr };
+		{
+			PROFILE_CPU("Decode image");
+			bitmap = FreeImage_Load(format, filepath.c_str());
+		}
+		PROFILE_CPU("Convert image");
 
 		// How many bits-per-pixel is the source image?
 		unsigned int bitsPerPixel{ FreeImage_GetBPP(bitmap) };
@@ -0,0 +1,148 @@
+#include "IndexBuffer.h"
+
+#include <unordered_map>
+
+namespace Helpers
+{
+	// Smallest index type able to hold maxIndex, keeping the top value free for restart
+	GLenum SelectIndexType(unsigned int maxIndex)
+	{
+		if (maxIndex < 0xFF)
+			return GL_UNSIGNED_BYTE;
+		if (maxIndex < 0xFFFF)
+			return GL_UNSIGNED_SHORT;
+		return GL_UNSIGNED_INT;
+	}
+
+	// Greedily join a CCW triangle list into strips separated by KStripRestart
+	// GL flips the first two vertices of every odd triangle in a strip, so to continue a strip ending in p,q
+	// the next triangle must own the directed edge p->q when even and q->p when odd
+	std::vector<unsigned int> ConvertToStrips(const std::vector<unsigned int>& triangles)
+	{
+		const size_t numTriangles{ triangles.size() / 3 };
+
+		auto edgeKey = [](unsigned int a, unsigned int b) { return ((unsigned long long)a << 32) | b; };
+
+		// Each directed edge belongs to at most one triangle in a consistently wound manifold mesh
+		std::unordered_map<unsigned long long, size_t> edgeOwner;
+		edgeOwner.reserve(triangles.size());
+		for (size_t t = 0; t < numTriangles; t++)
+		{
+			for (size_t k = 0; k < 3; k++)
+				edgeOwner.emplace(edgeKey(triangles[t * 3 + k], triangles[t * 3 + (k + 1) % 3]), t);
+		}
+
+		std::vector<bool> used(numTriangles, false);
+
+		// Unused triangle owning the directed edge a->b and its remaining vertex
+		auto findNext = [&](unsigned int a, unsigned int b, unsigned int& third) -> bool
+		{
+			const auto it{ edgeOwner.find(edgeKey(a, b)) };
+			if (it == edgeOwner.end() || used[it->second])
+				return false;
+
+			const unsigned int* tri{ &triangles[it->second * 3] };
+			for (size_t k = 0; k < 3; k++)
+			{
+				if (tri[k] == a && tri[(k + 1) % 3] == b)
+				{
+					third = tri[(k + 2) % 3];
+					used[it->second] = true;
+					return true;
+				}
+			}
+			return false;
+		};
+
+		std::vector<unsigned int> strips;
+		strips.reserve(triangles.size());
+
+		for (size_t t = 0; t < numTriangles; t++)
+		{
+			if (used[t])
+				continue;
+			used[t] = true;
+
+			// Pick the starting rotation that lets the strip continue, the second triangle is odd so needs v2->v1
+			const unsigned int* tri{ &triangles[t * 3] };
+			size_t rotation{ 0 };
+			for (size_t r = 0; r < 3; r++)
+			{
+				const auto it{ edgeOwner.find(edgeKey(tri[(r + 2) % 3], tri[(r + 1) % 3])) };
+				if (it != edgeOwner.end() && !used[it->second])
+				{
+					rotation = r;
+					break;
+				}
+			}
+
+			if (!strips.empty())
+				strips.push_back(KStripRestart);
+
+			const size_t stripStart{ strips.size() };
+			for (size_t k = 0; k < 3; k++)
+				strips.push_back(tri[(rotation + k) % 3]);
+
+			// Keep extending while a neighbour across the last edge is free
+			for (;;)
+			{
+				const size_t length{ strips.size() - stripStart };
+				const unsigned int p{ strips[strips.size() - 2] };
+				const unsigned int q{ strips[strips.size() - 1] };
+				const bool evenTriangle{ ((length - 2) & 1) == 0 };
+
+				unsigned int third;
+				if (!(evenTriangle ? findNext(p, q, third) : findNext(q, p, third)))
+					break;
+				strips.push_back(third);
+			}
+		}
+
+		return strips;
+	}
+
+	// Write the elements into the byte vector as the given type, mapping restarts to the type's fixed restart index
+	template<typename T>
+	static void PackAs(const std::vector<unsigned int>& elements, std::vector<GLubyte>& bytes)
+	{
+		bytes.resize(elements.size() * sizeof(T));
+		T* out{ (T*)bytes.data() };
+		for (size_t i = 0; i < elements.size(); i++)
+			out[i] = elements[i] == KStripRestart ? (T)~T(0) : (T)elements[i];
+	}
+
+	// Pack the elements with the smallest index type, optionally converting them to strips first
+	IndexBufferData BuildIndexBuffer(const std::vector<unsigned int>& triangles, bool convertToStrips, GLenum minimumType)
+	{
+		IndexBufferData data;
+
+		std::vector<unsigned int> strips;
+		if (convertToStrips)
+		{
+			strips = ConvertToStrips(triangles);
+			data.mode = GL_TRIANGLE_STRIP;
+		}
+		const std::vector<unsigned int>& elements{ convertToStrips ? strips : triangles };
+
+		unsigned int maxIndex{ 0 };
+		for (unsigned int e : elements)
+		{
+			if (e != KStripRestart)
+				maxIndex = std::max(maxIndex, e);
+		}
+
+		data.type = SelectIndexType(maxIndex);
+		if (IndexTypeSize(minimumType) > IndexTypeSize(data.type))
+			data.type = minimumType;
+		data.count = (GLuint)elements.size();
+
+		switch (data.type)
+		{
+		case GL_UNSIGNED_BYTE: PackAs<GLubyte>(elements, data.bytes); break;
+		case GL_UNSIGNED_SHORT: PackAs<GLushort>(elements, data.bytes); break;
+		default: PackAs<GLuint>(elements, data.bytes); break;
+		}
+
+		return data;
+	}
+}
@@ -0,0 +1,48 @@
+#pragma once
+// Index buffer packing: smallest index type per mesh and optional triangle strip conversion
+
+#include "ExternalLibraryHeaders.h"
+
+namespace Helpers
+{
+	// Marks the end of a strip in an unpacked element list, replaced by the fixed restart index of the chosen type
+	static constexpr unsigned int KStripRestart{ 0xFFFFFFFF };
+
+	// Size in bytes of one index of the given type
+	inline GLuint IndexTypeSize(GLenum type) { return type == GL_UNSIGNED_BYTE ? 1 : (type == GL_UNSIGNED_SHORT ? 2 : 4); }
+
+	// Packed index data ready to go into a GL_ELEMENT_ARRAY_BUFFER
+	struct IndexBufferData
+	{
+		// GL_UNSIGNED_BYTE, GL_UNSIGNED_SHORT or GL_UNSIGNED_INT
+		GLenum type{ GL_UNSIGNED_INT };
+
+		// GL_TRIANGLES or GL_TRIANGLE_STRIP (restarted using GL_PRIMITIVE_RESTART_FIXED_INDEX)
+		GLenum mode{ GL_TRIANGLES };
+
+		// Number of indices to draw, including any restart indices
+		GLuint count{ 0 };
+
+		// The packed indices
+		std::vector<GLubyte> bytes;
+
+		// Size in bytes of one index
+		GLuint IndexSize() const { return IndexTypeSize(type); }
+
+		// Readable name of the index type and mode e.g. "16 bit strip"
+		std::string ToString() const {
+			return std::to_string(IndexSize() * 8) + " bit " + (mode == GL_TRIANGLE_STRIP ? "strip" : "list");
+		}
+	};
+
+	// Smallest index type able to hold maxIndex. The largest value of each type is reserved
+	// as the primitive restart index as fixed index restart is enabled for every draw.
+	GLenum SelectIndexType(unsigned int maxIndex);
+
+	// Greedily join a CCW triangle list into strips separated by KStripRestart, winding is preserved
+	std::vector<unsigned int> ConvertToStrips(const std::vector<unsigned int>& triangles);
+
+	// Pack the elements with the smallest index type, optionally converting them to strips first
+	// minimumType allows several index ranges (e.g. levels of detail) to share one buffer and type
+	IndexBufferData BuildIndexBuffer(const std::vector<unsigned int>& triangles, bool convertToStrips, GLenum minimumType = GL_UNSIGNED_BYTE);
+}
@@ -0,0 +1,315 @@
+#include "JobSystem.h"
+
+#include <cfloat>
+#include <chrono>
+
+namespace Helpers
+{
+	// Worker threads know their job system and deque
+	static thread_local const JobSystem* tl_jobSystem{ nullptr };
+	static thread_local int tl_dequeIndex{ -1 };
+
+	// Owner only: add at the bottom
+	bool JobSystem::JobDeque::Push(Job* job)
+	{
+		const int64_t bottom{ m_bottom.load(std::memory_order_relaxed) };
+		const int64_t top{ m_top.load(std::memory_order_acquire) };
+		if (bottom - top >= KCapacity)
+			return false;
+
+		m_jobs[bottom & (KCapacity - 1)].store(job, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_release);
+		m_bottom.store(bottom + 1, std::memory_order_relaxed);
+		return true;
+	}
+
+	// Owner only: take from the bottom, racing thieves for the last job
+	JobSystem::Job* JobSystem::JobDeque::Pop()
+	{
+		const int64_t bottom{ m_bottom.load(std::memory_order_relaxed) - 1 };
+		m_bottom.store(bottom, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		int64_t top{ m_top.load(std::memory_order_relaxed) };
+
+		if (top > bottom)
+		{
+			m_bottom.store(bottom + 1, std::memory_order_relaxed);
+			return nullptr;
+		}
+
+		Job* job{ m_jobs[bottom & (KCapacity - 1)].load(std::memory_order_relaxed) };
+		if (top == bottom)
+		{
+			if (!m_top.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+				job = nullptr;
+			m_bottom.store(bottom + 1, std::memory_order_relaxed);
+		}
+		return job;
+	}
+
+	// Any thread: take from the top
+	JobSystem::Job* JobSystem::JobDeque::Steal()
+	{
+		int64_t top{ m_top.load(std::memory_order_acquire) };
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		const int64_t bottom{ m_bottom.load(std::memory_order_acquire) };
+		if (top >= bottom)
+			return nullptr;
+
+		Job* job{ m_jobs[top & (KCapacity - 1)].load(std::memory_order_relaxed) };
+		if (!m_top.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+			return nullptr;
+		return job;
+	}
+
+	// Workers in addition to the creating thread, which becomes the main thread. Default leaves one core per thread.
+	JobSystem::JobSystem(int numWorkers)
+	{
+		if (numWorkers < 0)
+			numWorkers = std::max(1, (int)std::thread::hardware_concurrency()) - 1;
+
+		m_mainThreadId = std::this_thread::get_id();
+		for (int i = 0; i <= numWorkers; i++)
+			m_deques.push_back(std::make_unique<JobDeque>());
+		for (int i = 1; i <= numWorkers; i++)
+			m_workers.emplace_back(&JobSystem::WorkerLoop, this, i);
+	}
+
+	JobSystem::~JobSystem()
+	{
+		m_quit = true;
+		m_wake.notify_all();
+		for (std::thread& worker : m_workers)
+			worker.join();
+
+		// Anything never run is just freed
+		for (auto& deque : m_deques)
+		{
+			while (Job* job = deque->Pop())
+				delete job;
+		}
+		for (Job* job : m_injected)
+			delete job;
+	}
+
+	// Deque owned by the calling thread or -1
+	int JobSystem::ThreadIndex() const
+	{
+		if (tl_jobSystem == this)
+			return tl_dequeIndex;
+		return std::this_thread::get_id() == m_mainThreadId ? 0 : -1;
+	}
+
+	// Queue a job from whichever thread is calling, running it straight away if the deque is full
+	void JobSystem::Push(Job* job)
+	{
+		const int index{ ThreadIndex() };
+		if (index >= 0)
+		{
+			if (!m_deques[index]->Push(job))
+			{
+				if (job->dependency)
+					Wait(*job->dependency);
+				job->function();
+				if (job->counter)
+					job->counter->count.fetch_sub(1, std::memory_order_release);
+				delete job;
+				m_jobsRun++;
+				return;
+			}
+		}
+		else
+		{
+			std::lock_guard<std::mutex> lock(m_injectedMutex);
+			m_injected.push_back(job);
+		}
+
+		if (m_sleeping.load(std::memory_order_relaxed) > 0)
+			m_wake.notify_one();
+	}
+
+	// Queue a function, counter (if given) is incremented now and decremented when it has run
+	void JobSystem::Run(std::function<void()> function, JobCounter* counter, const JobCounter* dependency)
+	{
+		if (counter)
+			counter->count.fetch_add(1, std::memory_order_relaxed);
+
+		Job* job{ new Job };
+		job->function = std::move(function);
+		job->counter = counter;
+		job->dependency = dependency;
+		Push(job);
+	}
+
+	// Own deque first, then jobs from other threads, then steal starting from a different victim each time
+	JobSystem::Job* JobSystem::FindJob(int index)
+	{
+		Job* job{ index >= 0 ? m_deques[index]->Pop() : nullptr };
+
+		if (!job)
+		{
+			std::unique_lock<std::mutex> lock(m_injectedMutex, std::try_to_lock);
+			if (lock.owns_lock() && !m_injected.empty())
+			{
+				job = m_injected.front();
+				m_injected.erase(m_injected.begin());
+			}
+		}
+
+		if (!job)
+		{
+			static thread_local size_t victim{ 0 };
+			for (size_t i = 0; i < m_deques.size() && !job; i++)
+			{
+				victim = (victim + 1) % m_deques.size();
+				if ((int)victim != index)
+					job = m_deques[victim]->Steal();
+			}
+			if (job)
+				m_steals++;
+		}
+
+		return job;
+	}
+
+	// Jobs whose dependency is not done yet are set aside until a ready one is found, then queued again
+	bool JobSystem::RunOneJob()
+	{
+		const int index{ ThreadIndex() };
+
+		std::vector<Job*> notReady;
+		Job* job{ FindJob(index) };
+		while (job && job->dependency && !job->dependency->Done())
+		{
+			notReady.push_back(job);
+			job = FindJob(index);
+		}
+		for (Job* waiting : notReady)
+			Push(waiting);
+
+		if (!job)
+			return false;
+
+		job->function();
+		if (job->counter)
+			job->counter->count.fetch_sub(1, std::memory_order_release);
+		delete job;
+		m_jobsRun++;
+		return true;
+	}
+
+	// Spin on jobs, yielding briefly and then sleeping when there is nothing to do
+	void JobSystem::WorkerLoop(int index)
+	{
+		tl_jobSystem = this;
+		tl_dequeIndex = index;
+
+		int idle{ 0 };
+		while (!m_quit)
+		{
+			if (RunOneJob())
+			{
+				idle = 0;
+				continue;
+			}
+
+			if (++idle < 64)
+			{
+				std::this_thread::yield();
+				continue;
+			}
+
+			// Timed so a missed wake up only costs a millisecond
+			m_sleeping++;
+			{
+				std::unique_lock<std::mutex> lock(m_sleepMutex);
+				m_wake.wait_for(lock, std::chrono::milliseconds(1));
+			}
+			m_sleeping--;
+		}
+
+		tl_jobSystem = nullptr;
+		tl_dequeIndex = -1;
+	}
+
+	// Run other jobs until the counter reaches zero
+	void JobSystem::Wait(const JobCounter& counter)
+	{
+		while (!counter.Done())
+		{
+			if (!RunOneJob())
+				std::this_thread::yield();
+		}
+	}
+
+	// Call function(begin, end) on ranges of at most grainSize items covering [0, count) and wait for them all
+	// The calling thread takes the first range itself
+	void JobSystem::ParallelFor(size_t count, size_t grainSize, const std::function<void(size_t begin, size_t end)>& function)
+	{
+		if (count == 0)
+			return;
+		grainSize = std::max(grainSize, (size_t)1);
+
+		JobCounter counter;
+		for (size_t begin = grainSize; begin < count; begin += grainSize)
+		{
+			const size_t end{ std::min(count, begin + grainSize) };
+			Run([&function, begin, end]() { function(begin, end); }, &counter);
+		}
+		function(0, std::min(count, grainSize));
+		Wait(counter);
+	}
+
+	// Queue a function for the main thread
+	void JobSystem::RunOnMainThread(std::function<void()> function)
+	{
+		std::lock_guard<std::mutex> lock(m_mainThreadMutex);
+		m_mainThreadJobs.push_back(std::move(function));
+	}
+
+	// Main thread only, runs the queued main thread jobs. Returns how many ran.
+	size_t JobSystem::RunMainThreadJobs()
+	{
+		assert(std::this_thread::get_id() == m_mainThreadId);
+
+		std::vector<std::function<void()>> jobs;
+		{
+			std::lock_guard<std::mutex> lock(m_mainThreadMutex);
+			jobs.swap(m_mainThreadJobs);
+		}
+		for (std::function<void()>& job : jobs)
+			job();
+		return jobs.size();
+	}
+
+	// The job system shared by the whole program, created by the main thread on first use
+	JobSystem& GetJobSystem()
+	{
+		static JobSystem jobSystem;
+		return jobSystem;
+	}
+
+	// Run the workload on job systems of 1 to maxThreads threads, keeping the best of a few repeats each
+	std::vector<JobScalingResult> MeasureJobScaling(size_t maxThreads, const std::function<void(JobSystem&)>& workload, int repeats)
+	{
+		std::vector<JobScalingResult> results;
+		for (size_t threads = 1; threads <= maxThreads; threads++)
+		{
+			JobSystem jobSystem((int)threads - 1);
+
+			JobScalingResult result;
+			result.threads = threads;
+			result.milliseconds = FLT_MAX;
+			for (int i = 0; i < std::max(repeats, 1); i++)
+			{
+				const auto start{ std::chrono::high_resolution_clock::now() };
+				workload(jobSystem);
+				result.milliseconds = std::min(result.milliseconds,
+					std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - start).count());
+			}
+			result.speedUp = results.empty() ? 1.0f : results[0].milliseconds / std::max(result.milliseconds, 1e-6f);
+			results.push_back(result);
+		}
+		return results;
+	}
+}
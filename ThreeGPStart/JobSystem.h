@@ -0,0 +1,129 @@
+#pragma once
+// Work stealing job system. Every worker owns a lock free deque it pushes and pops at the bottom
+// while idle workers steal from the top. Jobs signal counters as they finish so callers can wait
+// (helping with work meanwhile) or make other jobs depend on them. GL calls must only be made on the
+// main thread so there is also a queue of jobs that only the main thread runs.
+
+#include "ExternalLibraryHeaders.h"
+
+#include <atomic>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+
+namespace Helpers
+{
+	// Number of jobs still to finish, zero when they are all done
+	struct JobCounter
+	{
+		std::atomic<int> count{ 0 };
+
+		bool Done() const { return count.load(std::memory_order_acquire) == 0; }
+	};
+
+	class JobSystem
+	{
+	private:
+		struct Job
+		{
+			std::function<void()> function;
+			JobCounter* counter{ nullptr };
+			const JobCounter* dependency{ nullptr };
+		};
+
+		// Chase Lev deque with a fixed capacity, only the owning thread may Push and Pop
+		class JobDeque
+		{
+		private:
+			static constexpr int64_t KCapacity{ 4096 };
+
+			std::atomic<int64_t> m_top{ 0 };
+			std::atomic<int64_t> m_bottom{ 0 };
+			std::atomic<Job*> m_jobs[KCapacity];
+		public:
+			// False if full
+			bool Push(Job* job);
+			Job* Pop();
+			Job* Steal();
+		};
+
+		std::vector<std::unique_ptr<JobDeque>> m_deques;	// 0 belongs to the main thread
+		std::vector<std::thread> m_workers;
+		std::thread::id m_mainThreadId;
+		std::atomic<bool> m_quit{ false };
+
+		// Jobs from threads that do not own a deque
+		std::mutex m_injectedMutex;
+		std::vector<Job*> m_injected;
+
+		std::mutex m_mainThreadMutex;
+		std::vector<std::function<void()>> m_mainThreadJobs;
+
+		// Idle workers sleep here
+		std::mutex m_sleepMutex;
+		std::condition_variable m_wake;
+		std::atomic<int> m_sleeping{ 0 };
+
+		std::atomic<size_t> m_jobsRun{ 0 };
+		std::atomic<size_t> m_steals{ 0 };
+
+		// Queue a job from whichever thread is calling
+		void Push(Job* job);
+
+		// Take a job from anywhere, nullptr if there are none
+		Job* FindJob(int index);
+
+		// Find a job that is ready and run it, false if there was nothing ready
+		bool RunOneJob();
+
+		void WorkerLoop(int index);
+	public:
+		// Workers in addition to the creating thread, which becomes the main thread. Default leaves one core per thread.
+		explicit JobSystem(int numWorkers = -1);
+		~JobSystem();
+
+		JobSystem(const JobSystem&) = delete;
+		JobSystem& operator=(const JobSystem&) = delete;
+
+		// Queue a function, counter (if given) is incremented now and decremented when it has run.
+		// A job with a dependency does not start until that counter reaches zero.
+		void Run(std::function<void()> function, JobCounter* counter = nullptr, const JobCounter* dependency = nullptr);
+
+		// Run other jobs until the counter reaches zero
+		void Wait(const JobCounter& counter);
+
+		// Call function(begin, end) on ranges of at most grainSize items covering [0, count) and wait for them all
+		void ParallelFor(size_t count, size_t grainSize, const std::function<void(size_t begin, size_t end)>& function);
+
+		// Queue a function for the main thread, e.g. a GL upload after a worker has loaded the data
+		void RunOnMainThread(std::function<void()> function);
+
+		// Main thread only, runs the queued main thread jobs. Returns how many ran.
+		size_t RunMainThreadJobs();
+
+		// Threads that run jobs, including the main thread
+		size_t NumThreads() const { return m_deques.size(); }
+
+		// Index in [0, NumThreads()) of the calling thread, 0 for the main thread, or -1 if it is not one of ours.
+		// Lets jobs pick per thread data such as allocators.
+		int ThreadIndex() const;
+
+		size_t JobsRun() const { return m_jobsRun; }
+		size_t Steals() const { return m_steals; }
+	};
+
+	// The job system shared by the whole program, created by the main thread on first use
+	JobSystem& GetJobSystem();
+
+	// Time of one workload at a given number of threads
+	struct JobScalingResult
+	{
+		size_t threads{ 0 };
+		float milliseconds{ 0 };
+		float speedUp{ 1 };
+	};
+
+	// Run the workload on job systems of 1 to maxThreads threads, keeping the best of a few repeats each
+	std::vector<JobScalingResult> MeasureJobScaling(size_t maxThreads, const std::function<void(JobSystem&)>& workload, int repeats = 3);
+}
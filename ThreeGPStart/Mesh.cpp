@@ -1,4 +1,5 @@
 #include "Mesh.h"
+#include "Profiler.h"
 //#include <math.h>
 //#define VERBOSE
 
@@ -74,6 +75,7 @@ namespace Helpers
 	// Load a 3D model form a provided file and path, return false on error
 	bool ModelLoader::LoadFromFile(const std::string& objFilename)
 	{
+		PROFILE_CPU("Load model");
 		m_filename = objFilename;
 
 #if defined(VERBOSE)
@@ -116,7 +118,11 @@ namespace Helpers
 		if (objFilename.find(".fbx")!=std::string::npos)
 			importer.SetPropertyFloat(AI_CONFIG_GLOBAL_SCALE_FACTOR_KEY, 0.01f);
 
-		const aiScene* scene = importer.ReadFile(objFilename.c_str(), ppsteps);
+		const aiScene* scene{ nullptr };
+		{
+			PROFILE_CPU("Assimp import");
+			scene = importer.ReadFile(objFilename.c_str(), ppsteps);
+		}
 
 		if (!scene)
 		{
@@ -124,6 +130,7 @@ namespace Helpers
 			return false;
 		}
 
+		PROFILE_CPU("Convert model");
 		return PopulateFromAssimpScene(scene);
 	}
 
@@ -61,6 +61,9 @@ namespace Helpers
 		std::vector<glm::vec3> normals;
 		std::vector<glm::vec2> uvCoords;
 
+		// Optional per vertex colours, not filled by the loader but useful for procedural mesh
+		std::vector<glm::vec3> colours;
+
 		// Elements
 		std::vector<unsigned int> elements;
 
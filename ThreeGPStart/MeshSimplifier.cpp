@@ -0,0 +1,361 @@
+#include "MeshSimplifier.h"
+
+#include <cfloat>
+#include <queue>
+#include <unordered_map>
+
+namespace Helpers
+{
+	// Border edges get a constraint plane at right angles to the surface so silhouettes hold their shape
+	static constexpr double KBorderWeight{ 10.0 };
+
+	// Stop the chain when a level removes less than this fraction of the previous one
+	static constexpr double KMinLodReduction{ 0.15 };
+
+	// Do not bother building levels below this many triangles
+	static constexpr size_t KMinLodTriangles{ 16 };
+
+	// A symmetric 4x4 error quadric stored as its 10 unique values, plus the total weight of the planes summed into it
+	struct Quadric
+	{
+		double a00{ 0 }, a01{ 0 }, a02{ 0 }, a03{ 0 };
+		double a11{ 0 }, a12{ 0 }, a13{ 0 };
+		double a22{ 0 }, a23{ 0 };
+		double a33{ 0 };
+		double weight{ 0 };
+
+		// Add the plane n.p + d = 0 with the given weight
+		void AddPlane(const glm::dvec3& n, double d, double w)
+		{
+			a00 += w * n.x * n.x; a01 += w * n.x * n.y; a02 += w * n.x * n.z; a03 += w * n.x * d;
+			a11 += w * n.y * n.y; a12 += w * n.y * n.z; a13 += w * n.y * d;
+			a22 += w * n.z * n.z; a23 += w * n.z * d;
+			a33 += w * d * d;
+			weight += w;
+		}
+
+		void Add(const Quadric& q)
+		{
+			a00 += q.a00; a01 += q.a01; a02 += q.a02; a03 += q.a03;
+			a11 += q.a11; a12 += q.a12; a13 += q.a13;
+			a22 += q.a22; a23 += q.a23;
+			a33 += q.a33;
+			weight += q.weight;
+		}
+
+		// Weighted sum of squared distances from p to the planes
+		double Evaluate(const glm::dvec3& p) const
+		{
+			const double r{ a00 * p.x * p.x + 2 * a01 * p.x * p.y + 2 * a02 * p.x * p.z + 2 * a03 * p.x
+				+ a11 * p.y * p.y + 2 * a12 * p.y * p.z + 2 * a13 * p.y
+				+ a22 * p.z * p.z + 2 * a23 * p.z
+				+ a33 };
+			return std::max(r, 0.0);
+		}
+	};
+
+	// Candidate half edge collapse, moving from onto to
+	struct Collapse
+	{
+		double cost;
+		unsigned int from;
+		unsigned int to;
+
+		bool operator>(const Collapse& other) const { return cost > other.cost; }
+	};
+
+	// Hash of a position by its exact bits, used to weld vertices that only differ in their attributes
+	struct PositionHash
+	{
+		size_t operator()(const glm::vec3& p) const
+		{
+			unsigned int bits[3];
+			memcpy(bits, &p, sizeof(bits));
+			return ((size_t)bits[0] * 73856093u) ^ ((size_t)bits[1] * 19349663u) ^ ((size_t)bits[2] * 83492791u);
+		}
+	};
+
+	static unsigned long long EdgeKey(unsigned int a, unsigned int b)
+	{
+		if (a > b)
+			std::swap(a, b);
+		return ((unsigned long long)a << 32) | b;
+	}
+
+	// Collapse edges until the target index count or maximum error is reached
+	std::vector<unsigned int> SimplifyMesh(const Mesh& mesh, const std::vector<unsigned int>& elements,
+		size_t targetIndexCount, float maxError, float& resultError)
+	{
+		resultError = 0;
+
+		const size_t numVertices{ mesh.vertices.size() };
+		const size_t numTriangles{ elements.size() / 3 };
+
+		// Weld by position. Every vertex maps to the first vertex sharing its position (its representative)
+		// and a position with more than one vertex (wedge) is on a uv or normal seam.
+		std::vector<unsigned int> remap(numVertices);
+		std::vector<unsigned int> wedgeCount(numVertices, 0);
+		{
+			std::unordered_map<glm::vec3, unsigned int, PositionHash> firstWithPosition;
+			firstWithPosition.reserve(numVertices);
+			for (unsigned int v = 0; v < (unsigned int)numVertices; v++)
+				remap[v] = firstWithPosition.emplace(mesh.vertices[v], v).first->second;
+		}
+		{
+			std::vector<bool> counted(numVertices, false);
+			for (unsigned int e : elements)
+			{
+				if (!counted[e])
+				{
+					counted[e] = true;
+					wedgeCount[remap[e]]++;
+				}
+			}
+		}
+
+		std::vector<unsigned int> triangles(elements);
+		std::vector<bool> deadTriangle(numTriangles, false);
+
+		auto repOf = [&](size_t t, size_t k) { return remap[triangles[t * 3 + k]]; };
+		auto position = [&](unsigned int v) { return glm::dvec3(mesh.vertices[v]); };
+
+		// Triangles around each representative, dead ones are skipped rather than removed
+		std::vector<std::vector<unsigned int>> vertexTriangles(numVertices);
+		for (size_t t = 0; t < numTriangles; t++)
+		{
+			for (size_t k = 0; k < 3; k++)
+				vertexTriangles[repOf(t, k)].push_back((unsigned int)t);
+		}
+
+		// Edges with only one triangle are on an open border
+		std::unordered_map<unsigned long long, unsigned int> edgeUse;
+		edgeUse.reserve(elements.size());
+		for (size_t t = 0; t < numTriangles; t++)
+		{
+			for (size_t k = 0; k < 3; k++)
+				edgeUse[EdgeKey(repOf(t, k), repOf(t, (k + 1) % 3))]++;
+		}
+		auto isBorderEdge = [&](unsigned int a, unsigned int b) {
+			const auto it{ edgeUse.find(EdgeKey(a, b)) };
+			return it != edgeUse.end() && it->second == 1;
+		};
+
+		// Plane quadrics weighted by area, plus border constraint planes
+		std::vector<Quadric> quadrics(numVertices);
+		std::vector<bool> onBorder(numVertices, false);
+		for (size_t t = 0; t < numTriangles; t++)
+		{
+			const unsigned int r[3]{ repOf(t, 0), repOf(t, 1), repOf(t, 2) };
+			const glm::dvec3 p[3]{ position(r[0]), position(r[1]), position(r[2]) };
+
+			glm::dvec3 n{ glm::cross(p[1] - p[0], p[2] - p[0]) };
+			const double length{ glm::length(n) };
+			if (length <= 0.0)
+				continue;
+			n /= length;
+
+			const double area{ length * 0.5 };
+			const double d{ -glm::dot(n, p[0]) };
+			for (size_t k = 0; k < 3; k++)
+				quadrics[r[k]].AddPlane(n, d, area);
+
+			for (size_t k = 0; k < 3; k++)
+			{
+				const unsigned int a{ r[k] };
+				const unsigned int b{ r[(k + 1) % 3] };
+				if (!isBorderEdge(a, b))
+					continue;
+
+				onBorder[a] = onBorder[b] = true;
+
+				const glm::dvec3 edge{ p[(k + 1) % 3] - p[k] };
+				const glm::dvec3 edgeNormal{ glm::normalize(glm::cross(edge, n)) };
+				const double edgeWeight{ glm::dot(edge, edge) * KBorderWeight };
+				quadrics[a].AddPlane(edgeNormal, -glm::dot(edgeNormal, p[k]), edgeWeight);
+				quadrics[b].AddPlane(edgeNormal, -glm::dot(edgeNormal, p[k]), edgeWeight);
+			}
+		}
+
+		// Mean squared distance of the target position from the planes of both ends
+		auto collapseCost = [&](unsigned int from, unsigned int to) {
+			Quadric q{ quadrics[from] };
+			q.Add(quadrics[to]);
+			return q.weight > 0 ? q.Evaluate(position(to)) / q.weight : 0.0;
+		};
+
+		// Seam vertices stay put, border vertices may only slide along their border
+		auto canCollapse = [&](unsigned int from, unsigned int to) {
+			if (wedgeCount[from] > 1)
+				return false;
+			if (onBorder[from])
+				return onBorder[to] && isBorderEdge(from, to);
+			return true;
+		};
+
+		std::priority_queue<Collapse, std::vector<Collapse>, std::greater<Collapse>> queue;
+		auto pushEdge = [&](unsigned int a, unsigned int b) {
+			if (canCollapse(a, b))
+				queue.push(Collapse{ collapseCost(a, b), a, b });
+			if (canCollapse(b, a))
+				queue.push(Collapse{ collapseCost(b, a), b, a });
+		};
+
+		for (size_t t = 0; t < numTriangles; t++)
+		{
+			for (size_t k = 0; k < 3; k++)
+			{
+				const unsigned int a{ repOf(t, k) };
+				const unsigned int b{ repOf(t, (k + 1) % 3) };
+				if (a < b || isBorderEdge(a, b))
+					pushEdge(a, b);
+			}
+		}
+
+		std::vector<bool> removed(numVertices, false);
+		size_t liveIndices{ elements.size() };
+		const double maxErrorSq{ (double)maxError * maxError };
+
+		while (liveIndices > targetIndexCount && !queue.empty())
+		{
+			const Collapse collapse{ queue.top() };
+			queue.pop();
+
+			const unsigned int from{ collapse.from };
+			const unsigned int to{ collapse.to };
+			if (removed[from] || removed[to])
+				continue;
+
+			// Quadrics grow as collapses happen so refresh stale entries rather than acting on them
+			const double cost{ collapseCost(from, to) };
+			if (cost > collapse.cost * 1.0001 + 1e-12)
+			{
+				queue.push(Collapse{ cost, from, to });
+				continue;
+			}
+
+			if (cost > maxErrorSq)
+				break;
+
+			// The wedge of 'to' used on this side of the edge, found in a triangle that will be removed
+			bool adjacent{ false };
+			bool flips{ false };
+			unsigned int toWedge{ to };
+			for (unsigned int t : vertexTriangles[from])
+			{
+				if (deadTriangle[t])
+					continue;
+
+				size_t fromSlot{ 0 };
+				bool hasTo{ false };
+				for (size_t k = 0; k < 3; k++)
+				{
+					if (repOf(t, k) == from)
+						fromSlot = k;
+					if (repOf(t, k) == to)
+					{
+						hasTo = true;
+						toWedge = triangles[t * 3 + k];
+					}
+				}
+
+				if (hasTo)
+				{
+					adjacent = true;
+					continue;
+				}
+
+				// Reject collapses that would flip a remaining triangle over
+				const glm::dvec3 p0{ position(repOf(t, fromSlot)) };
+				const glm::dvec3 p1{ position(repOf(t, (fromSlot + 1) % 3)) };
+				const glm::dvec3 p2{ position(repOf(t, (fromSlot + 2) % 3)) };
+				const glm::dvec3 before{ glm::cross(p1 - p0, p2 - p0) };
+				const glm::dvec3 after{ glm::cross(p1 - position(to), p2 - position(to)) };
+				if (glm::dot(before, after) <= 0.0)
+				{
+					flips = true;
+					break;
+				}
+			}
+
+			if (!adjacent || flips)
+				continue;
+
+			// Apply: triangles on the edge go, the rest move their 'from' corner onto 'to'
+			for (unsigned int t : vertexTriangles[from])
+			{
+				if (deadTriangle[t])
+					continue;
+
+				bool hasTo{ false };
+				for (size_t k = 0; k < 3; k++)
+					hasTo = hasTo || repOf(t, k) == to;
+
+				if (hasTo)
+				{
+					deadTriangle[t] = true;
+					liveIndices -= 3;
+					continue;
+				}
+
+				for (size_t k = 0; k < 3; k++)
+				{
+					if (repOf(t, k) == from)
+						triangles[t * 3 + k] = toWedge;
+				}
+				vertexTriangles[to].push_back(t);
+			}
+
+			removed[from] = true;
+			quadrics[to].Add(quadrics[from]);
+			resultError = std::max(resultError, (float)std::sqrt(cost));
+
+			// Costs around 'to' have changed
+			for (unsigned int t : vertexTriangles[to])
+			{
+				if (deadTriangle[t])
+					continue;
+				for (size_t k = 0; k < 3; k++)
+				{
+					const unsigned int other{ repOf(t, k) };
+					if (other != to)
+						pushEdge(to, other);
+				}
+			}
+		}
+
+		std::vector<unsigned int> result;
+		result.reserve(liveIndices);
+		for (size_t t = 0; t < numTriangles; t++)
+		{
+			if (!deadTriangle[t])
+				result.insert(result.end(), triangles.begin() + t * 3, triangles.begin() + t * 3 + 3);
+		}
+		return result;
+	}
+
+	// Chain starting with the full mesh, each level roughly halving the triangle count
+	std::vector<MeshLod> BuildLodChain(const Mesh& mesh, size_t maxLevels)
+	{
+		std::vector<MeshLod> lods;
+		lods.push_back(MeshLod{ mesh.elements, 0.0f });
+
+		while (lods.size() < maxLevels)
+		{
+			const MeshLod& previous{ lods.back() };
+			const size_t target{ (previous.elements.size() / 6) * 3 };
+			if (target < KMinLodTriangles * 3)
+				break;
+
+			// Each level simplifies the last so the error is relative to it, summing keeps it conservative
+			float error{ 0 };
+			std::vector<unsigned int> elements{ SimplifyMesh(mesh, previous.elements, target, FLT_MAX, error) };
+			if (elements.size() > previous.elements.size() * (1.0 - KMinLodReduction))
+				break;
+
+			const float totalError{ previous.error + error };
+			lods.push_back(MeshLod{ std::move(elements), totalError });
+		}
+
+		return lods;
+	}
+}
@@ -0,0 +1,27 @@
+#pragma once
+// Quadric error metric mesh simplification and level of detail chain generation
+
+#include "ExternalLibraryHeaders.h"
+#include "Mesh.h"
+
+namespace Helpers
+{
+	// One level of detail. Elements reference the vertices of the original mesh so every level
+	// can share one vertex buffer. Error is the geometric deviation from the full mesh in model units.
+	struct MeshLod
+	{
+		std::vector<unsigned int> elements;
+		float error{ 0 };
+	};
+
+	// Collapse edges of the triangle list in elements (which index mesh.vertices) until at most targetIndexCount
+	// indices remain or the next collapse would exceed maxError. Vertices are never moved, an edge collapse moves
+	// one end onto the other, so normals and uvs stay valid. Vertices on uv or normal seams are kept and open
+	// borders only collapse along themselves. resultError receives the largest error of the collapses made.
+	std::vector<unsigned int> SimplifyMesh(const Mesh& mesh, const std::vector<unsigned int>& elements,
+		size_t targetIndexCount, float maxError, float& resultError);
+
+	// Chain of up to maxLevels levels starting with the full mesh, each level roughly halving the triangle count.
+	// Stops early once simplification stalls (e.g. everything left is on a seam).
+	std::vector<MeshLod> BuildLodChain(const Mesh& mesh, size_t maxLevels = 5);
+}
@@ -0,0 +1,285 @@
+#include "Meshlet.h"
+
+#include <cfloat>
+#include <emmintrin.h>
+
+namespace Helpers
+{
+	// The triangles expanded back to mesh vertex indices in meshlet order
+	std::vector<unsigned int> MeshletData::Elements() const
+	{
+		std::vector<unsigned int> elements;
+		elements.reserve(triangles.size());
+		for (const Meshlet& m : meshlets)
+		{
+			for (unsigned int i = 0; i < m.triangleCount * 3; i++)
+				elements.push_back(vertices[m.vertexOffset + triangles[m.triangleOffset * 3 + i]]);
+		}
+		return elements;
+	}
+
+	// Work out the sphere and normal cone of a finished meshlet
+	static void ComputeMeshletBounds(const Mesh& mesh, const MeshletData& data, Meshlet& m)
+	{
+		// Sphere around the centre of the vertex extents
+		glm::vec3 minExtents{ mesh.vertices[data.vertices[m.vertexOffset]] };
+		glm::vec3 maxExtents{ minExtents };
+		for (unsigned int v = 0; v < m.vertexCount; v++)
+		{
+			const glm::vec3& p{ mesh.vertices[data.vertices[m.vertexOffset + v]] };
+			minExtents = glm::min(minExtents, p);
+			maxExtents = glm::max(maxExtents, p);
+		}
+		m.centre = (minExtents + maxExtents) * 0.5f;
+		m.radius = 0;
+		for (unsigned int v = 0; v < m.vertexCount; v++)
+			m.radius = std::max(m.radius, glm::distance(m.centre, mesh.vertices[data.vertices[m.vertexOffset + v]]));
+
+		// Cone axis is the average face normal, its spread the worst face against it
+		std::vector<glm::vec3> normals;
+		std::vector<glm::vec3> corners;
+		glm::vec3 axis{ 0 };
+		for (unsigned int t = 0; t < m.triangleCount; t++)
+		{
+			const unsigned char* tri{ &data.triangles[(m.triangleOffset + t) * 3] };
+			const glm::vec3& p0{ mesh.vertices[data.vertices[m.vertexOffset + tri[0]]] };
+			const glm::vec3& p1{ mesh.vertices[data.vertices[m.vertexOffset + tri[1]]] };
+			const glm::vec3& p2{ mesh.vertices[data.vertices[m.vertexOffset + tri[2]]] };
+
+			const glm::vec3 n{ glm::cross(p1 - p0, p2 - p0) };
+			const float length{ glm::length(n) };
+			if (length <= 0.0f)
+				continue;
+			normals.push_back(n / length);
+			corners.push_back(p0);
+			axis += n / length;
+		}
+
+		m.coneAxis = glm::vec3(0);
+		m.coneApex = m.centre;
+		m.coneCutoff = 1.0f;
+
+		const float axisLength{ glm::length(axis) };
+		if (normals.empty() || axisLength <= 0.0f)
+			return;
+		axis /= axisLength;
+
+		float minDot{ 1.0f };
+		for (const glm::vec3& n : normals)
+			minDot = std::min(minDot, glm::dot(n, axis));
+
+		// Cone wider than a hemisphere can never be back facing as a whole
+		if (minDot <= 0.1f)
+			return;
+
+		// Apex: furthest point back along the axis from the centre that is behind every triangle's plane
+		float maxT{ 0.0f };
+		for (size_t i = 0; i < normals.size(); i++)
+		{
+			const float dc{ glm::dot(m.centre - corners[i], normals[i]) };
+			const float dn{ glm::dot(axis, normals[i]) };
+			maxT = std::max(maxT, dc / dn);
+		}
+
+		m.coneAxis = axis;
+		m.coneApex = m.centre - axis * maxT;
+		m.coneCutoff = std::sqrt(1.0f - minDot * minDot);
+	}
+
+	// Split the triangle list into meshlets, keeping triangles in their original order
+	// The loader runs ASSIMP's cache locality optimisation so neighbouring triangles are already close
+	MeshletData BuildMeshlets(const Mesh& mesh, const std::vector<unsigned int>& elements, size_t maxVertices, size_t maxTriangles)
+	{
+		assert(maxVertices <= 256);
+
+		MeshletData data;
+
+		// Local index of each mesh vertex in the meshlet being built, 0xFF if not in it
+		std::vector<unsigned char> localIndex(mesh.vertices.size(), 0xFF);
+
+		Meshlet current;
+		auto finish = [&]()
+		{
+			if (current.triangleCount == 0)
+				return;
+
+			for (unsigned int v = 0; v < current.vertexCount; v++)
+				localIndex[data.vertices[current.vertexOffset + v]] = 0xFF;
+
+			ComputeMeshletBounds(mesh, data, current);
+			data.meshlets.push_back(current);
+
+			current = Meshlet();
+			current.vertexOffset = (unsigned int)data.vertices.size();
+			current.triangleOffset = (unsigned int)(data.triangles.size() / 3);
+		};
+
+		for (size_t i = 0; i + 2 < elements.size(); i += 3)
+		{
+			unsigned int newVertices{ 0 };
+			for (size_t k = 0; k < 3; k++)
+				newVertices += localIndex[elements[i + k]] == 0xFF ? 1 : 0;
+
+			if (current.vertexCount + newVertices > maxVertices || current.triangleCount + 1 > maxTriangles)
+				finish();
+
+			for (size_t k = 0; k < 3; k++)
+			{
+				const unsigned int v{ elements[i + k] };
+				if (localIndex[v] == 0xFF)
+				{
+					localIndex[v] = (unsigned char)current.vertexCount++;
+					data.vertices.push_back(v);
+				}
+				data.triangles.push_back(localIndex[v]);
+			}
+			current.triangleCount++;
+		}
+		finish();
+
+		return data;
+	}
+
+	// Lay the bounds out as arrays, padding with spheres that every plane rejects
+	void MeshletCullData::Build(const std::vector<Meshlet>& meshlets)
+	{
+		count = meshlets.size();
+		const size_t padded{ (count + 3) & ~(size_t)3 };
+
+		for (std::vector<float>* v : { &centreX, &centreY, &centreZ, &apexX, &apexY, &apexZ, &axisX, &axisY, &axisZ })
+			v->assign(padded, 0.0f);
+		radius.assign(padded, -FLT_MAX);
+		cutoff.assign(padded, 1.0f);
+
+		for (size_t i = 0; i < count; i++)
+		{
+			const Meshlet& m{ meshlets[i] };
+			centreX[i] = m.centre.x; centreY[i] = m.centre.y; centreZ[i] = m.centre.z;
+			radius[i] = m.radius;
+			apexX[i] = m.coneApex.x; apexY[i] = m.coneApex.y; apexZ[i] = m.coneApex.z;
+			axisX[i] = m.coneAxis.x; axisY[i] = m.coneAxis.y; axisZ[i] = m.coneAxis.z;
+			cutoff[i] = m.coneCutoff;
+		}
+	}
+
+	// Gribb / Hartmann plane extraction, glm matrices are column major so rows are read across columns
+	void ExtractFrustumPlanes(const glm::mat4& m, glm::vec4 planes[6])
+	{
+		const glm::vec4 row0{ m[0][0], m[1][0], m[2][0], m[3][0] };
+		const glm::vec4 row1{ m[0][1], m[1][1], m[2][1], m[3][1] };
+		const glm::vec4 row2{ m[0][2], m[1][2], m[2][2], m[3][2] };
+		const glm::vec4 row3{ m[0][3], m[1][3], m[2][3], m[3][3] };
+
+		planes[0] = row3 + row0;	// left
+		planes[1] = row3 - row0;	// right
+		planes[2] = row3 + row1;	// bottom
+		planes[3] = row3 - row1;	// top
+		planes[4] = row3 + row2;	// near
+		planes[5] = row3 - row2;	// far
+
+		for (int i = 0; i < 6; i++)
+			planes[i] /= glm::length(glm::vec3(planes[i]));
+	}
+
+	// Four meshlets per iteration: sphere against the six planes, then the cone test
+	size_t CullMeshlets(const MeshletCullData& data, const glm::vec4 planes[6], const glm::vec3& cameraPosition,
+		bool backfaceCulling, std::vector<unsigned char>& visible)
+	{
+		visible.assign(data.count, 0);
+		size_t numVisible{ 0 };
+
+		const __m128 camX{ _mm_set1_ps(cameraPosition.x) };
+		const __m128 camY{ _mm_set1_ps(cameraPosition.y) };
+		const __m128 camZ{ _mm_set1_ps(cameraPosition.z) };
+
+		for (size_t i = 0; i < data.centreX.size(); i += 4)
+		{
+			const __m128 cx{ _mm_loadu_ps(&data.centreX[i]) };
+			const __m128 cy{ _mm_loadu_ps(&data.centreY[i]) };
+			const __m128 cz{ _mm_loadu_ps(&data.centreZ[i]) };
+			const __m128 negRadius{ _mm_sub_ps(_mm_setzero_ps(), _mm_loadu_ps(&data.radius[i])) };
+
+			__m128 inside{ _mm_castsi128_ps(_mm_set1_epi32(-1)) };
+			for (int p = 0; p < 6; p++)
+			{
+				const __m128 d{ _mm_add_ps(
+					_mm_add_ps(_mm_mul_ps(cx, _mm_set1_ps(planes[p].x)), _mm_mul_ps(cy, _mm_set1_ps(planes[p].y))),
+					_mm_add_ps(_mm_mul_ps(cz, _mm_set1_ps(planes[p].z)), _mm_set1_ps(planes[p].w))) };
+				inside = _mm_and_ps(inside, _mm_cmpgt_ps(d, negRadius));
+			}
+
+			if (backfaceCulling)
+			{
+				// dot(apex - camera, axis) >= cutoff * |apex - camera| means every triangle faces away
+				const __m128 vx{ _mm_sub_ps(_mm_loadu_ps(&data.apexX[i]), camX) };
+				const __m128 vy{ _mm_sub_ps(_mm_loadu_ps(&data.apexY[i]), camY) };
+				const __m128 vz{ _mm_sub_ps(_mm_loadu_ps(&data.apexZ[i]), camZ) };
+				const __m128 length{ _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(vx, vx), _mm_mul_ps(vy, vy)), _mm_mul_ps(vz, vz))) };
+				const __m128 d{ _mm_add_ps(_mm_add_ps(
+					_mm_mul_ps(vx, _mm_loadu_ps(&data.axisX[i])), _mm_mul_ps(vy, _mm_loadu_ps(&data.axisY[i]))),
+					_mm_mul_ps(vz, _mm_loadu_ps(&data.axisZ[i]))) };
+				const __m128 backFacing{ _mm_cmpge_ps(d, _mm_mul_ps(_mm_loadu_ps(&data.cutoff[i]), length)) };
+				inside = _mm_andnot_ps(backFacing, inside);
+			}
+
+			const int mask{ _mm_movemask_ps(inside) };
+			for (size_t k = 0; k < 4 && i + k < data.count; k++)
+			{
+				if (mask & (1 << k))
+				{
+					visible[i + k] = 1;
+					numVisible++;
+				}
+			}
+		}
+
+		return numVisible;
+	}
+
+	// Brute force check that meshlet culling is conservative
+	MeshletValidation ValidateMeshletCulling(const Mesh& mesh, const MeshletData& data, const std::vector<unsigned char>& visible,
+		const glm::vec4 planes[6], const glm::vec3& cameraPosition, bool backfaceCulling)
+	{
+		MeshletValidation result;
+
+		for (size_t m = 0; m < data.meshlets.size(); m++)
+		{
+			const Meshlet& meshlet{ data.meshlets[m] };
+			if (visible[m])
+				result.trianglesEmitted += meshlet.triangleCount;
+
+			for (unsigned int t = 0; t < meshlet.triangleCount; t++)
+			{
+				const unsigned char* tri{ &data.triangles[(meshlet.triangleOffset + t) * 3] };
+				const glm::vec3 p[3]{
+					mesh.vertices[data.vertices[meshlet.vertexOffset + tri[0]]],
+					mesh.vertices[data.vertices[meshlet.vertexOffset + tri[1]]],
+					mesh.vertices[data.vertices[meshlet.vertexOffset + tri[2]]] };
+
+				// Degenerate triangles produce nothing so can be culled either way
+				const glm::vec3 n{ glm::cross(p[1] - p[0], p[2] - p[0]) };
+				if (glm::dot(n, n) <= 0.0f)
+					continue;
+
+				if (backfaceCulling && glm::dot(n, cameraPosition - p[0]) <= 0.0f)
+					continue;
+
+				bool outside{ false };
+				for (int i = 0; i < 6 && !outside; i++)
+				{
+					outside = glm::dot(glm::vec3(planes[i]), p[0]) + planes[i].w < 0.0f &&
+						glm::dot(glm::vec3(planes[i]), p[1]) + planes[i].w < 0.0f &&
+						glm::dot(glm::vec3(planes[i]), p[2]) + planes[i].w < 0.0f;
+				}
+				if (outside)
+					continue;
+
+				result.trianglesVisible++;
+				if (!visible[m])
+					result.trianglesMissing++;
+			}
+		}
+
+		return result;
+	}
+}
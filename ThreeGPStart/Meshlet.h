@@ -0,0 +1,82 @@
+#pragma once
+// Splitting mesh into small clusters (meshlets) that can be culled individually
+
+#include "ExternalLibraryHeaders.h"
+#include "Mesh.h"
+
+namespace Helpers
+{
+	// A cluster of up to 64 vertices and 124 triangles with bounds for culling
+	struct Meshlet
+	{
+		// Ranges in MeshletData::vertices and MeshletData::triangles (3 local indices per triangle)
+		unsigned int vertexOffset{ 0 };
+		unsigned int vertexCount{ 0 };
+		unsigned int triangleOffset{ 0 };
+		unsigned int triangleCount{ 0 };
+
+		// Bounding sphere
+		glm::vec3 centre{ 0 };
+		float radius{ 0 };
+
+		// Normal cone. The whole cluster faces away from a viewer at v when
+		// dot(normalize(coneApex - v), coneAxis) >= coneCutoff. A cutoff of 1 means never back facing.
+		glm::vec3 coneApex{ 0 };
+		glm::vec3 coneAxis{ 0 };
+		float coneCutoff{ 1 };
+	};
+
+	// All the meshlets of a mesh
+	struct MeshletData
+	{
+		std::vector<Meshlet> meshlets;
+
+		// Mesh vertex index of each meshlet vertex
+		std::vector<unsigned int> vertices;
+
+		// Meshlet local vertex indices, 3 per triangle
+		std::vector<unsigned char> triangles;
+
+		// The triangles expanded back to mesh vertex indices in meshlet order,
+		// meshlet m uses elements [meshlets[m].triangleOffset * 3, + triangleCount * 3)
+		std::vector<unsigned int> Elements() const;
+	};
+
+	// Split the triangle list into meshlets, keeping triangles in their original order
+	MeshletData BuildMeshlets(const Mesh& mesh, const std::vector<unsigned int>& elements,
+		size_t maxVertices = 64, size_t maxTriangles = 124);
+
+	// Meshlet bounds laid out for culling four at a time with SSE, padded to a multiple of four
+	struct MeshletCullData
+	{
+		size_t count{ 0 };
+		std::vector<float> centreX, centreY, centreZ, radius;
+		std::vector<float> apexX, apexY, apexZ;
+		std::vector<float> axisX, axisY, axisZ, cutoff;
+
+		void Build(const std::vector<Meshlet>& meshlets);
+	};
+
+	// Extract the six normalised frustum planes (ax + by + cz + d >= 0 inside) from a combined matrix
+	void ExtractFrustumPlanes(const glm::mat4& combined, glm::vec4 planes[6]);
+
+	// Mark each meshlet visible (1) or culled (0) against the frustum planes and, if backfaceCulling, its normal cone.
+	// Planes and the camera position must be in the mesh's model space. Returns the number visible.
+	size_t CullMeshlets(const MeshletCullData& data, const glm::vec4 planes[6], const glm::vec3& cameraPosition,
+		bool backfaceCulling, std::vector<unsigned char>& visible);
+
+	// Result of comparing meshlet culling against culling each triangle on its own
+	struct MeshletValidation
+	{
+		size_t trianglesVisible{ 0 };		// by the brute force test
+		size_t trianglesEmitted{ 0 };		// in visible meshlets
+		size_t trianglesMissing{ 0 };		// visible by brute force but in a culled meshlet, must be 0
+
+		bool Passed() const { return trianglesMissing == 0; }
+	};
+
+	// Brute force check that meshlet culling is conservative: every triangle that is front facing
+	// and not wholly outside a frustum plane must belong to a visible meshlet
+	MeshletValidation ValidateMeshletCulling(const Mesh& mesh, const MeshletData& data, const std::vector<unsigned char>& visible,
+		const glm::vec4 planes[6], const glm::vec3& cameraPosition, bool backfaceCulling);
+}
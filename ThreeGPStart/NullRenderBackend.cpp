@@ -0,0 +1,478 @@
+#include "NullRenderBackend.h"
+#include "Helper.h"
+
+#include <sstream>
+
+namespace Helpers
+{
+	// Names declared with "uniform" in a shader and the files it includes, uniform blocks are skipped as they have no locations
+	static void ReadUniformNames(const std::string& filename, std::vector<std::string>& names, bool& found)
+	{
+		const std::string text{ ShaderSourceFromFile(filename) };
+		found = !text.empty();
+		if (!found)
+			return;
+
+		// Strip the comments
+		std::string code;
+		for (size_t i = 0; i < text.size(); i++)
+		{
+			if (text.compare(i, 2, "//") == 0)
+				i = std::min(text.find('\n', i), text.size()) - 1;
+			else if (text.compare(i, 2, "/*") == 0)
+				i = std::min(text.find("*/", i), text.size() - 2) + 1;
+			else
+				code += text[i];
+		}
+
+		auto isNameChar = [](char c) { return std::isalnum((unsigned char)c) || c == '_'; };
+
+		std::stringstream statements(code);
+		std::string statement;
+		while (std::getline(statements, statement, ';'))
+		{
+			const size_t start{ statement.find("uniform") };
+			if (start == std::string::npos || (start > 0 && isNameChar(statement[start - 1])) || start + 7 >= statement.size() || !std::isspace((unsigned char)statement[start + 7]))
+				continue;
+
+			std::string declaration{ statement.substr(start + 7) };
+			if (declaration.find('{') != std::string::npos)
+				continue;
+			declaration = declaration.substr(0, declaration.find('['));
+
+			size_t end{ declaration.size() };
+			while (end > 0 && !isNameChar(declaration[end - 1]))
+				end--;
+			size_t begin{ end };
+			while (begin > 0 && isNameChar(declaration[begin - 1]))
+				begin--;
+
+			const std::string name{ declaration.substr(begin, end - begin) };
+			if (!name.empty() && std::find(names.begin(), names.end(), name) == names.end())
+				names.push_back(name);
+		}
+	}
+
+	void NullRenderBackend::Error(const std::string& message)
+	{
+		m_stats.validationErrors++;
+		if (m_errorsReported++ < KMaxReportedErrors)
+			std::cout << "Null backend error: " << message << std::endl;
+	}
+
+	// Reads the shader files for their uniform declarations, which become locations 0, 1, 2...
+	GLuint NullRenderBackend::CreateProgram(const std::string& vertexPath, const std::string& fragmentPath)
+	{
+		std::vector<std::string> uniforms;
+		for (const std::string& path : { vertexPath, fragmentPath })
+		{
+			bool found{ false };
+			ReadUniformNames(path, uniforms, found);
+			if (!found)
+			{
+				std::cout << "Null backend: could not open shader " << path << std::endl;
+				return 0;
+			}
+		}
+
+		const GLuint program{ m_nextHandle++ };
+		m_programs[program] = uniforms;
+		return program;
+	}
+
+	void NullRenderBackend::DeleteProgram(GLuint program)
+	{
+		if (program && !m_programs.erase(program))
+			Error("deleting unknown program " + std::to_string(program));
+	}
+
+	GLint NullRenderBackend::GetUniformLocation(GLuint program, const std::string& name) const
+	{
+		const auto it{ m_programs.find(program) };
+		if (it == m_programs.end())
+			return -1;
+		const auto found{ std::find(it->second.begin(), it->second.end(), name) };
+		return found == it->second.end() ? -1 : (GLint)(found - it->second.begin());
+	}
+
+	GLuint NullRenderBackend::CreateBuffer(GLenum, const void*, size_t size, GLenum usage)
+	{
+		const GLuint buffer{ m_nextHandle++ };
+		m_buffers[buffer] = size;
+		if (usage == GL_STATIC_DRAW)
+			m_immutableBuffers.insert(buffer);
+		return buffer;
+	}
+
+	void NullRenderBackend::DeleteBuffer(GLuint buffer)
+	{
+		if (buffer && !m_buffers.erase(buffer))
+			Error("deleting unknown buffer " + std::to_string(buffer));
+		m_immutableBuffers.erase(buffer);
+		m_persistentMemory.erase(buffer);
+	}
+
+	// Mapped memory is plain host memory
+	GLuint NullRenderBackend::CreatePersistentBuffer(size_t size, void*& mapped)
+	{
+		const GLuint buffer{ CreateBuffer(GL_COPY_WRITE_BUFFER, nullptr, size, 0) };
+		m_immutableBuffers.insert(buffer);
+		m_persistentMemory[buffer] = std::make_unique<GLubyte[]>(size);
+		mapped = m_persistentMemory[buffer].get();
+		return buffer;
+	}
+
+	GLuint NullRenderBackend::CreateReadbackBuffer(size_t size, const void*& mapped)
+	{
+		void* memory{ nullptr };
+		const GLuint buffer{ CreatePersistentBuffer(size, memory) };
+		memset(memory, 0, size);
+		mapped = memory;
+		return buffer;
+	}
+
+	GLuint NullRenderBackend::CreateVertexArray(GLuint vertexBuffer, GLsizei stride, const std::vector<VertexAttribute>& attributes, GLuint elementBuffer)
+	{
+		if (!m_buffers.count(vertexBuffer))
+			Error("vertex array made with unknown vertex buffer " + std::to_string(vertexBuffer));
+		if (elementBuffer && !m_buffers.count(elementBuffer))
+			Error("vertex array made with unknown element buffer " + std::to_string(elementBuffer));
+		for (const VertexAttribute& attribute : attributes)
+		{
+			if (attribute.offset >= (size_t)stride || attribute.components < 1 || attribute.components > 4)
+				Error("bad vertex attribute at location " + std::to_string(attribute.location));
+		}
+
+		const GLuint vertexArray{ m_nextHandle++ };
+		m_vertexArrays.insert(vertexArray);
+		return vertexArray;
+	}
+
+	void NullRenderBackend::DeleteVertexArray(GLuint vertexArray)
+	{
+		if (vertexArray && !m_vertexArrays.erase(vertexArray))
+			Error("deleting unknown vertex array " + std::to_string(vertexArray));
+	}
+
+	GLuint NullRenderBackend::CreateTexture2D(GLsizei width, GLsizei height, const void* rgba, GLint)
+	{
+		if (width <= 0 || height <= 0 || !rgba)
+			Error("texture made without an image");
+
+		const GLuint texture{ m_nextHandle++ };
+		m_textures.insert(texture);
+		m_texture2DSizes[texture] = glm::ivec2(width, height);
+		return texture;
+	}
+
+	void NullRenderBackend::DeleteTexture(GLuint texture)
+	{
+		if (texture && !m_textures.erase(texture))
+			Error("deleting unknown texture " + std::to_string(texture));
+		m_textureArrays.erase(texture);
+		m_texture2DSizes.erase(texture);
+	}
+
+	void NullRenderBackend::UpdateTexture2D(GLuint texture, GLint level, GLint x, GLint y, GLsizei width, GLsizei height, const void* rgba)
+	{
+		const auto size{ m_texture2DSizes.find(texture) };
+		if (size == m_texture2DSizes.end())
+		{
+			Error("updating unknown 2D texture " + std::to_string(texture));
+			return;
+		}
+
+		if (level < 0 || level > 31 || (std::max(size->second.x, size->second.y) >> level) == 0)
+		{
+			Error("texture " + std::to_string(texture) + " has no level " + std::to_string(level));
+			return;
+		}
+
+		const glm::ivec2 levelSize{ std::max(size->second.x >> level, 1), std::max(size->second.y >> level, 1) };
+		if (!rgba)
+			Error("texture " + std::to_string(texture) + " updated without pixels");
+		else if (x < 0 || y < 0 || width <= 0 || height <= 0 || x + width > levelSize.x || y + height > levelSize.y)
+			Error("texture " + std::to_string(texture) + " updated outside level " + std::to_string(level));
+	}
+
+	GLuint NullRenderBackend::CreateTextureArray(GLsizei width, GLsizei height, GLsizei layers, const void* rgba, GLint)
+	{
+		if (width <= 0 || height <= 0 || layers <= 0 || !rgba)
+			Error("texture array made without images");
+
+		const GLuint texture{ m_nextHandle++ };
+		m_textures.insert(texture);
+		m_textureArrays.insert(texture);
+		return texture;
+	}
+
+	GLuint NullRenderBackend::CreateRenderTarget(GLsizei width, GLsizei height, GLenum)
+	{
+		if (width <= 0 || height <= 0)
+			Error("render target of no size");
+
+		const GLuint texture{ m_nextHandle++ };
+		m_textures.insert(texture);
+		return texture;
+	}
+
+	GLuint NullRenderBackend::CreateFramebuffer(const std::vector<GLuint>& colourTargets, GLuint depthTarget)
+	{
+		for (GLuint target : colourTargets)
+		{
+			if (!m_textures.count(target))
+				Error("framebuffer made with unknown colour target " + std::to_string(target));
+		}
+		if (depthTarget && !m_textures.count(depthTarget))
+			Error("framebuffer made with unknown depth target " + std::to_string(depthTarget));
+
+		const GLuint framebuffer{ m_nextHandle++ };
+		m_framebuffers.insert(framebuffer);
+		return framebuffer;
+	}
+
+	void NullRenderBackend::DeleteFramebuffer(GLuint framebuffer)
+	{
+		if (framebuffer && !m_framebuffers.erase(framebuffer))
+			Error("deleting unknown framebuffer " + std::to_string(framebuffer));
+	}
+
+	GLuint NullRenderBackend::CreateQuery()
+	{
+		const GLuint query{ m_nextHandle++ };
+		m_queries.insert(query);
+		return query;
+	}
+
+	void NullRenderBackend::DeleteQuery(GLuint query)
+	{
+		if (query && !m_queries.erase(query))
+			Error("deleting unknown query " + std::to_string(query));
+		m_timestamps.erase(query);
+	}
+
+	// Queries are always ready and always report samples passed
+	bool NullRenderBackend::GetQueryResult(GLuint query, GLuint& result)
+	{
+		if (!m_queries.count(query))
+			Error("reading unknown query " + std::to_string(query));
+		result = 1;
+		return true;
+	}
+
+	// Timestamps are the CPU time the command was executed
+	bool NullRenderBackend::GetTimestamp(GLuint query, GLuint64& nanoseconds)
+	{
+		const auto it{ m_timestamps.find(query) };
+		if (it == m_timestamps.end())
+		{
+			Error("reading timestamp " + std::to_string(query) + " that was never written");
+			return false;
+		}
+		nanoseconds = it->second;
+		return true;
+	}
+
+	// Fences are signalled as soon as they are made, the handle is just a unique non null value
+	GLsync NullRenderBackend::InsertFence()
+	{
+		const GLsync fence{ reinterpret_cast<GLsync>((uintptr_t)m_nextHandle++) };
+		m_fences.insert(fence);
+		return fence;
+	}
+
+	void NullRenderBackend::WaitFence(GLsync fence)
+	{
+		if (!m_fences.count(fence))
+			Error("waiting on unknown fence");
+	}
+
+	void NullRenderBackend::DeleteFence(GLsync fence)
+	{
+		if (fence && !m_fences.erase(fence))
+			Error("deleting unknown fence");
+	}
+
+	// Check each command against the resources and bindings and count it
+	void NullRenderBackend::Execute(const CommandList& list)
+	{
+		m_stats.commandLists++;
+		for (const Command* command = list.First(); command; command = command->next)
+		{
+			CountCommand(*command);
+			switch (command->type)
+			{
+			case CommandType::SetState:
+			{
+				const RenderState& state{ static_cast<const SetStateCommand*>(command)->state };
+				if (state.clipDistances > RenderState::KMaxClipDistances)
+					Error("state enables " + std::to_string(state.clipDistances) + " clip distances");
+				if (state.scissor.z < 0 || state.scissor.w < 0 || (state.scissor.z > 0 && state.scissor.w == 0))
+					Error("scissor rectangle of negative or no size");
+				break;
+			}
+			case CommandType::BindProgram:
+			{
+				const GLuint program{ static_cast<const BindProgramCommand*>(command)->program };
+				if (program && !m_programs.count(program))
+					Error("binding unknown program " + std::to_string(program));
+				m_boundProgram = program;
+				break;
+			}
+			case CommandType::SetUniform:
+			{
+				const GLint location{ static_cast<const SetUniformCommand*>(command)->location };
+				const auto program{ m_programs.find(m_boundProgram) };
+				if (program == m_programs.end())
+					Error("uniform set with no program bound");
+				else if (location >= (GLint)program->second.size())
+					Error("uniform location " + std::to_string(location) + " not in program " + std::to_string(m_boundProgram));
+				break;
+			}
+			case CommandType::BindTexture:
+			{
+				const BindTextureCommand* bind{ static_cast<const BindTextureCommand*>(command) };
+				if (bind->texture && !m_textures.count(bind->texture))
+					Error("binding unknown texture " + std::to_string(bind->texture));
+				else if (bind->texture && (bind->target == GL_TEXTURE_2D_ARRAY) != (m_textureArrays.count(bind->texture) != 0))
+					Error("binding texture " + std::to_string(bind->texture) + " to the wrong target");
+				break;
+			}
+			case CommandType::BindVertexArray:
+			{
+				const GLuint vertexArray{ static_cast<const BindVertexArrayCommand*>(command)->vao };
+				if (vertexArray && !m_vertexArrays.count(vertexArray))
+					Error("binding unknown vertex array " + std::to_string(vertexArray));
+				m_boundVertexArray = vertexArray;
+				break;
+			}
+			case CommandType::DrawElements:
+			{
+				const DrawElementsCommand* draw{ static_cast<const DrawElementsCommand*>(command) };
+				if (!m_boundProgram || !m_boundVertexArray)
+					Error("draw without a program and vertex array bound");
+				if (draw->count <= 0)
+					Error("draw of no elements");
+				break;
+			}
+			case CommandType::MultiDrawElementsIndirect:
+			{
+				const MultiDrawElementsIndirectCommand* draw{ static_cast<const MultiDrawElementsIndirectCommand*>(command) };
+				if (!m_boundProgram || !m_boundVertexArray)
+					Error("indirect draw without a program and vertex array bound");
+				const auto buffer{ m_buffers.find(draw->buffer) };
+				if (buffer == m_buffers.end())
+					Error("indirect draw from unknown buffer " + std::to_string(draw->buffer));
+				else if (buffer->second < draw->offset + (size_t)draw->drawCount * 5 * sizeof(GLuint))
+					Error("indirect draw reads past the end of buffer " + std::to_string(draw->buffer));
+				break;
+			}
+			case CommandType::UpdateBuffer:
+			{
+				const UpdateBufferCommand* update{ static_cast<const UpdateBufferCommand*>(command) };
+				const auto buffer{ m_buffers.find(update->buffer) };
+				if (buffer == m_buffers.end())
+					Error("updating unknown buffer " + std::to_string(update->buffer));
+				else if (m_immutableBuffers.count(update->buffer))
+					Error("updating immutable buffer " + std::to_string(update->buffer));
+				else
+					buffer->second = (size_t)update->size;
+				break;
+			}
+			case CommandType::BindBufferRange:
+			{
+				const BindBufferRangeCommand* bind{ static_cast<const BindBufferRangeCommand*>(command) };
+				const auto buffer{ m_buffers.find(bind->buffer) };
+				if (buffer == m_buffers.end())
+					Error("binding range of unknown buffer " + std::to_string(bind->buffer));
+				else if (bind->offset + bind->size > buffer->second || bind->size == 0)
+					Error("bound range is outside buffer " + std::to_string(bind->buffer));
+				if (bind->target == GL_UNIFORM_BUFFER && bind->offset % GetUniformBufferAlignment() != 0)
+					Error("uniform buffer range is not aligned");
+				if (bind->target == GL_SHADER_STORAGE_BUFFER && bind->offset % GetStorageBufferAlignment() != 0)
+					Error("shader storage buffer range is not aligned");
+				break;
+			}
+			case CommandType::BindFramebuffer:
+			{
+				const BindFramebufferCommand* bind{ static_cast<const BindFramebufferCommand*>(command) };
+				for (GLuint framebuffer : { bind->drawFramebuffer, bind->readFramebuffer })
+				{
+					if (framebuffer && !m_framebuffers.count(framebuffer))
+						Error("binding unknown framebuffer " + std::to_string(framebuffer));
+				}
+				if (bind->viewport.z <= 0 || bind->viewport.w <= 0)
+					Error("framebuffer bound with an empty viewport");
+				break;
+			}
+			case CommandType::BlitFramebuffer:
+			{
+				const BlitFramebufferCommand* blit{ static_cast<const BlitFramebufferCommand*>(command) };
+				if ((blit->mask & (GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT)) && blit->filter != GL_NEAREST)
+					Error("depth or stencil blit must use nearest filtering");
+				break;
+			}
+			case CommandType::Barrier:
+				if (!static_cast<const BarrierCommand*>(command)->barriers)
+					Error("memory barrier with no barrier bits");
+				break;
+			case CommandType::BeginQuery:
+			{
+				const QueryCommand* query{ static_cast<const QueryCommand*>(command) };
+				if (!m_queries.count(query->query))
+					Error("beginning unknown query " + std::to_string(query->query));
+				if (m_activeQueries[query->target])
+					Error("query begun while another of its type is active");
+				m_activeQueries[query->target] = query->query;
+				break;
+			}
+			case CommandType::EndQuery:
+			{
+				const QueryCommand* query{ static_cast<const QueryCommand*>(command) };
+				if (!m_activeQueries[query->target])
+					Error("ending a query that was not begun");
+				m_activeQueries[query->target] = 0;
+				break;
+			}
+			case CommandType::BeginConditionalRender:
+			{
+				const QueryCommand* query{ static_cast<const QueryCommand*>(command) };
+				if (!m_queries.count(query->query))
+					Error("conditional render on unknown query " + std::to_string(query->query));
+				if (m_conditionalRender)
+					Error("conditional render begun twice");
+				m_conditionalRender = true;
+				break;
+			}
+			case CommandType::EndConditionalRender:
+				if (!m_conditionalRender)
+					Error("ending a conditional render that was not begun");
+				m_conditionalRender = false;
+				break;
+			case CommandType::Timestamp:
+			{
+				const GLuint query{ static_cast<const QueryCommand*>(command)->query };
+				if (!m_queries.count(query))
+					Error("timestamp into unknown query " + std::to_string(query));
+				m_timestamps[query] = (GLuint64)(glfwGetTime() * 1e9);
+				break;
+			}
+			case CommandType::ReadPixels:
+			{
+				const ReadPixelsCommand* read{ static_cast<const ReadPixelsCommand*>(command) };
+				const auto buffer{ m_buffers.find(read->buffer) };
+				if (buffer == m_buffers.end())
+					Error("reading pixels into unknown buffer " + std::to_string(read->buffer));
+				else if (read->rect.z <= 0 || read->rect.w <= 0 || read->offset + (size_t)read->rect.z * (size_t)read->rect.w * 4 > buffer->second)
+					Error("pixels read past the end of buffer " + std::to_string(read->buffer));
+				break;
+			}
+			default:
+				break;
+			}
+		}
+
+		// As the GL backend leaves it
+		m_boundVertexArray = 0;
+	}
+}
@@ -0,0 +1,99 @@
+#pragma once
+// Render backend that makes no GL calls. Resources are just names, command lists are checked
+// (live handles, a program and VAO bound for draws, uniform locations, balanced queries) and
+// counted, so the renderer's CPU work can be run and timed with no GPU or window.
+
+#include "RenderBackend.h"
+
+#include <unordered_map>
+#include <unordered_set>
+
+namespace Helpers
+{
+	class NullRenderBackend : public RenderBackend
+	{
+	private:
+		// Only this many validation errors are written to the output
+		static constexpr size_t KMaxReportedErrors{ 20 };
+
+		glm::ivec4 m_viewport;
+		GLuint m_nextHandle{ 1 };
+		size_t m_errorsReported{ 0 };
+
+		// Live resources, programs hold their uniform names in location order and buffers their size
+		std::unordered_map<GLuint, std::vector<std::string>> m_programs;
+		std::unordered_map<GLuint, size_t> m_buffers;
+		std::unordered_set<GLuint> m_immutableBuffers;	// static and persistent, UpdateBuffer cannot replace them
+		std::unordered_map<GLuint, std::unique_ptr<GLubyte[]>> m_persistentMemory;
+		std::unordered_set<GLsync> m_fences;
+		std::unordered_set<GLuint> m_vertexArrays;
+		std::unordered_set<GLuint> m_textures;
+		std::unordered_set<GLuint> m_textureArrays;	// also in m_textures, must be bound as GL_TEXTURE_2D_ARRAY
+		std::unordered_map<GLuint, glm::ivec2> m_texture2DSizes;	// made by CreateTexture2D, which UpdateTexture2D may change
+		std::unordered_set<GLuint> m_framebuffers;
+		std::unordered_set<GLuint> m_queries;
+
+		// Bindings carried from one command list to the next
+		GLuint m_boundProgram{ 0 };
+		GLuint m_boundVertexArray{ 0 };
+		std::unordered_map<GLenum, GLuint> m_activeQueries;
+		std::unordered_map<GLuint, GLuint64> m_timestamps;
+		bool m_conditionalRender{ false };
+
+		void Error(const std::string& message);
+	public:
+		explicit NullRenderBackend(int width = 1280, int height = 720) : m_viewport(0, 0, width, height) {}
+
+		const char* Name() const override { return "Null"; }
+
+		// Reads the shader files for their uniform declarations, which become locations 0, 1, 2...
+		GLuint CreateProgram(const std::string& vertexPath, const std::string& fragmentPath) override;
+		void DeleteProgram(GLuint program) override;
+		GLint GetUniformLocation(GLuint program, const std::string& name) const override;
+
+		GLuint CreateBuffer(GLenum target, const void* data, size_t size, GLenum usage) override;
+		void DeleteBuffer(GLuint buffer) override;
+
+		// Mapped memory is plain host memory
+		GLuint CreatePersistentBuffer(size_t size, void*& mapped) override;
+
+		// Never written, ReadPixels only checks it lands inside the buffer so readers see zeros
+		GLuint CreateReadbackBuffer(size_t size, const void*& mapped) override;
+		size_t GetUniformBufferAlignment() const override { return 256; }
+		size_t GetStorageBufferAlignment() const override { return 256; }
+
+		GLuint CreateVertexArray(GLuint vertexBuffer, GLsizei stride, const std::vector<VertexAttribute>& attributes, GLuint elementBuffer) override;
+		void DeleteVertexArray(GLuint vertexArray) override;
+
+		GLuint CreateTexture2D(GLsizei width, GLsizei height, const void* rgba, GLint wrap) override;
+		void DeleteTexture(GLuint texture) override;
+		void UpdateTexture2D(GLuint texture, GLint level, GLint x, GLint y, GLsizei width, GLsizei height, const void* rgba) override;
+		GLuint CreateTextureArray(GLsizei width, GLsizei height, GLsizei layers, const void* rgba, GLint wrap) override;
+
+		GLuint CreateRenderTarget(GLsizei width, GLsizei height, GLenum format) override;
+		GLuint CreateFramebuffer(const std::vector<GLuint>& colourTargets, GLuint depthTarget) override;
+		void DeleteFramebuffer(GLuint framebuffer) override;
+
+		// Queries are always ready and always report samples passed
+		GLuint CreateQuery() override;
+		void DeleteQuery(GLuint query) override;
+		bool GetQueryResult(GLuint query, GLuint& result) override;
+
+		// Timestamps are the CPU time the command was executed
+		bool GetTimestamp(GLuint query, GLuint64& nanoseconds) override;
+		GLuint64 GetGpuTime() override { return (GLuint64)(glfwGetTime() * 1e9); }
+
+		// Fences are signalled as soon as they are made
+		GLsync InsertFence() override;
+		void WaitFence(GLsync fence) override;
+		void DeleteFence(GLsync fence) override;
+
+		glm::ivec4 GetViewport() const override { return m_viewport; }
+
+		void Execute(const CommandList& list) override;
+		void Finish() override {}
+
+		// Resources created and not deleted, for leak checks
+		size_t LiveResources() const { return m_programs.size() + m_buffers.size() + m_vertexArrays.size() + m_textures.size() + m_framebuffers.size() + m_queries.size() + m_fences.size(); }
+	};
+}
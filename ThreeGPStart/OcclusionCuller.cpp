@@ -0,0 +1,276 @@
+#include "OcclusionCuller.h"
+
+#include <cfloat>
+#include <chrono>
+#include <emmintrin.h>
+
+namespace Helpers
+{
+	static float MillisecondsSince(const std::chrono::high_resolution_clock::time_point& start)
+	{
+		return std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+	}
+
+	// Width is rounded up to a multiple of 4 for the SIMD rasteriser
+	OcclusionCuller::OcclusionCuller(int width, int height, JobSystem* jobSystem)
+	{
+		m_width = (std::max(width, 4) + 3) & ~3;
+		m_height = std::max(height, 1);
+		m_jobSystem = jobSystem ? jobSystem : &GetJobSystem();
+
+		glm::ivec2 size{ m_width, m_height };
+		for (;;)
+		{
+			m_levelSizes.push_back(size);
+			m_levels.push_back(std::vector<float>((size_t)size.x * size.y, 1.0f));
+			if (size.x == 1 && size.y == 1)
+				break;
+			size = glm::max((size + 1) / 2, glm::ivec2(1));
+		}
+	}
+
+	// Start a frame, clearing the occluders and depth
+	void OcclusionCuller::BeginFrame(const glm::mat4& viewProjection)
+	{
+		m_viewProjection = viewProjection;
+		m_triangles.clear();
+		m_stats = OcclusionStats();
+	}
+
+	// Sutherland Hodgman against z >= -w, which leaves a triangle or a quad
+	void OcclusionCuller::AddClippedTriangle(const glm::vec4& a, const glm::vec4& b, const glm::vec4& c)
+	{
+		const glm::vec4 in[3]{ a, b, c };
+		glm::vec4 out[4];
+		int numOut{ 0 };
+
+		for (int i = 0; i < 3; i++)
+		{
+			const glm::vec4& p{ in[i] };
+			const glm::vec4& q{ in[(i + 1) % 3] };
+			const float dp{ p.z + p.w };
+			const float dq{ q.z + q.w };
+
+			if (dp >= 0.0f)
+				out[numOut++] = p;
+			if ((dp >= 0.0f) != (dq >= 0.0f))
+				out[numOut++] = p + (q - p) * (dp / (dp - dq));
+		}
+
+		auto toScreen = [&](const glm::vec4& p)
+		{
+			const glm::vec3 ndc{ glm::vec3(p) / p.w };
+			return glm::vec3((ndc.x * 0.5f + 0.5f) * m_width, (ndc.y * 0.5f + 0.5f) * m_height, ndc.z * 0.5f + 0.5f);
+		};
+
+		for (int i = 1; i + 1 < numOut; i++)
+		{
+			ScreenTriangle tri;
+			tri.v[0] = toScreen(out[0]);
+			tri.v[1] = toScreen(out[i]);
+			tri.v[2] = toScreen(out[i + 1]);
+
+			// Counter clockwise is front facing as in OpenGL
+			const float area{ (tri.v[1].x - tri.v[0].x) * (tri.v[2].y - tri.v[0].y) - (tri.v[2].x - tri.v[0].x) * (tri.v[1].y - tri.v[0].y) };
+			if (area > 0.0f)
+				m_triangles.push_back(tri);
+		}
+	}
+
+	// Transform and clip a triangle list occluder, back facing triangles are skipped
+	void OcclusionCuller::AddOccluder(const std::vector<glm::vec3>& vertices, const std::vector<unsigned int>& elements, const glm::mat4& model_xform)
+	{
+		const auto start{ std::chrono::high_resolution_clock::now() };
+
+		const glm::mat4 xform{ m_viewProjection * model_xform };
+		std::vector<glm::vec4> clip(vertices.size());
+		for (size_t i = 0; i < vertices.size(); i++)
+			clip[i] = xform * glm::vec4(vertices[i], 1.0f);
+
+		for (size_t i = 0; i + 2 < elements.size(); i += 3)
+		{
+			const glm::vec4& a{ clip[elements[i]] };
+			const glm::vec4& b{ clip[elements[i + 1]] };
+			const glm::vec4& c{ clip[elements[i + 2]] };
+
+			// Trivially outside one of the side or far planes
+			if ((a.x > a.w && b.x > b.w && c.x > c.w) || (a.x < -a.w && b.x < -b.w && c.x < -c.w) ||
+				(a.y > a.w && b.y > b.w && c.y > c.w) || (a.y < -a.w && b.y < -b.w && c.y < -c.w) ||
+				(a.z > a.w && b.z > b.w && c.z > c.w))
+				continue;
+
+			AddClippedTriangle(a, b, c);
+		}
+
+		m_stats.occluderTriangles = m_triangles.size();
+		m_stats.transformMilliseconds += MillisecondsSince(start);
+	}
+
+	// Half space rasteriser, four pixels at a time. Edge functions and depth are planes in screen space
+	// evaluated at pixel centres, depth keeps the nearest value.
+	void OcclusionCuller::RasteriseBand(int firstRow, int endRow)
+	{
+		std::vector<float>& depth{ m_levels[0] };
+		const __m128 offsets{ _mm_set_ps(3.0f, 2.0f, 1.0f, 0.0f) };
+
+		for (const ScreenTriangle& tri : m_triangles)
+		{
+			const glm::vec3& v0{ tri.v[0] };
+			const glm::vec3& v1{ tri.v[1] };
+			const glm::vec3& v2{ tri.v[2] };
+
+			const int minY{ std::max(firstRow, (int)std::floor(std::min(v0.y, std::min(v1.y, v2.y)))) };
+			const int maxY{ std::min(endRow - 1, (int)std::ceil(std::max(v0.y, std::max(v1.y, v2.y)))) };
+			if (minY > maxY)
+				continue;
+			const int minX{ std::max(0, (int)std::floor(std::min(v0.x, std::min(v1.x, v2.x)))) & ~3 };
+			const int maxX{ std::min(m_width - 1, (int)std::ceil(std::max(v0.x, std::max(v1.x, v2.x)))) };
+			if (minX > maxX)
+				continue;
+
+			// Edge i is opposite vertex i, positive inside a counter clockwise triangle
+			const glm::vec3* v[3]{ &v0, &v1, &v2 };
+			float A[3], B[3], C[3];
+			for (int e = 0; e < 3; e++)
+			{
+				const glm::vec3& p{ *v[(e + 1) % 3] };
+				const glm::vec3& q{ *v[(e + 2) % 3] };
+				A[e] = -(q.y - p.y);
+				B[e] = q.x - p.x;
+				C[e] = -(A[e] * p.x + B[e] * p.y);
+			}
+			const float area{ A[0] * v0.x + B[0] * v0.y + C[0] };
+			if (area <= 0.0f)
+				continue;
+
+			const float zA{ (A[0] * v0.z + A[1] * v1.z + A[2] * v2.z) / area };
+			const float zB{ (B[0] * v0.z + B[1] * v1.z + B[2] * v2.z) / area };
+			const float zC{ (C[0] * v0.z + C[1] * v1.z + C[2] * v2.z) / area };
+
+			const __m128 stepE0{ _mm_set1_ps(A[0] * 4.0f) };
+			const __m128 stepE1{ _mm_set1_ps(A[1] * 4.0f) };
+			const __m128 stepE2{ _mm_set1_ps(A[2] * 4.0f) };
+			const __m128 stepZ{ _mm_set1_ps(zA * 4.0f) };
+			const __m128 startX{ _mm_add_ps(_mm_set1_ps(minX + 0.5f), offsets) };
+
+			for (int y = minY; y <= maxY; y++)
+			{
+				const float py{ y + 0.5f };
+				__m128 e0{ _mm_add_ps(_mm_mul_ps(_mm_set1_ps(A[0]), startX), _mm_set1_ps(B[0] * py + C[0])) };
+				__m128 e1{ _mm_add_ps(_mm_mul_ps(_mm_set1_ps(A[1]), startX), _mm_set1_ps(B[1] * py + C[1])) };
+				__m128 e2{ _mm_add_ps(_mm_mul_ps(_mm_set1_ps(A[2]), startX), _mm_set1_ps(B[2] * py + C[2])) };
+				__m128 z{ _mm_add_ps(_mm_mul_ps(_mm_set1_ps(zA), startX), _mm_set1_ps(zB * py + zC)) };
+
+				float* row{ &depth[(size_t)y * m_width] };
+				for (int x = minX; x <= maxX; x += 4)
+				{
+					const __m128 inside{ _mm_cmpge_ps(_mm_min_ps(e0, _mm_min_ps(e1, e2)), _mm_setzero_ps()) };
+					if (_mm_movemask_ps(inside))
+					{
+						const __m128 current{ _mm_loadu_ps(row + x) };
+						const __m128 nearest{ _mm_min_ps(current, z) };
+						_mm_storeu_ps(row + x, _mm_or_ps(_mm_and_ps(inside, nearest), _mm_andnot_ps(inside, current)));
+					}
+
+					e0 = _mm_add_ps(e0, stepE0);
+					e1 = _mm_add_ps(e1, stepE1);
+					e2 = _mm_add_ps(e2, stepE2);
+					z = _mm_add_ps(z, stepZ);
+				}
+			}
+		}
+	}
+
+	// Rasterise all occluders, split into horizontal bands over the job system, then build the pyramid
+	void OcclusionCuller::RasteriseOccluders()
+	{
+		auto start{ std::chrono::high_resolution_clock::now() };
+
+		std::fill(m_levels[0].begin(), m_levels[0].end(), 1.0f);
+
+		// Each band is a job, rows are never shared so no locking is needed
+		const int numBands{ (m_height + KRowsPerBand - 1) / KRowsPerBand };
+		m_jobSystem->ParallelFor(numBands, 1, [this](size_t begin, size_t end)
+		{
+			for (size_t band = begin; band < end; band++)
+				RasteriseBand((int)band * KRowsPerBand, std::min(m_height, ((int)band + 1) * KRowsPerBand));
+		});
+
+		m_stats.rasterMilliseconds = MillisecondsSince(start);
+		start = std::chrono::high_resolution_clock::now();
+
+		// Each texel keeps the furthest of the (up to) 2x2 texels under it
+		for (size_t level = 1; level < m_levels.size(); level++)
+		{
+			const std::vector<float>& src{ m_levels[level - 1] };
+			const glm::ivec2 srcSize{ m_levelSizes[level - 1] };
+			std::vector<float>& dst{ m_levels[level] };
+			const glm::ivec2 dstSize{ m_levelSizes[level] };
+
+			for (int y = 0; y < dstSize.y; y++)
+			{
+				const int y0{ std::min(y * 2, srcSize.y - 1) };
+				const int y1{ std::min(y * 2 + 1, srcSize.y - 1) };
+				for (int x = 0; x < dstSize.x; x++)
+				{
+					const int x0{ std::min(x * 2, srcSize.x - 1) };
+					const int x1{ std::min(x * 2 + 1, srcSize.x - 1) };
+					dst[(size_t)y * dstSize.x + x] = std::max(
+						std::max(src[(size_t)y0 * srcSize.x + x0], src[(size_t)y0 * srcSize.x + x1]),
+						std::max(src[(size_t)y1 * srcSize.x + x0], src[(size_t)y1 * srcSize.x + x1]));
+				}
+			}
+		}
+
+		m_stats.pyramidMilliseconds = MillisecondsSince(start);
+	}
+
+	// Project the box corners to a screen rectangle and nearest depth, then compare against the
+	// pyramid level where the rectangle covers at most 5x5 texels
+	bool OcclusionCuller::IsVisible(const glm::vec3& minExtents, const glm::vec3& maxExtents)
+	{
+		m_stats.objectsTested++;
+
+		glm::vec2 minScreen{ FLT_MAX };
+		glm::vec2 maxScreen{ -FLT_MAX };
+		float nearestDepth{ 1.0f };
+		for (int i = 0; i < 8; i++)
+		{
+			const glm::vec3 corner{ i & 1 ? maxExtents.x : minExtents.x, i & 2 ? maxExtents.y : minExtents.y, i & 4 ? maxExtents.z : minExtents.z };
+			const glm::vec4 clip{ m_viewProjection * glm::vec4(corner, 1.0f) };
+			if (clip.z < -clip.w)
+				return true;
+
+			const glm::vec3 ndc{ glm::vec3(clip) / clip.w };
+			minScreen = glm::min(minScreen, glm::vec2((ndc.x * 0.5f + 0.5f) * m_width, (ndc.y * 0.5f + 0.5f) * m_height));
+			maxScreen = glm::max(maxScreen, glm::vec2((ndc.x * 0.5f + 0.5f) * m_width, (ndc.y * 0.5f + 0.5f) * m_height));
+			nearestDepth = std::min(nearestDepth, ndc.z * 0.5f + 0.5f);
+		}
+
+		// Off screen is for frustum culling to decide
+		const int x0{ std::max(0, (int)std::floor(minScreen.x)) };
+		const int y0{ std::max(0, (int)std::floor(minScreen.y)) };
+		const int x1{ std::min(m_width - 1, (int)std::floor(maxScreen.x)) };
+		const int y1{ std::min(m_height - 1, (int)std::floor(maxScreen.y)) };
+		if (x0 > x1 || y0 > y1)
+			return true;
+
+		size_t level{ 0 };
+		while (level + 1 < m_levels.size() && (std::max(x1 - x0, y1 - y0) >> level) > 3)
+			level++;
+
+		const glm::ivec2 size{ m_levelSizes[level] };
+		const std::vector<float>& depth{ m_levels[level] };
+		for (int y = y0 >> level; y <= std::min(y1 >> level, size.y - 1); y++)
+		{
+			for (int x = x0 >> level; x <= std::min(x1 >> level, size.x - 1); x++)
+			{
+				if (nearestDepth <= depth[(size_t)y * size.x + x])
+					return true;
+			}
+		}
+
+		m_stats.objectsCulled++;
+		return false;
+	}
+}
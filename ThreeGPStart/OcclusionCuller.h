@@ -0,0 +1,80 @@
+#pragma once
+// Software occlusion culling: occluders are rasterised on the CPU into a small depth buffer
+// and a max depth pyramid built from it, then object bounds are tested against the pyramid.
+// Uses no OpenGL so works headless.
+
+#include "ExternalLibraryHeaders.h"
+#include "JobSystem.h"
+
+namespace Helpers
+{
+	// Timings and counts for one frame
+	struct OcclusionStats
+	{
+		float transformMilliseconds{ 0 };
+		float rasterMilliseconds{ 0 };
+		float pyramidMilliseconds{ 0 };
+		size_t occluderTriangles{ 0 };		// after clipping and back face removal
+		size_t objectsTested{ 0 };
+		size_t objectsCulled{ 0 };
+	};
+
+	// Depth is stored as window depth in 0 (near) to 1 (far), the pyramid keeps the furthest
+	// depth of each block so an object is hidden if it is behind that everywhere it covers
+	class OcclusionCuller
+	{
+	private:
+		// A screen space occluder triangle, x and y in pixels
+		struct ScreenTriangle
+		{
+			glm::vec3 v[3];
+		};
+
+		// Rows rasterised by each job
+		static constexpr int KRowsPerBand{ 16 };
+
+		int m_width{ 0 };
+		int m_height{ 0 };
+		JobSystem* m_jobSystem{ nullptr };
+
+		glm::mat4 m_viewProjection{ 1 };
+		std::vector<ScreenTriangle> m_triangles;
+
+		// Level 0 is the rasterised depth buffer, each level after halves the size
+		std::vector<std::vector<float>> m_levels;
+		std::vector<glm::ivec2> m_levelSizes;
+
+		OcclusionStats m_stats;
+
+		// Clip a clip space triangle against the near plane and add what is left
+		void AddClippedTriangle(const glm::vec4& a, const glm::vec4& b, const glm::vec4& c);
+
+		// Rasterise every triangle into the rows [firstRow, endRow) of level 0
+		void RasteriseBand(int firstRow, int endRow);
+	public:
+		// Width is rounded up to a multiple of 4 for the SIMD rasteriser. Uses the shared job system unless given one.
+		OcclusionCuller(int width = 320, int height = 180, JobSystem* jobSystem = nullptr);
+
+		// Start a frame, clearing the occluders and depth
+		void BeginFrame(const glm::mat4& viewProjection);
+
+		// Transform and clip a triangle list occluder, back facing triangles are skipped
+		void AddOccluder(const std::vector<glm::vec3>& vertices, const std::vector<unsigned int>& elements, const glm::mat4& model_xform);
+
+		// Rasterise all occluders, split into horizontal bands over the job system, then build the pyramid
+		void RasteriseOccluders();
+
+		// True if any part of the world space box may be visible. Boxes crossing the near plane are always visible.
+		bool IsVisible(const glm::vec3& minExtents, const glm::vec3& maxExtents);
+
+		// Sphere version of IsVisible, tests the box around the sphere
+		bool IsVisible(const glm::vec3& centre, float radius) { return IsVisible(centre - glm::vec3(radius), centre + glm::vec3(radius)); }
+
+		const OcclusionStats& GetStats() const { return m_stats; }
+		int Width() const { return m_width; }
+		int Height() const { return m_height; }
+
+		// Level 0 depth, row 0 at the bottom of the screen, for debug display
+		const std::vector<float>& GetDepth() const { return m_levels[0]; }
+	};
+}
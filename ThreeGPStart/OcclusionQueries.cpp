@@ -0,0 +1,174 @@
+#include "OcclusionQueries.h"
+
+namespace Helpers
+{
+	OcclusionQueries::~OcclusionQueries()
+	{
+		if (!m_backend)
+			return;
+
+		for (Object& object : m_objects)
+		{
+			for (const PendingQuery& pending : object.pending)
+				m_freeQueries.push_back(pending.query);
+		}
+		for (GLuint query : m_freeQueries)
+			m_backend->DeleteQuery(query);
+	}
+
+	// Create the unit box, program must use occlusion_box.vert / .frag. The registry must outlive this.
+	void OcclusionQueries::Initialise(GpuResourceRegistry& resources, GLuint program)
+	{
+		RenderBackend& backend{ resources.GetBackend() };
+		m_backend = &backend;
+		m_program = program;
+		m_combinedXformLocation = backend.GetUniformLocation(program, "combined_xform");
+		m_boxMinLocation = backend.GetUniformLocation(program, "box_min");
+		m_boxMaxLocation = backend.GetUniformLocation(program, "box_max");
+
+		const GLfloat corners[]
+		{
+			0, 0, 0,	1, 0, 0,	0, 1, 0,	1, 1, 0,
+			0, 0, 1,	1, 0, 1,	0, 1, 1,	1, 1, 1
+		};
+
+		// Winding does not matter as faces are not culled while testing
+		const GLubyte elements[]
+		{
+			0, 2, 1,	1, 2, 3,	// -z
+			4, 5, 6,	5, 7, 6,	// +z
+			0, 4, 2,	2, 4, 6,	// -x
+			1, 3, 5,	3, 7, 5,	// +x
+			0, 1, 4,	1, 5, 4,	// -y
+			2, 6, 3,	3, 6, 7		// +y
+		};
+
+		m_boxVBO = resources.CreateBuffer("Occlusion queries", GL_ARRAY_BUFFER, corners, sizeof(corners), GL_STATIC_DRAW);
+		m_boxEBO = resources.CreateBuffer("Occlusion queries", GL_ELEMENT_ARRAY_BUFFER, elements, sizeof(elements), GL_STATIC_DRAW);
+		m_boxVAO = resources.CreateVertexArray("Occlusion queries", m_boxVBO.Get(), 3 * sizeof(GLfloat), { VertexAttribute{ 0, 3, GL_FLOAT, GL_FALSE, 0 } }, m_boxEBO.Get());
+	}
+
+	// Add an object to track, returns its id
+	size_t OcclusionQueries::AddObject()
+	{
+		m_objects.push_back(Object());
+		return m_objects.size() - 1;
+	}
+
+	// Take a query object from the free list or create one
+	GLuint OcclusionQueries::AllocateQuery()
+	{
+		if (m_freeQueries.empty())
+			return m_backend->CreateQuery();
+
+		const GLuint query{ m_freeQueries.back() };
+		m_freeQueries.pop_back();
+		return query;
+	}
+
+	// Read back any results that are ready, never waiting on the GPU
+	// Queries complete in order so polling stops at the first one that is not ready
+	void OcclusionQueries::BeginFrame()
+	{
+		m_frame++;
+		m_lastStats = m_stats;
+		m_stats = OcclusionQueryStats();
+		m_stats.objects = m_objects.size();
+
+		for (Object& object : m_objects)
+		{
+			object.currentQuery = 0;
+
+			size_t done{ 0 };
+			for (; done < object.pending.size(); done++)
+			{
+				const PendingQuery& pending{ object.pending[done] };
+
+				GLuint anySamples{ GL_FALSE };
+				if (!m_backend->GetQueryResult(pending.query, anySamples))
+					break;
+
+				const bool visible{ anySamples != GL_FALSE };
+				m_stats.resolved++;
+				m_stats.occluded += visible ? 0 : 1;
+				m_stats.coherent += visible == object.visible ? 1 : 0;
+				m_stats.latencyFrames += m_frame - pending.frame;
+
+				object.visible = visible;
+				m_freeQueries.push_back(pending.query);
+			}
+			object.pending.erase(object.pending.begin(), object.pending.begin() + done);
+		}
+	}
+
+	// Set up state for drawing query boxes (no colour or depth writes, no face culling)
+	void OcclusionQueries::BeginBoxes(CommandList& list, const glm::mat4& combined_xform)
+	{
+		m_testingBoxes = true;
+
+		list.BindProgram(m_program);
+		list.SetUniform(m_combinedXformLocation, combined_xform);
+
+		RenderState state;
+		state.colourWrite = false;
+		state.depthWrite = false;
+		state.cullFace = false;
+		list.SetState(state);
+		list.BindVertexArray(m_boxVAO.Get());
+	}
+
+	// Record a query for the object's world space box if it is due a test
+	// Hidden objects are tested every frame so they reappear promptly, visible ones only every m_retestInterval frames
+	void OcclusionQueries::TestBox(CommandList& list, size_t id, const glm::vec3& minExtents, const glm::vec3& maxExtents, const glm::vec3& cameraPosition)
+	{
+		assert(m_testingBoxes);
+		Object& object{ m_objects[id] };
+
+		if (object.visible && (m_frame + id) % std::max(m_retestInterval, 1) != 0)
+			return;
+		if (object.pending.size() >= KMaxQueriesInFlight)
+			return;
+
+		// The box faces are clipped away when the camera is inside, so it must be visible
+		const glm::vec3 margin{ (maxExtents - minExtents) * 0.01f + glm::vec3(1.0f) };
+		if (glm::all(glm::greaterThanEqual(cameraPosition, minExtents - margin)) && glm::all(glm::lessThanEqual(cameraPosition, maxExtents + margin)))
+		{
+			object.visible = true;
+			return;
+		}
+
+		list.SetUniform(m_boxMinLocation, minExtents);
+		list.SetUniform(m_boxMaxLocation, maxExtents);
+
+		object.currentQuery = AllocateQuery();
+		list.BeginQuery(GL_ANY_SAMPLES_PASSED_CONSERVATIVE, object.currentQuery);
+		list.DrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_BYTE, 0);
+		list.EndQuery(GL_ANY_SAMPLES_PASSED_CONSERVATIVE);
+
+		object.pending.push_back(PendingQuery{ object.currentQuery, m_frame });
+		object.lastIssuedFrame = m_frame;
+		m_stats.issued++;
+	}
+
+	// Restore the state changed by BeginBoxes, later commands must bind their own program
+	void OcclusionQueries::EndBoxes(CommandList& list, const RenderState& state)
+	{
+		m_testingBoxes = false;
+
+		list.BindVertexArray(0);
+		list.SetState(state);
+	}
+
+	// With GL_QUERY_NO_WAIT the GPU draws anyway if the box result is not ready by the time it gets there
+	void OcclusionQueries::BeginConditionalDraw(CommandList& list, size_t id) const
+	{
+		if (m_objects[id].currentQuery)
+			list.BeginConditionalRender(m_objects[id].currentQuery, GL_QUERY_NO_WAIT);
+	}
+
+	void OcclusionQueries::EndConditionalDraw(CommandList& list, size_t id) const
+	{
+		if (m_objects[id].currentQuery)
+			list.EndConditionalRender();
+	}
+}
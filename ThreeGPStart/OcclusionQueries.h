@@ -0,0 +1,102 @@
+#pragma once
+// GPU occlusion queries on object bounding boxes with conditional rendering.
+// Results are read back frames later without stalling and visibility is kept between frames
+// so objects that were visible are only re-tested every few frames.
+
+#include "ExternalLibraryHeaders.h"
+#include "RenderBackend.h"
+#include "GpuResources.h"
+
+namespace Helpers
+{
+	// Counts for one frame, latency is in frames from issuing a query to reading its result
+	struct OcclusionQueryStats
+	{
+		size_t objects{ 0 };
+		size_t issued{ 0 };
+		size_t resolved{ 0 };
+		size_t occluded{ 0 };		// resolved with no samples passing
+		size_t coherent{ 0 };		// resolved agreeing with the visibility already held
+		size_t latencyFrames{ 0 };	// summed over the resolved queries
+
+		float AverageLatency() const { return resolved ? (float)latencyFrames / resolved : 0.0f; }
+		float OccludedRate() const { return resolved ? (float)occluded / resolved : 0.0f; }
+		float CoherenceRate() const { return resolved ? (float)coherent / resolved : 0.0f; }
+	};
+
+	class OcclusionQueries
+	{
+	private:
+		static constexpr size_t KMaxQueriesInFlight{ 4 };
+
+		struct PendingQuery
+		{
+			GLuint query{ 0 };
+			unsigned int frame{ 0 };
+		};
+
+		struct Object
+		{
+			bool visible{ true };
+			unsigned int lastIssuedFrame{ 0 };
+			std::vector<PendingQuery> pending;	// oldest first
+			GLuint currentQuery{ 0 };			// issued this frame, 0 if not tested
+		};
+
+		std::vector<Object> m_objects;
+		std::vector<GLuint> m_freeQueries;
+
+		RenderBackend* m_backend{ nullptr };
+		GLuint m_program{ 0 };
+		GLint m_combinedXformLocation{ -1 };
+		GLint m_boxMinLocation{ -1 };
+		GLint m_boxMaxLocation{ -1 };
+		GpuBuffer m_boxVBO;
+		GpuBuffer m_boxEBO;
+		GpuVertexArray m_boxVAO;
+
+		unsigned int m_frame{ 0 };
+		bool m_testingBoxes{ false };
+
+		OcclusionQueryStats m_stats;
+		OcclusionQueryStats m_lastStats;
+
+		// Take a query object from the free list or create one
+		GLuint AllocateQuery();
+	public:
+		// Visible objects are re-tested once in this many frames, spread over the frames by object
+		int m_retestInterval{ 4 };
+
+		OcclusionQueries() = default;
+		~OcclusionQueries();
+
+		// Create the unit box, program must use occlusion_box.vert / .frag. The registry must outlive this.
+		void Initialise(GpuResourceRegistry& resources, GLuint program);
+
+		// Add an object to track, returns its id
+		size_t AddObject();
+
+		// Read back any results that are ready, never waiting on the GPU
+		void BeginFrame();
+
+		// The box commands are recorded on the GL thread as query objects may need creating.
+		// Set up state for drawing query boxes (no colour or depth writes, no face culling)
+		void BeginBoxes(CommandList& list, const glm::mat4& combined_xform);
+
+		// Record a query for the object's world space box if it is due a test
+		void TestBox(CommandList& list, size_t id, const glm::vec3& minExtents, const glm::vec3& maxExtents, const glm::vec3& cameraPosition);
+
+		// Restore the state changed by BeginBoxes, later commands must bind their own program
+		void EndBoxes(CommandList& list, const RenderState& state);
+
+		// Draws between these are skipped by the GPU if the object's box tested hidden this frame.
+		// Safe to record on any thread once the boxes are recorded.
+		void BeginConditionalDraw(CommandList& list, size_t id) const;
+		void EndConditionalDraw(CommandList& list, size_t id) const;
+
+		// Visibility from the latest result read back
+		bool IsVisible(size_t id) const { return m_objects[id].visible; }
+
+		const OcclusionQueryStats& GetStats() const { return m_lastStats; }
+	};
+}
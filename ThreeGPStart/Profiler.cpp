@@ -0,0 +1,564 @@
+#include "Profiler.h"
+
+namespace Helpers
+{
+	// The calling thread's buffer, registered on first use
+	Profiler::ThreadBuffer& Profiler::ThisThread()
+	{
+		static thread_local ThreadBuffer* buffer{ nullptr };
+		if (!buffer)
+		{
+			std::lock_guard<std::mutex> lock(m_threadsMutex);
+			m_threads.push_back(std::make_unique<ThreadBuffer>());
+			buffer = m_threads.back().get();
+			buffer->index = (int)m_threads.size() - 1;
+			buffer->name = buffer->index == 0 ? "Main" : "Thread " + std::to_string(buffer->index);
+		}
+		return *buffer;
+	}
+
+	Profiler::~Profiler()
+	{
+		if (m_dumpThread.joinable())
+			m_dumpThread.join();
+	}
+
+	// Creates the timestamp queries, on the main thread which becomes thread 0
+	void Profiler::Initialise(RenderBackend& backend)
+	{
+		ThisThread();
+
+		m_backend = &backend;
+		for (GpuFrame& gpuFrame : m_gpuFrames)
+		{
+			for (GLuint& query : gpuFrame.queries)
+				query = m_backend->CreateQuery();
+		}
+		CalibrateGpuClock();
+	}
+
+	// Deletes the queries, must be before the backend goes
+	void Profiler::Release()
+	{
+		if (!m_backend)
+			return;
+
+		for (GpuFrame& gpuFrame : m_gpuFrames)
+		{
+			for (GLuint& query : gpuFrame.queries)
+			{
+				m_backend->DeleteQuery(query);
+				query = 0;
+			}
+			gpuFrame.pending = false;
+			gpuFrame.numScopes = 0;
+		}
+		m_backend = nullptr;
+	}
+
+	void Profiler::SetThreadName(const std::string& name)
+	{
+		ThreadBuffer& buffer{ ThisThread() };
+		std::lock_guard<std::mutex> lock(m_threadsMutex);
+		buffer.name = name;
+	}
+
+	// Main thread, a value for the current frame. Name must outlive the profiler.
+	void Profiler::SetCounter(const char* name, double value)
+	{
+		for (ProfileCounter& counter : m_counters)
+		{
+			if (counter.name == name)
+			{
+				counter.value = value;
+				return;
+			}
+		}
+		m_counters.push_back(ProfileCounter{ name, value });
+	}
+
+	// Write every frame from now on to a Chrome trace file, including scopes made before Initialise
+	bool Profiler::StartTrace(const std::string& filename)
+	{
+		if (!m_trace.Start(filename))
+			return false;
+		if (m_backend)
+			CalibrateGpuClock();
+		return true;
+	}
+
+	// The frame in progress and GPU frames not read back yet are not written
+	void Profiler::StopTrace()
+	{
+		if (!IsTracing())
+			return;
+
+		m_trace.Stop(TrackNames());
+		std::cout << "Trace: " << m_trace.EventsWritten() << " events written" << std::endl;
+	}
+
+	// Read the GPU's clock straight after the CPU's. The GPU may run ahead of when the call reaches it so
+	// this is only close, but it is redone every few seconds so the clocks never drift apart.
+	void Profiler::CalibrateGpuClock()
+	{
+		const GLuint64 gpuNow{ m_backend->GetGpuTime() };
+		m_gpuClockOffset = glfwGetTime() - gpuNow / 1e9;
+		m_calibratedFrame = m_frame;
+	}
+
+	// Frames first, then the threads, then the GPU
+	std::vector<std::pair<int, std::string>> Profiler::TrackNames()
+	{
+		std::vector<std::pair<int, std::string>> trackNames;
+		trackNames.emplace_back(KFrameTrack, "Frames");
+		{
+			std::lock_guard<std::mutex> lock(m_threadsMutex);
+			for (const auto& buffer : m_threads)
+				trackNames.emplace_back(buffer->index, buffer->name);
+		}
+		trackNames.emplace_back(KGpuTrack, "GPU");
+		return trackNames;
+	}
+
+	// The frame, its scopes on one track per thread and its counters at its start
+	TraceBatch Profiler::CpuBatch(const ProfileFrame& frame, bool hitch)
+	{
+		TraceBatch batch;
+		batch.spans.reserve(frame.cpu.size() + 1);
+		batch.spans.push_back(TraceSpan{ hitch ? "Hitch" : "Frame", KFrameTrack, frame.startSeconds, frame.cpuMilliseconds / 1000.0 });
+		for (const ProfileSample& sample : frame.cpu)
+			batch.spans.push_back(TraceSpan{ sample.name, sample.thread, frame.startSeconds + sample.startMilliseconds / 1000.0, sample.milliseconds / 1000.0 });
+
+		batch.counters.push_back(TraceCounter{ "CPU ms", frame.startSeconds, frame.cpuMilliseconds });
+		for (const ProfileCounter& counter : frame.counters)
+			batch.counters.push_back(TraceCounter{ counter.name, frame.startSeconds, counter.value });
+		return batch;
+	}
+
+	// GPU scopes on a track of their own, on the CPU clock
+	TraceBatch Profiler::GpuBatch(const ProfileFrame& frame)
+	{
+		TraceBatch batch;
+		batch.spans.reserve(frame.gpu.size());
+		for (const ProfileSample& sample : frame.gpu)
+			batch.spans.push_back(TraceSpan{ sample.name, KGpuTrack, frame.gpuStartSeconds + sample.startMilliseconds / 1000.0, sample.milliseconds / 1000.0 });
+
+		batch.counters.push_back(TraceCounter{ "GPU ms", frame.gpuStartSeconds, frame.gpuMilliseconds });
+		return batch;
+	}
+
+	// Hitches close together share a dump, which waits for the frames after the first
+	void Profiler::OnHitch(unsigned int frame, float milliseconds)
+	{
+		m_hitchStats.hitches++;
+		m_hitchStats.worstMilliseconds = std::max(m_hitchStats.worstMilliseconds, milliseconds);
+		if (m_recordHitches && std::find(m_pendingHitches.begin(), m_pendingHitches.end(), frame) == m_pendingHitches.end())
+			m_pendingHitches.push_back(frame);
+	}
+
+	// Copy the frames around the pending hitches and write them on a thread, skipped if the last dump is still going
+	void Profiler::DumpHitches()
+	{
+		std::vector<unsigned int> hitches{ std::move(m_pendingHitches) };
+		std::sort(hitches.begin(), hitches.end());
+		m_pendingHitches.clear();
+		if (m_dumping)
+		{
+			m_hitchStats.skippedDumps++;
+			return;
+		}
+		if (m_dumpThread.joinable())
+			m_dumpThread.join();
+
+		const unsigned int first{ hitches.front() > KHitchFramesBefore ? hitches.front() - KHitchFramesBefore : 0 };
+		std::vector<ProfileFrame> frames;
+		for (const ProfileFrame& frame : m_history)
+		{
+			if (frame.frame >= first)
+				frames.push_back(frame);
+		}
+
+		m_hitchStats.dumps++;
+		m_hitchStats.lastFile = "hitch_" + std::to_string(hitches.front()) + ".json";
+		m_dumping = true;
+		m_dumpThread = std::thread([this, frames{ std::move(frames) }, hitches, trackNames{ TrackNames() }, filename{ m_hitchStats.lastFile }]()
+		{
+			TraceWriter writer;
+			if (writer.Start(filename))
+			{
+				for (const ProfileFrame& frame : frames)
+				{
+					const bool hitch{ std::find(hitches.begin(), hitches.end(), frame.frame) != hitches.end() };
+					writer.Submit(CpuBatch(frame, hitch));
+					if (frame.gpuResolved)
+						writer.Submit(GpuBatch(frame));
+				}
+				writer.Stop(trackNames);
+			}
+			m_dumping = false;
+		});
+	}
+
+	void Profiler::BeginCpuScope(double& start, int& depth)
+	{
+		depth = ThisThread().depth++;
+		start = glfwGetTime();
+	}
+
+	// Pushed when the scope ends, dropped if the main thread has not drained the ring in time
+	void Profiler::EndCpuScope(const char* name, double start, int depth)
+	{
+		const double end{ glfwGetTime() };
+		ThreadBuffer& buffer{ ThisThread() };
+		buffer.depth = depth;
+
+		const size_t head{ buffer.head.load(std::memory_order_relaxed) };
+		if (head - buffer.tail.load(std::memory_order_acquire) >= KThreadRingSize)
+		{
+			buffer.dropped.fetch_add(1, std::memory_order_relaxed);
+			return;
+		}
+
+		CpuEvent& event{ buffer.events[head & (KThreadRingSize - 1)] };
+		event.name = name;
+		event.depth = depth;
+		event.start = start;
+		event.end = end;
+		buffer.head.store(head + 1, std::memory_order_release);
+	}
+
+	// A timestamp now and another when the scope ends, SIZE_MAX if this frame has used all its queries
+	size_t Profiler::BeginGpuScope(const char* name, CommandList& list)
+	{
+		if (!m_backend)
+			return SIZE_MAX;
+
+		GpuFrame& gpuFrame{ m_gpuFrames[m_frame % KFramesInFlight] };
+		const size_t scope{ gpuFrame.numScopes.fetch_add(1, std::memory_order_relaxed) };
+		if (scope >= KMaxGpuScopes)
+			return SIZE_MAX;
+
+		ThreadBuffer& buffer{ ThisThread() };
+		gpuFrame.scopes[scope].name = name;
+		gpuFrame.scopes[scope].depth = buffer.gpuDepth++;
+		gpuFrame.scopes[scope].thread = buffer.index;
+		list.Timestamp(gpuFrame.queries[scope * 2]);
+		return scope;
+	}
+
+	void Profiler::EndGpuScope(size_t scope, CommandList& list)
+	{
+		GpuFrame& gpuFrame{ m_gpuFrames[m_frame % KFramesInFlight] };
+		list.Timestamp(gpuFrame.queries[scope * 2 + 1]);
+		ThisThread().gpuDepth--;
+	}
+
+	// Move every thread's finished scopes into the frame, ordered by thread then start
+	void Profiler::DrainThreads(ProfileFrame& frame)
+	{
+		std::lock_guard<std::mutex> lock(m_threadsMutex);
+		for (const auto& buffer : m_threads)
+		{
+			const size_t head{ buffer->head.load(std::memory_order_acquire) };
+			size_t tail{ buffer->tail.load(std::memory_order_relaxed) };
+			const size_t first{ frame.cpu.size() };
+			for (; tail != head; tail++)
+			{
+				const CpuEvent& event{ buffer->events[tail & (KThreadRingSize - 1)] };
+				ProfileSample sample;
+				sample.name = event.name;
+				sample.depth = event.depth;
+				sample.thread = buffer->index;
+				sample.startMilliseconds = (float)((event.start - m_frameStart) * 1000.0);
+				sample.milliseconds = (float)((event.end - event.start) * 1000.0);
+				frame.cpu.push_back(sample);
+			}
+			buffer->tail.store(tail, std::memory_order_release);
+
+			// Scopes are pushed as they end so parents come after their children
+			std::stable_sort(frame.cpu.begin() + first, frame.cpu.end(), [](const ProfileSample& a, const ProfileSample& b)
+			{
+				return a.startMilliseconds < b.startMilliseconds || (a.startMilliseconds == b.startMilliseconds && a.depth < b.depth);
+			});
+		}
+	}
+
+	ProfileFrame* Profiler::FindFrame(unsigned int frame)
+	{
+		for (ProfileFrame& candidate : m_history)
+		{
+			if (candidate.frame == frame)
+				return &candidate;
+		}
+		return nullptr;
+	}
+
+	// Read a frame's timestamps if they have all arrived, or with discard give up on them so the queries can be reused
+	bool Profiler::ResolveGpuFrame(GpuFrame& gpuFrame, bool discard)
+	{
+		const size_t numScopes{ std::min(gpuFrame.numScopes.load(std::memory_order_relaxed), KMaxGpuScopes) };
+		std::vector<GLuint64> times(numScopes * 2);
+		for (size_t i = 0; i < times.size(); i++)
+		{
+			if (!m_backend->GetTimestamp(gpuFrame.queries[i], times[i]))
+			{
+				if (discard)
+				{
+					m_gpuFramesDropped++;
+					gpuFrame.pending = false;
+				}
+				return false;
+			}
+		}
+		gpuFrame.pending = false;
+
+		ProfileFrame* frame{ FindFrame(gpuFrame.frame) };
+		if (times.empty() || (!frame && !IsTracing()))
+			return true;
+
+		// Still traced when the frame has left the history
+		ProfileFrame resolved;
+		const GLuint64 first{ *std::min_element(times.begin(), times.end()) };
+		const GLuint64 last{ *std::max_element(times.begin(), times.end()) };
+		for (size_t i = 0; i < numScopes; i++)
+		{
+			ProfileSample sample;
+			sample.name = gpuFrame.scopes[i].name;
+			sample.depth = gpuFrame.scopes[i].depth;
+			sample.thread = gpuFrame.scopes[i].thread;
+			sample.startMilliseconds = (float)((times[i * 2] - first) / 1e6);
+			sample.milliseconds = (float)((times[i * 2 + 1] - times[i * 2]) / 1e6);
+			resolved.gpu.push_back(sample);
+		}
+		std::stable_sort(resolved.gpu.begin(), resolved.gpu.end(), [](const ProfileSample& a, const ProfileSample& b)
+		{
+			return a.startMilliseconds < b.startMilliseconds || (a.startMilliseconds == b.startMilliseconds && a.depth < b.depth);
+		});
+		resolved.gpuMilliseconds = (float)((last - first) / 1e6);
+		resolved.gpuStartSeconds = first / 1e9 + m_gpuClockOffset;
+		resolved.gpuResolved = true;
+
+		if (IsTracing())
+			m_trace.Submit(GpuBatch(resolved));
+		if (resolved.gpuMilliseconds > m_hitchMilliseconds && gpuFrame.frame > 0)
+			OnHitch(gpuFrame.frame, resolved.gpuMilliseconds);
+		if (frame)
+		{
+			frame->gpu = std::move(resolved.gpu);
+			frame->gpuMilliseconds = resolved.gpuMilliseconds;
+			frame->gpuStartSeconds = resolved.gpuStartSeconds;
+			frame->gpuResolved = true;
+		}
+		return true;
+	}
+
+	// Closes the last frame's CPU scopes and reads any GPU results that have arrived, then starts the next frame
+	// reusing the queries of the frame KFramesInFlight ago. Frame 0 is everything before the first frame,
+	// such as loading, which is traced but kept out of the history.
+	void Profiler::BeginFrame()
+	{
+		const double now{ glfwGetTime() };
+		ProfileFrame frame;
+		frame.frame = m_frame;
+		frame.startSeconds = m_frameStart;
+		frame.cpuMilliseconds = (float)((now - m_frameStart) * 1000.0);
+		frame.counters.swap(m_counters);
+		DrainThreads(frame);
+		if (IsTracing())
+			m_trace.Submit(CpuBatch(frame, false));
+		if (frame.cpuMilliseconds > m_hitchMilliseconds && m_frame > 0)
+			OnHitch(m_frame, frame.cpuMilliseconds);
+		if (m_frame > 0)
+		{
+			m_history.push_back(std::move(frame));
+			if (m_history.size() > KHistoryFrames)
+				m_history.pop_front();
+
+			GpuFrame& gpuFrame{ m_gpuFrames[m_frame % KFramesInFlight] };
+			m_gpuScopesDropped += gpuFrame.numScopes > KMaxGpuScopes ? gpuFrame.numScopes - KMaxGpuScopes : 0;
+			gpuFrame.pending = gpuFrame.numScopes > 0;
+		}
+
+		if (m_backend)
+		{
+			if (IsTracing() && m_frame - m_calibratedFrame >= KCalibrationFrames)
+				CalibrateGpuClock();
+			for (GpuFrame& gpuFrame : m_gpuFrames)
+			{
+				if (gpuFrame.pending)
+					ResolveGpuFrame(gpuFrame, false);
+			}
+		}
+
+		if (!m_pendingHitches.empty() && m_frame >= *std::min_element(m_pendingHitches.begin(), m_pendingHitches.end()) + KHitchFramesAfter)
+			DumpHitches();
+
+		m_frame++;
+		GpuFrame& gpuFrame{ m_gpuFrames[m_frame % KFramesInFlight] };
+		if (gpuFrame.pending && m_backend)
+			ResolveGpuFrame(gpuFrame, true);
+		gpuFrame.frame = m_frame;
+		gpuFrame.numScopes = 0;
+
+		for (const auto& buffer : m_threads)
+			buffer->gpuDepth = 0;
+		m_frameStart = now;
+	}
+
+	// The newest frame with GPU times, nullptr if there is none yet
+	const ProfileFrame* Profiler::LatestResolvedFrame() const
+	{
+		for (auto it = m_history.rbegin(); it != m_history.rend(); ++it)
+		{
+			if (it->gpuResolved)
+				return &*it;
+		}
+		return nullptr;
+	}
+
+	// A stable colour from a scope's name
+	static ImU32 ScopeColour(const char* name)
+	{
+		size_t hash{ std::hash<std::string>()(name) };
+		return IM_COL32(90 + hash % 120, 90 + (hash >> 8) % 120, 90 + (hash >> 16) % 120, 255);
+	}
+
+	// Scopes as a tree, samples must be in start order with children after their parent
+	static void ScopeTree(const std::vector<ProfileSample>& samples, int thread)
+	{
+		int open{ 0 };
+		for (size_t i = 0; i < samples.size(); i++)
+		{
+			const ProfileSample& sample{ samples[i] };
+			if (sample.thread != thread && thread >= 0)
+				continue;
+			if (sample.depth > open)
+				continue;	// parent is closed
+			while (open > sample.depth)
+			{
+				ImGui::TreePop();
+				open--;
+			}
+
+			bool children{ false };
+			for (size_t j = i + 1; j < samples.size(); j++)
+			{
+				if (samples[j].thread != sample.thread && thread >= 0)
+					continue;
+				children = samples[j].depth > sample.depth;
+				break;
+			}
+
+			const ImGuiTreeNodeFlags flags{ children ? ImGuiTreeNodeFlags_DefaultOpen : ImGuiTreeNodeFlags_Leaf };
+			if (ImGui::TreeNodeEx((void*)(intptr_t)(i + 1), flags, "%-20s %7.3f ms", sample.name, sample.milliseconds))
+				open++;
+		}
+		while (open-- > 0)
+			ImGui::TreePop();
+	}
+
+	// One row per depth, scaled so the frame fills the width
+	static void FlameGraph(const char* label, const std::vector<ProfileSample>& samples, int thread, float frameMilliseconds)
+	{
+		const float KRowHeight{ 18.0f };
+		int maxDepth{ 0 };
+		for (const ProfileSample& sample : samples)
+		{
+			if (thread < 0 || sample.thread == thread)
+				maxDepth = std::max(maxDepth, sample.depth);
+		}
+
+		ImGui::Text("%s", label);
+		const ImVec2 origin{ ImGui::GetCursorScreenPos() };
+		const float width{ std::max(ImGui::GetContentRegionAvail().x, 100.0f) };
+		const float scale{ width / std::max(frameMilliseconds, 0.001f) };
+		ImDrawList* drawList{ ImGui::GetWindowDrawList() };
+		drawList->AddRectFilled(origin, ImVec2(origin.x + width, origin.y + KRowHeight * (maxDepth + 1)), IM_COL32(30, 30, 30, 255));
+
+		for (const ProfileSample& sample : samples)
+		{
+			if (thread >= 0 && sample.thread != thread)
+				continue;
+			const ImVec2 min{ origin.x + std::max(sample.startMilliseconds, 0.0f) * scale, origin.y + sample.depth * KRowHeight };
+			const ImVec2 max{ std::min(min.x + std::max(sample.milliseconds * scale, 1.0f), origin.x + width), min.y + KRowHeight - 1 };
+			drawList->AddRectFilled(min, max, ScopeColour(sample.name));
+			drawList->PushClipRect(min, max, true);
+			drawList->AddText(ImVec2(min.x + 2, min.y + 2), IM_COL32_WHITE, sample.name);
+			drawList->PopClipRect();
+			if (ImGui::IsMouseHoveringRect(min, max))
+				ImGui::SetTooltip("%s\n%.3f ms at %.3f ms", sample.name, sample.milliseconds, sample.startMilliseconds);
+		}
+		ImGui::Dummy(ImVec2(width, KRowHeight * (maxDepth + 1)));
+	}
+
+	// Per pass breakdown, flame graphs of the selected frame and frame times over the history
+	void Profiler::DefineGUI()
+	{
+		ImGui::Checkbox("Enabled", &m_enabled);
+		ImGui::SameLine();
+		if (ImGui::Checkbox("Pause", &m_paused) && m_paused)
+			m_pausedHistory = m_history;
+
+		// Flight recorder
+		ImGui::Checkbox("Record hitches", &m_recordHitches);
+		ImGui::SameLine();
+		ImGui::SetNextItemWidth(120);
+		ImGui::SliderFloat("Hitch ms", &m_hitchMilliseconds, 5.0f, 200.0f, "%.1f");
+		ImGui::TextColored(m_hitchStats.hitches ? ImVec4(1, 0.4f, 0.4f, 1) : ImVec4(0.6f, 1, 0.6f, 1), "%zu hitches, worst %.1f ms",
+			m_hitchStats.hitches, m_hitchStats.worstMilliseconds);
+		if (m_hitchStats.dumps)
+			ImGui::Text("%zu dumps, last %s%s, %zu skipped", m_hitchStats.dumps, m_hitchStats.lastFile.c_str(), m_dumping ? " (writing)" : "", m_hitchStats.skippedDumps);
+
+		const std::deque<ProfileFrame>& history{ m_paused ? m_pausedHistory : m_history };
+		if (history.empty())
+			return;
+
+		float cpuTimes[KHistoryFrames]{};
+		float gpuTimes[KHistoryFrames]{};
+		for (size_t i = 0; i < history.size(); i++)
+		{
+			cpuTimes[i] = history[i].cpuMilliseconds;
+			gpuTimes[i] = history[i].gpuMilliseconds;
+		}
+		ImGui::PlotLines("CPU ms", cpuTimes, (int)history.size(), 0, nullptr, 0.0f, FLT_MAX, ImVec2(0, 40));
+		ImGui::PlotLines("GPU ms", gpuTimes, (int)history.size(), 0, nullptr, 0.0f, FLT_MAX, ImVec2(0, 40));
+
+		m_selectedFrame = std::min(m_selectedFrame, (int)history.size() - 1);
+		ImGui::SliderInt("Frames back", &m_selectedFrame, 0, (int)history.size() - 1);
+		const ProfileFrame& frame{ history[history.size() - 1 - m_selectedFrame] };
+		ImGui::Text("Frame %u: CPU %.3f ms, GPU %s", frame.frame, frame.cpuMilliseconds,
+			frame.gpuResolved ? std::to_string(frame.gpuMilliseconds).c_str() : "pending");
+		if (m_gpuScopesDropped || m_gpuFramesDropped)
+			ImGui::Text("Dropped %zu GPU scopes, %zu GPU frames", m_gpuScopesDropped, m_gpuFramesDropped);
+
+		FlameGraph("CPU main thread", frame.cpu, 0, frame.cpuMilliseconds);
+		if (frame.gpuResolved)
+			FlameGraph("GPU", frame.gpu, -1, frame.gpuMilliseconds);
+
+		if (ImGui::TreeNode("CPU scopes"))
+		{
+			std::lock_guard<std::mutex> lock(m_threadsMutex);
+			for (const auto& buffer : m_threads)
+			{
+				if (ImGui::TreeNode(buffer.get(), "%s (%zu dropped)", buffer->name.c_str(), buffer->dropped.load(std::memory_order_relaxed)))
+				{
+					ScopeTree(frame.cpu, buffer->index);
+					ImGui::TreePop();
+				}
+			}
+			ImGui::TreePop();
+		}
+		if (frame.gpuResolved && ImGui::TreeNode("GPU scopes"))
+		{
+			ScopeTree(frame.gpu, -1);
+			ImGui::TreePop();
+		}
+	}
+
+	// The profiler shared by the whole program
+	Profiler& GetProfiler()
+	{
+		static Profiler profiler;
+		return profiler;
+	}
+}
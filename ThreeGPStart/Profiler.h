@@ -0,0 +1,255 @@
+#pragma once
+// CPU and GPU scope timing. CPU scopes are timed with the GLFW clock into a ring per thread that only
+// that thread writes, so timing needs no locks. GPU scopes record timestamp queries into the command list
+// being recorded, from a set of queries per frame in flight, and are read back frames later so reading
+// never waits for the GPU. PROFILE times a section on both, PROFILE_CPU on the CPU only.
+// While tracing, every closed frame and every GPU frame read back is also handed to a TraceWriter, with
+// GPU times moved onto the CPU clock, so startup and hitches can be looked at afterwards.
+// The history is also a flight recorder: a frame slower than the hitch threshold on the CPU or GPU has the
+// frames either side of it written to a trace file of their own, on a background thread.
+
+#include "ExternalLibraryHeaders.h"
+#include "RenderBackend.h"
+#include "TraceWriter.h"
+
+#include <atomic>
+#include <deque>
+#include <mutex>
+#include <thread>
+
+namespace Helpers
+{
+	// A finished scope, times are milliseconds from the start of its frame
+	struct ProfileSample
+	{
+		const char* name{ nullptr };
+		int depth{ 0 };
+		int thread{ 0 };
+		float startMilliseconds{ 0 };
+		float milliseconds{ 0 };
+	};
+
+	// A value set for a frame, e.g. its draw count
+	struct ProfileCounter
+	{
+		const char* name{ nullptr };
+		double value{ 0 };
+	};
+
+	// Scopes are in the order they started
+	struct ProfileFrame
+	{
+		unsigned int frame{ 0 };
+		double startSeconds{ 0 };		// GLFW clock
+		double gpuStartSeconds{ 0 };	// first GPU timestamp on the GLFW clock
+		float cpuMilliseconds{ 0 };		// from this frame's BeginFrame to the next
+		float gpuMilliseconds{ 0 };		// first GPU timestamp to the last
+		bool gpuResolved{ false };
+		std::vector<ProfileSample> cpu;
+		std::vector<ProfileSample> gpu;
+		std::vector<ProfileCounter> counters;
+	};
+
+	// Frames slower than the hitch threshold and the trace files written around them
+	struct HitchStats
+	{
+		size_t hitches{ 0 };
+		size_t dumps{ 0 };
+		size_t skippedDumps{ 0 };	// hitches while the last dump was still being written
+		float worstMilliseconds{ 0 };
+		std::string lastFile;
+	};
+
+	class Profiler
+	{
+	private:
+		static constexpr size_t KFramesInFlight{ 4 };
+		static constexpr size_t KHistoryFrames{ 240 };
+		static constexpr size_t KThreadRingSize{ 4096 };	// a power of two
+		static constexpr size_t KMaxGpuScopes{ 128 };		// per frame
+		static constexpr unsigned int KCalibrationFrames{ 120 };	// frames between lining the GPU clock up with the CPU's
+		static constexpr int KGpuTrack{ 1000 };			// trace track of GPU scopes, after the threads
+		static constexpr int KFrameTrack{ 999 };		// trace track with a span per frame
+		static constexpr unsigned int KHitchFramesBefore{ 90 };	// frames written before and after a hitch
+		static constexpr unsigned int KHitchFramesAfter{ 30 };
+
+		struct CpuEvent
+		{
+			const char* name{ nullptr };
+			int depth{ 0 };
+			double start{ 0 };
+			double end{ 0 };
+		};
+
+		// Finished scopes of one thread, written only by that thread and drained by the main thread
+		struct ThreadBuffer
+		{
+			int index{ 0 };
+			std::string name;
+			int depth{ 0 };
+			int gpuDepth{ 0 };
+			CpuEvent events[KThreadRingSize];
+			std::atomic<size_t> head{ 0 };	// next to write
+			std::atomic<size_t> tail{ 0 };	// next to read
+			std::atomic<size_t> dropped{ 0 };
+		};
+
+		struct GpuScope
+		{
+			const char* name{ nullptr };
+			int depth{ 0 };
+			int thread{ 0 };
+		};
+
+		// The queries of one frame in flight, scope i uses queries 2i and 2i + 1
+		struct GpuFrame
+		{
+			unsigned int frame{ 0 };
+			bool pending{ false };
+			std::atomic<size_t> numScopes{ 0 };
+			GpuScope scopes[KMaxGpuScopes];
+			GLuint queries[KMaxGpuScopes * 2]{};
+		};
+
+		RenderBackend* m_backend{ nullptr };
+		bool m_enabled{ true };
+
+		std::mutex m_threadsMutex;
+		std::vector<std::unique_ptr<ThreadBuffer>> m_threads;
+
+		GpuFrame m_gpuFrames[KFramesInFlight];
+		size_t m_gpuScopesDropped{ 0 };
+		size_t m_gpuFramesDropped{ 0 };
+
+		unsigned int m_frame{ 0 };
+		double m_frameStart{ 0 };
+		std::vector<ProfileCounter> m_counters;
+		std::deque<ProfileFrame> m_history;
+
+		// Seconds to add to a GPU time to get the CPU time it happened
+		double m_gpuClockOffset{ 0 };
+		unsigned int m_calibratedFrame{ 0 };
+
+		TraceWriter m_trace;
+
+		// Flight recorder
+		bool m_recordHitches{ true };
+		float m_hitchMilliseconds{ 33.3f };
+		std::vector<unsigned int> m_pendingHitches;	// to be written once the frames after the first are in
+		HitchStats m_hitchStats;
+		std::thread m_dumpThread;
+		std::atomic<bool> m_dumping{ false };
+
+		// GUI state, pausing shows a copy of the history so recording goes on
+		bool m_paused{ false };
+		std::deque<ProfileFrame> m_pausedHistory;
+		int m_selectedFrame{ 0 };	// frames back from the newest
+
+		ThreadBuffer& ThisThread();
+		void DrainThreads(ProfileFrame& frame);
+		bool ResolveGpuFrame(GpuFrame& gpuFrame, bool discard);
+		ProfileFrame* FindFrame(unsigned int frame);
+		void CalibrateGpuClock();
+		std::vector<std::pair<int, std::string>> TrackNames();
+		static TraceBatch CpuBatch(const ProfileFrame& frame, bool hitch);
+		static TraceBatch GpuBatch(const ProfileFrame& frame);
+		void OnHitch(unsigned int frame, float milliseconds);
+		void DumpHitches();
+	public:
+		Profiler() = default;
+		Profiler(const Profiler&) = delete;
+		Profiler& operator=(const Profiler&) = delete;
+		~Profiler();
+
+		// Creates the timestamp queries, on the main thread which becomes thread 0
+		void Initialise(RenderBackend& backend);
+
+		// Deletes the queries, must be before the backend goes
+		void Release();
+
+		// Main thread, at the start of each frame. Closes the last frame's CPU scopes and reads any GPU results that have arrived.
+		void BeginFrame();
+
+		bool IsEnabled() const { return m_enabled; }
+		void SetEnabled(bool enabled) { m_enabled = enabled; }
+
+		// Name shown for the calling thread, e.g. "Simulation"
+		void SetThreadName(const std::string& name);
+
+		// Main thread, a value for the current frame. Name must outlive the profiler.
+		void SetCounter(const char* name, double value);
+
+		// Write every frame from now on to a Chrome trace file, including scopes made before Initialise
+		bool StartTrace(const std::string& filename);
+		void StopTrace();
+		bool IsTracing() const { return m_trace.IsOpen(); }
+
+		// Frames slower than this on the CPU or GPU are hitches, and with recording on are written to hitch_<frame>.json
+		void SetHitchThreshold(float milliseconds) { m_hitchMilliseconds = milliseconds; }
+		float GetHitchThreshold() const { return m_hitchMilliseconds; }
+		void SetRecordHitches(bool record) { m_recordHitches = record; }
+		const HitchStats& GetHitchStats() const { return m_hitchStats; }
+
+		// Used by ProfileScope. Name must outlive the profiler, e.g. a string literal.
+		void BeginCpuScope(double& start, int& depth);
+		void EndCpuScope(const char* name, double start, int depth);
+		size_t BeginGpuScope(const char* name, CommandList& list);
+		void EndGpuScope(size_t scope, CommandList& list);
+
+		// Newest first, index 0 is the frame last closed
+		size_t NumFrames() const { return m_history.size(); }
+		const ProfileFrame& GetFrame(size_t framesBack) const { return m_history[m_history.size() - 1 - framesBack]; }
+
+		// The newest frame with GPU times, nullptr if there is none yet
+		const ProfileFrame* LatestResolvedFrame() const;
+
+		// Per pass breakdown, flame graphs of the selected frame and frame times over the history
+		void DefineGUI();
+	};
+
+	// The profiler shared by the whole program
+	Profiler& GetProfiler();
+
+	// Times its lifetime on the CPU, and on the GPU when given a command list being recorded
+	class ProfileScope
+	{
+	private:
+		const char* m_name;
+		CommandList* m_list;
+		double m_start{ 0 };
+		int m_depth{ -1 };
+		size_t m_gpuScope{ SIZE_MAX };
+	public:
+		ProfileScope(const char* name, CommandList* list) : m_name(name), m_list(list)
+		{
+			Profiler& profiler{ GetProfiler() };
+			if (!profiler.IsEnabled())
+				return;
+			profiler.BeginCpuScope(m_start, m_depth);
+			if (m_list)
+				m_gpuScope = profiler.BeginGpuScope(m_name, *m_list);
+		}
+
+		~ProfileScope()
+		{
+			if (m_depth < 0)
+				return;
+			Profiler& profiler{ GetProfiler() };
+			if (m_gpuScope != SIZE_MAX)
+				profiler.EndGpuScope(m_gpuScope, *m_list);
+			profiler.EndCpuScope(m_name, m_start, m_depth);
+		}
+
+		ProfileScope(const ProfileScope&) = delete;
+		ProfileScope& operator=(const ProfileScope&) = delete;
+	};
+}
+
+#define PROFILE_CONCAT_INNER(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_INNER(a, b)
+
+// Time the rest of the enclosing block on the CPU, and on the GPU through the command list being recorded
+#define PROFILE(name, list) Helpers::ProfileScope PROFILE_CONCAT(profileScope, __LINE__)(name, &(list))
+
+// Time the rest of the enclosing block on the CPU
+#define PROFILE_CPU(name) Helpers::ProfileScope PROFILE_CONCAT(profileScope, __LINE__)(name, nullptr)
@@ -0,0 +1,55 @@
+#include "RenderBackend.h"
+
+namespace Helpers
+{
+	// Add a command to this frame's counts
+	void RenderBackend::CountCommand(const Command& command)
+	{
+		m_stats.commands++;
+		switch (command.type)
+		{
+		case CommandType::SetState:
+			m_stats.stateChanges++;
+			break;
+		case CommandType::BindProgram:
+			m_stats.programBinds++;
+			break;
+		case CommandType::SetUniform:
+			m_stats.uniforms++;
+			break;
+		case CommandType::BindTexture:
+			m_stats.textureBinds++;
+			break;
+		case CommandType::BindVertexArray:
+			m_stats.vertexArrayBinds++;
+			break;
+		case CommandType::DrawElements:
+		case CommandType::MultiDrawElementsIndirect:
+			m_stats.draws++;
+			break;
+		case CommandType::BindBufferRange:
+			m_stats.bufferBinds++;
+			break;
+		case CommandType::BindFramebuffer:
+			m_stats.framebufferBinds++;
+			break;
+		case CommandType::Barrier:
+			m_stats.barriers++;
+			break;
+		case CommandType::UpdateBuffer:
+			m_stats.bufferUploadBytes += (size_t)static_cast<const UpdateBufferCommand&>(command).size;
+			break;
+		case CommandType::BeginQuery:
+			m_stats.queries++;
+			break;
+		case CommandType::ReadPixels:
+		{
+			const glm::ivec4& rect{ static_cast<const ReadPixelsCommand&>(command).rect };
+			m_stats.readbackBytes += (size_t)rect.z * (size_t)rect.w * 4;
+			break;
+		}
+		default:
+			break;
+		}
+	}
+}
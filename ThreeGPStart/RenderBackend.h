@@ -0,0 +1,155 @@
+#pragma once
+// The interface the Renderer creates resources and executes command lists through. GLRenderBackend
+// does it with OpenGL, NullRenderBackend only validates and counts so the CPU side of rendering can be
+// run and timed on machines with no GPU. Handles are GLuint names in both.
+
+#include "ExternalLibraryHeaders.h"
+#include "RenderCommands.h"
+
+namespace Helpers
+{
+	// One attribute of an interleaved vertex buffer
+	struct VertexAttribute
+	{
+		GLuint location{ 0 };
+		GLint components{ 0 };
+		GLenum type{ GL_FLOAT };
+		GLboolean normalised{ GL_FALSE };
+		size_t offset{ 0 };
+	};
+
+	// Counts for one frame
+	struct RenderBackendStats
+	{
+		size_t commandLists{ 0 };
+		size_t commands{ 0 };
+		size_t draws{ 0 };
+		size_t stateChanges{ 0 };
+		size_t programBinds{ 0 };
+		size_t uniforms{ 0 };
+		size_t textureBinds{ 0 };
+		size_t vertexArrayBinds{ 0 };
+		size_t bufferBinds{ 0 };
+		size_t framebufferBinds{ 0 };
+		size_t barriers{ 0 };
+		size_t queries{ 0 };
+		size_t bufferUploadBytes{ 0 };
+		size_t readbackBytes{ 0 };
+		size_t validationErrors{ 0 };	// null backend only
+
+		RenderBackendStats& operator+=(const RenderBackendStats& other) {
+			commandLists += other.commandLists;
+			commands += other.commands;
+			draws += other.draws;
+			stateChanges += other.stateChanges;
+			programBinds += other.programBinds;
+			uniforms += other.uniforms;
+			textureBinds += other.textureBinds;
+			vertexArrayBinds += other.vertexArrayBinds;
+			bufferBinds += other.bufferBinds;
+			framebufferBinds += other.framebufferBinds;
+			barriers += other.barriers;
+			queries += other.queries;
+			bufferUploadBytes += other.bufferUploadBytes;
+			readbackBytes += other.readbackBytes;
+			validationErrors += other.validationErrors;
+			return *this;
+		}
+	};
+
+	class RenderBackend
+	{
+	protected:
+		RenderBackendStats m_stats;
+		RenderBackendStats m_lastFrameStats;
+
+		// Add a command to this frame's counts
+		void CountCommand(const Command& command);
+	public:
+		virtual ~RenderBackend() = default;
+
+		virtual const char* Name() const = 0;
+
+		// Load, compile and link a program, 0 on error
+		virtual GLuint CreateProgram(const std::string& vertexPath, const std::string& fragmentPath) = 0;
+		virtual void DeleteProgram(GLuint program) = 0;
+
+		// Location of an active uniform, -1 if the program has none. Safe to call from recording threads.
+		virtual GLint GetUniformLocation(GLuint program, const std::string& name) const = 0;
+
+		// A buffer holding size bytes of data, which may be nullptr to leave it empty.
+		// GL_STATIC_DRAW buffers are immutable, only buffers of other usages can be replaced with UpdateBuffer.
+		virtual GLuint CreateBuffer(GLenum target, const void* data, size_t size, GLenum usage) = 0;
+		virtual void DeleteBuffer(GLuint buffer) = 0;
+
+		// A buffer that stays mapped for writing until deleted, writes are seen by the GPU without flushing.
+		// The GPU may be reading any part of it so writers must fence what they hand over.
+		virtual GLuint CreatePersistentBuffer(size_t size, void*& mapped) = 0;
+
+		// A buffer ReadPixels commands copy into, mapped for reading until deleted. The CPU must wait on a fence
+		// after the command before reading what it wrote.
+		virtual GLuint CreateReadbackBuffer(size_t size, const void*& mapped) = 0;
+
+		// Required alignment of the offset of a uniform block range
+		virtual size_t GetUniformBufferAlignment() const = 0;
+
+		// Required alignment of the offset of a shader storage block range
+		virtual size_t GetStorageBufferAlignment() const = 0;
+
+		// A vertex array reading the attributes from vertexBuffer, with elementBuffer (if not 0) bound to it
+		virtual GLuint CreateVertexArray(GLuint vertexBuffer, GLsizei stride, const std::vector<VertexAttribute>& attributes, GLuint elementBuffer) = 0;
+		virtual void DeleteVertexArray(GLuint vertexArray) = 0;
+
+		// A mipmapped RGBA8 texture with linear filtering
+		virtual GLuint CreateTexture2D(GLsizei width, GLsizei height, const void* rgba, GLint wrap) = 0;
+		virtual void DeleteTexture(GLuint texture) = 0;
+
+		// Replace a region of one level of a CreateTexture2D texture with RGBA8 pixels, the other levels are left as they are
+		virtual void UpdateTexture2D(GLuint texture, GLint level, GLint x, GLint y, GLsizei width, GLsizei height, const void* rgba) = 0;
+
+		// A mipmapped RGBA8 2D array texture with linear filtering, bound with GL_TEXTURE_2D_ARRAY and deleted with DeleteTexture.
+		// rgba holds the layers one after another.
+		virtual GLuint CreateTextureArray(GLsizei width, GLsizei height, GLsizei layers, const void* rgba, GLint wrap) = 0;
+
+		// A single level texture to draw into with nearest filtering, format is sized e.g. GL_RGBA8 or GL_DEPTH_COMPONENT24
+		virtual GLuint CreateRenderTarget(GLsizei width, GLsizei height, GLenum format) = 0;
+
+		// A framebuffer drawing into the colour targets in order and the depth target if not 0, 0 if incomplete
+		virtual GLuint CreateFramebuffer(const std::vector<GLuint>& colourTargets, GLuint depthTarget) = 0;
+		virtual void DeleteFramebuffer(GLuint framebuffer) = 0;
+
+		virtual GLuint CreateQuery() = 0;
+		virtual void DeleteQuery(GLuint query) = 0;
+
+		// Never waits, false if the result is not available yet
+		virtual bool GetQueryResult(GLuint query, GLuint& result) = 0;
+
+		// Time a Timestamp command reached the GPU in nanoseconds, never waits, false if not available yet
+		virtual bool GetTimestamp(GLuint query, GLuint64& nanoseconds) = 0;
+
+		// The GPU's clock now in nanoseconds, the clock timestamps use, for lining GPU times up with the CPU's
+		virtual GLuint64 GetGpuTime() = 0;
+
+		// A fence after everything executed so far, signalled once the GPU has finished it
+		virtual GLsync InsertFence() = 0;
+
+		// Block until the fence is signalled
+		virtual void WaitFence(GLsync fence) = 0;
+		virtual void DeleteFence(GLsync fence) = 0;
+
+		// x, y, width, height of the area drawn to
+		virtual glm::ivec4 GetViewport() const = 0;
+
+		// Start counting a new frame
+		virtual void BeginFrame() { m_lastFrameStats = m_stats; m_stats = RenderBackendStats(); }
+
+		// Run a recorded list, lists run in the order given with state carrying on from one to the next
+		virtual void Execute(const CommandList& list) = 0;
+
+		// Wait until everything executed has finished
+		virtual void Finish() = 0;
+
+		// Counts for the last full frame
+		const RenderBackendStats& GetStats() const { return m_lastFrameStats; }
+	};
+}
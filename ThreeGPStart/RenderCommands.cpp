@@ -0,0 +1,221 @@
+#include "RenderCommands.h"
+
+namespace Helpers
+{
+	// Memory for bytes with the given power of two alignment, moving on to the next block when this one is full
+	void* LinearAllocator::Allocate(size_t bytes, size_t alignment)
+	{
+		while (m_blockIndex < m_blocks.size())
+		{
+			Block& block{ m_blocks[m_blockIndex] };
+			const uintptr_t base{ (uintptr_t)block.memory.get() };
+			const size_t aligned{ ((base + m_offset + alignment - 1) & ~(uintptr_t)(alignment - 1)) - base };
+			if (aligned + bytes <= block.size)
+			{
+				m_offset = aligned + bytes;
+				m_bytesUsed += bytes;
+				return block.memory.get() + aligned;
+			}
+			m_blockIndex++;
+			m_offset = 0;
+		}
+
+		// Out of blocks, anything bigger than a block gets a block of its own
+		Block block;
+		block.size = std::max(KBlockSize, bytes + alignment);
+		block.memory = std::make_unique<GLubyte[]>(block.size);
+		m_blocks.push_back(std::move(block));
+		m_blockIndex = m_blocks.size() - 1;
+		m_offset = 0;
+		return Allocate(bytes, alignment);
+	}
+
+	// Free everything, keeping the blocks for reuse
+	void LinearAllocator::Reset()
+	{
+		m_blockIndex = 0;
+		m_offset = 0;
+		m_bytesUsed = 0;
+	}
+
+	size_t LinearAllocator::BytesReserved() const
+	{
+		size_t bytes{ 0 };
+		for (const Block& block : m_blocks)
+			bytes += block.size;
+		return bytes;
+	}
+
+	void CommandList::SetState(const RenderState& state)
+	{
+		Add<SetStateCommand>(CommandType::SetState).state = state;
+	}
+
+	void CommandList::Clear(GLbitfield mask)
+	{
+		Add<ClearCommand>(CommandType::Clear).mask = mask;
+	}
+
+	void CommandList::BindProgram(GLuint program)
+	{
+		Add<BindProgramCommand>(CommandType::BindProgram).program = program;
+	}
+
+	SetUniformCommand& CommandList::AddUniform(GLint location, GLenum uniformType)
+	{
+		SetUniformCommand& command{ Add<SetUniformCommand>(CommandType::SetUniform) };
+		command.location = location;
+		command.uniformType = uniformType;
+		return command;
+	}
+
+	// Uniforms at location -1 are not recorded, as GL would ignore them
+	void CommandList::SetUniform(GLint location, GLint value)
+	{
+		if (location >= 0)
+			AddUniform(location, GL_INT).value.i[0] = value;
+	}
+
+	void CommandList::SetUniform(GLint location, GLfloat value)
+	{
+		if (location >= 0)
+			AddUniform(location, GL_FLOAT).value.f[0] = value;
+	}
+
+	void CommandList::SetUniform(GLint location, const glm::vec3& value)
+	{
+		if (location >= 0)
+			memcpy(AddUniform(location, GL_FLOAT_VEC3).value.f, glm::value_ptr(value), sizeof(value));
+	}
+
+	void CommandList::SetUniform(GLint location, const glm::vec4& value)
+	{
+		if (location >= 0)
+			memcpy(AddUniform(location, GL_FLOAT_VEC4).value.f, glm::value_ptr(value), sizeof(value));
+	}
+
+	void CommandList::SetUniform(GLint location, const glm::mat4& value)
+	{
+		if (location >= 0)
+			memcpy(AddUniform(location, GL_FLOAT_MAT4).value.f, glm::value_ptr(value), sizeof(value));
+	}
+
+	void CommandList::BindTexture(GLuint unit, GLuint texture, GLenum target)
+	{
+		BindTextureCommand& command{ Add<BindTextureCommand>(CommandType::BindTexture) };
+		command.unit = unit;
+		command.target = target;
+		command.texture = texture;
+	}
+
+	void CommandList::BindVertexArray(GLuint vao)
+	{
+		Add<BindVertexArrayCommand>(CommandType::BindVertexArray).vao = vao;
+	}
+
+	void CommandList::DrawElements(GLenum mode, GLsizei count, GLenum indexType, size_t byteOffset)
+	{
+		DrawElementsCommand& command{ Add<DrawElementsCommand>(CommandType::DrawElements) };
+		command.mode = mode;
+		command.count = count;
+		command.indexType = indexType;
+		command.byteOffset = byteOffset;
+		m_numDraws++;
+	}
+
+	void CommandList::MultiDrawElementsIndirect(GLenum mode, GLenum indexType, GLuint buffer, size_t offset, GLsizei drawCount)
+	{
+		MultiDrawElementsIndirectCommand& command{ Add<MultiDrawElementsIndirectCommand>(CommandType::MultiDrawElementsIndirect) };
+		command.mode = mode;
+		command.indexType = indexType;
+		command.buffer = buffer;
+		command.offset = offset;
+		command.drawCount = drawCount;
+		m_numDraws++;
+	}
+
+	// Copies the data now, so it may change or go away once recorded
+	void CommandList::UpdateBuffer(GLenum target, GLuint buffer, const void* data, size_t size)
+	{
+		void* copy{ size ? m_allocator->Allocate(size) : nullptr };
+		if (size)
+			memcpy(copy, data, size);
+
+		UpdateBufferCommand& command{ Add<UpdateBufferCommand>(CommandType::UpdateBuffer) };
+		command.target = target;
+		command.buffer = buffer;
+		command.size = (GLsizeiptr)size;
+		command.data = copy;
+	}
+
+	void CommandList::BindBufferRange(GLenum target, GLuint index, GLuint buffer, size_t offset, size_t size)
+	{
+		BindBufferRangeCommand& command{ Add<BindBufferRangeCommand>(CommandType::BindBufferRange) };
+		command.target = target;
+		command.index = index;
+		command.buffer = buffer;
+		command.offset = offset;
+		command.size = size;
+	}
+
+	void CommandList::BindFramebuffer(GLuint drawFramebuffer, GLuint readFramebuffer, const glm::ivec4& viewport)
+	{
+		BindFramebufferCommand& command{ Add<BindFramebufferCommand>(CommandType::BindFramebuffer) };
+		command.drawFramebuffer = drawFramebuffer;
+		command.readFramebuffer = readFramebuffer;
+		command.viewport = viewport;
+	}
+
+	void CommandList::BlitFramebuffer(const glm::ivec4& source, const glm::ivec4& destination, GLbitfield mask, GLenum filter)
+	{
+		BlitFramebufferCommand& command{ Add<BlitFramebufferCommand>(CommandType::BlitFramebuffer) };
+		command.source = source;
+		command.destination = destination;
+		command.mask = mask;
+		command.filter = filter;
+	}
+
+	void CommandList::Barrier(GLbitfield barriers)
+	{
+		Add<BarrierCommand>(CommandType::Barrier).barriers = barriers;
+	}
+
+	void CommandList::BeginQuery(GLenum target, GLuint query)
+	{
+		QueryCommand& command{ Add<QueryCommand>(CommandType::BeginQuery) };
+		command.target = target;
+		command.query = query;
+	}
+
+	void CommandList::EndQuery(GLenum target)
+	{
+		Add<QueryCommand>(CommandType::EndQuery).target = target;
+	}
+
+	void CommandList::BeginConditionalRender(GLuint query, GLenum mode)
+	{
+		QueryCommand& command{ Add<QueryCommand>(CommandType::BeginConditionalRender) };
+		command.target = mode;
+		command.query = query;
+	}
+
+	void CommandList::EndConditionalRender()
+	{
+		Add<Command>(CommandType::EndConditionalRender);
+	}
+
+	void CommandList::Timestamp(GLuint query)
+	{
+		QueryCommand& command{ Add<QueryCommand>(CommandType::Timestamp) };
+		command.target = GL_TIMESTAMP;
+		command.query = query;
+	}
+
+	void CommandList::ReadPixels(const glm::ivec4& rect, GLuint buffer, size_t offset)
+	{
+		ReadPixelsCommand& command{ Add<ReadPixelsCommand>(CommandType::ReadPixels) };
+		command.rect = rect;
+		command.buffer = buffer;
+		command.offset = offset;
+	}
+}
@@ -0,0 +1,270 @@
+#pragma once
+// Render command lists. Drawing is recorded as a list of small commands into linear allocator memory
+// without touching OpenGL, so lists can be recorded on any thread, then a RenderBackend executes them in order.
+
+#include "ExternalLibraryHeaders.h"
+
+namespace Helpers
+{
+	// Bump allocator, everything allocated is freed at once by Reset. Grows in blocks so earlier
+	// allocations never move. Not thread safe, each recording thread has its own.
+	class LinearAllocator
+	{
+	private:
+		static constexpr size_t KBlockSize{ 1024 * 1024 };
+
+		struct Block
+		{
+			std::unique_ptr<GLubyte[]> memory;
+			size_t size{ 0 };
+		};
+
+		std::vector<Block> m_blocks;
+		size_t m_blockIndex{ 0 };
+		size_t m_offset{ 0 };
+		size_t m_bytesUsed{ 0 };
+	public:
+		LinearAllocator() = default;
+		LinearAllocator(const LinearAllocator&) = delete;
+		LinearAllocator& operator=(const LinearAllocator&) = delete;
+
+		// Memory for bytes with the given power of two alignment, never nullptr
+		void* Allocate(size_t bytes, size_t alignment = 16);
+
+		// Free everything, keeping the blocks for reuse
+		void Reset();
+
+		size_t BytesUsed() const { return m_bytesUsed; }
+		size_t BytesReserved() const;
+	};
+
+	// Fixed function state set by a SetState command, everything is set each time
+	struct RenderState
+	{
+		bool depthTest{ true };
+		bool depthWrite{ true };
+		bool cullFace{ true };
+		bool colourWrite{ true };
+		bool wireframe{ false };
+		bool primitiveRestart{ true };	// restart strips at the largest value of their index type
+		GLuint clipDistances{ 0 };		// gl_ClipDistance[0] to [clipDistances - 1] are enabled, at most KMaxClipDistances
+		glm::ivec4 scissor{ 0 };		// x, y, width, height, no scissor test while the width is 0, also limits Clear
+
+		static constexpr GLuint KMaxClipDistances{ 8 };
+	};
+
+	enum class CommandType : GLubyte
+	{
+		SetState,
+		Clear,
+		BindProgram,
+		SetUniform,
+		BindTexture,
+		BindVertexArray,
+		DrawElements,
+		MultiDrawElementsIndirect,
+		UpdateBuffer,
+		BindBufferRange,
+		BindFramebuffer,
+		BlitFramebuffer,
+		Barrier,
+		BeginQuery,
+		EndQuery,
+		BeginConditionalRender,
+		EndConditionalRender,
+		Timestamp,
+		ReadPixels
+	};
+
+	// Every command starts with this, commands are linked in recording order
+	struct Command
+	{
+		CommandType type;
+		const Command* next{ nullptr };
+	};
+
+	struct SetStateCommand : Command
+	{
+		RenderState state;
+	};
+
+	struct ClearCommand : Command
+	{
+		GLbitfield mask{ 0 };
+	};
+
+	struct BindProgramCommand : Command
+	{
+		GLuint program{ 0 };
+	};
+
+	// Type is the GLSL type e.g. GL_FLOAT_MAT4, ints and samplers use GL_INT
+	struct SetUniformCommand : Command
+	{
+		GLint location{ -1 };
+		GLenum uniformType{ GL_FLOAT };
+		union
+		{
+			GLfloat f[16];
+			GLint i[4];
+		} value;
+	};
+
+	struct BindTextureCommand : Command
+	{
+		GLuint unit{ 0 };
+		GLenum target{ GL_TEXTURE_2D };
+		GLuint texture{ 0 };
+	};
+
+	struct BindVertexArrayCommand : Command
+	{
+		GLuint vao{ 0 };
+	};
+
+	struct DrawElementsCommand : Command
+	{
+		GLenum mode{ GL_TRIANGLES };
+		GLsizei count{ 0 };
+		GLenum indexType{ GL_UNSIGNED_INT };
+		size_t byteOffset{ 0 };
+	};
+
+	// Reads drawCount commands from buffer starting offset bytes in
+	struct MultiDrawElementsIndirectCommand : Command
+	{
+		GLenum mode{ GL_TRIANGLES };
+		GLenum indexType{ GL_UNSIGNED_INT };
+		GLuint buffer{ 0 };
+		size_t offset{ 0 };
+		GLsizei drawCount{ 0 };
+	};
+
+	// Replaces the whole buffer store, orphaning the old one. Data is a copy in the list's memory.
+	struct UpdateBufferCommand : Command
+	{
+		GLenum target{ GL_ARRAY_BUFFER };
+		GLuint buffer{ 0 };
+		GLsizeiptr size{ 0 };
+		const void* data{ nullptr };
+	};
+
+	// Binds part of a buffer to an indexed target, e.g. a uniform block binding
+	struct BindBufferRangeCommand : Command
+	{
+		GLenum target{ GL_UNIFORM_BUFFER };
+		GLuint index{ 0 };
+		GLuint buffer{ 0 };
+		size_t offset{ 0 };
+		size_t size{ 0 };
+	};
+
+	// Framebuffer 0 is the window, the viewport is x, y, width, height
+	struct BindFramebufferCommand : Command
+	{
+		GLuint drawFramebuffer{ 0 };
+		GLuint readFramebuffer{ 0 };
+		glm::ivec4 viewport{ 0 };
+	};
+
+	// Copies between the bound read and draw framebuffers
+	struct BlitFramebufferCommand : Command
+	{
+		glm::ivec4 source{ 0 };			// x0, y0, x1, y1
+		glm::ivec4 destination{ 0 };
+		GLbitfield mask{ GL_COLOR_BUFFER_BIT };
+		GLenum filter{ GL_NEAREST };
+	};
+
+	// glMemoryBarrier, makes image store and shader storage writes visible to the reads in the bits
+	struct BarrierCommand : Command
+	{
+		GLbitfield barriers{ 0 };
+	};
+
+	// Used by BeginQuery, EndQuery (query unused), BeginConditionalRender (target is the wait mode) and Timestamp (target unused)
+	struct QueryCommand : Command
+	{
+		GLenum target{ 0 };
+		GLuint query{ 0 };
+	};
+
+	// Copies RGBA8 pixels of the bound read framebuffer's first colour target into a buffer at offset, rows packed
+	// tightly from the bottom. The CPU may only read them once a fence after the command is signalled.
+	struct ReadPixelsCommand : Command
+	{
+		glm::ivec4 rect{ 0 };	// x, y, width, height
+		GLuint buffer{ 0 };
+		size_t offset{ 0 };
+	};
+
+	// Records commands into an allocator. The list only points into the allocator's memory so it is
+	// valid until the allocator is reset.
+	class CommandList
+	{
+	private:
+		LinearAllocator* m_allocator{ nullptr };
+		const Command* m_first{ nullptr };
+		Command* m_last{ nullptr };
+		size_t m_numCommands{ 0 };
+		size_t m_numDraws{ 0 };
+
+		template<typename T>
+		T& Add(CommandType type)
+		{
+			T* command{ new (m_allocator->Allocate(sizeof(T), alignof(T))) T() };
+			command->type = type;
+			if (m_last)
+				m_last->next = command;
+			else
+				m_first = command;
+			m_last = command;
+			m_numCommands++;
+			return *command;
+		}
+
+		SetUniformCommand& AddUniform(GLint location, GLenum uniformType);
+	public:
+		CommandList() = default;
+		explicit CommandList(LinearAllocator& allocator) : m_allocator(&allocator) {}
+
+		void SetState(const RenderState& state);
+		void Clear(GLbitfield mask);
+		void BindProgram(GLuint program);
+
+		// Uniforms at location -1 are not recorded, as GL would ignore them
+		void SetUniform(GLint location, GLint value);
+		void SetUniform(GLint location, GLfloat value);
+		void SetUniform(GLint location, const glm::vec3& value);
+		void SetUniform(GLint location, const glm::vec4& value);
+		void SetUniform(GLint location, const glm::mat4& value);
+
+		void BindTexture(GLuint unit, GLuint texture, GLenum target = GL_TEXTURE_2D);
+		void BindVertexArray(GLuint vao);
+		void DrawElements(GLenum mode, GLsizei count, GLenum indexType, size_t byteOffset);
+		void MultiDrawElementsIndirect(GLenum mode, GLenum indexType, GLuint buffer, size_t offset, GLsizei drawCount);
+
+		// Copies the data now, so it may change or go away once recorded
+		void UpdateBuffer(GLenum target, GLuint buffer, const void* data, size_t size);
+
+		void BindBufferRange(GLenum target, GLuint index, GLuint buffer, size_t offset, size_t size);
+
+		void BindFramebuffer(GLuint drawFramebuffer, GLuint readFramebuffer, const glm::ivec4& viewport);
+		void BlitFramebuffer(const glm::ivec4& source, const glm::ivec4& destination, GLbitfield mask, GLenum filter);
+		void Barrier(GLbitfield barriers);
+
+		void BeginQuery(GLenum target, GLuint query);
+		void EndQuery(GLenum target);
+		void BeginConditionalRender(GLuint query, GLenum mode);
+		void EndConditionalRender();
+
+		// The GPU time once the commands before it have finished
+		void Timestamp(GLuint query);
+
+		void ReadPixels(const glm::ivec4& rect, GLuint buffer, size_t offset);
+
+		const Command* First() const { return m_first; }
+		size_t NumCommands() const { return m_numCommands; }
+		size_t NumDraws() const { return m_numDraws; }
+	};
+}
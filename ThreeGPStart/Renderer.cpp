@@ -1,8 +1,18 @@
 #include "Renderer.h"
 #include "Camera.h"
 #include "ImageLoader.h"
+#include "GLRenderBackend.h"
+#include "GLInterceptor.h"
+#include "FrameCapture.h"
 
-Renderer::Renderer() 
+#include <random>
+
+Renderer::Renderer() : m_backend(std::make_unique<Helpers::GLRenderBackend>())
+{
+
+}
+
+Renderer::Renderer(std::unique_ptr<Helpers::RenderBackend> backend) : m_backend(std::move(backend))
 {
 
 }
@@ -10,13 +20,8 @@ Renderer::Renderer()
 // On exit must clean up any OpenGL resources e.g. the program, the buffers
 Renderer::~Renderer()
 {
-	// TODO: clean up any memory used including OpenGL objects via glDelete* calls
-	glDeleteProgram(m_program);
-	glDeleteProgram(cube_Program);
-	//for (int i = 0; i < m_modelVector.size(); i++)
-	//{
-	//	glDeleteBuffers(1, &m_modelVector[i].m_meshVector[i].VAO);
-	//}
+	// The GPU objects are deleted by their handles, after which m_gpuResources reports anything left
+	Helpers::GetProfiler().Release();
 }
 
 // Use IMGUI for a simple on screen GUI
@@ -32,41 +37,1022 @@ void Renderer::DefineGUI()
 	ImGui::Checkbox("Wireframe", &m_wireframe);	// A checkbox linked to a member variable
 
 	ImGui::Text("Application average %.3f ms/frame (%.1f FPS)", 1000.0f / ImGui::GetIO().Framerate, ImGui::GetIO().Framerate);
+	ImGui::Text("Simulation tick %u", m_lastSimulationTick);
+
+	// Vertex sizes and the error introduced by quantisation, per mesh
+	if (ImGui::CollapsingHeader("Vertex formats"))
+	{
+		for (const Model* model : { &Skymodel, &jeepmodel, &terrainmodel, &cubemodel })
+		{
+			for (const Mesh& mesh : model->m_meshVector)
+			{
+				ImGui::Text("%s: %u verts, %u bytes/vertex (was %u)", mesh.m_name.c_str(), mesh.m_numVertices, mesh.m_vertexStride, (GLuint)Helpers::KUnpackedVertexSize);
+				ImGui::Text("  pos err %.4f (rms %.4f) normal err %.3f deg uv err %.5f", mesh.m_quantisationError.maxPositionError,
+					mesh.m_quantisationError.rmsPositionError, mesh.m_quantisationError.maxNormalErrorDegrees, mesh.m_quantisationError.maxUVError);
+			}
+		}
+	}
+
+	// Level of detail settings and what they saved last frame
+	if (ImGui::CollapsingHeader("Level of detail"))
+	{
+		ImGui::Checkbox("Enable LOD", &m_lodEnabled);
+		ImGui::Checkbox("Dithered cross fade", &m_lodCrossFade);
+		ImGui::SliderFloat("Max error (pixels)", &m_lodErrorPixels, 0.1f, 20.0f);
+		ImGui::SliderFloat("Hysteresis", &m_lodHysteresis, 0.0f, 0.9f);
+		ImGui::SliderFloat("Fade time (s)", &m_lodFadeSeconds, 0.0f, 2.0f);
+
+		GLuint drawn{ 0 };
+		GLuint full{ 0 };
+		for (const Model* model : { &Skymodel, &jeepmodel, &terrainmodel, &cubemodel })
+		{
+			for (const Mesh& mesh : model->m_meshVector)
+			{
+				drawn += mesh.m_lastFrameStats.triangles;
+				full += mesh.m_lastFrameStats.fullDetailTriangles;
+				if (mesh.m_lods.size() > 1)
+					ImGui::Text("%s: LOD %d of %d%s", mesh.m_name.c_str(), mesh.m_currentLod, (int)mesh.m_lods.size(), mesh.m_fadingLod >= 0 ? " (fading)" : "");
+			}
+		}
+		ImGui::Text("Triangles drawn %u, saved %d", drawn, (int)full - (int)drawn);
+	}
+
+	// Meshlet culling results, validation compares against culling each triangle on the next frame
+	if (ImGui::CollapsingHeader("Meshlet culling"))
+	{
+		ImGui::Checkbox("Cull meshlets", &m_meshletCulling);
+		ImGui::Checkbox("Normal cone culling", &m_meshletBackfaceCulling);
+		if (ImGui::Button("Validate against per triangle culling"))
+			m_validateMeshlets = true;
+		if (!m_meshletValidationResult.empty())
+			ImGui::TextWrapped("%s", m_meshletValidationResult.c_str());
+
+		for (const Model* model : { &Skymodel, &jeepmodel, &terrainmodel, &cubemodel })
+		{
+			for (const Mesh& mesh : model->m_meshVector)
+			{
+				if (!mesh.m_clusters)
+					continue;
+				const MeshClusters& clusters{ *mesh.m_clusters };
+				ImGui::Text("%s: %u of %u meshlets, %u of %u triangles", mesh.m_name.c_str(), clusters.visibleMeshlets,
+					(GLuint)clusters.data.meshlets.size(), clusters.visibleTriangles, mesh.m_numTriangles);
+				ImGui::Text("  %u indirect draws, culled in %.3f ms", (GLuint)clusters.commands.size(), clusters.cullMilliseconds);
+			}
+		}
+	}
+
+	// Software occlusion culling timings and results for last frame
+	if (ImGui::CollapsingHeader("Occlusion culling"))
+	{
+		ImGui::Checkbox("Cull occluded objects", &m_occlusionCulling);
+		const Helpers::OcclusionStats& stats{ m_occlusionCuller.GetStats() };
+		ImGui::Text("Depth buffer %dx%d, %zu occluder triangles", m_occlusionCuller.Width(), m_occlusionCuller.Height(), stats.occluderTriangles);
+		ImGui::Text("Transform %.3f ms, raster %.3f ms, pyramid %.3f ms", stats.transformMilliseconds, stats.rasterMilliseconds, stats.pyramidMilliseconds);
+		ImGui::Text("Tested %zu objects, culled %zu", stats.objectsTested, stats.objectsCulled);
+	}
+
+	// GPU occlusion queries, results arrive a frame or more after the boxes are drawn
+	if (ImGui::CollapsingHeader("Occlusion queries"))
+	{
+		ImGui::Checkbox("Query bounding boxes", &m_gpuOcclusionQueries);
+		ImGui::SliderInt("Retest visible every N frames", &m_occlusionQueries.m_retestInterval, 1, 16);
+		const Helpers::OcclusionQueryStats& stats{ m_occlusionQueries.GetStats() };
+		ImGui::Text("%zu objects, %zu queries issued, %zu results read", stats.objects, stats.issued, stats.resolved);
+		ImGui::Text("Latency %.2f frames, occluded %.0f%%, same as before %.0f%%", stats.AverageLatency(), stats.OccludedRate() * 100.0f, stats.CoherenceRate() * 100.0f);
+		ImGui::Text("Jeep %s, cube %s", m_occlusionQueries.IsVisible(m_jeepQueryId) ? "visible" : "hidden", m_occlusionQueries.IsVisible(m_cubeQueryId) ? "visible" : "hidden");
+	}
+
+	// Job system counters and how the occlusion rasteriser scales over threads
+	if (ImGui::CollapsingHeader("Job system"))
+	{
+		const Helpers::JobSystem& jobs{ Helpers::GetJobSystem() };
+		ImGui::Text("%zu threads, %zu jobs run, %zu stolen", jobs.NumThreads(), jobs.JobsRun(), jobs.Steals());
+		if (ImGui::Button("Measure scaling (stalls for a few seconds)"))
+			MeasureJobScaling();
+		for (const Helpers::JobScalingResult& result : m_jobScaling)
+			ImGui::Text("%2zu threads: %7.2f ms, x%.2f", result.threads, result.milliseconds, result.speedUp);
+	}
+
+	// Command list recording and submission for this frame, and the many draws benchmark
+	if (ImGui::CollapsingHeader("Command lists"))
+	{
+		const Helpers::RenderBackendStats& stats{ m_backend->GetStats() };
+		ImGui::Checkbox("Record passes in parallel", &m_parallelRecording);
+		ImGui::Text("%s backend: %zu lists, %zu draws, %zu state, %zu program, %zu uniform, %zu texture, %zu VAO", m_backend->Name(),
+			stats.commandLists, stats.draws, stats.stateChanges, stats.programBinds, stats.uniforms, stats.textureBinds, stats.vertexArrayBinds);
+		ImGui::Text("%zu commands, %.1f KB, recorded in %.3f ms, submitted in %.3f ms", m_frameCommands,
+			m_frameCommandBytes / 1024.0f, m_recordMilliseconds, m_submitMilliseconds);
+		if (ImGui::Button("Benchmark 100k draws"))
+			BenchmarkCommandLists(100000);
+		if (m_commandBenchmark.draws)
+		{
+			const CommandListBenchmark& bench{ m_commandBenchmark };
+			ImGui::Text("%zu draws, %zu commands, %.1f MB", bench.draws, bench.commands, bench.bytes / (1024.0f * 1024.0f));
+			ImGui::Text("Record %.2f ms on 1 thread, %.2f ms on %zu (x%.2f)", bench.recordSerialMilliseconds, bench.recordParallelMilliseconds,
+				Helpers::GetJobSystem().NumThreads(), bench.recordSerialMilliseconds / std::max(bench.recordParallelMilliseconds, 0.001f));
+			ImGui::Text("Submit %.2f ms (%.1f M draws/s), GPU finish %.2f ms", bench.submitMilliseconds,
+				bench.draws / std::max(bench.submitMilliseconds, 0.001f) / 1000.0f, bench.finishMilliseconds);
+		}
+	}
+
+	// The passes in the order the frame graph chose, and the render target memory it saved by aliasing
+	if (ImGui::CollapsingHeader("Frame graph"))
+	{
+		const Helpers::FrameGraphStats& stats{ m_frameGraph.GetStats() };
+		ImGui::Checkbox("Draw the scene into transient targets", &m_offscreenScene);
+		bool aliasing{ m_frameGraph.IsAliasing() };
+		if (ImGui::Checkbox("Alias transient targets", &aliasing))
+			m_frameGraph.SetAliasing(aliasing);
+		ImGui::Text("%zu passes, %zu culled, %zu barriers, %zu framebuffer changes, compiled in %.3f ms", stats.passes, stats.culledPasses,
+			stats.barriers, stats.framebufferChanges, stats.compileMilliseconds);
+		ImGui::Text("%zu transient targets in %zu textures, %.2f MB (%.2f MB without aliasing)", stats.transientTextures, stats.physicalTextures,
+			stats.aliasedBytes / (1024.0f * 1024.0f), stats.transientBytes / (1024.0f * 1024.0f));
+		for (size_t i = 0; i < m_frameGraph.NumPasses(); i++)
+		{
+			ImGui::Text("%zu: %s%s%s", i, m_frameGraph.PassName(i).c_str(), m_frameGraph.PassOnMainThread(i) ? " (main thread)" : "",
+				m_frameGraph.PassBarriers(i) ? " (barrier)" : "");
+		}
+	}
+
+	// CPU and GPU time of each pass, from the PROFILE scopes, with the hitch count always visible
+	char profilerLabel[64];
+	snprintf(profilerLabel, sizeof(profilerLabel), "Profiler (%zu hitches)###Profiler", Helpers::GetProfiler().GetHitchStats().hitches);
+	if (ImGui::CollapsingHeader(profilerLabel))
+		Helpers::GetProfiler().DefineGUI();
+
+	// The GL calls the backend actually made last frame, and capturing a frame for the replayer
+	if (ImGui::CollapsingHeader("GL calls"))
+	{
+		if (Helpers::CaptureRenderBackend* capture = dynamic_cast<Helpers::CaptureRenderBackend*>(m_backend.get()))
+		{
+			if (ImGui::Button("Capture frame"))
+				capture->CaptureNextFrame();
+			ImGui::SameLine();
+			ImGui::Text("%s, %zu written", capture->GetFilename().c_str(), capture->CapturesWritten());
+		}
+		Helpers::GetGLInterceptor().DefineGUI();
+	}
+
+	// GPU memory of every asset, and the objects each owns
+	if (ImGui::CollapsingHeader("GPU memory"))
+		m_gpuResources.DefineGUI();
+
+	// The texture arrays and the textures in their layers
+	if (ImGui::CollapsingHeader("Texture pool"))
+		m_texturePool.DefineGUI();
+
+	// Mip levels on the GPU against those wanted, within the memory budget
+	if (ImGui::CollapsingHeader("Texture residency"))
+		m_textureResidency.DefineGUI();
+
+	// How the terrain is textured, and how much of the splat map's weight the materials sampled cover
+	if (ImGui::CollapsingHeader("Terrain"))
+	{
+		int shading{ (int)m_terrainShading };
+		ImGui::RadioButton("Tiled", &shading, (int)TerrainShading::Tiled);
+		ImGui::SameLine();
+		ImGui::RadioButton("Virtual texture", &shading, (int)TerrainShading::VirtualTexture);
+		ImGui::SameLine();
+		ImGui::RadioButton("Splat map", &shading, (int)TerrainShading::Splat);
+		m_terrainShading = (TerrainShading)shading;
+
+		ImGui::SliderInt("Splat materials sampled", &m_splatSamples, 1, 4);
+		ImGui::SliderFloat("Splat blend depth", &m_splatBlendDepth, 0.01f, 1.0f, "%.2f");
+		ImGui::Text("%zu materials, %dx%d weights, %.1f%% of texels have more materials than are sampled", m_splatRules.size(),
+			KSplatMapSize, KSplatMapSize, m_splatStats.FractionOver((size_t)m_splatSamples) * 100.0f);
+		for (size_t i = 0; i < m_splatRules.size() && i < m_splatStats.coverage.size(); i++)
+			ImGui::Text("%2zu  %5.1f%%  %s", i, m_splatStats.coverage[i] * 100.0f, m_splatRules[i].name.c_str());
+	}
+
+	// Pages of the terrain's virtual texture asked for by the feedback against those in the cache
+	if (ImGui::CollapsingHeader("Virtual texture"))
+	{
+		m_virtualTexture.DefineGUI();
+	}
+
+	// Lights binned into the clusters of the view this frame, checked against brute force and benchmarked on demand
+	if (ImGui::CollapsingHeader("Clustered lighting"))
+	{
+		const Helpers::LightBinningStats& stats{ m_lightClusters.GetLastStats() };
+		ImGui::Checkbox("Clustered lights", &m_clusteredLightsOn);
+		ImGui::SliderInt("Lights", &m_numLights, 0, 4096);
+		ImGui::Text("%d x %d x %d clusters, %zu lit, at most %zu lights in one", Helpers::ClusteredLighting::KClustersX, Helpers::ClusteredLighting::KClustersY,
+			Helpers::ClusteredLighting::KClustersZ, stats.clustersLit, stats.maxLightsPerCluster);
+		ImGui::Text("%zu of %zu lights in view, %zu indices (%zu dropped), binned in %.3f ms", stats.lightsBinned, stats.lights, stats.indices,
+			stats.indicesDropped, stats.milliseconds);
+		if (ImGui::Button("Validate against brute force"))
+			m_lightValidation = m_lightClusters.Validate(m_lights);
+		if (m_lightValidation.pairs)
+		{
+			ImGui::Text("%s: %zu light cluster pairs, %zu binned, %zu missing, brute force %.2f ms", m_lightValidation.Passed() ? "Passed" : "FAILED",
+				m_lightValidation.pairs, m_lightValidation.pairsBinned, m_lightValidation.pairsMissing, m_lightValidation.bruteForceMilliseconds);
+		}
+		if (ImGui::Button("Benchmark 1k and 10k lights"))
+			BenchmarkLightBinning();
+		for (const LightBinningBenchmark& bench : m_lightBenchmarks)
+		{
+			ImGui::Text("%5zu lights: binned %.3f ms, brute force %.2f ms (x%.0f), %zu indices, %s", bench.lights, bench.stats.milliseconds,
+				bench.validation.bruteForceMilliseconds, bench.validation.bruteForceMilliseconds / std::max(bench.stats.milliseconds, 0.001f),
+				bench.stats.indices, bench.validation.Passed() ? "none missing" : "FAILED");
+		}
+	}
+
+	// The sun's shadow cascades, what was culled and drawn into each and why the cached ones were last drawn
+	if (ImGui::CollapsingHeader("Shadows"))
+	{
+		ImGui::Checkbox("Sun shadows", &m_shadowsOn);
+		ImGui::SliderFloat("Sun azimuth", &m_sunAzimuth, -180.0f, 180.0f, "%.1f");
+		ImGui::SliderFloat("Sun elevation", &m_sunElevation, 5.0f, 90.0f, "%.1f");
+		m_shadows.DefineGUI();
+	}
+
+	// Per frame data written to the mapped stream buffer, and any wait for the GPU to free a region
+	if (ImGui::CollapsingHeader("Stream buffer"))
+	{
+		const Helpers::StreamBufferStats& stats{ m_streamBuffer.GetLastFrameStats() };
+		ImGui::Text("%zu regions of %zu KB, %zu buffer range binds", m_streamBuffer.NumRegions(), m_streamBuffer.RegionSize() / 1024,
+			m_backend->GetStats().bufferBinds);
+		ImGui::Text("%.1f KB in %zu allocations, peak %.1f KB", stats.bytes / 1024.0f, stats.allocations, m_streamBuffer.PeakBytes() / 1024.0f);
+		ImGui::Text("Stalled %.3f ms waiting for the GPU", stats.stallMilliseconds);
+		if (stats.failed)
+			ImGui::TextColored(ImVec4(1, 0.3f, 0.3f, 1), "%zu allocations did not fit", stats.failed);
+	}
+
+	// Index sizes against a 32 bit triangle list, and the bytes read by last frame's draws
+	if (ImGui::CollapsingHeader("Index buffers"))
+	{
+		for (const Model* model : { &Skymodel, &jeepmodel, &terrainmodel, &cubemodel })
+		{
+			for (const Mesh& mesh : model->m_meshVector)
+			{
+				ImGui::Text("%s: %u bit %s, %u indices, %u bytes (32 bit list %u)", mesh.m_name.c_str(), mesh.m_indexSize * 8,
+					mesh.m_primitive == GL_TRIANGLE_STRIP ? "strip" : "list", mesh.m_numElements, mesh.m_indexBufferBytes, mesh.m_numTriangles * 3 * (GLuint)sizeof(GLuint));
+				ImGui::Text("  %u draws, %u index bytes/frame", mesh.m_lastFrameStats.draws, mesh.m_lastFrameStats.indexBytes);
+			}
+		}
+	}
 		
 	ImGui::End();
 }
 
 // Load, compile and link the shaders and create a program object to host them
-GLuint Renderer::CreateProgram(std::string fragmentpath, std::string vertexpath)
+// Several programs share a vertex shader so both paths name it in the resource reports
+Helpers::GpuProgram Renderer::CreateProgram(std::string fragmentpath, std::string vertexpath)
+{
+	return m_gpuResources.CreateProgram(vertexpath + "+" + fragmentpath, vertexpath, fragmentpath);
+}
+
+// Location of a uniform looked up by the backend when the program was created, -1 if it has none
+GLint Renderer::Uniform(GLuint program, const std::string& name) const
+{
+	return m_backend->GetUniformLocation(program, name);
+}
+
+// The command allocator of the calling job thread, made on first use by the main thread
+Helpers::LinearAllocator& Renderer::ThreadAllocator()
+{
+	const int index{ Helpers::GetJobSystem().ThreadIndex() };
+	assert(index >= 0 && index < (int)m_commandAllocators.size());
+	return *m_commandAllocators[index];
+}
+
+// Free every command recorded, the lists must have been executed
+void Renderer::ResetCommandAllocators()
+{
+	if (m_commandAllocators.empty())
+	{
+		for (size_t i = 0; i < Helpers::GetJobSystem().NumThreads(); i++)
+			m_commandAllocators.push_back(std::make_unique<Helpers::LinearAllocator>());
+	}
+
+	for (auto& allocator : m_commandAllocators)
+		allocator->Reset();
+}
+
+// Interleave a helper mesh with the given vertex layout and upload it into a VBO, an EBO and a VAO
+// Elements are packed with the smallest index type that fits and optionally converted into restarted strips
+// All levels of detail share the vertices and live one after another in the element buffer
+// With meshlets level 0 is reordered into meshlet order, which needs a triangle list rather than strips
+// Its GPU memory is counted against asset
+template<typename Layout>
+Mesh Renderer::CreateMesh(const std::string& asset, const Helpers::Mesh& mesh, bool useStrips, bool buildLods, bool buildMeshlets)
+{
+	PROFILE_CPU("Create mesh");
+	Mesh newMesh;
+	newMesh.m_name = mesh.name.empty() ? "Noname" : mesh.name;
+	newMesh.m_quantisation = Helpers::MeshQuantisation::FromMesh(mesh);
+	newMesh.m_numVertices = (GLuint)mesh.vertices.size();
+	newMesh.m_vertexStride = (GLuint)Layout::KStride;
+	newMesh.m_boundsCentre = newMesh.m_quantisation.positionOffset + newMesh.m_quantisation.positionScale * 0.5f;
+	newMesh.m_boundsRadius = glm::length(newMesh.m_quantisation.positionScale) * 0.5f;
+
+	const std::vector<GLubyte> vertexData{ Layout::Pack(mesh, newMesh.m_quantisation) };
+
+	newMesh.m_buffers = std::make_shared<MeshBuffers>();
+	newMesh.m_buffers->vertexBuffer = m_gpuResources.CreateBuffer(asset, GL_ARRAY_BUFFER, vertexData.data(), vertexData.size(), GL_STATIC_DRAW);
+
+	std::vector<Helpers::MeshLod> lods;
+	if (buildLods)
+	{
+		PROFILE_CPU("Build LODs");
+		lods = Helpers::BuildLodChain(mesh);
+	}
+	else
+		lods.push_back(Helpers::MeshLod{ mesh.elements, 0.0f });
+
+	if (buildMeshlets && !useStrips)
+	{
+		PROFILE_CPU("Build meshlets");
+		newMesh.m_clusters = std::make_shared<MeshClusters>();
+		newMesh.m_clusters->positions.vertices = mesh.vertices;
+		newMesh.m_clusters->data = Helpers::BuildMeshlets(mesh, lods[0].elements);
+		newMesh.m_clusters->cullData.Build(newMesh.m_clusters->data.meshlets);
+		lods[0].elements = newMesh.m_clusters->data.Elements();
+	}
+
+	// Level 0 decides the index type from the narrowest, the smaller levels use the same one
+	std::vector<GLubyte> indexBytes;
+	for (const Helpers::MeshLod& lod : lods)
+	{
+		const GLenum minimumType{ newMesh.m_lods.empty() ? (GLenum)GL_UNSIGNED_BYTE : newMesh.m_indexType };
+		const Helpers::IndexBufferData indexData{ Helpers::BuildIndexBuffer(lod.elements, useStrips, minimumType) };
+		if (newMesh.m_lods.empty())
+		{
+			newMesh.m_indexType = indexData.type;
+			newMesh.m_primitive = indexData.mode;
+			newMesh.m_indexSize = indexData.IndexSize();
+			newMesh.m_numElements = indexData.count;
+			newMesh.m_numTriangles = (GLuint)(lod.elements.size() / 3);
+			std::cout << "Mesh " << newMesh.m_name << ": " << Layout::KStride << " bytes per vertex, " << indexData.ToString() << " indices" << std::endl;
+		}
+
+		LodRange range;
+		range.firstIndex = (GLuint)(indexBytes.size() / newMesh.m_indexSize);
+		range.count = indexData.count;
+		range.numTriangles = (GLuint)(lod.elements.size() / 3);
+		range.error = lod.error;
+		newMesh.m_lods.push_back(range);
+
+		indexBytes.insert(indexBytes.end(), indexData.bytes.begin(), indexData.bytes.end());
+
+		if (buildLods)
+			std::cout << "  LOD " << newMesh.m_lods.size() - 1 << ": " << range.numTriangles << " triangles, error " << range.error << std::endl;
+	}
+	if (newMesh.m_clusters)
+		std::cout << "  " << newMesh.m_clusters->data.meshlets.size() << " meshlets" << std::endl;
+	newMesh.m_indexBufferBytes = (GLuint)indexBytes.size();
+
+	MeshBuffers& buffers{ *newMesh.m_buffers };
+	buffers.elementBuffer = m_gpuResources.CreateBuffer(asset, GL_ELEMENT_ARRAY_BUFFER, indexBytes.data(), indexBytes.size(), GL_STATIC_DRAW);
+	buffers.vertexArray = m_gpuResources.CreateVertexArray(asset, buffers.vertexBuffer.Get(), (GLsizei)Layout::KStride, Layout::VertexAttributes(),
+		buffers.elementBuffer.Get());
+	newMesh.VAO = buffers.vertexArray.Get();
+
+	// Measure what the quantisation cost us against the float originals
+	newMesh.m_quantisationError = Layout::MeasureError(mesh, newMesh.m_quantisation);
+	std::cout << "  Quantisation error " << newMesh.m_quantisationError.ToString() << std::endl;
+
+	return newMesh;
+}
+
+// Choose the level of detail of a mesh from its projected error in pixels
+// Detail is added as soon as the current level exceeds the limit but only removed once the coarser
+// level is comfortably under it, so a mesh at the boundary distance does not flick between levels
+void Renderer::SelectLod(Mesh& mesh, const glm::mat4& model_xform, const glm::vec3& cameraPosition, float pixelsPerUnit, float deltaTime)
+{
+	// Advance any cross fade in progress
+	if (mesh.m_fadingLod >= 0)
+	{
+		mesh.m_lodFade += deltaTime / std::max(m_lodFadeSeconds, 0.001f);
+		if (mesh.m_lodFade >= 1.0f)
+		{
+			mesh.m_lodFade = 1.0f;
+			mesh.m_fadingLod = -1;
+		}
+	}
+
+	if (!m_lodEnabled || mesh.m_lods.size() < 2)
+	{
+		mesh.m_currentLod = 0;
+		mesh.m_fadingLod = -1;
+		return;
+	}
+
+	// Distance to the nearest point of the bounding sphere, scaled into world units
+	const glm::vec3 worldCentre{ model_xform * glm::vec4(mesh.m_boundsCentre, 1.0f) };
+	const float scale{ std::max(glm::length(glm::vec3(model_xform[0])), std::max(glm::length(glm::vec3(model_xform[1])), glm::length(glm::vec3(model_xform[2])))) };
+	const float distance{ std::max(glm::distance(worldCentre, cameraPosition) - mesh.m_boundsRadius * scale, 0.1f) };
+	auto projectedError = [&](int lod) { return mesh.m_lods[lod].error * scale * pixelsPerUnit / distance; };
+
+	int target{ mesh.m_currentLod };
+	while (target + 1 < (int)mesh.m_lods.size() && projectedError(target + 1) < m_lodErrorPixels * (1.0f - m_lodHysteresis))
+		target++;
+	while (target > 0 && projectedError(target) > m_lodErrorPixels)
+		target--;
+
+	if (target != mesh.m_currentLod)
+	{
+		mesh.m_fadingLod = m_lodCrossFade ? mesh.m_currentLod : -1;
+		mesh.m_lodFade = m_lodCrossFade ? 0.0f : 1.0f;
+		mesh.m_currentLod = target;
+	}
+}
+
+// Record drawing the mesh's current level of detail, counting the index traffic for the stats
+// While cross fading the old and new levels are drawn with complementary dither patterns
+void Renderer::DrawMesh(Helpers::CommandList& list, GLuint program, Mesh& mesh)
+{
+	const GLint lod_dither_id{ Uniform(program, "lod_dither") };
+
+	auto drawLod = [&](int lod, float dither)
+	{
+		const LodRange& range{ mesh.m_lods[lod] };
+		list.SetUniform(lod_dither_id, dither);
+
+		// Full detail with clusters draws just the meshlets that survived CullMeshlets, or everything
+		// if there was no room for the commands in the stream buffer
+		if (lod == 0 && m_meshletCulling && mesh.m_clusters && (mesh.m_clusters->indirect || mesh.m_clusters->commands.empty()))
+		{
+			const MeshClusters& clusters{ *mesh.m_clusters };
+			if (!clusters.commands.empty())
+			{
+				list.MultiDrawElementsIndirect(mesh.m_primitive, mesh.m_indexType, clusters.indirect.buffer, clusters.indirect.offset, (GLsizei)clusters.commands.size());
+				mesh.m_frameStats.draws++;
+			}
+			mesh.m_frameStats.indexBytes += clusters.visibleTriangles * 3 * mesh.m_indexSize;
+			mesh.m_frameStats.triangles += clusters.visibleTriangles;
+			mesh.m_frameStats.fullDetailTriangles += mesh.m_numTriangles;
+			return;
+		}
+
+		list.DrawElements(mesh.m_primitive, range.count, mesh.m_indexType, (size_t)range.firstIndex * mesh.m_indexSize);
+
+		mesh.m_frameStats.draws++;
+		mesh.m_frameStats.indexBytes += range.count * mesh.m_indexSize;
+		mesh.m_frameStats.triangles += range.numTriangles;
+		mesh.m_frameStats.fullDetailTriangles += mesh.m_numTriangles;
+	};
+
+	if (mesh.m_fadingLod >= 0)
+	{
+		drawLod(mesh.m_fadingLod, -mesh.m_lodFade);
+		drawLod(mesh.m_currentLod, mesh.m_lodFade);
+	}
+	else
+	{
+		drawLod(mesh.m_currentLod, 0.0f);
+	}
+}
+
+// Cull the meshlets of a mesh four at a time against the frustum and their normal cones, in model space,
+// then turn the visible ones into indirect draws, joining meshlets that follow on in the element buffer
+void Renderer::CullMeshlets(Mesh& mesh, const glm::mat4& model_xform, const glm::mat4& combined_xform, const glm::vec3& cameraPosition)
+{
+	if (!mesh.m_clusters)
+		return;
+
+	MeshClusters& clusters{ *mesh.m_clusters };
+	const double startTime{ glfwGetTime() };
+
+	glm::vec4 planes[6];
+	Helpers::ExtractFrustumPlanes(combined_xform * model_xform, planes);
+	const glm::vec3 localCamera{ glm::inverse(model_xform) * glm::vec4(cameraPosition, 1.0f) };
+
+	clusters.visibleMeshlets = (GLuint)Helpers::CullMeshlets(clusters.cullData, planes, localCamera, m_meshletBackfaceCulling, clusters.visible);
+
+	// The check can only model the frustum and cone tests, so it sees their result before occlusion removes more
+	std::vector<unsigned char> conservativeVisible;
+	if (m_validateMeshlets)
+		conservativeVisible = clusters.visible;
+
+	// Meshlets that survived are tested against the occluders
+	if (m_occlusionCulling)
+	{
+		const float scale{ std::max(glm::length(glm::vec3(model_xform[0])), std::max(glm::length(glm::vec3(model_xform[1])), glm::length(glm::vec3(model_xform[2])))) };
+		for (size_t i = 0; i < clusters.data.meshlets.size(); i++)
+		{
+			const Helpers::Meshlet& meshlet{ clusters.data.meshlets[i] };
+			if (clusters.visible[i] && !m_occlusionCuller.IsVisible(glm::vec3(model_xform * glm::vec4(meshlet.centre, 1.0f)), meshlet.radius * scale))
+			{
+				clusters.visible[i] = 0;
+				clusters.visibleMeshlets--;
+			}
+		}
+	}
+
+	clusters.commands.clear();
+	clusters.visibleTriangles = 0;
+	const GLuint lodStart{ mesh.m_lods[0].firstIndex };
+	for (size_t i = 0; i < clusters.data.meshlets.size(); i++)
+	{
+		if (!clusters.visible[i])
+			continue;
+
+		const Helpers::Meshlet& meshlet{ clusters.data.meshlets[i] };
+		const GLuint first{ lodStart + meshlet.triangleOffset * 3 };
+		clusters.visibleTriangles += meshlet.triangleCount;
+
+		if (!clusters.commands.empty() && clusters.commands.back().firstIndex + clusters.commands.back().count == first)
+		{
+			clusters.commands.back().count += meshlet.triangleCount * 3;
+			continue;
+		}
+
+		DrawElementsIndirectCommand command;
+		command.count = meshlet.triangleCount * 3;
+		command.firstIndex = first;
+		clusters.commands.push_back(command);
+	}
+
+	// Written to this frame's region of the stream buffer, which the GPU is not reading
+	clusters.indirect = m_streamBuffer.AllocateArray(clusters.commands.data(), clusters.commands.size());
+
+	clusters.cullMilliseconds = (float)((glfwGetTime() - startTime) * 1000.0);
+
+	// Check nothing visible was thrown away by culling every triangle individually
+	if (m_validateMeshlets)
+	{
+		const Helpers::MeshletValidation result{ Helpers::ValidateMeshletCulling(clusters.positions, clusters.data,
+			conservativeVisible, planes, localCamera, m_meshletBackfaceCulling) };
+
+		std::stringstream ss;
+		ss << mesh.m_name << ": " << (result.Passed() ? "passed" : "FAILED") << ", " << result.trianglesVisible << " visible triangles, "
+			<< result.trianglesEmitted << " emitted, " << result.trianglesMissing << " missing";
+		m_meshletValidationResult = ss.str();
+		m_meshletValidation = result;
+		m_meshletValidations++;
+		std::cout << "Meshlet culling validation " << m_meshletValidationResult << std::endl;
+		m_validateMeshlets = false;
+	}
+}
+
+// World space box around a mesh, from its quantisation box which is exactly the mesh extents
+static void GetWorldBounds(const Mesh& mesh, const glm::mat4& model_xform, glm::vec3& minExtents, glm::vec3& maxExtents)
+{
+	minExtents = glm::vec3(FLT_MAX);
+	maxExtents = glm::vec3(-FLT_MAX);
+	for (int i = 0; i < 8; i++)
+	{
+		const glm::vec3 corner{ mesh.m_quantisation.positionOffset + mesh.m_quantisation.positionScale * glm::vec3(i & 1, (i >> 1) & 1, (i >> 2) & 1) };
+		const glm::vec3 world{ model_xform * glm::vec4(corner, 1.0f) };
+		minExtents = glm::min(minExtents, world);
+		maxExtents = glm::max(maxExtents, world);
+	}
+}
+
+// True if the mesh's bounds are hidden behind the occluders rasterised this frame
+bool Renderer::IsOccluded(const Mesh& mesh, const glm::mat4& model_xform)
+{
+	if (!m_occlusionCulling)
+		return false;
+
+	glm::vec3 minExtents, maxExtents;
+	GetWorldBounds(mesh, model_xform, minExtents, maxExtents);
+	return !m_occlusionCuller.IsVisible(minExtents, maxExtents);
+}
+
+// Write the transform and the dequantisation values needed to unpack a mesh created with Helpers::PackedVertex
+// to the stream buffer and record binding them, false if the stream buffer is full
+bool Renderer::SetObjectData(Helpers::CommandList& list, const Mesh& mesh, const glm::mat4& model_xform)
+{
+	const Helpers::MeshQuantisation& q{ mesh.m_quantisation };
+	ObjectData data;
+	data.model_xform = model_xform;
+	data.pos_dequant_offset = glm::vec4(q.positionOffset, (float)mesh.m_material.texture.layer);
+	data.pos_dequant_scale = glm::vec4(q.positionScale, 0.0f);
+	data.uv_dequant = glm::vec4(q.uvOffset, q.uvScale);
+
+	const Helpers::StreamAllocation allocation{ m_streamBuffer.AllocateUniforms(data) };
+	if (!allocation)
+		return false;
+
+	list.BindBufferRange(GL_UNIFORM_BUFFER, KObjectDataBinding, allocation.buffer, allocation.offset, allocation.size);
+	return true;
+}
+
+// Three in four are point lights, the rest spots pointing down, at random over the terrain from a fixed seed
+std::vector<Helpers::Light> Renderer::GenerateLights(size_t count)
+{
+	std::mt19937 random(1234);
+	std::uniform_real_distribution<float> x(-2000.0f, 2900.0f), z(-2000.0f, 5350.0f), height(40.0f, 150.0f);
+	std::uniform_real_distribution<float> radius(150.0f, 400.0f), hue(0.0f, 1.0f), tilt(-0.3f, 0.3f);
+
+	std::vector<Helpers::Light> lights;
+	lights.reserve(count);
+	for (size_t i = 0; i < count; i++)
+	{
+		const glm::vec3 position{ x(random), height(random), z(random) };
+		const float h{ hue(random) * 6.0f };
+		const glm::vec3 colour{ glm::clamp(glm::vec3(std::abs(h - 3.0f) - 1.0f, 2.0f - std::abs(h - 2.0f), 2.0f - std::abs(h - 4.0f)), 0.0f, 1.0f) * 2.0f };
+		if (i % 4 == 3)
+		{
+			const glm::vec3 direction{ tilt(random), -1.0f, tilt(random) };
+			lights.push_back(Helpers::Light::Spot(position, direction, radius(random) * 1.5f, colour, glm::radians(20.0f), glm::radians(35.0f)));
+		}
+		else
+		{
+			lights.push_back(Helpers::Light::Point(position, radius(random), colour));
+		}
+	}
+	return lights;
+}
+
+// The ranges were written to the stream buffer before recording, so passes only bind them
+void Renderer::BindClusteredLights(Helpers::CommandList& list, GLuint program, bool lit)
+{
+	lit = lit && m_clusteredLightsOn && m_lightsAllocation && m_clustersAllocation && m_lightIndicesAllocation;
+	list.SetUniform(Uniform(program, "clustered_lights_on"), lit ? 1 : 0);
+	if (!lit)
+		return;
+
+	list.SetUniform(Uniform(program, "cluster_depth_plane"), m_lightClusters.GetDepthPlane());
+	list.SetUniform(Uniform(program, "cluster_scale"), glm::vec4(m_lightClusters.GetTileScale(), m_lightClusters.GetSliceScale(), m_lightClusters.GetSliceBias()));
+	list.BindBufferRange(GL_SHADER_STORAGE_BUFFER, KLightsBinding, m_lightsAllocation.buffer, m_lightsAllocation.offset, m_lightsAllocation.size);
+	list.BindBufferRange(GL_SHADER_STORAGE_BUFFER, KClustersBinding, m_clustersAllocation.buffer, m_clustersAllocation.offset, m_clustersAllocation.size);
+	list.BindBufferRange(GL_SHADER_STORAGE_BUFFER, KLightIndicesBinding, m_lightIndicesAllocation.buffer, m_lightIndicesAllocation.offset, m_lightIndicesAllocation.size);
+}
+
+// From the sun's azimuth and elevation, towards the ground
+glm::vec3 Renderer::SunDirection() const
+{
+	const float azimuth{ glm::radians(m_sunAzimuth) };
+	const float elevation{ glm::radians(m_sunElevation) };
+	return -glm::vec3(std::cos(elevation) * std::sin(azimuth), std::sin(elevation), std::cos(elevation) * std::cos(azimuth));
+}
+
+// Full detail, as a shadow's outline shows what a coarser level drops. One indirect draw of an instance per cascade.
+void Renderer::AddShadowCaster(std::vector<ShadowDraw>& draws, const Mesh& mesh, const glm::mat4& model_xform, GLuint cascades, bool packedPositions)
+{
+	if (!cascades)
+		return;
+
+	glm::vec3 minExtents, maxExtents;
+	GetWorldBounds(mesh, model_xform, minExtents, maxExtents);
+	const GLuint touched{ m_shadows.CullCaster(minExtents, maxExtents, cascades) };
+	if (!touched)
+		return;
+
+	ObjectData object;
+	object.model_xform = model_xform;
+	if (packedPositions)
+	{
+		object.pos_dequant_offset = glm::vec4(mesh.m_quantisation.positionOffset, 0.0f);
+		object.pos_dequant_scale = glm::vec4(mesh.m_quantisation.positionScale, 0.0f);
+	}
+
+	GLsizei instances{ 0 };
+	const Helpers::ShadowCasterData caster{ m_shadows.GetCasterData(touched, instances) };
+	const LodRange& range{ mesh.m_lods[0] };
+	DrawElementsIndirectCommand command;
+	command.count = range.count;
+	command.instanceCount = (GLuint)instances;
+	command.firstIndex = range.firstIndex;
+
+	ShadowDraw draw;
+	draw.mesh = &mesh;
+	draw.object = m_streamBuffer.AllocateUniforms(object);
+	draw.caster = m_streamBuffer.AllocateUniforms(caster);
+	draw.indirect = m_streamBuffer.AllocateArray(&command, 1);
+	if (!draw.object || !draw.caster || !draw.indirect)
+	{
+		// A cached cascade missing a caster is drawn again next frame
+		if (touched & Helpers::CascadedShadows::KCachedCascades)
+			m_shadows.Invalidate();
+		return;
+	}
+
+	m_shadows.CountDraw(touched, range.numTriangles);
+	draws.push_back(draw);
+}
+
+// Each cascade is cleared alone through the scissor as the cached ones keep their depths, then the clip distances
+// keep each instance of a caster inside its own cascade
+void Renderer::DrawShadowCascades(Helpers::CommandList& list, const std::vector<ShadowDraw>& draws, GLuint cascades)
+{
+	Helpers::RenderState clearState;
+	for (int c = 0; c < Helpers::CascadedShadows::KNumCascades; c++)
+	{
+		if (!(cascades & (1u << c)))
+			continue;
+		clearState.scissor = m_shadows.GetCascadeRect(c);
+		list.SetState(clearState);
+		list.Clear(GL_DEPTH_BUFFER_BIT);
+	}
+
+	Helpers::RenderState casterState;
+	casterState.clipDistances = 4;
+	list.SetState(casterState);
+	list.BindProgram(m_shadowCasterProgram.Get());
+	for (const ShadowDraw& draw : draws)
+	{
+		const Mesh& mesh{ *draw.mesh };
+		list.BindBufferRange(GL_UNIFORM_BUFFER, KObjectDataBinding, draw.object.buffer, draw.object.offset, draw.object.size);
+		list.BindBufferRange(GL_UNIFORM_BUFFER, KShadowCasterBinding, draw.caster.buffer, draw.caster.offset, draw.caster.size);
+		list.BindVertexArray(mesh.VAO);
+		list.MultiDrawElementsIndirect(mesh.m_primitive, mesh.m_indexType, draw.indirect.buffer, draw.indirect.offset, 1);
+	}
+}
+
+// The cascades were written to the stream buffer before recording, so passes only bind them. The atlas's unit is set
+// even when unused, as left on unit 0 it would clash with the material's array sampler.
+void Renderer::BindShadows(Helpers::CommandList& list, GLuint program, bool shadowed)
+{
+	shadowed = shadowed && m_shadowsOn && m_shadowReceiverAllocation;
+	list.SetUniform(Uniform(program, "sun_direction"), SunDirection());
+	list.SetUniform(Uniform(program, "shadow_atlas"), (GLint)KShadowAtlasUnit);
+	list.SetUniform(Uniform(program, "shadows_on"), shadowed ? 1 : 0);
+	if (!shadowed)
+		return;
+
+	list.BindTexture(KShadowAtlasUnit, m_shadows.GetAtlas());
+	list.BindBufferRange(GL_UNIFORM_BUFFER, KShadowReceiverBinding, m_shadowReceiverAllocation.buffer, m_shadowReceiverAllocation.offset,
+		m_shadowReceiverAllocation.size);
+}
+
+// Measured to the nearest point of the bounding sphere as SelectLod does, so the level is what the closest texels need
+void Renderer::RequestTextureLevel(const Mesh& mesh, const glm::mat4& model_xform, const glm::vec3& cameraPosition, float pixelsPerUnit)
+{
+	const Helpers::TextureLayer& texture{ mesh.m_material.texture };
+	if (!texture.array)
+		return;
+
+	const glm::vec3 worldCentre{ model_xform * glm::vec4(mesh.m_boundsCentre, 1.0f) };
+	const float scale{ std::max(glm::length(glm::vec3(model_xform[0])), std::max(glm::length(glm::vec3(model_xform[1])), glm::length(glm::vec3(model_xform[2])))) };
+	const float distance{ std::max(glm::distance(worldCentre, cameraPosition) - mesh.m_boundsRadius * scale, 0.1f) };
+	const float pixels{ 2.0f * mesh.m_boundsRadius * scale * pixelsPerUnit / distance };
+	const glm::vec2 uvExtent{ mesh.m_quantisation.uvScale };
+	const float texels{ std::max(m_texturePool.GetWidth(texture.array) * uvExtent.x, m_texturePool.GetHeight(texture.array) * uvExtent.y) };
+	m_textureResidency.Request(texture, Helpers::MipLevelForScreenSize(texels, pixels));
+}
+
+// The layer goes to the shader with the object data, so only a change of array is a bind
+void Renderer::BindMaterial(Helpers::CommandList& list, const Mesh& mesh, GLuint& boundArray)
 {
-	// Create a new program (returns a unqiue id)
-	GLuint program = glCreateProgram();
+	if (mesh.m_material.texture.array == boundArray)
+		return;
+	list.BindTexture(0, m_texturePool.GetTexture(mesh.m_material.texture.array), GL_TEXTURE_2D_ARRAY);
+	boundArray = mesh.m_material.texture.array;
+}
 
-	// Load and create vertex and fragment shaders
-	GLuint vertex_shader{ Helpers::LoadAndCompileShader(GL_VERTEX_SHADER, vertexpath) };
-	GLuint fragment_shader{ Helpers::LoadAndCompileShader(GL_FRAGMENT_SHADER, fragmentpath) };
-	if (vertex_shader == 0 || fragment_shader == 0)
+// Grass on low flat ground, long grass higher up and dirt wherever it is steep. The materials are decoded on the
+// job system and resampled to one size, a material that fails to load is left mid grey.
+bool Renderer::CreateTerrainSplat(const Helpers::Heightfield& heightfield)
+{
+	PROFILE_CPU("Terrain splat");
+	m_splatRules.clear();
+
+	Helpers::SplatRule grass;
+	grass.name = "Data\\Textures\\grass_green-01_df_.dds";
+	grass.maxHeight = 20.0f;
+	grass.heightFade = 20.0f;
+	grass.maxSlope = 0.04f;
+	grass.slopeFade = 0.02f;
+	m_splatRules.push_back(grass);
+
+	Helpers::SplatRule longGrass;
+	longGrass.name = "Data\\Textures\\grass11.bmp";
+	longGrass.minHeight = 20.0f;
+	longGrass.heightFade = 20.0f;
+	longGrass.maxSlope = 0.05f;
+	longGrass.slopeFade = 0.02f;
+	m_splatRules.push_back(longGrass);
+
+	Helpers::SplatRule dirt;
+	dirt.name = "Data\\Textures\\dirt_earth-n-moss_df_.dds";
+	dirt.minSlope = 0.035f;
+	dirt.slopeFade = 0.02f;
+	m_splatRules.push_back(dirt);
+
+	const size_t layerBytes{ (size_t)KSplatLayerSize * (size_t)KSplatLayerSize * 4 };
+	std::vector<GLubyte> layers(layerBytes * m_splatRules.size(), 128);
+	Helpers::GetJobSystem().ParallelFor(m_splatRules.size(), 1, [&](size_t begin, size_t end)
+	{
+		for (size_t i = begin; i < end; i++)
+		{
+			Helpers::ImageLoader image;
+			if (!image.Load(m_splatRules[i].name))
+				continue;
+			const std::vector<GLubyte> resampled{ Helpers::ResampleImage(image.GetData(), image.Width(), image.Height(), KSplatLayerSize, KSplatLayerSize) };
+			std::copy(resampled.begin(), resampled.end(), layers.begin() + i * layerBytes);
+		}
+	});
+
+	const std::vector<GLubyte> weights{ Helpers::BuildSplatWeights(heightfield, m_splatRules, KSplatMapSize, m_splatStats) };
+	m_splatLayers = m_gpuResources.CreateTextureArray("Terrain splat materials", KSplatLayerSize, KSplatLayerSize, (GLsizei)m_splatRules.size(), layers.data(), GL_REPEAT);
+	m_splatWeights = m_gpuResources.CreateTextureArray("Terrain splat weights", KSplatMapSize, KSplatMapSize, (GLsizei)(Helpers::KMaxSplatLayers / 4), weights.data(), GL_CLAMP_TO_EDGE);
+	if (!m_splatLayers || !m_splatWeights)
+	{
+		std::cout << "ERROR: could not make the terrain's splat textures" << std::endl;
 		return false;
+	}
 
-	// Attach the vertex shader to this program (copies it)
-	glAttachShader(program, vertex_shader);
+	std::cout << "Terrain splat: " << m_splatRules.size() << " materials, coverage";
+	for (float coverage : m_splatStats.coverage)
+		std::cout << " " << coverage * 100.0f << "%";
+	std::cout << ", " << m_splatStats.FractionOver((size_t)m_splatSamples) * 100.0f << "% of texels over " << m_splatSamples << " samples" << std::endl;
+	return true;
+}
 
-	// The attibute location 0 maps to the input stream "vertex_position" in the vertex shader
-	// Not needed if you use (location=0) in the vertex shader itself
-	//glBindAttribLocation(m_program, 0, "vertex_position");
+// Smooth noise from -1 to 1, a hashed value at each whole point blended with smoothstep
+static float TerrainDetailNoise(float x, float y)
+{
+	auto hash = [](int ix, int iy)
+	{
+		GLuint n{ (GLuint)ix * 374761393u + (GLuint)iy * 668265263u };
+		n = (n ^ (n >> 13)) * 1274126177u;
+		return ((n ^ (n >> 16)) & 0xFFFF) / 32767.5f - 1.0f;
+	};
+
+	const float fx{ std::floor(x) }, fy{ std::floor(y) };
+	const int ix{ (int)fx }, iy{ (int)fy };
+	const float tx{ (x - fx) * (x - fx) * (3.0f - 2.0f * (x - fx)) };
+	const float ty{ (y - fy) * (y - fy) * (3.0f - 2.0f * (y - fy)) };
+	const float bottom{ glm::mix(hash(ix, iy), hash(ix + 1, iy), tx) };
+	const float top{ glm::mix(hash(ix, iy + 1), hash(ix + 1, iy + 1), tx) };
+	return glm::mix(bottom, top, ty);
+}
 
-	// Attach the fragment shader (copies it)
-	glAttachShader(program, fragment_shader);
+// The grass image repeated across the terrain from the mip nearest a page texel's footprint, tinted by two octaves
+// of noise over the whole terrain that a repeating texture could not have. The border continues past the page's
+// edges so filtering there matches its neighbours.
+void Renderer::CompositeTerrainPage(const Helpers::VirtualPage& page, GLubyte* rgba) const
+{
+	using VT = Helpers::VirtualTexture;
+	const TerrainPageSource& source{ m_terrainPageSource };
+	const float virtualTexels{ (float)(VT::KPagesAcross * VT::KPageTexels) };
+	const float texelSize{ (float)(1u << page.level) / virtualTexels };
+
+	GLuint level{ 0 };
+	GLsizei width{ 0 }, height{ 0 };
+	if (!source.levels.empty())
+	{
+		level = std::min(Helpers::MipLevelForScreenSize(KTerrainRepeats * source.width * texelSize, 1.0f), (GLuint)source.levels.size() - 1);
+		width = std::max(source.width >> level, 1);
+		height = std::max(source.height >> level, 1);
+	}
 
-	// Done with the originals of these as we have made copies
-	glDeleteShader(vertex_shader);
-	glDeleteShader(fragment_shader);
+	for (GLuint ty = 0; ty < VT::KSlotTexels; ty++)
+	{
+		for (GLuint tx = 0; tx < VT::KSlotTexels; tx++)
+		{
+			const glm::vec2 uv{ ((float)(page.x * VT::KPageTexels + tx) - VT::KBorderTexels + 0.5f) * texelSize,
+				((float)(page.y * VT::KPageTexels + ty) - VT::KBorderTexels + 0.5f) * texelSize };
+			const float tint{ 0.8f + 0.12f * TerrainDetailNoise(uv.x * 12.0f, uv.y * 12.0f) + 0.08f * TerrainDetailNoise(uv.x * 64.0f, uv.y * 64.0f) };
 
-	// Link the shaders, checking for errors
-	if (!Helpers::LinkProgramShaders(program))
-		return 0;
+			glm::vec3 colour{ 128.0f };
+			if (width && height)
+			{
+				const int ix{ (((int)std::floor(uv.x * KTerrainRepeats * width)) % width + width) % width };
+				const int iy{ (((int)std::floor(uv.y * KTerrainRepeats * height)) % height + height) % height };
+				const GLubyte* texel{ &source.levels[level][((size_t)iy * width + ix) * 4] };
+				colour = glm::vec3(texel[0], texel[1], texel[2]);
+			}
 
-	return program;
+			GLubyte* out{ rgba + ((size_t)ty * VT::KSlotTexels + tx) * 4 };
+			for (int c = 0; c < 3; c++)
+				out[c] = (GLubyte)glm::clamp(colour[c] * tint, 0.0f, 255.0f);
+			out[3] = 255;
+		}
+	}
+}
+
+// Decode an image on a worker then queue adding it to the texture pool on the main thread
+void Renderer::LoadTextureAsync(const std::string& filename, GLint wrap, Helpers::JobCounter& counter, std::function<void(const Helpers::TextureLayer&)> onCreated)
+{
+	Helpers::JobSystem& jobs{ Helpers::GetJobSystem() };
+	jobs.Run([this, &jobs, filename, wrap, onCreated]()
+	{
+		std::shared_ptr<Helpers::ImageLoader> image{ std::make_shared<Helpers::ImageLoader>() };
+		if (!image->Load(filename))
+			return;
+
+		jobs.RunOnMainThread([this, image, wrap, filename, onCreated]()
+		{
+			m_texturePool.Add(filename, image->Width(), image->Height(), image->GetData(), wrap, onCreated);
+		});
+	}, &counter);
+}
+
+// Time the terrain occluders rasterised at 1280x720 on 1 to N threads, each with its own job system
+void Renderer::MeasureJobScaling()
+{
+	const glm::mat4 combined_xform{ glm::perspective(glm::radians(45.0f), 16.0f / 9.0f, 0.1f, 10000.0f) *
+		glm::lookAt(glm::vec3(0, 200, 900), glm::vec3(0), glm::vec3(0, 1, 0)) };
+
+	m_jobScaling = Helpers::MeasureJobScaling(std::max(1u, std::thread::hardware_concurrency()), [&](Helpers::JobSystem& jobs)
+	{
+		Helpers::OcclusionCuller culler(1280, 720, &jobs);
+		for (int i = 0; i < 10; i++)
+		{
+			culler.BeginFrame(combined_xform);
+			for (const Occluder& occluder : m_occluders)
+				culler.AddOccluder(occluder.mesh.vertices, occluder.mesh.elements, occluder.model_xform);
+			culler.RasteriseOccluders();
+		}
+	});
+
+	for (const Helpers::JobScalingResult& result : m_jobScaling)
+		std::cout << "Job scaling " << result.threads << " threads: " << result.milliseconds << " ms, x" << result.speedUp << std::endl;
+}
+
+// Record numDraws cube draws, one thousand to a list, first on this thread alone and then over the job system, and submit them.
+// A zero view transform collapses every cube to a point so only the cost of submitting is measured, and the frame is unchanged.
+void Renderer::BenchmarkCommandLists(size_t numDraws)
+{
+	static constexpr size_t KDrawsPerList{ 1000 };
+
+	Helpers::JobSystem& jobs{ Helpers::GetJobSystem() };
+	const Mesh& cube{ cubemodel.m_meshVector[0] };
+	const GLint model_xform_id{ Uniform(cube_Program.Get(), "model_xform2") };
+
+	std::vector<Helpers::CommandList> lists((numDraws + KDrawsPerList - 1) / KDrawsPerList);
+	auto recordLists = [&](size_t begin, size_t end)
+	{
+		for (size_t l = begin; l < end; l++)
+		{
+			lists[l] = Helpers::CommandList(ThreadAllocator());
+			for (size_t d = l * KDrawsPerList; d < std::min(numDraws, (l + 1) * KDrawsPerList); d++)
+			{
+				// Every draw has its own transform, a cube from a 64 x 64 x N grid
+				const glm::vec3 position{ (float)(d % 64), (float)((d / 64) % 64), (float)(d / 4096) };
+				lists[l].BindVertexArray(cube.VAO);
+				lists[l].SetUniform(model_xform_id, glm::translate(glm::mat4(1), position * 30.0f));
+				lists[l].DrawElements(cube.m_primitive, cube.m_lods[0].count, cube.m_indexType, 0);
+			}
+		}
+	};
+
+	ResetCommandAllocators();
+	double start{ glfwGetTime() };
+	recordLists(0, lists.size());
+	m_commandBenchmark.recordSerialMilliseconds = (float)((glfwGetTime() - start) * 1000.0);
+
+	ResetCommandAllocators();
+	start = glfwGetTime();
+	jobs.ParallelFor(lists.size(), 1, recordLists);
+	m_commandBenchmark.recordParallelMilliseconds = (float)((glfwGetTime() - start) * 1000.0);
+
+	Helpers::RenderState state;
+	state.colourWrite = false;
+	state.depthWrite = false;
+	Helpers::CommandList setup(ThreadAllocator());
+	setup.SetState(state);
+	setup.BindProgram(cube_Program.Get());
+	setup.SetUniform(Uniform(cube_Program.Get(), "combined_xform3"), glm::mat4(0));
+	Helpers::CommandList restore(ThreadAllocator());
+	restore.SetState(Helpers::RenderState());
+
+	// Anything still queued from the frame is not counted
+	m_backend->Finish();
+	start = glfwGetTime();
+	m_backend->Execute(setup);
+	for (const Helpers::CommandList& list : lists)
+		m_backend->Execute(list);
+	m_backend->Execute(restore);
+	m_commandBenchmark.submitMilliseconds = (float)((glfwGetTime() - start) * 1000.0);
+	start = glfwGetTime();
+	m_backend->Finish();
+	m_commandBenchmark.finishMilliseconds = (float)((glfwGetTime() - start) * 1000.0);
+
+	m_commandBenchmark.draws = numDraws;
+	m_commandBenchmark.commands = 0;
+	for (const Helpers::CommandList& list : lists)
+		m_commandBenchmark.commands += list.NumCommands();
+	m_commandBenchmark.bytes = 0;
+	for (const auto& allocator : m_commandAllocators)
+		m_commandBenchmark.bytes += allocator->BytesUsed();
+
+	std::cout << "Command lists: " << numDraws << " draws recorded in " << m_commandBenchmark.recordSerialMilliseconds << " ms on one thread, "
+		<< m_commandBenchmark.recordParallelMilliseconds << " ms on " << jobs.NumThreads() << ", submitted in " << m_commandBenchmark.submitMilliseconds
+		<< " ms, GPU finished " << m_commandBenchmark.finishMilliseconds << " ms later" << std::endl;
+
+	ResetCommandAllocators();
+}
+
+// A copy of this frame's clusters bins each set of lights without an index limit, so the frame's own bins are untouched
+bool Renderer::BenchmarkLightBinning()
+{
+	m_lightBenchmarks.clear();
+	bool passed{ true };
+	for (size_t count : { 1000, 10000 })
+	{
+		const std::vector<Helpers::Light> lights{ GenerateLights(count) };
+		Helpers::ClusteredLighting clusters{ m_lightClusters };
+		clusters.SetMaxIndices(SIZE_MAX);
+		clusters.Bin(lights);
+
+		LightBinningBenchmark bench;
+		bench.lights = count;
+		bench.stats = clusters.GetLastStats();
+		bench.validation = clusters.Validate(lights);
+		passed = passed && bench.validation.Passed();
+		m_lightBenchmarks.push_back(bench);
+
+		std::cout << "Light binning: " << count << " lights binned in " << bench.stats.milliseconds << " ms, " << bench.stats.indices
+			<< " indices, brute force " << bench.validation.bruteForceMilliseconds << " ms, " << bench.validation.pairs << " pairs, "
+			<< bench.validation.pairsMissing << " missing" << std::endl;
+	}
+	return passed;
 }
 
 float Renderer::Noise(int x, int y)
@@ -80,6 +1066,11 @@ float Renderer::Noise(int x, int y)
 // Load / create geometry into OpenGL buffers	
 bool Renderer::InitialiseGeometry()
 {
+	PROFILE_CPU("Initialise geometry");
+	m_gpuResources.Initialise(*m_backend);
+	m_texturePool.Initialise(m_gpuResources);
+	m_textureResidency.Initialise(m_texturePool);
+
 	// Load and compile shaders into m_program
 	m_program = CreateProgram("Data/Shaders/fragment_shader.frag", "Data/Shaders/vertex_shader.vert");
 
@@ -87,7 +1078,31 @@ bool Renderer::InitialiseGeometry()
 	//// Load and compile shaders into m_program
 	cube_Program = CreateProgram("Data/Shaders/cubeFrag_shader.frag", "Data/Shaders/cubeVert_shader.vert");
 
-	Mesh cubeMesh;
+	// The terrain sampling its virtual texture, and writing the pages it samples
+	m_terrainVTProgram = CreateProgram("Data/Shaders/terrain_vt.frag", "Data/Shaders/vertex_shader.vert");
+	m_vtFeedbackProgram = CreateProgram("Data/Shaders/vt_feedback.frag", "Data/Shaders/vertex_shader.vert");
+
+	// The terrain blending the splat map's materials
+	m_terrainSplatProgram = CreateProgram("Data/Shaders/terrain_splat.frag", "Data/Shaders/vertex_shader.vert");
+
+	// Bounding boxes for GPU occlusion queries
+	m_occlusionBoxProgram = CreateProgram("Data/Shaders/occlusion_box.frag", "Data/Shaders/occlusion_box.vert");
+	m_occlusionQueries.Initialise(m_gpuResources, m_occlusionBoxProgram.Get());
+	m_jeepQueryId = m_occlusionQueries.AddObject();
+	m_cubeQueryId = m_occlusionQueries.AddObject();
+
+	m_frameGraph.Initialise(m_gpuResources);
+	Helpers::GetProfiler().Initialise(*m_backend);
+
+	// The shadow casters' depth into the cascades of the shadow atlas
+	m_shadowCasterProgram = CreateProgram("Data/Shaders/shadow_caster.frag", "Data/Shaders/shadow_caster.vert");
+	if (!m_shadows.Initialise(m_gpuResources))
+		return false;
+
+	// Three frames of per frame data so the CPU can run two frames ahead of the GPU without waiting
+	if (!m_streamBuffer.Initialise(m_gpuResources, KStreamRegionSize, 3))
+		return false;
+
 	std::vector<glm::vec3> verts =
 	{
 		//Front Face
@@ -187,42 +1202,19 @@ bool Renderer::InitialiseGeometry()
 		23,22,21,22,20,21//20-23
 	};
 
-	GLuint positionsVBO;
-	glGenBuffers(1, &positionsVBO);
-	glBindBuffer(GL_ARRAY_BUFFER, positionsVBO);
-	glBufferData(GL_ARRAY_BUFFER, sizeof(glm::vec3)* verts.size(), verts.data(), GL_STATIC_DRAW);
-	glBindBuffer(GL_ARRAY_BUFFER, 0);
-
-	GLuint elementsEBO;
-	glGenBuffers(1, &elementsEBO);
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, elementsEBO);
-	glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(GLuint)* Elements.size(), Elements.data(), GL_STATIC_DRAW);
-	glBindBuffer(GL_ARRAY_BUFFER, 0);
-	cubeMesh.m_numElements = Elements.size();
-	
-	GLuint ColoursVBO;
-	glGenBuffers(1, &ColoursVBO);
-	glBindBuffer(GL_ARRAY_BUFFER, ColoursVBO);
-	glBufferData(GL_ARRAY_BUFFER, sizeof(glm::vec3)* colors.size(), colors.data(), GL_STATIC_DRAW);
-	glBindBuffer(GL_ARRAY_BUFFER, 0);
-
-	glGenVertexArrays(1, &cubeMesh.VAO);
-	glBindVertexArray(cubeMesh.VAO);
-
-	glBindBuffer(GL_ARRAY_BUFFER, positionsVBO);
-	glEnableVertexAttribArray(0);
-	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, (void*)0);
+	Helpers::Mesh cubeData;
+	cubeData.name = "Cube";
+	cubeData.vertices = verts;
+	cubeData.colours = colors;
+	cubeData.elements = Elements;
 
-	glBindBuffer(GL_ARRAY_BUFFER, ColoursVBO);
-	glEnableVertexAttribArray(1);
-	glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 0, (void*)0);
+	cubemodel.m_meshVector.emplace_back(CreateMesh<Helpers::ColouredVertex>("Cube", cubeData));
 
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, elementsEBO);
-	glBindVertexArray(0);
-
-	cubemodel.m_meshVector.emplace_back(cubeMesh);
 
 
+	// Textures are decoded by the job system while the meshes below are built
+	Helpers::JobSystem& jobs{ Helpers::GetJobSystem() };
+	Helpers::JobCounter texturesLoaded;
 
 	// Helpers has an object for loading 3D geometry, supports most types
 	// Load in the jeep
@@ -232,87 +1224,37 @@ bool Renderer::InitialiseGeometry()
 
 	// Now we can loop through all the mesh in the loaded model:
 	for (const Helpers::Mesh& mesh : loader.GetMeshVector())
-	{
-		Mesh newMesh;
-
-		GLuint meshVBO;
-		glGenBuffers(1, &meshVBO);
-		glBindBuffer(GL_ARRAY_BUFFER, meshVBO);
-		glBufferData(GL_ARRAY_BUFFER, sizeof(glm::vec3) * mesh.vertices.size(), mesh.vertices.data(), GL_STATIC_DRAW);
-		glBindBuffer(GL_ARRAY_BUFFER, 0);
-
-		GLuint normalsVBO;
-		glGenBuffers(1, &normalsVBO);
-		glBindBuffer(GL_ARRAY_BUFFER, normalsVBO);
-		glBufferData(GL_ARRAY_BUFFER, sizeof(glm::vec3) * mesh.normals.size(), mesh.normals.data(), GL_STATIC_DRAW);
-		glBindBuffer(GL_ARRAY_BUFFER, 0);
-
-		GLuint meshElementsEBO;
-		glGenBuffers(1, &meshElementsEBO);
-		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, meshElementsEBO);
-		glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(GLuint) * mesh.elements.size(), mesh.elements.data(), GL_STATIC_DRAW);
-		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
-
-		GLuint texcoordsVBO;
-		glGenBuffers(1, &texcoordsVBO);
-		glBindBuffer(GL_ARRAY_BUFFER, texcoordsVBO);
-		glBufferData(GL_ARRAY_BUFFER, sizeof(glm::vec2) * mesh.uvCoords.size(), mesh.uvCoords.data(), GL_STATIC_DRAW);
-		glBindBuffer(GL_ARRAY_BUFFER, 0);
-
-		newMesh.m_numElements = mesh.elements.size();
-
-		glGenVertexArrays(1, &newMesh.VAO);
-		glBindVertexArray(newMesh.VAO);
-
-		glBindBuffer(GL_ARRAY_BUFFER, meshVBO);
-		glEnableVertexAttribArray(0);
-		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, (void*)0);
-
-		glBindBuffer(GL_ARRAY_BUFFER, normalsVBO);
-		glEnableVertexAttribArray(1);
-		glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 0, (void*)0);
-
-		glBindBuffer(GL_ARRAY_BUFFER, texcoordsVBO);
-		glEnableVertexAttribArray(2);
-		glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 0, (void*)0);
-
-		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, meshElementsEBO);
-		glBindVertexArray(0);
-
-		Helpers::ImageLoader texture;
-		if (texture.Load("Data\\Models\\Jeep\\jeep_rood.jpg"))
-		{
-			glGenTextures(1, &newMesh.Tex);
-			glBindTexture(GL_TEXTURE_2D, newMesh.Tex);
-			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-			glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, texture.Width(), texture.Height(), 0, GL_RGBA, GL_UNSIGNED_BYTE, texture.GetData());
-			glGenerateMipmap(GL_TEXTURE_2D);
-		}
+		jeepmodel.m_meshVector.emplace_back(CreateMesh<Helpers::PackedVertex>("Data\\Models\\Jeep\\jeep.obj", mesh, false, true, true));
 
-		jeepmodel.m_meshVector.emplace_back(newMesh);
-	}
+	LoadTextureAsync("Data\\Models\\Jeep\\jeep_rood.jpg", GL_REPEAT, texturesLoaded, [this](const Helpers::TextureLayer& texture)
+	{
+		for (Mesh& mesh : jeepmodel.m_meshVector)
+			mesh.m_material.texture = texture;
+	});
 
 	// Terrain
-	std::vector<glm::vec3> terVerts;
-	std::vector<glm::vec3> terNormals;
-	std::vector<glm::vec2> terTexture;
-	std::vector<GLuint> terElements;
+	Helpers::Mesh terrainData;
+	terrainData.name = "Terrain";
+	std::vector<glm::vec3>& terVerts{ terrainData.vertices };
+	std::vector<glm::vec3>& terNormals{ terrainData.normals };
+	std::vector<glm::vec2>& terTexture{ terrainData.uvCoords };
+	std::vector<GLuint>& terElements{ terrainData.elements };
 
 	int mNumVertsX = 50;
 	int mNumVertsZ = 50;
 
 	bool noise_on = true;
 
+	// The terrain is a regular grid so joins well into strips
+	bool strips_on = true;
+
 	for (float i = 0; i < mNumVertsZ; i++)
 	{
 		for (int j = 0; j < mNumVertsX; j++)
 		{
 			terVerts.push_back(glm::vec3(i * 100 - 2000, 0, j * 150 - 2000));
 			terNormals.push_back({ 0,1,0 });
-			terTexture.push_back({ ((float)i / mNumVertsZ) * 40, ((float)j / mNumVertsX) * 40 });
+			terTexture.push_back({ ((float)i / mNumVertsZ) * KTerrainRepeats, ((float)j / mNumVertsX) * KTerrainRepeats });
 		}
 	}
 
@@ -336,6 +1278,13 @@ bool Renderer::InitialiseGeometry()
 		}
 	}
 
+	// The heights as a grid for the splat map, its rows are the outer loop above and run along x
+	Helpers::Heightfield terrainHeights;
+	terrainHeights.rows = mNumVertsZ;
+	terrainHeights.columns = mNumVertsX;
+	terrainHeights.spacing = glm::vec2(100, 150);
+	for (const glm::vec3& vertex : terVerts)
+		terrainHeights.heights.push_back(vertex.y);
 
 	bool toggleDiamond = true;
 
@@ -372,65 +1321,40 @@ bool Renderer::InitialiseGeometry()
 		}
 	}
 
-	Mesh terrainMesh;
-
-	GLuint terVertsVBO;
-	glGenBuffers(1, &terVertsVBO);
-	glBindBuffer(GL_ARRAY_BUFFER, terVertsVBO);
-	glBufferData(GL_ARRAY_BUFFER, sizeof(glm::vec3)* terVerts.size(), terVerts.data(), GL_STATIC_DRAW);
-	glBindBuffer(GL_ARRAY_BUFFER, 0);
-
-	GLuint terNormalsVBO;
-	glGenBuffers(1, &terNormalsVBO);
-	glBindBuffer(GL_ARRAY_BUFFER, terNormalsVBO);
-	glBufferData(GL_ARRAY_BUFFER, sizeof(glm::vec3)* terNormals.size(), terNormals.data(), GL_STATIC_DRAW);
-	glBindBuffer(GL_ARRAY_BUFFER, 0);
-
-	GLuint terTextureVBO;
-	glGenBuffers(1, &terTextureVBO);
-	glBindBuffer(GL_ARRAY_BUFFER, terTextureVBO);
-	glBufferData(GL_ARRAY_BUFFER, sizeof(glm::vec2)* terTexture.size(), terTexture.data(), GL_STATIC_DRAW);
-	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	terrainmodel.m_meshVector.emplace_back(CreateMesh<Helpers::PackedVertex>("Terrain", terrainData, strips_on));
 
-	GLuint terElementsEBO;
-	glGenBuffers(1, &terElementsEBO);
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, terElementsEBO);
-	glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(GLuint)* terElements.size(), terElements.data(), GL_STATIC_DRAW);//Broken
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
-	terrainMesh.m_numElements = terElements.size();
-
-	glGenVertexArrays(1, &terrainMesh.VAO);
-	glBindVertexArray(terrainMesh.VAO);
-
-	glBindBuffer(GL_ARRAY_BUFFER, terVertsVBO);
-	glEnableVertexAttribArray(0);
-	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, (void*)0);
-
-	glBindBuffer(GL_ARRAY_BUFFER, terNormalsVBO);
-	glEnableVertexAttribArray(1);
-	glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 0, (void*)0);
-
-	glBindBuffer(GL_ARRAY_BUFFER, terTextureVBO);
-	glEnableVertexAttribArray(2);
-	glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 0, (void*)0);
+	LoadTextureAsync("Data\\Textures\\grass11.bmp", GL_REPEAT, texturesLoaded, [this](const Helpers::TextureLayer& texture)
+	{
+		terrainmodel.m_meshVector[0].m_material.texture = texture;
+	});
 
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, terElementsEBO);
-	glBindVertexArray(0);
+	if (!CreateTerrainSplat(terrainHeights))
+		return false;
 
-	Helpers::ImageLoader terrain_texture;
-	if (terrain_texture.Load("Data\\Textures\\grass11.bmp"))
+	// The virtual texture's pages are made from the grass and its mips, the coarsest page straight away
 	{
-		glGenTextures(1, &terrainMesh.Tex);
-		glBindTexture(GL_TEXTURE_2D, terrainMesh.Tex);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, terrain_texture.Width(), terrain_texture.Height(), 0, GL_RGBA, GL_UNSIGNED_BYTE, terrain_texture.GetData());
-		glGenerateMipmap(GL_TEXTURE_2D);
+		PROFILE_CPU("Virtual texture");
+		Helpers::ImageLoader grass;
+		if (grass.Load("Data\\Textures\\grass11.bmp"))
+		{
+			TerrainPageSource& source{ m_terrainPageSource };
+			source.width = grass.Width();
+			source.height = grass.Height();
+			source.levels.emplace_back(grass.GetData(), grass.GetData() + (size_t)source.width * (size_t)source.height * 4);
+			for (GLsizei w = source.width, h = source.height; w > 1 || h > 1; w = std::max(w / 2, 1), h = std::max(h / 2, 1))
+				source.levels.push_back(Helpers::HalveLevel(source.levels.back(), w, h, 1));
+		}
+		if (!m_virtualTexture.Initialise(m_gpuResources, [this](const Helpers::VirtualPage& page, GLubyte* rgba) { CompositeTerrainPage(page, rgba); }))
+			return false;
 	}
 
-	terrainmodel.m_meshVector.emplace_back(terrainMesh);
+	// A simplified terrain is the occluder, it only has to be close as the software depth buffer is small
+	Occluder terrainOccluder;
+	float terrainOccluderError{ 0 };
+	terrainOccluder.mesh.vertices = terrainData.vertices;
+	terrainOccluder.mesh.elements = Helpers::SimplifyMesh(terrainData, terrainData.elements, terrainData.elements.size() / 4, 2.0f, terrainOccluderError);
+	std::cout << "Terrain occluder: " << terrainOccluder.mesh.elements.size() / 3 << " triangles, error " << terrainOccluderError << std::endl;
+	m_occluders.push_back(terrainOccluder);
 
 	Helpers::ModelLoader loader2;
 	if (!loader2.LoadFromFile("Data\\Models\\Sky\\Hills\\skybox.x"))
@@ -438,55 +1362,7 @@ bool Renderer::InitialiseGeometry()
 
 
 	for (const Helpers::Mesh& mesh2 : loader2.GetMeshVector())
-	{
-		Mesh newMesh;
-		
-		GLuint skyvertsVBO;
-		glGenBuffers(1, &skyvertsVBO);
-		glBindBuffer(GL_ARRAY_BUFFER, skyvertsVBO);
-		glBufferData(GL_ARRAY_BUFFER, sizeof(glm::vec3)* mesh2.vertices.size(), mesh2.vertices.data(), GL_STATIC_DRAW);
-		glBindBuffer(GL_ARRAY_BUFFER, 0);
-
-		GLuint skynormalsVBO;
-		glGenBuffers(1, &skynormalsVBO);
-		glBindBuffer(GL_ARRAY_BUFFER, skynormalsVBO);
-		glBufferData(GL_ARRAY_BUFFER, sizeof(glm::vec3)* mesh2.normals.size(), mesh2.normals.data(), GL_STATIC_DRAW);
-		glBindBuffer(GL_ARRAY_BUFFER, 0);
-
-		GLuint skyboxElementsEBO;
-		glGenBuffers(1, &skyboxElementsEBO);
-		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, skyboxElementsEBO);
-		glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(GLuint)* mesh2.elements.size(), mesh2.elements.data(), GL_STATIC_DRAW);
-		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
-
-		GLuint skyboxtexcoordsVBO;
-		glGenBuffers(1, &skyboxtexcoordsVBO);
-		glBindBuffer(GL_ARRAY_BUFFER, skyboxtexcoordsVBO);
-		glBufferData(GL_ARRAY_BUFFER, sizeof(glm::vec2)* mesh2.uvCoords.size(), mesh2.uvCoords.data(), GL_STATIC_DRAW);
-		glBindBuffer(GL_ARRAY_BUFFER, 0);
-
-
-		glGenVertexArrays(1, &newMesh.VAO);
-		glBindVertexArray(newMesh.VAO);
-
-		glBindBuffer(GL_ARRAY_BUFFER, skyvertsVBO);
-		glEnableVertexAttribArray(0);
-		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, (void*)0);
-
-		glBindBuffer(GL_ARRAY_BUFFER, skynormalsVBO);
-		glEnableVertexAttribArray(1);
-		glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 0, (void*)0);
-
-		glBindBuffer(GL_ARRAY_BUFFER, skyboxtexcoordsVBO);
-		glEnableVertexAttribArray(2);
-		glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 0, (void*)0);
-
-		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, skyboxElementsEBO);
-		glBindVertexArray(0);
-
-		newMesh.m_numElements = mesh2.elements.size();
-		Skymodel.m_meshVector.emplace_back(newMesh);
-	}
+		Skymodel.m_meshVector.emplace_back(CreateMesh<Helpers::PackedVertex>("Data\\Models\\Sky\\Hills\\skybox.x", mesh2));
 
 	m_modelVector.emplace_back(Skymodel);
 
@@ -503,110 +1379,551 @@ bool Renderer::InitialiseGeometry()
 
 	for (int i = 0; i < Skymodel.m_meshVector.size(); i++)
 	{
-		Helpers::ImageLoader skyBox_texture;
-		if (skyBox_texture.Load(facesCubemap[i]))
+		LoadTextureAsync(facesCubemap[i], GL_CLAMP_TO_EDGE, texturesLoaded, [this, i](const Helpers::TextureLayer& texture)
 		{
-			glGenTextures(1, &Skymodel.m_meshVector[i].Tex);
-			glBindTexture(GL_TEXTURE_2D, Skymodel.m_meshVector[i].Tex);
-			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-			glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, skyBox_texture.Width(), skyBox_texture.Height(), 0, GL_RGBA, GL_UNSIGNED_BYTE, skyBox_texture.GetData());
-			glGenerateMipmap(GL_TEXTURE_2D);
-		}
+			Skymodel.m_meshVector[i].m_material.texture = texture;
+		});
+	}
+
+	// Finish decoding then make the texture arrays here on the main thread
+	jobs.Wait(texturesLoaded);
+	jobs.RunMainThreadJobs();
+	{
+		PROFILE_CPU("Upload textures");
+		m_texturePool.Build();
 	}
+
+	return true;
+}
+
+// The stream buffer region can be reused once the GPU is past this frame's commands
+void Renderer::EndFrame()
+{
+	Helpers::CommandList windowList(ThreadAllocator());
+	m_frameGraph.RecordWindowRebind(windowList);
+	m_backend->Execute(windowList);
+	m_frameCommands += windowList.NumCommands();
+
+	m_streamBuffer.EndFrame();
+	if (m_terrainShading == TerrainShading::VirtualTexture)
+		m_virtualTexture.EndFrame();
 }
 
 // Render the scene. Passed the delta time since last called.
-void Renderer::Render(const Helpers::Camera& camera, float deltaTime)
+// The passes are declared to the frame graph, recorded into command lists in parallel on the job system,
+// then executed here in the order the graph compiled
+void Renderer::Render(const Helpers::Camera& camera, const WorldState& world, float deltaTime)
 {			
-	// Configure pipeline settings
-	//glEnable(GL_DEPTH_TEST);
-	glEnable(GL_CULL_FACE);
+	Helpers::JobSystem& jobs{ Helpers::GetJobSystem() };
+
+	// Last frame's lists have all been executed
+	Helpers::GetProfiler().BeginFrame();
+	Helpers::GetGLInterceptor().BeginFrame();
+	PROFILE_CPU("Render");
+	ResetCommandAllocators();
+	m_backend->BeginFrame();
+	m_streamBuffer.BeginFrame();
+
+	// Keep last frame's draw counts for the stats panel
+	for (Model* model : { &Skymodel, &jeepmodel, &terrainmodel, &cubemodel })
+	{
+		for (Mesh& mesh : model->m_meshVector)
+		{
+			mesh.m_lastFrameStats = mesh.m_frameStats;
+			mesh.m_frameStats = MeshFrameStats();
+		}
+	}
 
-	// Wireframe mode controlled by ImGui
-	if (m_wireframe)
-		glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
-	else
-		glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+	// Configure pipeline settings, wireframe mode controlled by ImGui
+	// Strips are restarted with the largest value of their index type
+	Helpers::RenderState sceneState;
+	sceneState.wireframe = m_wireframe;
 
-	// Clear buffers from previous frame
-//	glClearColor(0.0f, 0.0f, 0.0f, 0.f);
-	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+	// The sky is drawn first without depth so everything else is in front of it
+	Helpers::RenderState skyState{ sceneState };
+	skyState.depthTest = false;
+	skyState.depthWrite = false;
 
 	// Compute viewport and projection matrix
-	GLint viewportSize[4];
-	glGetIntegerv(GL_VIEWPORT, viewportSize);
+	const glm::ivec4 viewportSize{ m_backend->GetViewport() };
 	const float aspect_ratio = viewportSize[2] / (float)viewportSize[3];
 	glm::mat4 projection_xform = glm::perspective(glm::radians(45.0f), aspect_ratio, 0.1f, 10000.0f);
 
-	glUseProgram(m_program);
-	glDepthMask(GL_FALSE);
-	glDisable(GL_DEPTH_TEST);
+	// Pixels covered by one world unit at a distance of one, used to project level of detail errors
+	const float pixelsPerUnit{ viewportSize[3] / (2.0f * std::tan(glm::radians(45.0f) * 0.5f)) };
 
-	glm::mat4 model_xform = glm::mat4(1);
+	const glm::mat4 model_xform = glm::mat4(1);
 	// Compute camera view matrix and combine with projection matrix for passing to shader
 	glm::mat4 view_xform = glm::lookAt(camera.GetPosition(), camera.GetPosition() + camera.GetLookVector(), camera.GetUpVector());
 
 
-	//Skybox Rendering
-	glm::mat4 view_xform2 = glm::mat4(glm::mat3(view_xform));
-	glm::mat4 combined_xform2 = projection_xform * view_xform2;
-	GLuint combined_xform_id2 = glGetUniformLocation(m_program, "combined_xform");
-	glUniformMatrix4fv(combined_xform_id2, 1, GL_FALSE, glm::value_ptr(combined_xform2));
-	for (int i = 0;i < Skymodel.m_meshVector.size(); i++)
-	{		
-		glActiveTexture(GL_TEXTURE0);
-		glBindTexture(GL_TEXTURE_2D, Skymodel.m_meshVector[i].Tex);
-		glUniform1i(glGetUniformLocation(m_program, "sampler_tex"), 0);
-		glBindVertexArray(Skymodel.m_meshVector[i].VAO);
-		glDrawElements(GL_TRIANGLES, Skymodel.m_meshVector[i].m_numElements, GL_UNSIGNED_INT, (void*)0);
+	glm::mat4 combined_xform = projection_xform * view_xform;
+
+	// Bin the lights for this view and copy them, their clusters and indices to the stream buffer for the lit passes
+	m_lightsAllocation = m_clustersAllocation = m_lightIndicesAllocation = Helpers::StreamAllocation();
+	if (m_clusteredLightsOn)
+	{
+		PROFILE_CPU("Light binning");
+		if (m_lights.size() != (size_t)m_numLights)
+			m_lights = GenerateLights((size_t)m_numLights);
+		m_lightClusters.SetView(view_xform, glm::radians(45.0f), aspect_ratio, 0.1f, 10000.0f, glm::ivec2(viewportSize[2], viewportSize[3]));
+		m_lightClusters.Bin(m_lights);
+		m_lightsAllocation = m_streamBuffer.AllocateStorage(m_lights.data(), m_lights.size());
+		m_clustersAllocation = m_streamBuffer.AllocateStorage(m_lightClusters.GetClusters().data(), m_lightClusters.GetClusters().size());
+		m_lightIndicesAllocation = m_streamBuffer.AllocateStorage(m_lightClusters.GetIndices().data(), m_lightClusters.GetIndices().size());
 	}
-	glDepthMask(GL_TRUE);
-	glEnable(GL_DEPTH_TEST);
 
-	//Jeep Rendering
-	glm::mat4 combined_xform = projection_xform * view_xform;
-	GLuint combined_xform_id = glGetUniformLocation(m_program, "combined_xform");
-	glUniformMatrix4fv(combined_xform_id, 1, GL_FALSE, glm::value_ptr(combined_xform));
-	glActiveTexture(GL_TEXTURE0);
-	glBindTexture(GL_TEXTURE_2D, jeepmodel.m_meshVector[0].Tex);
-	glUniform1i(glGetUniformLocation(m_program, "sampler_tex"), 0);
-	glBindVertexArray(jeepmodel.m_meshVector[0].VAO);
-	glDrawElements(GL_TRIANGLES, jeepmodel.m_meshVector[0].m_numElements, GL_UNSIGNED_INT, (void*)0);
-
-	//Terrain Rendering
-	GLuint model_xform_id = glGetUniformLocation(m_program, "model_xform");
-	glUniformMatrix4fv(model_xform_id, 1, GL_FALSE, glm::value_ptr(model_xform));
-	glActiveTexture(GL_TEXTURE0);
-	glBindTexture(GL_TEXTURE_2D, terrainmodel.m_meshVector[0].Tex);
-	glBindVertexArray(terrainmodel.m_meshVector[0].VAO);
-	glDrawElements(GL_TRIANGLES, terrainmodel.m_meshVector[0].m_numElements, GL_UNSIGNED_INT, (void*)0);
+	// Collect the GPU occlusion results that have arrived since last frame
+	if (m_gpuOcclusionQueries)
+		m_occlusionQueries.BeginFrame();
 
-	//Cube Rendering
-	glUseProgram(cube_Program);
+	// Draw the occluders into the software depth buffer before anything is tested against it
+	if (m_occlusionCulling)
+	{
+		PROFILE_CPU("Occluders");
+		m_occlusionCuller.BeginFrame(combined_xform);
+		for (const Occluder& occluder : m_occluders)
+			m_occlusionCuller.AddOccluder(occluder.mesh.vertices, occluder.mesh.elements, occluder.model_xform);
+		m_occlusionCuller.RasteriseOccluders();
+	}
+
+	//Cube transform from the simulation, needed before the occlusion queries
 	glm::mat4 transMatrix = glm::translate(glm::mat4(1), glm::vec3(0, 500, 0));
 	glm::mat4 scaleMatrix = glm::scale(transMatrix, glm::vec3(10.0f,10.0f,10.0f));
 	glm::mat4 model_xform2 = glm::mat4(1);
-	static float angle = 0;
-	static bool rotateY = true;
-	if (rotateY) // Rotate around y axis		
-		model_xform2 = glm::rotate(scaleMatrix, angle, glm::vec3{ 0 ,1,0 });
+	if (world.cubeRotateY) // Rotate around y axis		
+		model_xform2 = glm::rotate(scaleMatrix, world.cubeAngle, glm::vec3{ 0 ,1,0 });
 	else // Rotate around x axis		
-		model_xform2 = glm::rotate(scaleMatrix, angle, glm::vec3{ 1 ,0,0 });
-	angle+=0.001f;
-	if (angle > glm::two_pi<float>())
-	{
-		angle = 0;
-		rotateY = !rotateY;
-	}
-	glm::mat4 combined_xform3 = projection_xform * view_xform;
-	GLuint combined_xform_id3 = glGetUniformLocation(cube_Program, "combined_xform3");
-	glUniformMatrix4fv(combined_xform_id3, 1, GL_FALSE, glm::value_ptr(combined_xform3));
-	GLuint model_xform_id2 = glGetUniformLocation(cube_Program, "model_xform2");
-	glUniformMatrix4fv(model_xform_id2, 1, GL_FALSE, glm::value_ptr(model_xform2));
-	glBindVertexArray(cubemodel.m_meshVector[0].VAO);
-	glDrawElements(GL_TRIANGLES, cubemodel.m_meshVector[0].m_numElements, GL_UNSIGNED_INT, (void*)0);
-
-}
\ No newline at end of file
+		model_xform2 = glm::rotate(scaleMatrix, world.cubeAngle, glm::vec3{ 1 ,0,0 });
+	m_lastSimulationTick = world.tick;
+
+	// Whole objects are tested here as the occlusion culler is not thread safe, while recording
+	// only the jeep's pass uses it for its meshlets
+	const bool jeepOccluded{ IsOccluded(jeepmodel.m_meshVector[0], model_xform) };
+	const bool cubeOccluded{ IsOccluded(cubemodel.m_meshVector[0], model_xform2) };
+
+	// Fit the shadow cascades to the view and the terrain, cull the casters into them and write their draws. The terrain
+	// and jeep never move so go into the cached cascades only on the frames those are drawn again, the cube never does.
+	m_shadowDraws.clear();
+	m_cachedShadowDraws.clear();
+	m_shadowReceiverAllocation = Helpers::StreamAllocation();
+	GLuint shadowCascades{ 0 };
+	if (m_shadowsOn)
+	{
+		PROFILE_CPU("Shadow cascades");
+		Helpers::ShadowView shadowView;
+		shadowView.view = view_xform;
+		shadowView.fovY = glm::radians(45.0f);
+		shadowView.aspect = aspect_ratio;
+		shadowView.nearZ = 0.1f;
+		shadowView.sunDirection = SunDirection();
+		GetWorldBounds(terrainmodel.m_meshVector[0], model_xform, shadowView.receiversMin, shadowView.receiversMax);
+		GetWorldBounds(cubemodel.m_meshVector[0], model_xform2, shadowView.castersMin, shadowView.castersMax);
+		m_shadows.Update(shadowView);
+
+		shadowCascades = m_shadows.GetDrawCascades();
+		const GLuint dynamicCascades{ shadowCascades & ~Helpers::CascadedShadows::KCachedCascades };
+		const GLuint cachedCascades{ shadowCascades & Helpers::CascadedShadows::KCachedCascades };
+		for (const Model* model : { &terrainmodel, &jeepmodel })
+		{
+			for (const Mesh& mesh : model->m_meshVector)
+			{
+				AddShadowCaster(m_shadowDraws, mesh, model_xform, dynamicCascades, true);
+				AddShadowCaster(m_cachedShadowDraws, mesh, model_xform, cachedCascades, true);
+			}
+		}
+		AddShadowCaster(m_shadowDraws, cubemodel.m_meshVector[0], model_xform2, dynamicCascades, false);
+		m_shadowReceiverAllocation = m_streamBuffer.AllocateUniforms(m_shadows.GetReceiverData());
+	}
+
+	// Arrays are made again here if their levels change, so before any pass records their textures.
+	// The sky is drawn around the camera so is measured from the origin.
+	{
+		PROFILE_CPU("Texture residency");
+		m_textureResidency.BeginFrame();
+		for (const Mesh& mesh : Skymodel.m_meshVector)
+			RequestTextureLevel(mesh, model_xform, glm::vec3(0), pixelsPerUnit);
+		if (m_terrainShading == TerrainShading::Tiled)
+			RequestTextureLevel(terrainmodel.m_meshVector[0], model_xform, camera.GetPosition(), pixelsPerUnit);
+		if (!jeepOccluded)
+			RequestTextureLevel(jeepmodel.m_meshVector[0], model_xform, camera.GetPosition(), pixelsPerUnit);
+		m_textureResidency.Update();
+	}
+
+	// Likewise the pages asked for by the feedback of a few frames ago are uploaded and the page table updated
+	if (m_terrainShading == TerrainShading::VirtualTexture)
+	{
+		PROFILE_CPU("Virtual texture");
+		m_virtualTexture.BeginFrame(viewportSize);
+	}
+
+	const double recordStart{ glfwGetTime() };
+
+	// The scene draws into a colour and depth target, transient ones copied to the window at the end or the window's own
+	m_frameGraph.Reset();
+	const Helpers::FrameGraphTextureDesc colourDesc{ viewportSize[2], viewportSize[3], GL_RGBA8 };
+	const Helpers::FrameGraphTextureDesc depthDesc{ viewportSize[2], viewportSize[3], GL_DEPTH_COMPONENT24 };
+	const Helpers::FrameGraphResource backbuffer{ m_frameGraph.ImportBackbuffer("Window", colourDesc) };
+	m_frameGraph.MarkOutput(backbuffer);
+	Helpers::FrameGraphResource sceneColour{ backbuffer };
+	Helpers::FrameGraphResource sceneDepth{ backbuffer };
+	if (!m_offscreenScene)
+		sceneDepth = m_frameGraph.ImportBackbuffer("Window depth", depthDesc);
+
+	// The shadow atlas lives across frames as the cached cascades keep their depths
+	const Helpers::FrameGraphResource shadowAtlas{ m_frameGraph.ImportTexture("Shadow atlas", m_shadows.GetAtlas(),
+		Helpers::FrameGraphTextureDesc{ Helpers::CascadedShadows::KAtlasSize, Helpers::CascadedShadows::KAtlasSize, Helpers::CascadedShadows::KAtlasFormat }) };
+
+	// Passes that draw more of the scene into its targets
+	auto drawsScene = [&](Helpers::FrameGraph::PassBuilder& builder)
+	{
+		builder.Write(sceneColour, Helpers::FrameGraphAccess::ColourTarget);
+		builder.Write(sceneDepth, Helpers::FrameGraphAccess::DepthTarget);
+		builder.Read(shadowAtlas, Helpers::FrameGraphAccess::Sampled);
+	};
+
+	// The cascades that are not cached, then any cached ones drawn again
+	if (m_shadowsOn)
+	{
+		m_frameGraph.AddPass("Shadows", [&](Helpers::FrameGraph::PassBuilder& builder)
+		{
+			builder.Write(shadowAtlas, Helpers::FrameGraphAccess::DepthTarget);
+		},
+		[&](Helpers::CommandList& list)
+		{
+			PROFILE("Shadows", list);
+			DrawShadowCascades(list, m_shadowDraws, shadowCascades & ~Helpers::CascadedShadows::KCachedCascades);
+		});
+	}
+	if (shadowCascades & Helpers::CascadedShadows::KCachedCascades)
+	{
+		m_frameGraph.AddPass("Shadows cached", [&](Helpers::FrameGraph::PassBuilder& builder)
+		{
+			builder.Write(shadowAtlas, Helpers::FrameGraphAccess::DepthTarget);
+		},
+		[&](Helpers::CommandList& list)
+		{
+			PROFILE("Shadows cached", list);
+			DrawShadowCascades(list, m_cachedShadowDraws, shadowCascades & Helpers::CascadedShadows::KCachedCascades);
+		});
+	}
+
+	// Clear buffers from previous frame, depth writes must be on for the depth to clear
+	m_frameGraph.AddPass("Clear", [&](Helpers::FrameGraph::PassBuilder& builder)
+	{
+		if (m_offscreenScene)
+		{
+			sceneColour = builder.CreateTexture("Scene colour", colourDesc);
+			sceneDepth = builder.CreateTexture("Scene depth", depthDesc, Helpers::FrameGraphAccess::DepthTarget);
+		}
+		else
+		{
+			drawsScene(builder);
+		}
+	},
+	[&](Helpers::CommandList& list)
+	{
+		PROFILE("Clear", list);
+		list.SetState(sceneState);
+		list.Clear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+	});
+
+	// Each pass sets all the state it needs as they may be recorded in any order
+	// Passes only touch their own meshes so may be recorded at the same time
+
+	//Skybox Rendering, tests nothing against the depth but must draw into the same framebuffer
+	m_frameGraph.AddPass("Sky", [&](Helpers::FrameGraph::PassBuilder& builder)
+	{
+		builder.Write(sceneColour, Helpers::FrameGraphAccess::ColourTarget);
+		builder.Read(sceneDepth, Helpers::FrameGraphAccess::DepthTarget);
+	},
+	[&](Helpers::CommandList& list)
+	{
+		PROFILE("Sky", list);
+		glm::mat4 view_xform2 = glm::mat4(glm::mat3(view_xform));
+		glm::mat4 combined_xform2 = projection_xform * view_xform2;
+		list.SetState(skyState);
+		list.BindProgram(m_program.Get());
+		list.SetUniform(Uniform(m_program.Get(), "combined_xform"), combined_xform2);
+		list.SetUniform(Uniform(m_program.Get(), "sampler_tex"), 0);
+		BindClusteredLights(list, m_program.Get(), false);
+		BindShadows(list, m_program.Get(), false);
+		GLuint boundArray{ GL_INVALID_INDEX };
+		for (Mesh& mesh : Skymodel.m_meshVector)
+		{		
+			if (!SetObjectData(list, mesh, model_xform))
+				continue;
+			BindMaterial(list, mesh, boundArray);
+			list.BindVertexArray(mesh.VAO);
+			DrawMesh(list, m_program.Get(), mesh);
+		}
+	});
+
+	//Terrain Rendering, before the jeep and cube as it is what hides them
+	m_frameGraph.AddPass("Terrain", drawsScene, [&](Helpers::CommandList& list)
+	{
+		PROFILE("Terrain", list);
+		Mesh& terrain{ terrainmodel.m_meshVector[0] };
+		list.SetState(sceneState);
+		if (m_terrainShading == TerrainShading::Splat)
+		{
+			const GLuint program{ m_terrainSplatProgram.Get() };
+			list.BindProgram(program);
+			list.SetUniform(Uniform(program, "combined_xform"), combined_xform);
+			list.SetUniform(Uniform(program, "splat_layers"), 1);
+			list.SetUniform(Uniform(program, "splat_weights"), 2);
+			list.SetUniform(Uniform(program, "splat_uv_scale"), 1.0f / KTerrainRepeats);
+			list.SetUniform(Uniform(program, "splat_samples"), m_splatSamples);
+			list.SetUniform(Uniform(program, "splat_blend_depth"), m_splatBlendDepth);
+			BindClusteredLights(list, program, true);
+			BindShadows(list, program, true);
+			if (!SetObjectData(list, terrain, model_xform))
+				return;
+			list.BindTexture(1, m_splatLayers.Get(), GL_TEXTURE_2D_ARRAY);
+			list.BindTexture(2, m_splatWeights.Get(), GL_TEXTURE_2D_ARRAY);
+			list.BindVertexArray(terrain.VAO);
+			DrawMesh(list, program, terrain);
+			return;
+		}
+
+		if (m_terrainShading == TerrainShading::VirtualTexture)
+		{
+			const GLuint program{ m_terrainVTProgram.Get() };
+			list.BindProgram(program);
+			list.SetUniform(Uniform(program, "combined_xform"), combined_xform);
+			list.SetUniform(Uniform(program, "page_table"), 1);
+			list.SetUniform(Uniform(program, "page_cache"), 2);
+			list.SetUniform(Uniform(program, "vt_uv_scale"), 1.0f / KTerrainRepeats);
+			list.SetUniform(Uniform(program, "vt_lod_bias"), m_virtualTexture.GetLodBias());
+			BindClusteredLights(list, program, true);
+			BindShadows(list, program, true);
+			if (!SetObjectData(list, terrain, model_xform))
+				return;
+			list.BindTexture(1, m_virtualTexture.GetPageTable());
+			list.BindTexture(2, m_virtualTexture.GetCache());
+			list.BindVertexArray(terrain.VAO);
+			DrawMesh(list, program, terrain);
+			return;
+		}
+
+		list.BindProgram(m_program.Get());
+		list.SetUniform(Uniform(m_program.Get(), "combined_xform"), combined_xform);
+		list.SetUniform(Uniform(m_program.Get(), "sampler_tex"), 0);
+		BindClusteredLights(list, m_program.Get(), true);
+		BindShadows(list, m_program.Get(), true);
+		if (!SetObjectData(list, terrain, model_xform))
+			return;
+		GLuint boundArray{ GL_INVALID_INDEX };
+		BindMaterial(list, terrain, boundArray);
+		list.BindVertexArray(terrain.VAO);
+		DrawMesh(list, m_program.Get(), terrain);
+	});
+
+	//Virtual texture feedback, the terrain again at a fraction of the size writing the page each pixel samples,
+	//then copied to the readback buffer the virtual texture reads a few frames later
+	if (m_terrainShading == TerrainShading::VirtualTexture)
+	{
+		const glm::ivec2 feedbackSize{ m_virtualTexture.GetFeedbackSize() };
+		Helpers::FrameGraphResource feedback;
+		m_frameGraph.AddPass("VT feedback", [&](Helpers::FrameGraph::PassBuilder& builder)
+		{
+			feedback = builder.CreateTexture("VT feedback", Helpers::FrameGraphTextureDesc{ feedbackSize.x, feedbackSize.y, GL_RGBA8 });
+			builder.CreateTexture("VT feedback depth", Helpers::FrameGraphTextureDesc{ feedbackSize.x, feedbackSize.y, GL_DEPTH_COMPONENT24 },
+				Helpers::FrameGraphAccess::DepthTarget);
+		},
+		[&](Helpers::CommandList& list)
+		{
+			PROFILE("VT feedback", list);
+			const Mesh& terrain{ terrainmodel.m_meshVector[0] };
+			const GLuint program{ m_vtFeedbackProgram.Get() };
+			list.SetState(Helpers::RenderState());
+			list.Clear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+			list.BindProgram(program);
+			list.SetUniform(Uniform(program, "combined_xform"), combined_xform);
+			list.SetUniform(Uniform(program, "vt_uv_scale"), 1.0f / KTerrainRepeats);
+			list.SetUniform(Uniform(program, "vt_lod_bias"), m_virtualTexture.GetFeedbackLodBias());
+			if (!SetObjectData(list, terrain, model_xform))
+				return;
+
+			// Drawn directly rather than with DrawMesh, which counts into the mesh's stats while the terrain pass may be recording
+			const LodRange& range{ terrain.m_lods[0] };
+			list.BindVertexArray(terrain.VAO);
+			list.DrawElements(terrain.m_primitive, range.count, terrain.m_indexType, (size_t)range.firstIndex * terrain.m_indexSize);
+		});
+
+		m_frameGraph.AddPass("VT readback", [&](Helpers::FrameGraph::PassBuilder& builder)
+		{
+			builder.Read(feedback, Helpers::FrameGraphAccess::TransferSource);
+			builder.SideEffects();
+		},
+		[&](Helpers::CommandList& list)
+		{
+			PROFILE("VT readback", list);
+			m_virtualTexture.RecordFeedbackReadback(list);
+		});
+	}
+
+	//Occlusion query boxes, tested against the terrain depth. Recorded on the main thread as they may create query objects
+	//and their results are read back in later frames, so the pass is never culled
+	if (m_gpuOcclusionQueries)
+	{
+		m_frameGraph.AddPass("Occlusion queries", [&](Helpers::FrameGraph::PassBuilder& builder)
+		{
+			builder.Read(sceneColour, Helpers::FrameGraphAccess::ColourTarget);
+			builder.Read(sceneDepth, Helpers::FrameGraphAccess::DepthTarget);
+			builder.SideEffects();
+			builder.MainThread();
+		},
+		[&](Helpers::CommandList& list)
+		{
+			PROFILE("Occlusion queries", list);
+			glm::vec3 minExtents, maxExtents;
+			m_occlusionQueries.BeginBoxes(list, combined_xform);
+			GetWorldBounds(jeepmodel.m_meshVector[0], model_xform, minExtents, maxExtents);
+			m_occlusionQueries.TestBox(list, m_jeepQueryId, minExtents, maxExtents, camera.GetPosition());
+			GetWorldBounds(cubemodel.m_meshVector[0], model_xform2, minExtents, maxExtents);
+			m_occlusionQueries.TestBox(list, m_cubeQueryId, minExtents, maxExtents, camera.GetPosition());
+			m_occlusionQueries.EndBoxes(list, sceneState);
+		});
+	}
+
+	//Jeep Rendering
+	m_frameGraph.AddPass("Jeep", drawsScene, [&](Helpers::CommandList& list)
+	{
+		PROFILE("Jeep", list);
+		Mesh& jeep{ jeepmodel.m_meshVector[0] };
+		SelectLod(jeep, model_xform, camera.GetPosition(), pixelsPerUnit, deltaTime);
+		if (jeepOccluded)
+			return;
+
+		if (m_meshletCulling)
+		{
+			PROFILE_CPU("Meshlet culling");
+			CullMeshlets(jeep, model_xform, combined_xform, camera.GetPosition());
+		}
+		list.SetState(sceneState);
+		list.BindProgram(m_program.Get());
+		list.SetUniform(Uniform(m_program.Get(), "combined_xform"), combined_xform);
+		list.SetUniform(Uniform(m_program.Get(), "sampler_tex"), 0);
+		BindClusteredLights(list, m_program.Get(), true);
+		BindShadows(list, m_program.Get(), true);
+		if (!SetObjectData(list, jeep, model_xform))
+			return;
+		GLuint boundArray{ GL_INVALID_INDEX };
+		BindMaterial(list, jeep, boundArray);
+		list.BindVertexArray(jeep.VAO);
+		if (m_gpuOcclusionQueries)
+			m_occlusionQueries.BeginConditionalDraw(list, m_jeepQueryId);
+		DrawMesh(list, m_program.Get(), jeep);
+		if (m_gpuOcclusionQueries)
+			m_occlusionQueries.EndConditionalDraw(list, m_jeepQueryId);
+	});
+
+	//Cube Rendering
+	m_frameGraph.AddPass("Cube", drawsScene, [&](Helpers::CommandList& list)
+	{
+		PROFILE("Cube", list);
+		if (cubeOccluded)
+			return;
+
+		Mesh& cube{ cubemodel.m_meshVector[0] };
+		glm::mat4 combined_xform3 = projection_xform * view_xform;
+		list.SetState(sceneState);
+		list.BindProgram(cube_Program.Get());
+		list.SetUniform(Uniform(cube_Program.Get(), "combined_xform3"), combined_xform3);
+		list.SetUniform(Uniform(cube_Program.Get(), "model_xform2"), model_xform2);
+		list.BindVertexArray(cube.VAO);
+		if (m_gpuOcclusionQueries)
+			m_occlusionQueries.BeginConditionalDraw(list, m_cubeQueryId);
+		DrawMesh(list, cube_Program.Get(), cube);
+		if (m_gpuOcclusionQueries)
+			m_occlusionQueries.EndConditionalDraw(list, m_cubeQueryId);
+	});
+
+	// Copy the finished scene to the window
+	if (m_offscreenScene)
+	{
+		m_frameGraph.AddPass("Present", [&](Helpers::FrameGraph::PassBuilder& builder)
+		{
+			builder.Read(sceneColour, Helpers::FrameGraphAccess::TransferSource);
+			builder.Write(backbuffer, Helpers::FrameGraphAccess::TransferDestination);
+		},
+		[&](Helpers::CommandList& list)
+		{
+			PROFILE("Present", list);
+			const glm::ivec4 rect{ 0, 0, colourDesc.width, colourDesc.height };
+			list.BlitFramebuffer(rect, rect, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+		});
+	}
+
+	{
+		PROFILE_CPU("Frame graph compile");
+		if (!m_frameGraph.Compile())
+		{
+			// Nothing is drawn but the frame is still closed, else the stream buffer never moves on to its next region
+			m_frameCommands = 0;
+			EndFrame();
+			return;
+		}
+	}
+
+	// Passes that must be on the main thread are recorded here first, the rest on the job system
+	const size_t numPasses{ m_frameGraph.NumPasses() };
+	std::vector<Helpers::CommandList> passLists(numPasses);
+	for (size_t i = 0; i < numPasses; i++)
+	{
+		if (!m_frameGraph.PassOnMainThread(i))
+			continue;
+		passLists[i] = Helpers::CommandList(ThreadAllocator());
+		m_frameGraph.RecordPass(i, passLists[i]);
+	}
+
+	auto recordPasses = [&](size_t begin, size_t end)
+	{
+		for (size_t i = begin; i < end; i++)
+		{
+			if (m_frameGraph.PassOnMainThread(i))
+				continue;
+			passLists[i] = Helpers::CommandList(ThreadAllocator());
+			m_frameGraph.RecordPass(i, passLists[i]);
+		}
+	};
+	{
+		PROFILE_CPU("Record");
+		if (m_parallelRecording)
+			jobs.ParallelFor(numPasses, 1, recordPasses);
+		else
+			recordPasses(0, numPasses);
+	}
+
+	// Execute in the order the frame graph chose
+	const double submitStart{ glfwGetTime() };
+	m_frameCommands = 0;
+	{
+		PROFILE_CPU("Submit");
+		for (const Helpers::CommandList& list : passLists)
+		{
+			m_backend->Execute(list);
+			m_frameCommands += list.NumCommands();
+		}
+		EndFrame();
+	}
+
+	m_frameCommandBytes = 0;
+	for (const auto& allocator : m_commandAllocators)
+		m_frameCommandBytes += allocator->BytesUsed();
+	m_recordMilliseconds = (float)((submitStart - recordStart) * 1000.0);
+	m_submitMilliseconds = (float)((glfwGetTime() - submitStart) * 1000.0);
+
+	// Plotted in traces alongside the scopes
+	Helpers::Profiler& profiler{ Helpers::GetProfiler() };
+	const Helpers::RenderBackendStats& stats{ m_backend->GetStats() };
+	profiler.SetCounter("Draws", (double)stats.draws);
+	profiler.SetCounter("Commands", (double)m_frameCommands);
+	profiler.SetCounter("State changes", (double)stats.stateChanges);
+	profiler.SetCounter("Program binds", (double)stats.programBinds);
+	profiler.SetCounter("Texture binds", (double)stats.textureBinds);
+	profiler.SetCounter("Bytes uploaded", (double)stats.bufferUploadBytes);
+	profiler.SetCounter("Command list bytes", (double)m_frameCommandBytes);
+	profiler.SetCounter("Stream buffer bytes", (double)m_streamBuffer.BytesThisFrame());
+}
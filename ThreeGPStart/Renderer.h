@@ -5,12 +5,167 @@
 #include "Helper.h"
 #include "Mesh.h"
 #include "Camera.h"
+#include "VertexFormat.h"
+#include "IndexBuffer.h"
+#include "MeshSimplifier.h"
+#include "Meshlet.h"
+#include "OcclusionCuller.h"
+#include "OcclusionQueries.h"
+#include "JobSystem.h"
+#include "RenderCommands.h"
+#include "RenderBackend.h"
+#include "GpuResources.h"
+#include "TexturePool.h"
+#include "TextureResidency.h"
+#include "VirtualTexture.h"
+#include "TerrainSplat.h"
+#include "ClusteredLighting.h"
+#include "CascadedShadows.h"
+#include "StreamBuffer.h"
+#include "FrameGraph.h"
+#include "Profiler.h"
+#include "ImageLoader.h"
+#include "WorldState.h"
+
+// One level of detail, a range of the mesh's element buffer
+struct LodRange
+{
+	GLuint firstIndex{ 0 };
+	GLuint count{ 0 };
+	GLuint numTriangles{ 0 };
+	float error{ 0 };	// model units
+};
+
+// What a mesh cost to draw in a frame
+struct MeshFrameStats
+{
+	GLuint draws{ 0 };
+	GLuint indexBytes{ 0 };
+	GLuint triangles{ 0 };
+	GLuint fullDetailTriangles{ 0 };
+};
+
+// The GPU objects of a mesh, the levels of detail share them
+struct MeshBuffers
+{
+	Helpers::GpuBuffer vertexBuffer;
+	Helpers::GpuBuffer elementBuffer;
+	Helpers::GpuVertexArray vertexArray;
+};
+
+// Layout of one glMultiDrawElementsIndirect command
+struct DrawElementsIndirectCommand
+{
+	GLuint count{ 0 };
+	GLuint instanceCount{ 1 };
+	GLuint firstIndex{ 0 };
+	GLint baseVertex{ 0 };
+	GLuint baseInstance{ 0 };
+};
+
+// The ObjectData uniform block of vertex_shader.vert, std140 so vec3s are padded to vec4s
+struct ObjectData
+{
+	glm::mat4 model_xform{ 1 };
+	glm::vec4 pos_dequant_offset{ 0 };	// w = layer of the material's texture array
+	glm::vec4 pos_dequant_scale{ 1 };
+	glm::vec4 uv_dequant{ 0, 0, 1, 1 };	// xy = offset, zw = scale
+};
+
+// Meshlets of level 0 for cluster culling, level 0 of the element buffer is stored in meshlet order
+// so every visible meshlet is one contiguous range and neighbouring visible meshlets join into one draw
+struct MeshClusters
+{
+	Helpers::Mesh positions;	// vertices only, kept for validating the culling
+	Helpers::MeshletData data;
+	Helpers::MeshletCullData cullData;
+	std::vector<unsigned char> visible;
+	std::vector<DrawElementsIndirectCommand> commands;
+	Helpers::StreamAllocation indirect;	// this frame's copy of the commands, empty if it did not fit
+
+	// Last culling result
+	GLuint visibleMeshlets{ 0 };
+	GLuint visibleTriangles{ 0 };
+	float cullMilliseconds{ 0 };
+};
+
+// What a mesh is drawn with, its texture is a layer of one of the texture pool's arrays
+struct Material
+{
+	Helpers::TextureLayer texture;
+};
 
 struct Mesh
 {
 	GLuint VAO;
 	GLuint m_numElements;
-	GLuint Tex;
+	Material m_material;
+
+	// Owns the VAO and its buffers, shared as meshes are copied into models
+	std::shared_ptr<MeshBuffers> m_buffers;
+
+	// Vertex format details, the quantisation values are needed by the shader to unpack the vertices
+	std::string m_name;
+	GLuint m_numVertices{ 0 };
+	GLuint m_vertexStride{ 0 };
+	Helpers::MeshQuantisation m_quantisation;
+	Helpers::QuantisationError m_quantisationError;
+
+	// Index format, chosen per mesh at upload
+	GLenum m_indexType{ GL_UNSIGNED_INT };
+	GLenum m_primitive{ GL_TRIANGLES };
+	GLuint m_indexSize{ 4 };
+	GLuint m_numTriangles{ 0 };
+	GLuint m_indexBufferBytes{ 0 };
+
+	// Levels of detail, level 0 is the full mesh. While m_fadingLod is set both are drawn dithered.
+	std::vector<LodRange> m_lods;
+	int m_currentLod{ 0 };
+	int m_fadingLod{ -1 };
+	float m_lodFade{ 1 };
+
+	// Optional meshlets, shared as meshes are copied into models
+	std::shared_ptr<MeshClusters> m_clusters;
+
+	// Bounding sphere in model space
+	glm::vec3 m_boundsCentre{ 0 };
+	float m_boundsRadius{ 0 };
+
+	// Stats
+	MeshFrameStats m_frameStats;
+	MeshFrameStats m_lastFrameStats;
+};
+
+// A simplified mesh drawn into the software depth buffer to hide what is behind it
+struct Occluder
+{
+	Helpers::Mesh mesh;
+	glm::mat4 model_xform{ 1 };
+};
+
+// The image the terrain's virtual texture pages are made from, with its mip chain
+struct TerrainPageSource
+{
+	std::vector<std::vector<GLubyte>> levels;	// RGBA8, full size first
+	GLsizei width{ 0 };
+	GLsizei height{ 0 };
+};
+
+// How the terrain is textured
+enum class TerrainShading
+{
+	Tiled,				// the grass image repeated, from the texture pool
+	VirtualTexture,		// unique texels from the virtual texture
+	Splat				// materials blended by the splat map
+};
+
+// A caster's draw into the shadow atlas, one instance per cascade it touches, written to the stream buffer before recording
+struct ShadowDraw
+{
+	const Mesh* mesh{ nullptr };
+	Helpers::StreamAllocation object;
+	Helpers::StreamAllocation caster;
+	Helpers::StreamAllocation indirect;
 };
 
 struct Model
@@ -18,10 +173,63 @@ struct Model
 	std::vector<Mesh> m_meshVector;
 };
 
+// Recording and submission times of many draws through command lists
+struct CommandListBenchmark
+{
+	size_t draws{ 0 };
+	size_t commands{ 0 };
+	size_t bytes{ 0 };
+	float recordSerialMilliseconds{ 0 };
+	float recordParallelMilliseconds{ 0 };
+	float submitMilliseconds{ 0 };
+	float finishMilliseconds{ 0 };	// waiting for the GPU after submitting
+};
+
+// Binning a number of lights for one view, and checking it by brute force
+struct LightBinningBenchmark
+{
+	size_t lights{ 0 };
+	Helpers::LightBinningStats stats;
+	Helpers::LightBinningValidation validation;
+};
 
 class Renderer
 {
 private:
+	// Everything GL goes through this, declared first so it is destroyed last
+	std::unique_ptr<Helpers::RenderBackend> m_backend;
+
+	// Owns every GPU object made below, which are all destroyed before it so anything left is a leak
+	Helpers::GpuResourceRegistry m_gpuResources;
+
+	// Every texture loaded, meshes refer to them by array and layer so draws sharing an array need no binds
+	Helpers::TexturePool m_texturePool;
+
+	// Which mips of the pool's arrays are on the GPU, from what each frame draws and the memory budget
+	Helpers::TextureResidency m_textureResidency;
+
+	// The terrain's texture coordinates run from 0 to this across it, the tiled texture repeating as often
+	static constexpr float KTerrainRepeats{ 40.0f };
+	TerrainShading m_terrainShading{ TerrainShading::Splat };
+
+	// The terrain's texture as a virtual texture, its pages made from the source on the job system as the
+	// feedback asks for them. The source is declared first as the jobs still running read it.
+	TerrainPageSource m_terrainPageSource;
+	Helpers::VirtualTexture m_virtualTexture;
+	Helpers::GpuProgram m_terrainVTProgram;
+	Helpers::GpuProgram m_vtFeedbackProgram;
+
+	// The terrain's splat materials, resampled to one size to share an array, and their weights across it
+	static constexpr GLsizei KSplatLayerSize{ 1024 };
+	static constexpr GLsizei KSplatMapSize{ 256 };
+	std::vector<Helpers::SplatRule> m_splatRules;
+	Helpers::SplatMapStats m_splatStats;
+	Helpers::GpuTextureArray m_splatLayers;
+	Helpers::GpuTextureArray m_splatWeights;
+	Helpers::GpuProgram m_terrainSplatProgram;
+	int m_splatSamples{ 2 };			// materials sampled per pixel, those with the largest weights
+	float m_splatBlendDepth{ 0.2f };
+
 	Model Skymodel;
 	Model jeepmodel;
 	Model terrainmodel;
@@ -29,16 +237,196 @@ private:
 	std::vector<Model> m_modelVector;
 
 	// Program object - to host shaders
-	GLuint m_program{ 0 };
-	GLuint cube_Program{ 0 };
+	Helpers::GpuProgram m_program;
+	Helpers::GpuProgram cube_Program;
 
 	bool m_wireframe{ false };
 
-	GLuint CreateProgram(std::string fragmentpath, std::string vertexpath);
+	// Tick of the simulation state last drawn
+	unsigned int m_lastSimulationTick{ 0 };
+
+	// Level of detail selection
+	bool m_lodEnabled{ true };
+	bool m_lodCrossFade{ true };
+	float m_lodErrorPixels{ 1.0f };		// largest allowed projected error
+	float m_lodHysteresis{ 0.25f };		// only drop detail once the error is this fraction under the limit
+	float m_lodFadeSeconds{ 0.25f };
+
+	// Meshlet culling
+	bool m_meshletCulling{ true };
+	bool m_meshletBackfaceCulling{ true };
+	bool m_validateMeshlets{ false };	// compare against per triangle culling next frame
+	std::string m_meshletValidationResult;
+	Helpers::MeshletValidation m_meshletValidation;
+	size_t m_meshletValidations{ 0 };
+
+	// Software occlusion culling against the occluders
+	bool m_occlusionCulling{ true };
+	Helpers::OcclusionCuller m_occlusionCuller;
+	std::vector<Occluder> m_occluders;
+
+	// GPU occlusion queries on the bounding boxes of the jeep and cube
+	bool m_gpuOcclusionQueries{ false };
+	Helpers::OcclusionQueries m_occlusionQueries;
+	Helpers::GpuProgram m_occlusionBoxProgram;
+	size_t m_jeepQueryId{ 0 };
+	size_t m_cubeQueryId{ 0 };
+
+	// Last run of MeasureJobScaling
+	std::vector<Helpers::JobScalingResult> m_jobScaling;
+
+	// Each pass is recorded into a command list, on the job system when m_parallelRecording is set,
+	// then the lists are executed in order here. Every job thread records into its own allocator.
+	bool m_parallelRecording{ true };
+	std::vector<std::unique_ptr<Helpers::LinearAllocator>> m_commandAllocators;
+	size_t m_frameCommands{ 0 };
+	size_t m_frameCommandBytes{ 0 };
+	float m_recordMilliseconds{ 0 };
+	float m_submitMilliseconds{ 0 };
+	CommandListBenchmark m_commandBenchmark;
+
+	// Per frame data (object uniform blocks, indirect draws, the binned lights) is written straight into mapped memory
+	static constexpr size_t KStreamRegionSize{ 2 * 1024 * 1024 };
+	static constexpr GLuint KObjectDataBinding{ 1 };
+	Helpers::StreamBuffer m_streamBuffer;
+
+	// Point and spot lights over the terrain, binned each frame into the clusters of the view so each pixel shades
+	// only the lights of its cluster. The bindings must match clustered_lighting.glsl.
+	static constexpr GLuint KLightsBinding{ 2 };
+	static constexpr GLuint KClustersBinding{ 3 };
+	static constexpr GLuint KLightIndicesBinding{ 4 };
+	bool m_clusteredLightsOn{ true };
+	int m_numLights{ 256 };
+	std::vector<Helpers::Light> m_lights;
+	Helpers::ClusteredLighting m_lightClusters;
+	Helpers::StreamAllocation m_lightsAllocation;		// this frame's copies, empty if they did not fit
+	Helpers::StreamAllocation m_clustersAllocation;
+	Helpers::StreamAllocation m_lightIndicesAllocation;
+	Helpers::LightBinningValidation m_lightValidation;
+	std::vector<LightBinningBenchmark> m_lightBenchmarks;
+
+	// Cascaded shadow maps for the sun. The casters are culled per cascade and their draws written before recording,
+	// into the cached cascades only on the frames those are drawn again. The bindings and unit must match
+	// shadow_caster.vert and shadows.glsl.
+	static constexpr GLuint KShadowCasterBinding{ 5 };
+	static constexpr GLuint KShadowReceiverBinding{ 6 };
+	static constexpr GLuint KShadowAtlasUnit{ 3 };
+	bool m_shadowsOn{ true };
+	float m_sunAzimuth{ 0.0f };			// degrees, 0 is towards +z
+	float m_sunElevation{ 63.43f };		// degrees above the horizon
+	Helpers::CascadedShadows m_shadows;
+	Helpers::GpuProgram m_shadowCasterProgram;
+	std::vector<ShadowDraw> m_shadowDraws;			// this frame's, into the cascades that are not cached
+	std::vector<ShadowDraw> m_cachedShadowDraws;	// this frame's, into the cached cascades drawn again
+	Helpers::StreamAllocation m_shadowReceiverAllocation;
+
+	// The passes are declared to the frame graph each frame, which orders them and owns the render targets.
+	// With m_offscreenScene the scene is drawn into transient targets and then copied to the window.
+	Helpers::FrameGraph m_frameGraph;
+	bool m_offscreenScene{ true };
+
+	Helpers::GpuProgram CreateProgram(std::string fragmentpath, std::string vertexpath);
+
+	// Location of a uniform looked up by the backend when the program was created, -1 if it has none
+	GLint Uniform(GLuint program, const std::string& name) const;
+
+	// The command allocator of the calling job thread
+	Helpers::LinearAllocator& ThreadAllocator();
+
+	// Free every command recorded, the lists must have been executed
+	void ResetCommandAllocators();
+
+	// Record numDraws cube draws serially and then in parallel, and submit them without changing the frame
+	void BenchmarkCommandLists(size_t numDraws);
+
+	// Upload a helper mesh using an interleaved vertex layout from VertexFormat.h
+	// Optionally generates a chain of simplified levels of detail sharing the vertices
+	// and the meshlets of the full detail level for cluster culling
+	// Its GPU memory is counted against asset
+	template<typename Layout>
+	Mesh CreateMesh(const std::string& asset, const Helpers::Mesh& mesh, bool useStrips = false, bool buildLods = false, bool buildMeshlets = false);
+
+	// Decode an image on the job system and add it to the texture pool on the main thread once the counter is waited on
+	// and the main thread jobs run, onCreated receives its layer when the pool is built
+	void LoadTextureAsync(const std::string& filename, GLint wrap, Helpers::JobCounter& counter, std::function<void(const Helpers::TextureLayer&)> onCreated);
+
+	// Ask the texture residency for the mip level the mesh's texture needs, from the texels across its UVs against its size on screen
+	void RequestTextureLevel(const Mesh& mesh, const glm::mat4& model_xform, const glm::vec3& cameraPosition, float pixelsPerUnit);
+
+	// Load the splat materials and make the weights from the terrain's heights and slopes, false on error
+	bool CreateTerrainSplat(const Helpers::Heightfield& heightfield);
+
+	// Make a page of the terrain's virtual texture on a job thread, see Helpers::VirtualPageCompositor
+	void CompositeTerrainPage(const Helpers::VirtualPage& page, GLubyte* rgba) const;
+
+	// Record binding the mesh's texture array to unit 0 if it is not the one bound already, boundArray starts each pass as GL_INVALID_INDEX
+	void BindMaterial(Helpers::CommandList& list, const Mesh& mesh, GLuint& boundArray);
+
+	// Time the occlusion rasteriser on job systems of 1 to N threads
+	void MeasureJobScaling();
+
+	// Choose the level of detail of a mesh from its projected error in pixels
+	void SelectLod(Mesh& mesh, const glm::mat4& model_xform, const glm::vec3& cameraPosition, float pixelsPerUnit, float deltaTime);
+
+	// Record drawing the mesh's current level of detail (cross fading if changing), the VAO must already be bound
+	void DrawMesh(Helpers::CommandList& list, GLuint program, Mesh& mesh);
+
+	// Cull the meshlets of a mesh with clusters and write its indirect draw list to the stream buffer
+	void CullMeshlets(Mesh& mesh, const glm::mat4& model_xform, const glm::mat4& combined_xform, const glm::vec3& cameraPosition);
+
+	// True if the mesh's bounds are hidden behind the occluders rasterised this frame
+	bool IsOccluded(const Mesh& mesh, const glm::mat4& model_xform);
+
+	// Write the mesh's object data to the stream buffer and record binding it, false if it did not fit
+	bool SetObjectData(Helpers::CommandList& list, const Mesh& mesh, const glm::mat4& model_xform);
+
+	// Scatter count lights over the terrain, the same lights for the same count
+	static std::vector<Helpers::Light> GenerateLights(size_t count);
+
+	// Record binding this frame's binned lights for the program's clustered_lights, or turning them off
+	void BindClusteredLights(Helpers::CommandList& list, GLuint program, bool lit);
+
+	// The way the sun's light travels
+	glm::vec3 SunDirection() const;
+
+	// Cull a caster against cascades and write its instanced draw of full detail to the stream buffer, if it touches any.
+	// Positions are dequantised as the mesh's unless packedPositions is false, when they are already floats.
+	void AddShadowCaster(std::vector<ShadowDraw>& draws, const Mesh& mesh, const glm::mat4& model_xform, GLuint cascades, bool packedPositions);
+
+	// Record clearing cascades of the atlas, bound as the framebuffer, and drawing the casters into them
+	void DrawShadowCascades(Helpers::CommandList& list, const std::vector<ShadowDraw>& draws, GLuint cascades);
+
+	// Record binding the shadow atlas and this frame's cascades for the program's sun_shadow, or turning them off
+	void BindShadows(Helpers::CommandList& list, GLuint program, bool shadowed);
+
+	// Bind the window again and fence what this frame streamed and read back, also when nothing was drawn
+	void EndFrame();
 public:
+	// Draws with OpenGL
 	Renderer();
+
+	// Draws through the given backend, e.g. a NullRenderBackend to run without a GPU
+	explicit Renderer(std::unique_ptr<Helpers::RenderBackend> backend);
 	~Renderer();
 
+	const Helpers::RenderBackend& GetBackend() const { return *m_backend; }
+	const Helpers::FrameGraph& GetFrameGraph() const { return m_frameGraph; }
+	const Helpers::GpuResourceRegistry& GetGpuResources() const { return m_gpuResources; }
+	const Helpers::TextureResidency& GetTextureResidency() const { return m_textureResidency; }
+	const Helpers::VirtualTexture& GetVirtualTexture() const { return m_virtualTexture; }
+	const Helpers::ClusteredLighting& GetLightClusters() const { return m_lightClusters; }
+	const Helpers::CascadedShadows& GetShadows() const { return m_shadows; }
+
+	// Bin 1k and 10k lights for the last frame's view and check each against brute force, false if any missed a cluster
+	bool BenchmarkLightBinning();
+
+	// Compare meshlet culling against culling each triangle in the next frame that culls meshlets
+	void ValidateMeshletsNextFrame() { m_validateMeshlets = true; }
+
+	// The last of those comparisons, and how many have been made
+	const Helpers::MeshletValidation& GetMeshletValidation() const { return m_meshletValidation; }
+	size_t GetMeshletValidations() const { return m_meshletValidations; }
+
 	// Draw GUI
 	void DefineGUI();
 
@@ -47,7 +435,7 @@ public:
 	// Create and / or load geometry, this is like 'level load'
 	bool InitialiseGeometry();
 
-	// Render the scene
-	void Render(const Helpers::Camera& camera, float deltaTime);
+	// Render the scene, world is the interpolated simulation state
+	void Render(const Helpers::Camera& camera, const WorldState& world, float deltaTime);
 };
 
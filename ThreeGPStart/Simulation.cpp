@@ -1,10 +1,14 @@
 #include "Simulation.h"
 #include "Camera.h"
 #include "Renderer.h"
+#include "Profiler.h"
+#include "GLRenderBackend.h"
+#include "FrameCapture.h"
 
 
 // Initialise this as well as the renderer, returns false on error
-bool Simulation::Initialise()
+// Frames can be captured to captureFile when it is given
+bool Simulation::Initialise(const std::string& captureFile)
 {
 	// Set up camera
 	m_camera = std::make_shared<Helpers::Camera>();
@@ -13,8 +17,67 @@ bool Simulation::Initialise()
 	//m_camera->Initialise(glm::vec3(0, 20, 60), glm::vec3(0.3f, 0, 0)); // Cube
 
 	// Set up renderer
-	m_renderer = std::make_shared<Renderer>();
-	return m_renderer->InitialiseGeometry();
+	if (captureFile.empty())
+		m_renderer = std::make_shared<Renderer>();
+	else
+		m_renderer = std::make_shared<Renderer>(std::make_unique<Helpers::CaptureRenderBackend>(std::make_unique<Helpers::GLRenderBackend>(), captureFile));
+	if (!m_renderer->InitialiseGeometry())
+		return false;
+
+	// Start the world ticking
+	m_simulationRunning = true;
+	m_simulationThread = std::thread(&Simulation::SimulationLoop, this);
+	return true;
+}
+
+// Stops the simulation thread
+Simulation::~Simulation()
+{
+	m_simulationRunning = false;
+	if (m_simulationThread.joinable())
+		m_simulationThread.join();
+}
+
+// Step the world whenever a tick is due, publishing after each wake up. Several ticks are run to catch up
+// after oversleeping but a long stall (e.g. a breakpoint) is skipped rather than replayed.
+void Simulation::SimulationLoop()
+{
+	Helpers::GetProfiler().SetThreadName("Simulation");
+
+	WorldState state;
+	WorldState previous;
+	double simulationTime{ glfwGetTime() };
+
+	while (m_simulationRunning)
+	{
+		const double now{ glfwGetTime() };
+		if (now - simulationTime > 0.25)
+			simulationTime = now - KTickSeconds;
+
+		bool stepped{ false };
+		while (simulationTime + KTickSeconds <= now)
+		{
+			PROFILE_CPU("Simulation tick");
+			previous = state;
+			state.Step((float)KTickSeconds);
+			simulationTime += KTickSeconds;
+			stepped = true;
+		}
+
+		if (stepped)
+		{
+			WorldSnapshot& snapshot{ m_snapshots.Back() };
+			snapshot.previous = previous;
+			snapshot.current = state;
+			snapshot.previousTime = simulationTime - KTickSeconds;
+			snapshot.currentTime = simulationTime;
+			m_snapshots.Publish();
+		}
+
+		const double untilNextTick{ simulationTime + KTickSeconds - glfwGetTime() };
+		if (untilNextTick > 0.0)
+			std::this_thread::sleep_for(std::chrono::duration<double>(untilNextTick));
+	}
 }
 
 // Handle any user input. Return false if program should close.
@@ -60,10 +123,15 @@ bool Simulation::Update(GLFWwindow* window)
 	// The camera needs updating to handle user input internally
 	m_camera->Update(window, deltaTime);
 
+	// Pick up the latest tick and draw the world as it was one tick ago
+	m_snapshots.Update();
+	const WorldState world{ m_snapshots.Front().StateAt(glfwGetTime() - KTickSeconds) };
+
 	// Render the scene
-	m_renderer->Render(*m_camera, deltaTime);
+	m_renderer->Render(*m_camera, world, deltaTime);
 
 	// IMGUI	
+	PROFILE_CPU("GUI");
 	ImGui_ImplOpenGL3_NewFrame();
 	ImGui_ImplGlfw_NewFrame();
 	ImGui::NewFrame();
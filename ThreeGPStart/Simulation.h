@@ -2,6 +2,10 @@
 
 #include "ExternalLibraryHeaders.h"
 #include "Camera.h"
+#include "TripleBuffer.h"
+#include "WorldState.h"
+
+#include <thread>
 
 class Renderer;
 struct GLFWwindow;
@@ -19,11 +23,25 @@ private:
 	// Remember last update time so we can calculate delta time
 	float m_lastTime{ 0 };
 
+	// The world is stepped at a fixed rate on its own thread, which hands each tick to rendering
+	// through a triple buffer. Rendering draws one tick behind, interpolating the two latest ticks.
+	static constexpr double KTickSeconds{ 1.0 / 60.0 };
+	std::thread m_simulationThread;
+	std::atomic<bool> m_simulationRunning{ false };
+	Helpers::TripleBuffer<WorldSnapshot> m_snapshots;
+
+	// Simulation thread body, runs until m_simulationRunning is cleared
+	void SimulationLoop();
+
 	// Handle any user input. Return false if program should close.
 	bool HandleInput(GLFWwindow* window);
 public:
+	// Stops the simulation thread
+	~Simulation();
+
 	// Initialise this as well as the renderer, returns false on error
-	bool Initialise();	
+	// Frames can be captured to captureFile when it is given
+	bool Initialise(const std::string& captureFile = std::string());
 
 	// Update the simulation (and render) returns false if program should clse
 	bool Update(GLFWwindow* window);
@@ -0,0 +1,109 @@
+#include "StreamBuffer.h"
+
+namespace Helpers
+{
+	StreamBuffer::~StreamBuffer()
+	{
+		if (!m_backend)
+			return;
+
+		for (GLsync fence : m_fences)
+		{
+			if (fence)
+				m_backend->DeleteFence(fence);
+		}
+	}
+
+	// numRegions frames can be in flight before BeginFrame has to wait for the GPU
+	bool StreamBuffer::Initialise(GpuResourceRegistry& resources, size_t regionSize, size_t numRegions)
+	{
+		RenderBackend& backend{ resources.GetBackend() };
+
+		// Regions start aligned for anything that is bound from them
+		const size_t alignment{ std::max<size_t>(std::max(backend.GetUniformBufferAlignment(), backend.GetStorageBufferAlignment()), 16) };
+		regionSize = (regionSize + alignment - 1) / alignment * alignment;
+
+		void* mapped{ nullptr };
+		GpuBuffer buffer{ resources.CreatePersistentBuffer("Stream buffer", regionSize * numRegions, mapped) };
+		if (!buffer || !mapped)
+		{
+			std::cout << "ERROR: could not map the stream buffer" << std::endl;
+			return false;
+		}
+
+		m_backend = &backend;
+		m_buffer = std::move(buffer);
+		m_mapped = static_cast<GLubyte*>(mapped);
+		m_regionSize = regionSize;
+		m_fences.assign(numRegions, 0);
+		m_currentRegion = numRegions - 1;
+		return true;
+	}
+
+	// Move on to the next region, waiting for the GPU to finish with it if it has not yet
+	void StreamBuffer::BeginFrame()
+	{
+		if (!m_backend || m_inFrame)
+			return;
+
+		m_lastFrameStats.bytes = m_head.load(std::memory_order_relaxed);
+		m_lastFrameStats.allocations = m_allocations.exchange(0, std::memory_order_relaxed);
+		m_lastFrameStats.failed = m_failed.exchange(0, std::memory_order_relaxed);
+		m_lastFrameStats.stallMilliseconds = m_stallMilliseconds;
+		m_peakBytes = std::max(m_peakBytes, m_lastFrameStats.bytes);
+
+		m_currentRegion = (m_currentRegion + 1) % m_fences.size();
+		m_stallMilliseconds = 0;
+
+		GLsync& fence{ m_fences[m_currentRegion] };
+		if (fence)
+		{
+			const double start{ glfwGetTime() };
+			m_backend->WaitFence(fence);
+			m_stallMilliseconds = (float)((glfwGetTime() - start) * 1000.0);
+			m_backend->DeleteFence(fence);
+			fence = 0;
+		}
+
+		m_head.store(0, std::memory_order_relaxed);
+		m_inFrame = true;
+	}
+
+	// Fence the region once the frame's commands using it have been executed
+	void StreamBuffer::EndFrame()
+	{
+		if (!m_backend || !m_inFrame)
+			return;
+
+		m_fences[m_currentRegion] = m_backend->InsertFence();
+		m_inFrame = false;
+	}
+
+	// Bumps the head with a compare and swap so recording jobs can allocate at the same time
+	StreamAllocation StreamBuffer::Allocate(size_t size, size_t alignment)
+	{
+		StreamAllocation allocation;
+		if (!m_inFrame || size == 0)
+			return allocation;
+
+		size_t head{ m_head.load(std::memory_order_relaxed) };
+		size_t aligned;
+		do
+		{
+			aligned = (head + alignment - 1) & ~(alignment - 1);
+			if (aligned + size > m_regionSize)
+			{
+				m_failed.fetch_add(1, std::memory_order_relaxed);
+				return allocation;
+			}
+		} while (!m_head.compare_exchange_weak(head, aligned + size, std::memory_order_relaxed));
+
+		m_allocations.fetch_add(1, std::memory_order_relaxed);
+
+		allocation.buffer = m_buffer.Get();
+		allocation.offset = m_currentRegion * m_regionSize + aligned;
+		allocation.size = size;
+		allocation.memory = m_mapped + allocation.offset;
+		return allocation;
+	}
+}
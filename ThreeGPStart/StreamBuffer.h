@@ -0,0 +1,115 @@
+#pragma once
+// Ring of persistently mapped buffer regions for data written by the CPU every frame (uniform blocks,
+// instance data, indirect commands, transient vertices). Each frame writes into its own region and a
+// fence is placed after the frame's commands, so a region is only reused once the GPU has read it.
+
+#include "ExternalLibraryHeaders.h"
+#include "RenderBackend.h"
+#include "GpuResources.h"
+
+#include <algorithm>
+#include <atomic>
+
+namespace Helpers
+{
+	// Use of the stream buffer in one frame, the stall is time spent waiting on a region's fence
+	struct StreamBufferStats
+	{
+		size_t bytes{ 0 };
+		size_t allocations{ 0 };
+		size_t failed{ 0 };		// allocations that did not fit in the region
+		float stallMilliseconds{ 0 };
+	};
+
+	// Part of the buffer written this frame, memory is nullptr if the allocation failed.
+	// Write only, the memory may be uncached and is read by the GPU.
+	struct StreamAllocation
+	{
+		void* memory{ nullptr };
+		GLuint buffer{ 0 };
+		size_t offset{ 0 };		// from the start of the buffer
+		size_t size{ 0 };
+
+		explicit operator bool() const { return memory != nullptr; }
+	};
+
+	class StreamBuffer
+	{
+	private:
+		RenderBackend* m_backend{ nullptr };
+		GpuBuffer m_buffer;
+		GLubyte* m_mapped{ nullptr };
+
+		size_t m_regionSize{ 0 };
+		size_t m_currentRegion{ 0 };
+		std::vector<GLsync> m_fences;	// one per region, 0 if the region has never been used
+
+		// Offset within the current region, allocations bump it from any thread
+		std::atomic<size_t> m_head{ 0 };
+		std::atomic<size_t> m_allocations{ 0 };
+		std::atomic<size_t> m_failed{ 0 };
+
+		bool m_inFrame{ false };
+		float m_stallMilliseconds{ 0 };
+
+		StreamBufferStats m_lastFrameStats;
+		size_t m_peakBytes{ 0 };
+	public:
+		StreamBuffer() = default;
+		StreamBuffer(const StreamBuffer&) = delete;
+		StreamBuffer& operator=(const StreamBuffer&) = delete;
+		~StreamBuffer();
+
+		// numRegions frames can be in flight before BeginFrame has to wait for the GPU
+		bool Initialise(GpuResourceRegistry& resources, size_t regionSize, size_t numRegions = 3);
+
+		// Move on to the next region, waiting for the GPU to finish with it if it has not yet
+		void BeginFrame();
+
+		// Fence the region once the frame's commands using it have been executed
+		void EndFrame();
+
+		// Thread safe. Alignment must be a power of two.
+		StreamAllocation Allocate(size_t size, size_t alignment = 16);
+
+		// Space for a uniform block aligned as the backend requires
+		template<typename T>
+		StreamAllocation AllocateUniforms(const T& block)
+		{
+			const StreamAllocation allocation{ Allocate(sizeof(T), m_backend->GetUniformBufferAlignment()) };
+			if (allocation)
+				memcpy(allocation.memory, &block, sizeof(T));
+			return allocation;
+		}
+
+		// Copy of an array bound as a shader storage block, aligned as the backend requires
+		template<typename T>
+		StreamAllocation AllocateStorage(const T* data, size_t count)
+		{
+			const StreamAllocation allocation{ Allocate(std::max<size_t>(count, 1) * sizeof(T), m_backend->GetStorageBufferAlignment()) };
+			if (allocation && count)
+				memcpy(allocation.memory, data, count * sizeof(T));
+			return allocation;
+		}
+
+		// Copy of an array, e.g. instance data or indirect commands
+		template<typename T>
+		StreamAllocation AllocateArray(const T* data, size_t count)
+		{
+			const StreamAllocation allocation{ Allocate(count * sizeof(T), alignof(T) < 16 ? 16 : alignof(T)) };
+			if (allocation)
+				memcpy(allocation.memory, data, count * sizeof(T));
+			return allocation;
+		}
+
+		GLuint Buffer() const { return m_buffer.Get(); }
+		size_t RegionSize() const { return m_regionSize; }
+		size_t NumRegions() const { return m_fences.size(); }
+
+		// Allocated so far this frame, including padding for alignment
+		size_t BytesThisFrame() const { return m_head.load(std::memory_order_relaxed); }
+
+		const StreamBufferStats& GetLastFrameStats() const { return m_lastFrameStats; }
+		size_t PeakBytes() const { return m_peakBytes; }
+	};
+}
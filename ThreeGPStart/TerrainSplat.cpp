@@ -0,0 +1,145 @@
+#include "TerrainSplat.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace Helpers
+{
+	// Bilinear between the grid points, clamped to the edges
+	float Heightfield::HeightAt(float row, float column) const
+	{
+		if (rows <= 0 || columns <= 0)
+			return 0.0f;
+
+		row = glm::clamp(row, 0.0f, (float)(rows - 1));
+		column = glm::clamp(column, 0.0f, (float)(columns - 1));
+		const int r0{ (int)row }, c0{ (int)column };
+		const int r1{ std::min(r0 + 1, rows - 1) }, c1{ std::min(c0 + 1, columns - 1) };
+		const float tr{ row - r0 }, tc{ column - c0 };
+		const float first{ glm::mix(heights[(size_t)r0 * columns + c0], heights[(size_t)r0 * columns + c1], tc) };
+		const float second{ glm::mix(heights[(size_t)r1 * columns + c0], heights[(size_t)r1 * columns + c1], tc) };
+		return glm::mix(first, second, tr);
+	}
+
+	// Central differences a grid step either side
+	float Heightfield::SlopeAt(float row, float column) const
+	{
+		const float dRow{ (HeightAt(row + 1.0f, column) - HeightAt(row - 1.0f, column)) / (2.0f * spacing.x) };
+		const float dColumn{ (HeightAt(row, column + 1.0f) - HeightAt(row, column - 1.0f)) / (2.0f * spacing.y) };
+		return 1.0f - glm::normalize(glm::vec3(-dRow, 1.0f, -dColumn)).y;
+	}
+
+	// Texels whose weight is spread over more layers than are sampled
+	float SplatMapStats::FractionOver(size_t samples) const
+	{
+		size_t over{ 0 };
+		for (size_t layers = samples + 1; layers < texelsWithLayers.size(); layers++)
+			over += texelsWithLayers[layers];
+		return texels ? over / (float)texels : 0.0f;
+	}
+
+	// 1 inside minimum to maximum, falling to 0 fade outside
+	static float RangeWeight(float value, float minimum, float maximum, float fade)
+	{
+		const float outside{ std::max(minimum - value, value - maximum) };
+		if (outside <= 0.0f)
+			return 1.0f;
+		return fade > 0.0f ? std::max(1.0f - outside / fade, 0.0f) : 0.0f;
+	}
+
+	// A texel no rule covers is given wholly to the first
+	std::vector<GLubyte> BuildSplatWeights(const Heightfield& heightfield, const std::vector<SplatRule>& rules, GLsizei size, SplatMapStats& stats)
+	{
+		const size_t layers{ std::min(rules.size(), KMaxSplatLayers) };
+		if (rules.size() > KMaxSplatLayers)
+			std::cout << "ERROR: " << rules.size() << " splat rules, only the first " << KMaxSplatLayers << " are used" << std::endl;
+
+		const size_t layerBytes{ (size_t)size * (size_t)size * 4 };
+		std::vector<GLubyte> weights(layerBytes * (KMaxSplatLayers / 4), 0);
+		stats = SplatMapStats();
+		stats.coverage.assign(layers, 0.0f);
+		stats.texelsWithLayers.assign(KMaxSplatLayers + 1, 0);
+		stats.texels = (size_t)size * (size_t)size;
+		if (!layers)
+			return weights;
+
+		for (GLsizei y = 0; y < size; y++)
+		{
+			for (GLsizei x = 0; x < size; x++)
+			{
+				const float row{ (x + 0.5f) / size * heightfield.rows };
+				const float column{ (y + 0.5f) / size * heightfield.columns };
+				const float height{ heightfield.HeightAt(row, column) };
+				const float slope{ heightfield.SlopeAt(row, column) };
+
+				float layerWeights[KMaxSplatLayers]{};
+				float total{ 0.0f };
+				for (size_t i = 0; i < layers; i++)
+				{
+					const SplatRule& rule{ rules[i] };
+					layerWeights[i] = RangeWeight(height, rule.minHeight, rule.maxHeight, rule.heightFade) *
+						RangeWeight(slope, rule.minSlope, rule.maxSlope, rule.slopeFade) * rule.strength;
+					total += layerWeights[i];
+				}
+				if (total <= 0.0f)
+				{
+					layerWeights[0] = 1.0f;
+					total = 1.0f;
+				}
+
+				size_t nonZero{ 0 };
+				const size_t texel{ ((size_t)y * size + x) * 4 };
+				for (size_t i = 0; i < layers; i++)
+				{
+					const float weight{ layerWeights[i] / total };
+					const GLubyte packed{ (GLubyte)std::lround(weight * 255.0f) };
+					weights[(i / 4) * layerBytes + texel + i % 4] = packed;
+					stats.coverage[i] += weight;
+					nonZero += packed ? 1 : 0;
+				}
+				stats.texelsWithLayers[nonZero]++;
+			}
+		}
+
+		for (float& coverage : stats.coverage)
+			coverage /= stats.texels;
+		return weights;
+	}
+
+	// Texel centres of the new size mapped onto the old, each blending the four nearest texels
+	std::vector<GLubyte> ResampleImage(const GLubyte* rgba, GLsizei width, GLsizei height, GLsizei newWidth, GLsizei newHeight)
+	{
+		std::vector<GLubyte> resampled((size_t)newWidth * (size_t)newHeight * 4);
+		if (width == newWidth && height == newHeight)
+		{
+			std::copy(rgba, rgba + resampled.size(), resampled.begin());
+			return resampled;
+		}
+
+		auto wrap = [](int value, int size) { return ((value % size) + size) % size; };
+		for (GLsizei y = 0; y < newHeight; y++)
+		{
+			const float sy{ (y + 0.5f) * height / newHeight - 0.5f };
+			const int y0{ (int)std::floor(sy) };
+			const float ty{ sy - y0 };
+			for (GLsizei x = 0; x < newWidth; x++)
+			{
+				const float sx{ (x + 0.5f) * width / newWidth - 0.5f };
+				const int x0{ (int)std::floor(sx) };
+				const float tx{ sx - x0 };
+
+				const GLubyte* p00{ &rgba[((size_t)wrap(y0, height) * width + wrap(x0, width)) * 4] };
+				const GLubyte* p10{ &rgba[((size_t)wrap(y0, height) * width + wrap(x0 + 1, width)) * 4] };
+				const GLubyte* p01{ &rgba[((size_t)wrap(y0 + 1, height) * width + wrap(x0, width)) * 4] };
+				const GLubyte* p11{ &rgba[((size_t)wrap(y0 + 1, height) * width + wrap(x0 + 1, width)) * 4] };
+				GLubyte* out{ &resampled[((size_t)y * newWidth + x) * 4] };
+				for (int c = 0; c < 4; c++)
+				{
+					const float value{ glm::mix(glm::mix((float)p00[c], (float)p10[c], tx), glm::mix((float)p01[c], (float)p11[c], tx), ty) };
+					out[c] = (GLubyte)std::lround(value);
+				}
+			}
+		}
+		return resampled;
+	}
+}
@@ -0,0 +1,64 @@
+#pragma once
+// Splat map texturing of a heightfield. Up to KMaxSplatLayers material layers share one texture array and the
+// weight of each layer at each point of the terrain is packed four to a texel into a second array of four RGBA8
+// layers, made here from the height and slope under each texel by a rule per material layer. The shader reads
+// the 16 weights with four filtered fetches, keeps the few largest and samples only those materials, blending
+// them by the material's own height (its brightness) so stones show through grass rather than fading into it.
+
+#include "ExternalLibraryHeaders.h"
+
+#include <cfloat>
+
+namespace Helpers
+{
+	// The shader reads the weights of this many layers, must match terrain_splat.frag
+	static constexpr size_t KMaxSplatLayers{ 16 };
+
+	// Heights of a regular grid, row r and column c at heights[r * columns + c], spacing world units apart
+	struct Heightfield
+	{
+		int rows{ 0 };
+		int columns{ 0 };
+		glm::vec2 spacing{ 1 };		// between rows, between columns
+		std::vector<float> heights;
+
+		// Bilinear between the grid points, clamped to the edges, row and column may be fractional
+		float HeightAt(float row, float column) const;
+
+		// 0 flat to 1 vertical, one minus the y of the normal from the height differences a grid step either side
+		float SlopeAt(float row, float column) const;
+	};
+
+	// Where a material layer shows. Its weight is 1 inside both ranges falling to 0 fade outside them,
+	// times strength, then every texel's weights are normalised to sum to 1.
+	struct SplatRule
+	{
+		std::string name;
+		float minHeight{ -FLT_MAX };
+		float maxHeight{ FLT_MAX };
+		float heightFade{ 1.0f };
+		float minSlope{ 0.0f };
+		float maxSlope{ 1.0f };
+		float slopeFade{ 0.05f };
+		float strength{ 1.0f };
+	};
+
+	// What a splat map holds, for choosing how many layers the shader samples
+	struct SplatMapStats
+	{
+		std::vector<float> coverage;			// per rule, mean weight over the map
+		std::vector<size_t> texelsWithLayers;	// [n] texels with n layers of non-zero weight
+		size_t texels{ 0 };
+
+		// Fraction of texels where sampling only the largest samples layers drops some weight
+		float FractionOver(size_t samples) const;
+	};
+
+	// Weights of up to KMaxSplatLayers rules over a size x size map, texel x along the rows and y along the columns
+	// of the heightfield. RGBA8 laid out as KMaxSplatLayers / 4 layers, the weight of rule i in channel i % 4 of layer i / 4.
+	std::vector<GLubyte> BuildSplatWeights(const Heightfield& heightfield, const std::vector<SplatRule>& rules, GLsizei size, SplatMapStats& stats);
+
+	// An RGBA8 image resampled bilinearly to a new size, wrapping at the edges as a repeating texture does,
+	// so images of different sizes can be layers of one array
+	std::vector<GLubyte> ResampleImage(const GLubyte* rgba, GLsizei width, GLsizei height, GLsizei newWidth, GLsizei newHeight);
+}
@@ -0,0 +1,185 @@
+#include "TextureAtlas.h"
+
+#include <algorithm>
+#include <fstream>
+
+// Our own copy of the packer, ImGui's is static to imgui_draw.cpp
+#define STBRP_STATIC
+#define STB_RECT_PACK_IMPLEMENTATION
+#include "imstb_rectpack.h"
+
+namespace Helpers
+{
+	// Queue an RGBA8 image for the next Build, the pixels are copied
+	void TextureAtlas::Add(const std::string& name, GLsizei width, GLsizei height, const void* rgba)
+	{
+		if (width <= 0 || height <= 0 || !rgba)
+		{
+			std::cout << "ERROR: image " << name << " added to the atlas without pixels" << std::endl;
+			return;
+		}
+
+		Image image;
+		image.name = name;
+		image.width = width;
+		image.height = height;
+		image.pixels.assign(static_cast<const GLubyte*>(rgba), static_cast<const GLubyte*>(rgba) + (size_t)width * (size_t)height * 4);
+		m_images.push_back(std::move(image));
+	}
+
+	// Copy an image into its rect and fill the gutter around it from its edges
+	void TextureAtlas::Blit(const Image& image, const AtlasRect& rect, GLsizei gutter)
+	{
+		const auto texel = [&](GLsizei x, GLsizei y) { return &m_pixels[((size_t)y * m_width + x) * 4]; };
+		for (GLsizei y = -gutter; y < image.height + gutter; y++)
+		{
+			const GLsizei sourceY{ std::min(std::max(y, 0), image.height - 1) };
+			for (GLsizei x = -gutter; x < image.width + gutter; x++)
+			{
+				const GLsizei sourceX{ std::min(std::max(x, 0), image.width - 1) };
+				memcpy(texel(rect.x + x, rect.y + y), &image.pixels[((size_t)sourceY * image.width + sourceX) * 4], 4);
+			}
+		}
+	}
+
+	// Sizes are tried smallest first, doubling the width then the height. Each image's padded rect is rounded
+	// up to the mip alignment and packed in units of it, so every rect lands on an aligned texel.
+	bool TextureAtlas::Build(GLsizei maxSize, int mipLevels)
+	{
+		m_rects.clear();
+		m_pixels.clear();
+		m_width = m_height = 0;
+		m_mipLevels = mipLevels;
+		if (m_images.empty())
+			return true;
+
+		const GLsizei align{ 1 << mipLevels };
+		const GLsizei gutter{ align };
+
+		std::vector<stbrp_rect> packed(m_images.size());
+		for (size_t i = 0; i < m_images.size(); i++)
+		{
+			packed[i].id = (int)i;
+			packed[i].w = (stbrp_coord)((m_images[i].width + 2 * gutter + align - 1) / align);
+			packed[i].h = (stbrp_coord)((m_images[i].height + 2 * gutter + align - 1) / align);
+		}
+
+		GLsizei width{ align }, height{ align };
+		bool fits{ false };
+		while (width <= maxSize && height <= maxSize)
+		{
+			const int units{ width / align };
+			std::vector<stbrp_node> nodes((size_t)units);
+			stbrp_context context;
+			stbrp_init_target(&context, units, height / align, nodes.data(), units);
+			if (stbrp_pack_rects(&context, packed.data(), (int)packed.size()))
+			{
+				fits = true;
+				break;
+			}
+
+			if (width == height)
+				width *= 2;
+			else
+				height *= 2;
+		}
+		if (!fits)
+		{
+			std::cout << "ERROR: " << m_images.size() << " images do not fit in a " << maxSize << "x" << maxSize << " atlas" << std::endl;
+			return false;
+		}
+
+		m_width = width;
+		m_height = height;
+		m_pixels.assign((size_t)width * (size_t)height * 4, 0);
+		for (const stbrp_rect& place : packed)
+		{
+			const Image& image{ m_images[place.id] };
+			AtlasRect rect;
+			rect.name = image.name;
+			rect.x = place.x * align + gutter;
+			rect.y = place.y * align + gutter;
+			rect.width = image.width;
+			rect.height = image.height;
+			rect.uvOffset = glm::vec2(rect.x / (float)width, rect.y / (float)height);
+			rect.uvScale = glm::vec2(rect.width / (float)width, rect.height / (float)height);
+			Blit(image, rect, gutter);
+			m_rects.push_back(rect);
+		}
+
+		// The images are in the atlas now
+		m_images.clear();
+		return true;
+	}
+
+	// nullptr if no image of that name was packed
+	const AtlasRect* TextureAtlas::Find(const std::string& name) const
+	{
+		for (const AtlasRect& rect : m_rects)
+		{
+			if (rect.name == name)
+				return &rect;
+		}
+		return nullptr;
+	}
+
+	// Fraction of the atlas covered by images rather than gutters and empty space
+	float TextureAtlas::Occupancy() const
+	{
+		if (!m_width || !m_height)
+			return 0;
+
+		size_t texels{ 0 };
+		for (const AtlasRect& rect : m_rects)
+			texels += (size_t)rect.width * (size_t)rect.height;
+		return texels / ((float)m_width * (float)m_height);
+	}
+
+	// The atlas size and every rect as JSON, false on error
+	bool TextureAtlas::WriteRectTable(const std::string& filename) const
+	{
+		std::ofstream file(filename, std::ios::trunc);
+		if (!file)
+		{
+			std::cout << "ERROR: could not write the atlas rect table to " << filename << std::endl;
+			return false;
+		}
+
+		file << "{\n  \"width\":" << m_width << ",\n  \"height\":" << m_height << ",\n  \"mipLevels\":" << m_mipLevels << ",\n  \"rects\":[";
+		for (size_t i = 0; i < m_rects.size(); i++)
+		{
+			const AtlasRect& rect{ m_rects[i] };
+			std::string name;
+			for (char c : rect.name)
+			{
+				if (c == '"' || c == '\\')
+					name += '\\';
+				name += c;
+			}
+			file << (i ? ",\n" : "\n") << "    {\"name\":\"" << name << "\",\"x\":" << rect.x << ",\"y\":" << rect.y
+				<< ",\"width\":" << rect.width << ",\"height\":" << rect.height
+				<< ",\"uvOffset\":[" << rect.uvOffset.x << "," << rect.uvOffset.y << "],\"uvScale\":[" << rect.uvScale.x << "," << rect.uvScale.y << "]}";
+		}
+		file << "\n  ]\n}\n";
+		return (bool)file;
+	}
+
+	// Move the UVs of a mesh textured with the image onto its rect, false if any is outside 0 to 1
+	bool RemapUVs(Mesh& mesh, const AtlasRect& rect)
+	{
+		// A little slack for exporters that write 1.0001
+		static constexpr float KSlack{ 1e-3f };
+		for (const glm::vec2& uv : mesh.uvCoords)
+		{
+			if (uv.x < -KSlack || uv.y < -KSlack || uv.x > 1 + KSlack || uv.y > 1 + KSlack)
+			{
+				std::cout << "ERROR: mesh " << mesh.name << " wraps its texture so cannot use atlas rect " << rect.name << std::endl;
+				return false;
+			}
+		}
+
+		for (glm::vec2& uv : mesh.uvCoords)
+			uv = rect.uvOffset + glm::clamp(uv, 0.0f, 1.0f) * rect.uvScale;
+		return true;
+	}
+}
@@ -0,0 +1,73 @@
+#pragma once
+// Packing of many small RGBA8 images into one atlas image with the stb rectangle packer that ships with
+// ImGui, so meshes with small textures can share one texture rather than each having its own. Every image
+// sits on a multiple of 2^mipLevels texels inside a gutter of its own edge texels that wide, so the first
+// mipLevels levels of the atlas never mix neighbouring images; smaller levels than that do. Meshes are
+// moved onto their image's rect with RemapUVs, and the rect table can be written out for other tools.
+
+#include "ExternalLibraryHeaders.h"
+#include "Mesh.h"
+
+namespace Helpers
+{
+	// Where an image ended up, a UV of the image maps to uvOffset + uv * uvScale in the atlas
+	struct AtlasRect
+	{
+		std::string name;
+		GLsizei x{ 0 };			// texels of the image itself, the gutter is around it
+		GLsizei y{ 0 };
+		GLsizei width{ 0 };
+		GLsizei height{ 0 };
+		glm::vec2 uvOffset{ 0 };
+		glm::vec2 uvScale{ 1 };
+	};
+
+	class TextureAtlas
+	{
+	private:
+		struct Image
+		{
+			std::string name;
+			GLsizei width{ 0 };
+			GLsizei height{ 0 };
+			std::vector<GLubyte> pixels;
+		};
+
+		std::vector<Image> m_images;
+		std::vector<AtlasRect> m_rects;
+		std::vector<GLubyte> m_pixels;
+		GLsizei m_width{ 0 };
+		GLsizei m_height{ 0 };
+		int m_mipLevels{ 0 };
+
+		// Copy an image into its rect and fill the gutter around it from its edges
+		void Blit(const Image& image, const AtlasRect& rect, GLsizei gutter);
+	public:
+		// Queue an RGBA8 image for the next Build, the pixels are copied. Names must be unique.
+		void Add(const std::string& name, GLsizei width, GLsizei height, const void* rgba);
+
+		// Pack everything added into the smallest power of two atlas no wider than maxSize, false if it does not fit
+		bool Build(GLsizei maxSize = 4096, int mipLevels = 4);
+
+		// nullptr if no image of that name was packed
+		const AtlasRect* Find(const std::string& name) const;
+
+		const std::vector<AtlasRect>& GetRects() const { return m_rects; }
+		GLsizei Width() const { return m_width; }
+		GLsizei Height() const { return m_height; }
+		int MipLevels() const { return m_mipLevels; }
+
+		// RGBA8, Width() by Height()
+		const GLubyte* GetData() const { return m_pixels.data(); }
+
+		// Fraction of the atlas covered by images rather than gutters and empty space
+		float Occupancy() const;
+
+		// The atlas size and every rect as JSON, false on error
+		bool WriteRectTable(const std::string& filename) const;
+	};
+
+	// Move the UVs of a mesh textured with the image onto its rect, false if any is outside 0 to 1 as a wrapping
+	// texture cannot be atlased
+	bool RemapUVs(Mesh& mesh, const AtlasRect& rect);
+}
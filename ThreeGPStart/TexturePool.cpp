@@ -0,0 +1,205 @@
+#include "TexturePool.h"
+
+#include <algorithm>
+
+namespace Helpers
+{
+	// The arrays are made through resources, which must outlive this
+	void TexturePool::Initialise(GpuResourceRegistry& resources)
+	{
+		m_resources = &resources;
+	}
+
+	// Queue an RGBA8 texture for the next Build, the pixels are copied
+	void TexturePool::Add(const std::string& asset, GLsizei width, GLsizei height, const void* rgba, GLint wrap, std::function<void(const TextureLayer&)> onCreated)
+	{
+		if (width <= 0 || height <= 0 || !rgba)
+		{
+			std::cout << "ERROR: texture " << asset << " added to the pool without an image" << std::endl;
+			return;
+		}
+
+		PendingGroup& group{ m_pending[std::make_tuple(width, height, wrap)] };
+		const GLubyte* pixels{ static_cast<const GLubyte*>(rgba) };
+		group.pixels.insert(group.pixels.end(), pixels, pixels + (size_t)width * (size_t)height * 4);
+		group.assets.push_back(asset);
+		group.onCreated.push_back(std::move(onCreated));
+	}
+
+	// Each layer of a level halved with a 2x2 box filter, an odd last row or column is averaged with itself
+	std::vector<GLubyte> HalveLevel(const std::vector<GLubyte>& pixels, GLsizei width, GLsizei height, size_t layers)
+	{
+		const GLsizei halfWidth{ std::max(width / 2, 1) };
+		const GLsizei halfHeight{ std::max(height / 2, 1) };
+		std::vector<GLubyte> half((size_t)halfWidth * (size_t)halfHeight * layers * 4);
+		for (size_t layer = 0; layer < layers; layer++)
+		{
+			const GLubyte* source{ &pixels[layer * (size_t)width * (size_t)height * 4] };
+			GLubyte* destination{ &half[layer * (size_t)halfWidth * (size_t)halfHeight * 4] };
+			for (GLsizei y = 0; y < halfHeight; y++)
+			{
+				const GLsizei y0{ std::min(y * 2, height - 1) }, y1{ std::min(y * 2 + 1, height - 1) };
+				for (GLsizei x = 0; x < halfWidth; x++)
+				{
+					const GLsizei x0{ std::min(x * 2, width - 1) }, x1{ std::min(x * 2 + 1, width - 1) };
+					for (int c = 0; c < 4; c++)
+					{
+						const int sum{ source[((size_t)y0 * width + x0) * 4 + c] + source[((size_t)y0 * width + x1) * 4 + c] +
+							source[((size_t)y1 * width + x0) * 4 + c] + source[((size_t)y1 * width + x1) * 4 + c] };
+						destination[((size_t)y * halfWidth + x) * 4 + c] = (GLubyte)((sum + 2) / 4);
+					}
+				}
+			}
+		}
+		return half;
+	}
+
+	// One array per group, or per KMaxLayers of a group, named by its size as it holds many assets
+	bool TexturePool::Build()
+	{
+		bool succeeded{ true };
+		for (auto& pending : m_pending)
+		{
+			GLsizei width, height;
+			GLint wrap;
+			std::tie(width, height, wrap) = pending.first;
+			PendingGroup& group{ pending.second };
+			const size_t layerBytes{ (size_t)width * (size_t)height * 4 };
+
+			for (size_t first = 0; first < group.assets.size(); first += KMaxLayers)
+			{
+				const size_t layers{ std::min(KMaxLayers, group.assets.size() - first) };
+				const std::string asset{ "Texture array " + std::to_string(width) + "x" + std::to_string(height) +
+					(wrap == GL_REPEAT ? " repeat" : " clamp") };
+
+				Array array;
+				array.texture = m_resources->CreateTextureArray(asset, width, height, (GLsizei)layers, group.pixels.data() + first * layerBytes, wrap);
+				if (!array.texture)
+				{
+					std::cout << "ERROR: could not make a " << asset << " of " << layers << " layers" << std::endl;
+					succeeded = false;
+					continue;
+				}
+				array.asset = asset;
+				array.width = width;
+				array.height = height;
+				array.wrap = wrap;
+				array.layers.assign(group.assets.begin() + first, group.assets.begin() + first + layers);
+				m_uploadBytes += layers * layerBytes;
+
+				// The mip chain is kept for the residency to make the array again from any level
+				array.levels.emplace_back(group.pixels.begin() + first * layerBytes, group.pixels.begin() + (first + layers) * layerBytes);
+				for (GLsizei w = width, h = height; w > 1 || h > 1; w = std::max(w / 2, 1), h = std::max(h / 2, 1))
+					array.levels.push_back(HalveLevel(array.levels.back(), w, h, layers));
+
+				const GLuint id{ (GLuint)m_arrays.size() + 1 };
+				for (size_t i = 0; i < layers; i++)
+				{
+					if (group.onCreated[first + i])
+						group.onCreated[first + i](TextureLayer{ id, (GLuint)i });
+				}
+				m_arrays.push_back(std::move(array));
+			}
+		}
+		m_pending.clear();
+		return succeeded;
+	}
+
+	const TexturePool::Array* TexturePool::Find(GLuint array) const
+	{
+		return array >= 1 && array <= m_arrays.size() ? &m_arrays[array - 1] : nullptr;
+	}
+
+	// 0 if there is no such array
+	GLuint TexturePool::GetTexture(GLuint array) const
+	{
+		const Array* found{ Find(array) };
+		return found ? found->texture.Get() : 0;
+	}
+
+	GLsizei TexturePool::GetWidth(GLuint array) const
+	{
+		const Array* found{ Find(array) };
+		return found ? found->width : 0;
+	}
+
+	GLsizei TexturePool::GetHeight(GLuint array) const
+	{
+		const Array* found{ Find(array) };
+		return found ? found->height : 0;
+	}
+
+	GLuint TexturePool::NumLevels(GLuint array) const
+	{
+		const Array* found{ Find(array) };
+		return found ? (GLuint)found->levels.size() : 0;
+	}
+
+	GLuint TexturePool::GetResidentLevel(GLuint array) const
+	{
+		const Array* found{ Find(array) };
+		return found ? found->residentLevel : 0;
+	}
+
+	// GPU memory of an array with level the finest resident
+	size_t TexturePool::LevelBytes(GLuint array, GLuint level) const
+	{
+		const Array* found{ Find(array) };
+		if (!found)
+			return 0;
+		return TextureBytes(std::max(found->width >> level, 1), std::max(found->height >> level, 1), GL_RGBA8, true) * found->layers.size();
+	}
+
+	// The new array gets the full chain below level, the old one is deleted
+	bool TexturePool::SetResidentLevel(GLuint array, GLuint level)
+	{
+		if (!Find(array) || level >= NumLevels(array))
+			return false;
+
+		Array& found{ m_arrays[array - 1] };
+		if (found.residentLevel == level && found.texture)
+			return true;
+
+		GpuTextureArray texture{ m_resources->CreateTextureArray(found.asset, std::max(found.width >> level, 1), std::max(found.height >> level, 1),
+			(GLsizei)found.layers.size(), found.levels[level].data(), found.wrap) };
+		if (!texture)
+		{
+			std::cout << "ERROR: could not make " << found.asset << " again from level " << level << std::endl;
+			return false;
+		}
+		found.texture = std::move(texture);
+		found.residentLevel = level;
+		m_uploadBytes += found.levels[level].size();
+		return true;
+	}
+
+	size_t TexturePool::NumPending() const
+	{
+		size_t textures{ 0 };
+		for (const auto& pending : m_pending)
+			textures += pending.second.assets.size();
+		return textures;
+	}
+
+	// Each array's size, memory and the assets in its layers
+	void TexturePool::DefineGUI()
+	{
+		size_t layers{ 0 };
+		for (const Array& array : m_arrays)
+			layers += array.layers.size();
+		ImGui::Text("%zu textures in %zu arrays, one bind per array a pass", layers, m_arrays.size());
+
+		for (size_t i = 0; i < m_arrays.size(); i++)
+		{
+			const Array& array{ m_arrays[i] };
+			const size_t bytes{ LevelBytes((GLuint)i + 1, array.residentLevel) };
+			if (ImGui::TreeNode(&array, "%dx%d %s, %zu layers, %.1f KB from level %u", array.width, array.height, array.wrap == GL_REPEAT ? "repeat" : "clamp",
+				array.layers.size(), bytes / 1024.0f, array.residentLevel))
+			{
+				for (size_t layer = 0; layer < array.layers.size(); layer++)
+					ImGui::Text("%3zu  %s", layer, array.layers[layer].c_str());
+				ImGui::TreePop();
+			}
+		}
+	}
+}
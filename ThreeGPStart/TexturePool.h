@@ -0,0 +1,106 @@
+#pragma once
+// Textures grouped by size and wrap mode into 2D array textures, one texture to a layer. A material refers
+// to its texture as an (array, layer) pair, so everything sharing an array is drawn with it bound once and
+// the layer passed with the rest of the per draw data, rather than binding a texture before every draw.
+// An array's layer count is fixed when it is made, so textures are queued with Add and the arrays made
+// together by Build. The mip chain of every array is kept in memory too, so an array can be made again
+// from a coarser or finer level when the texture residency decides to drop or stream in its top mips.
+// GL thread only.
+
+#include "ExternalLibraryHeaders.h"
+#include "GpuResources.h"
+
+#include <functional>
+#include <map>
+#include <tuple>
+
+namespace Helpers
+{
+	// Where a texture of the pool is, sampled with texture(sampler2DArray, vec3(uv, layer)).
+	// Arrays are numbered from 1 and stay numbered as they are made again, TexturePool::GetTexture gives the GL texture.
+	struct TextureLayer
+	{
+		GLuint array{ 0 };
+		GLuint layer{ 0 };
+	};
+
+	// The next mip of RGBA8 pixels holding layers images of width x height one after another, with a 2x2 box filter
+	std::vector<GLubyte> HalveLevel(const std::vector<GLubyte>& pixels, GLsizei width, GLsizei height, size_t layers);
+
+	class TexturePool
+	{
+	private:
+		// Every GL 3 driver supports arrays this deep, larger groups are split
+		static constexpr size_t KMaxLayers{ 256 };
+
+		// Textures of one size and wrap mode waiting for Build, their pixels one after another
+		struct PendingGroup
+		{
+			std::vector<GLubyte> pixels;
+			std::vector<std::string> assets;
+			std::vector<std::function<void(const TextureLayer&)>> onCreated;
+		};
+
+		// An array made by Build and the asset in each layer. Level n of levels holds every layer's pixels of
+		// mip n one after another, the GPU has residentLevel and the levels below it.
+		struct Array
+		{
+			GpuTextureArray texture;
+			std::string asset;
+			GLsizei width{ 0 };
+			GLsizei height{ 0 };
+			GLint wrap{ 0 };
+			std::vector<std::string> layers;
+			std::vector<std::vector<GLubyte>> levels;
+			GLuint residentLevel{ 0 };
+		};
+
+		GpuResourceRegistry* m_resources{ nullptr };
+
+		// Keyed by width, height and wrap
+		std::map<std::tuple<GLsizei, GLsizei, GLint>, PendingGroup> m_pending;
+		std::vector<Array> m_arrays;
+		size_t m_uploadBytes{ 0 };
+
+		const Array* Find(GLuint array) const;
+	public:
+		TexturePool() = default;
+		TexturePool(const TexturePool&) = delete;
+		TexturePool& operator=(const TexturePool&) = delete;
+
+		// The arrays are made through resources, which must outlive this
+		void Initialise(GpuResourceRegistry& resources);
+
+		// Queue an RGBA8 texture for the next Build, the pixels are copied. onCreated is called by Build with its layer.
+		void Add(const std::string& asset, GLsizei width, GLsizei height, const void* rgba, GLint wrap, std::function<void(const TextureLayer&)> onCreated);
+
+		// Make the arrays of everything queued since the last Build and tell each texture where it is, false on error
+		bool Build();
+
+		size_t NumArrays() const { return m_arrays.size(); }
+		size_t NumPending() const;
+
+		// The GL texture of an array, 0 if there is no such array
+		GLuint GetTexture(GLuint array) const;
+
+		// Size of level 0 of an array
+		GLsizei GetWidth(GLuint array) const;
+		GLsizei GetHeight(GLuint array) const;
+
+		// Levels of the full mip chain, and the finest of them on the GPU
+		GLuint NumLevels(GLuint array) const;
+		GLuint GetResidentLevel(GLuint array) const;
+
+		// GPU memory of an array with level the finest resident
+		size_t LevelBytes(GLuint array, GLuint level) const;
+
+		// Make an array again with level the finest on the GPU, which changes its GL texture. False on error.
+		bool SetResidentLevel(GLuint array, GLuint level);
+
+		// Pixels uploaded by Build and SetResidentLevel so far
+		size_t UploadBytes() const { return m_uploadBytes; }
+
+		// Each array's size, memory and the assets in its layers
+		void DefineGUI();
+	};
+}
@@ -0,0 +1,179 @@
+#include "TextureResidency.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+
+namespace Helpers
+{
+	// Each level halves the texels, so the level where they are no more than the pixels
+	GLuint MipLevelForScreenSize(float texels, float pixels)
+	{
+		if (pixels <= 0.0f)
+			return 31;
+		if (texels <= pixels)
+			return 0;
+		return (GLuint)std::floor(std::log2(texels / pixels));
+	}
+
+	// The pool must outlive this
+	void TextureResidency::Initialise(TexturePool& pool)
+	{
+		m_pool = &pool;
+	}
+
+	// Forget last frame's requests, arrays built since are picked up here
+	void TextureResidency::BeginFrame()
+	{
+		m_frame++;
+		m_arrays.resize(m_pool->NumArrays());
+		for (ArrayState& state : m_arrays)
+			state.requested = false;
+	}
+
+	// The texture is drawn this frame and needs level or finer
+	void TextureResidency::Request(const TextureLayer& texture, GLuint level)
+	{
+		if (texture.array < 1 || texture.array > m_arrays.size())
+			return;
+
+		ArrayState& state{ m_arrays[texture.array - 1] };
+		state.requestedLevel = state.requested ? std::min(state.requestedLevel, level) : level;
+		state.requested = true;
+		state.lastUsedFrame = m_frame;
+	}
+
+	// Arrays drawn this frame get the level they asked for, or keep a finer one they already have, and the rest
+	// keep what they have. Over budget, levels are dropped one at a time from arrays not drawn this frame, least
+	// recently used first, then from drawn arrays with more detail than they need and last from the largest.
+	// Drops are applied straight away as they free memory, finer levels only up to the upload limit.
+	void TextureResidency::Update()
+	{
+		TextureResidencyStats stats;
+		std::vector<GLuint> target(m_arrays.size());
+		for (size_t i = 0; i < m_arrays.size(); i++)
+		{
+			const GLuint array{ (GLuint)i + 1 };
+			const ArrayState& state{ m_arrays[i] };
+			const GLuint resident{ m_pool->GetResidentLevel(array) };
+			const GLuint requested{ std::min(state.requestedLevel, m_pool->NumLevels(array) - 1) };
+			if (!m_enabled)
+				target[i] = 0;
+			else
+				target[i] = state.requested ? std::min(requested, resident) : resident;
+
+			if (state.requested)
+				stats.requestedBytes += m_pool->LevelBytes(array, requested);
+		}
+
+		size_t total{ 0 };
+		for (size_t i = 0; i < m_arrays.size(); i++)
+			total += m_pool->LevelBytes((GLuint)i + 1, target[i]);
+
+		while (m_enabled && total > m_budgetBytes)
+		{
+			size_t victim{ m_arrays.size() };
+			std::pair<int, size_t> victimOrder{ 3, 0 };
+			for (size_t i = 0; i < m_arrays.size(); i++)
+			{
+				const GLuint array{ (GLuint)i + 1 };
+				if (target[i] + 1 >= m_pool->NumLevels(array))
+					continue;
+
+				const ArrayState& state{ m_arrays[i] };
+				const size_t bytes{ m_pool->LevelBytes(array, target[i]) };
+				std::pair<int, size_t> order;
+				if (!state.requested)
+					order = { 0, state.lastUsedFrame };
+				else if (target[i] < state.requestedLevel)
+					order = { 1, SIZE_MAX - bytes };
+				else
+					order = { 2, SIZE_MAX - bytes };
+
+				if (order < victimOrder)
+				{
+					victim = i;
+					victimOrder = order;
+				}
+			}
+			if (victim == m_arrays.size())
+				break;
+
+			const GLuint array{ (GLuint)victim + 1 };
+			total -= m_pool->LevelBytes(array, target[victim]);
+			target[victim]++;
+			total += m_pool->LevelBytes(array, target[victim]);
+		}
+
+		// Evict first, then stream in those missing the most levels first
+		std::vector<size_t> streamIn;
+		for (size_t i = 0; i < m_arrays.size(); i++)
+		{
+			const GLuint array{ (GLuint)i + 1 };
+			const GLuint resident{ m_pool->GetResidentLevel(array) };
+			if (target[i] > resident)
+			{
+				if (m_pool->SetResidentLevel(array, target[i]))
+					stats.arraysEvicted++;
+			}
+			else if (target[i] < resident)
+			{
+				streamIn.push_back(i);
+			}
+		}
+		std::stable_sort(streamIn.begin(), streamIn.end(), [&](size_t a, size_t b)
+		{
+			return m_pool->GetResidentLevel((GLuint)a + 1) - target[a] > m_pool->GetResidentLevel((GLuint)b + 1) - target[b];
+		});
+		for (size_t i : streamIn)
+		{
+			const GLuint array{ (GLuint)i + 1 };
+			const size_t bytes{ m_pool->LevelBytes(array, target[i]) };
+			if (stats.streamedInBytes && stats.streamedInBytes + bytes > m_uploadBytesPerFrame)
+			{
+				stats.arraysWaiting++;
+				continue;
+			}
+			if (m_pool->SetResidentLevel(array, target[i]))
+			{
+				stats.streamedInBytes += bytes;
+				stats.arraysStreamedIn++;
+			}
+		}
+
+		for (size_t i = 0; i < m_arrays.size(); i++)
+			stats.residentBytes += m_pool->LevelBytes((GLuint)i + 1, m_pool->GetResidentLevel((GLuint)i + 1));
+		m_lastStats = stats;
+	}
+
+	// Budget, resident against requested memory and each array's levels
+	void TextureResidency::DefineGUI()
+	{
+		ImGui::Checkbox("Stream mips within the budget", &m_enabled);
+
+		int budgetMB{ (int)(m_budgetBytes / (1024 * 1024)) };
+		if (ImGui::SliderInt("Budget MB", &budgetMB, 1, 1024))
+			m_budgetBytes = (size_t)budgetMB * 1024 * 1024;
+		int uploadMB{ (int)(m_uploadBytesPerFrame / (1024 * 1024)) };
+		if (ImGui::SliderInt("Upload MB a frame", &uploadMB, 1, 64))
+			m_uploadBytesPerFrame = (size_t)uploadMB * 1024 * 1024;
+
+		const TextureResidencyStats& stats{ m_lastStats };
+		ImGui::ProgressBar(m_budgetBytes ? std::min(stats.residentBytes / (float)m_budgetBytes, 1.0f) : 0.0f, ImVec2(-1, 0),
+			(std::to_string(stats.residentBytes / 1024) + " KB of " + std::to_string(m_budgetBytes / 1024) + " KB").c_str());
+		ImGui::Text("Resident %.2f MB, requested %.2f MB", stats.residentBytes / (1024.0f * 1024.0f), stats.requestedBytes / (1024.0f * 1024.0f));
+		ImGui::Text("Last frame: %zu streamed in (%.1f KB), %zu evicted, %zu waiting", stats.arraysStreamedIn, stats.streamedInBytes / 1024.0f,
+			stats.arraysEvicted, stats.arraysWaiting);
+
+		ImGui::Separator();
+		for (size_t i = 0; i < m_arrays.size(); i++)
+		{
+			const GLuint array{ (GLuint)i + 1 };
+			const ArrayState& state{ m_arrays[i] };
+			const GLuint resident{ m_pool->GetResidentLevel(array) };
+			ImGui::Text("%2u  %4dx%-4d  level %u of %u, %s %u, %8.1f KB, used %zu frames ago", array, m_pool->GetWidth(array), m_pool->GetHeight(array),
+				resident, m_pool->NumLevels(array), state.requested ? "needs" : "last needed", state.requestedLevel,
+				m_pool->LevelBytes(array, resident) / 1024.0f, m_frame - state.lastUsedFrame);
+		}
+	}
+}
@@ -0,0 +1,68 @@
+#pragma once
+// Keeps the texture pool's arrays within a GPU memory budget. Each frame the renderer requests the finest mip
+// level every texture needs from its size on screen. Arrays that need more detail than they have are made again
+// from a finer level, a few a frame, and while the resident total is over budget the top level of the least
+// recently used array is dropped. An array is one GL texture so its layers share one resident level, the
+// finest any of them asked for. Main thread only, as arrays are made again before the frame is recorded.
+
+#include "ExternalLibraryHeaders.h"
+#include "TexturePool.h"
+
+namespace Helpers
+{
+	// Memory and streaming of the last Update
+	struct TextureResidencyStats
+	{
+		size_t residentBytes{ 0 };
+		size_t requestedBytes{ 0 };		// if every array had the level asked for
+		size_t streamedInBytes{ 0 };
+		size_t arraysStreamedIn{ 0 };
+		size_t arraysEvicted{ 0 };
+		size_t arraysWaiting{ 0 };		// need a finer level than the upload limit allowed this frame
+	};
+
+	// Finest mip level worth having for texels across a surface shown pixels across, 0 when magnified
+	GLuint MipLevelForScreenSize(float texels, float pixels);
+
+	class TextureResidency
+	{
+	private:
+		// Per array of the pool, indexed by array - 1
+		struct ArrayState
+		{
+			GLuint requestedLevel{ 0 };
+			size_t lastUsedFrame{ 0 };
+			bool requested{ false };	// this frame
+		};
+
+		TexturePool* m_pool{ nullptr };
+		std::vector<ArrayState> m_arrays;
+		size_t m_frame{ 0 };
+
+		bool m_enabled{ true };
+		size_t m_budgetBytes{ 64 * 1024 * 1024 };
+		size_t m_uploadBytesPerFrame{ 8 * 1024 * 1024 };
+
+		TextureResidencyStats m_lastStats;
+	public:
+		// The pool must outlive this
+		void Initialise(TexturePool& pool);
+
+		// Forget last frame's requests
+		void BeginFrame();
+
+		// The texture is drawn this frame and needs level or finer
+		void Request(const TextureLayer& texture, GLuint level);
+
+		// Stream in and evict to meet this frame's requests within the budget
+		void Update();
+
+		void SetBudget(size_t bytes) { m_budgetBytes = bytes; }
+		size_t GetBudget() const { return m_budgetBytes; }
+
+		const TextureResidencyStats& GetLastStats() const { return m_lastStats; }
+
+		// Budget, resident against requested memory and each array's levels
+		void DefineGUI();
+	};
+}
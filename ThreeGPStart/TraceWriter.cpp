@@ -0,0 +1,136 @@
+#include "TraceWriter.h"
+
+#include <iostream>
+
+namespace Helpers
+{
+	TraceWriter::~TraceWriter()
+	{
+		Stop({});
+	}
+
+	// Opens the file and starts the writing thread, false if the file could not be made
+	bool TraceWriter::Start(const std::string& filename)
+	{
+		if (IsOpen())
+			return false;
+
+		m_file.open(filename, std::ios::out | std::ios::trunc);
+		if (!m_file)
+		{
+			std::cout << "ERROR: could not create trace file " << filename << std::endl;
+			return false;
+		}
+
+		m_file << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+		m_stopping = false;
+		m_firstEvent = true;
+		m_eventsWritten = 0;
+		m_thread = std::thread(&TraceWriter::WriteLoop, this);
+		return true;
+	}
+
+	// Writes everything queued, names the tracks, shown in the order listed, and closes the file
+	void TraceWriter::Stop(const std::vector<std::pair<int, std::string>>& trackNames)
+	{
+		if (!IsOpen())
+			return;
+
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_stopping = true;
+		}
+		m_wake.notify_one();
+		m_thread.join();
+
+		// Track names are metadata events, which may be anywhere in the file
+		std::string text;
+		int sortIndex{ 0 };
+		for (const auto& track : trackNames)
+		{
+			std::string name;
+			for (char c : track.second)
+			{
+				if (c == '"' || c == '\\')
+					name += '\\';
+				name += c;
+			}
+			Separator(text);
+			text += "{\"ph\":\"M\",\"pid\":1,\"tid\":" + std::to_string(track.first) + ",\"name\":\"thread_name\",\"args\":{\"name\":\"" + name + "\"}}";
+			Separator(text);
+			text += "{\"ph\":\"M\",\"pid\":1,\"tid\":" + std::to_string(track.first) + ",\"name\":\"thread_sort_index\",\"args\":{\"sort_index\":" + std::to_string(sortIndex++) + "}}";
+		}
+		m_file << text << "\n]}\n";
+		m_file.close();
+	}
+
+	// Queue events to be written, any thread
+	void TraceWriter::Submit(TraceBatch&& batch)
+	{
+		if (!IsOpen())
+			return;
+
+		size_t queued{ 0 };
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_queue.push_back(std::move(batch));
+			queued = m_queue.size();
+		}
+		if (queued >= KBatchesPerWake)
+			m_wake.notify_one();
+	}
+
+	void TraceWriter::Separator(std::string& text)
+	{
+		if (!m_firstEvent)
+			text += ",\n";
+		m_firstEvent = false;
+		m_eventsWritten++;
+	}
+
+	// Spans are complete events and counters counter events, times in microseconds
+	void TraceWriter::Write(const TraceBatch& batch, std::string& text)
+	{
+		char event[256];
+		for (const TraceSpan& span : batch.spans)
+		{
+			Separator(text);
+			snprintf(event, sizeof(event), "{\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"name\":\"%s\",\"ts\":%.3f,\"dur\":%.3f}",
+				span.track, span.name, span.startSeconds * 1e6, span.seconds * 1e6);
+			text += event;
+		}
+		for (const TraceCounter& counter : batch.counters)
+		{
+			Separator(text);
+			snprintf(event, sizeof(event), "{\"ph\":\"C\",\"pid\":1,\"name\":\"%s\",\"ts\":%.3f,\"args\":{\"value\":%g}}",
+				counter.name, counter.seconds * 1e6, counter.value);
+			text += event;
+		}
+	}
+
+	// Takes everything queued at once so the lock is only held to swap the queue
+	void TraceWriter::WriteLoop()
+	{
+		std::deque<TraceBatch> batches;
+		std::string text;
+		for (;;)
+		{
+			bool stopping{ false };
+			{
+				std::unique_lock<std::mutex> lock(m_mutex);
+				m_wake.wait(lock, [this]() { return m_stopping || m_queue.size() >= KBatchesPerWake; });
+				batches.swap(m_queue);
+				stopping = m_stopping;
+			}
+
+			text.clear();
+			for (const TraceBatch& batch : batches)
+				Write(batch, text);
+			batches.clear();
+			m_file << text;
+
+			if (stopping)
+				return;
+		}
+	}
+}
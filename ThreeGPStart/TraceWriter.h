@@ -0,0 +1,79 @@
+#pragma once
+// Writes timelines to a file in the Chrome trace event JSON format, which chrome://tracing and the Perfetto
+// UI both open. Events are handed over a frame at a time and formatted and written on a thread of the
+// writer's own, so the frame only pays for moving them into the queue.
+
+#include <condition_variable>
+#include <deque>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace Helpers
+{
+	// A timed section on one track, times are seconds on the GLFW clock
+	struct TraceSpan
+	{
+		const char* name{ nullptr };	// must outlive the writer, e.g. a string literal
+		int track{ 0 };
+		double startSeconds{ 0 };
+		double seconds{ 0 };
+	};
+
+	// A value plotted over time
+	struct TraceCounter
+	{
+		const char* name{ nullptr };
+		double seconds{ 0 };
+		double value{ 0 };
+	};
+
+	// Events handed to the writer together
+	struct TraceBatch
+	{
+		std::vector<TraceSpan> spans;
+		std::vector<TraceCounter> counters;
+	};
+
+	class TraceWriter
+	{
+	private:
+		// The writing thread is woken once this many batches are queued, rather than every frame
+		static constexpr size_t KBatchesPerWake{ 30 };
+
+		std::ofstream m_file;
+		std::thread m_thread;
+		std::mutex m_mutex;
+		std::condition_variable m_wake;
+		std::deque<TraceBatch> m_queue;
+		bool m_stopping{ false };
+		bool m_firstEvent{ true };
+		size_t m_eventsWritten{ 0 };	// only touched by the writing thread until it is joined
+
+		void WriteLoop();
+		void Write(const TraceBatch& batch, std::string& text);
+		void Separator(std::string& text);
+	public:
+		TraceWriter() = default;
+		TraceWriter(const TraceWriter&) = delete;
+		TraceWriter& operator=(const TraceWriter&) = delete;
+		~TraceWriter();
+
+		// Opens the file and starts the writing thread, false if the file could not be made
+		bool Start(const std::string& filename);
+
+		// Writes everything queued, names the tracks, shown in the order listed, and closes the file
+		void Stop(const std::vector<std::pair<int, std::string>>& trackNames);
+
+		bool IsOpen() const { return m_thread.joinable(); }
+
+		// Queue events to be written, any thread
+		void Submit(TraceBatch&& batch);
+
+		// Valid once stopped
+		size_t EventsWritten() const { return m_eventsWritten; }
+	};
+}
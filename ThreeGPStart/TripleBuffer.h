@@ -0,0 +1,47 @@
+#pragma once
+// Lock free triple buffer for handing whole values from one writer thread to one reader thread.
+// The writer fills the back buffer and publishes it, the reader picks up the newest published
+// buffer whenever it likes. Neither side ever waits for the other and the reader never sees a
+// half written value, though it may skip values if the writer is faster.
+
+#include <atomic>
+
+namespace Helpers
+{
+	template<typename T>
+	class TripleBuffer
+	{
+	private:
+		static constexpr int KIndexMask{ 3 };
+		static constexpr int KNewData{ 4 };
+
+		T m_buffers[3];
+
+		// Index of the middle buffer, with KNewData set when the reader has not taken it yet
+		std::atomic<int> m_middle{ 1 };
+
+		int m_back{ 0 };	// writer only
+		int m_front{ 2 };	// reader only
+	public:
+		// Writer: the buffer to fill, it may hold an old value so every field must be written
+		T& Back() { return m_buffers[m_back]; }
+
+		// Writer: make the back buffer the newest value and take the old middle as the new back
+		void Publish()
+		{
+			m_back = m_middle.exchange(m_back | KNewData, std::memory_order_acq_rel) & KIndexMask;
+		}
+
+		// Reader: swap in the newest value if there is one, returns true if Front changed
+		bool Update()
+		{
+			if (!(m_middle.load(std::memory_order_relaxed) & KNewData))
+				return false;
+			m_front = m_middle.exchange(m_front, std::memory_order_acq_rel) & KIndexMask;
+			return true;
+		}
+
+		// Reader: the newest value taken by Update
+		const T& Front() const { return m_buffers[m_front]; }
+	};
+}
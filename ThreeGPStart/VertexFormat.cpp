@@ -0,0 +1,63 @@
+#include "VertexFormat.h"
+
+namespace Helpers
+{
+	// Work out the dequantisation ranges from the extents of the mesh data
+	MeshQuantisation MeshQuantisation::FromMesh(const Mesh& mesh)
+	{
+		MeshQuantisation q;
+
+		if (!mesh.vertices.empty())
+		{
+			glm::vec3 minExtents, maxExtents;
+			mesh.GetLocalExtents(minExtents, maxExtents);
+
+			// A flat mesh still needs a non zero scale to avoid a divide by zero
+			q.positionOffset = minExtents;
+			q.positionScale = glm::max(maxExtents - minExtents, glm::vec3(1e-6f));
+		}
+
+		if (!mesh.uvCoords.empty())
+		{
+			glm::vec2 minUV{ mesh.uvCoords[0] };
+			glm::vec2 maxUV{ mesh.uvCoords[0] };
+			for (const glm::vec2& uv : mesh.uvCoords)
+			{
+				minUV = glm::min(minUV, uv);
+				maxUV = glm::max(maxUV, uv);
+			}
+
+			q.uvOffset = minUV;
+			q.uvScale = glm::max(maxUV - minUV, glm::vec2(1e-6f));
+		}
+
+		return q;
+	}
+
+	// Project onto the octahedron then fold the lower half over the diagonals
+	glm::vec2 OctEncode(const glm::vec3& n)
+	{
+		const float l1{ std::abs(n.x) + std::abs(n.y) + std::abs(n.z) };
+		if (l1 <= 0.0f)
+			return glm::vec2(0);
+
+		glm::vec2 e{ n.x / l1, n.y / l1 };
+		if (n.z < 0.0f)
+		{
+			e = glm::vec2(
+				(1.0f - std::abs(e.y)) * (e.x >= 0.0f ? 1.0f : -1.0f),
+				(1.0f - std::abs(e.x)) * (e.y >= 0.0f ? 1.0f : -1.0f));
+		}
+		return e;
+	}
+
+	// Inverse of OctEncode, must match oct_decode in vertex_shader.vert
+	glm::vec3 OctDecode(const glm::vec2& e)
+	{
+		glm::vec3 n{ e.x, e.y, 1.0f - std::abs(e.x) - std::abs(e.y) };
+		const float t{ glm::clamp(-n.z, 0.0f, 1.0f) };
+		n.x += n.x >= 0.0f ? -t : t;
+		n.y += n.y >= 0.0f ? -t : t;
+		return glm::normalize(n);
+	}
+}
@@ -0,0 +1,330 @@
+#pragma once
+// Compile time description of interleaved (and optionally quantised) vertex layouts
+
+#include "ExternalLibraryHeaders.h"
+#include "Mesh.h"
+#include "RenderBackend.h"
+
+#include <glm/gtc/packing.hpp>
+#include <algorithm>
+#include <tuple>
+#include <utility>
+
+namespace Helpers
+{
+	// What a vertex attribute holds
+	enum class VertexSemantic
+	{
+		Position,
+		Normal,
+		Colour,
+		TexCoord
+	};
+
+	// Fixed attribute locations shared by all the shaders, colour takes the place of the normal
+	constexpr GLuint SemanticLocation(VertexSemantic semantic)
+	{
+		switch (semantic)
+		{
+		case VertexSemantic::Position: return 0;
+		case VertexSemantic::Normal: return 1;
+		case VertexSemantic::Colour: return 1;
+		default: return 2;
+		}
+	}
+
+	// Per mesh values needed to turn quantised data back into the original ranges
+	// The shader recovers a position as offset + scale * attribute (and the same for uvs)
+	struct MeshQuantisation
+	{
+		glm::vec3 positionOffset{ 0 };
+		glm::vec3 positionScale{ 1 };
+		glm::vec2 uvOffset{ 0 };
+		glm::vec2 uvScale{ 1 };
+
+		// Work out the dequantisation ranges from the extents of the mesh data
+		static MeshQuantisation FromMesh(const Mesh& mesh);
+	};
+
+	// Octahedral encoding of a unit normal into two values in the range -1 to 1
+	glm::vec2 OctEncode(const glm::vec3& n);
+	glm::vec3 OctDecode(const glm::vec2& e);
+
+	/*
+		Attribute encodings
+		Each describes the GL format, how to pack a source value and how to unpack it again (used to measure the error)
+		Storage is always a multiple of 4 bytes so every attribute offset stays aligned
+	*/
+
+	// Full precision position, 12 bytes
+	struct PositionFloat3
+	{
+		using Storage = glm::vec3;
+		static constexpr VertexSemantic KSemantic{ VertexSemantic::Position };
+		static constexpr GLint KComponents{ 3 };
+		static constexpr GLenum KType{ GL_FLOAT };
+		static constexpr GLboolean KNormalised{ GL_FALSE };
+		static constexpr bool KDequantised{ false };
+
+		static Storage Encode(const glm::vec3& p, const MeshQuantisation&) { return p; }
+		static glm::vec3 Decode(const Storage& s, const MeshQuantisation&) { return s; }
+	};
+
+	// 16 bit normalised position relative to the mesh bounds, 8 bytes (w is padding)
+	struct PositionUnorm16
+	{
+		using Storage = glm::uint64;
+		static constexpr VertexSemantic KSemantic{ VertexSemantic::Position };
+		static constexpr GLint KComponents{ 3 };
+		static constexpr GLenum KType{ GL_UNSIGNED_SHORT };
+		static constexpr GLboolean KNormalised{ GL_TRUE };
+		static constexpr bool KDequantised{ true };
+
+		static Storage Encode(const glm::vec3& p, const MeshQuantisation& q) {
+			return glm::packUnorm4x16(glm::vec4((p - q.positionOffset) / q.positionScale, 0));
+		}
+		static glm::vec3 Decode(const Storage& s, const MeshQuantisation& q) {
+			return q.positionOffset + q.positionScale * glm::vec3(glm::unpackUnorm4x16(s));
+		}
+	};
+
+	// Half float position relative to the mesh bounds, 8 bytes (w is padding)
+	struct PositionHalf
+	{
+		using Storage = glm::uint64;
+		static constexpr VertexSemantic KSemantic{ VertexSemantic::Position };
+		static constexpr GLint KComponents{ 3 };
+		static constexpr GLenum KType{ GL_HALF_FLOAT };
+		static constexpr GLboolean KNormalised{ GL_FALSE };
+		static constexpr bool KDequantised{ true };
+
+		static Storage Encode(const glm::vec3& p, const MeshQuantisation& q) {
+			return glm::packHalf4x16(glm::vec4((p - q.positionOffset) / q.positionScale, 0));
+		}
+		static glm::vec3 Decode(const Storage& s, const MeshQuantisation& q) {
+			return q.positionOffset + q.positionScale * glm::vec3(glm::unpackHalf4x16(s));
+		}
+	};
+
+	// Full precision normal, 12 bytes
+	struct NormalFloat3
+	{
+		using Storage = glm::vec3;
+		static constexpr VertexSemantic KSemantic{ VertexSemantic::Normal };
+		static constexpr GLint KComponents{ 3 };
+		static constexpr GLenum KType{ GL_FLOAT };
+		static constexpr GLboolean KNormalised{ GL_FALSE };
+		static constexpr bool KDequantised{ false };
+
+		static Storage Encode(const glm::vec3& n, const MeshQuantisation&) { return n; }
+		static glm::vec3 Decode(const Storage& s, const MeshQuantisation&) { return s; }
+	};
+
+	// Octahedral normal in two signed normalised shorts, 4 bytes. Shader must call oct_decode.
+	struct NormalOct16
+	{
+		using Storage = glm::uint32;
+		static constexpr VertexSemantic KSemantic{ VertexSemantic::Normal };
+		static constexpr GLint KComponents{ 2 };
+		static constexpr GLenum KType{ GL_SHORT };
+		static constexpr GLboolean KNormalised{ GL_TRUE };
+		static constexpr bool KDequantised{ false };
+
+		static Storage Encode(const glm::vec3& n, const MeshQuantisation&) { return glm::packSnorm2x16(OctEncode(n)); }
+		static glm::vec3 Decode(const Storage& s, const MeshQuantisation&) { return OctDecode(glm::unpackSnorm2x16(s)); }
+	};
+
+	// Full precision texture coordinate, 8 bytes
+	struct TexCoordFloat2
+	{
+		using Storage = glm::vec2;
+		static constexpr VertexSemantic KSemantic{ VertexSemantic::TexCoord };
+		static constexpr GLint KComponents{ 2 };
+		static constexpr GLenum KType{ GL_FLOAT };
+		static constexpr GLboolean KNormalised{ GL_FALSE };
+		static constexpr bool KDequantised{ false };
+
+		static Storage Encode(const glm::vec2& uv, const MeshQuantisation&) { return uv; }
+		static glm::vec2 Decode(const Storage& s, const MeshQuantisation&) { return s; }
+	};
+
+	// 16 bit normalised texture coordinate relative to the mesh uv range, 4 bytes
+	// Preferred over half floats as tiled uvs (e.g. the terrain goes up to 40) lose too much precision as halfs
+	struct TexCoordUnorm16
+	{
+		using Storage = glm::uint32;
+		static constexpr VertexSemantic KSemantic{ VertexSemantic::TexCoord };
+		static constexpr GLint KComponents{ 2 };
+		static constexpr GLenum KType{ GL_UNSIGNED_SHORT };
+		static constexpr GLboolean KNormalised{ GL_TRUE };
+		static constexpr bool KDequantised{ true };
+
+		static Storage Encode(const glm::vec2& uv, const MeshQuantisation& q) { return glm::packUnorm2x16((uv - q.uvOffset) / q.uvScale); }
+		static glm::vec2 Decode(const Storage& s, const MeshQuantisation& q) { return q.uvOffset + q.uvScale * glm::unpackUnorm2x16(s); }
+	};
+
+	// Half float texture coordinate, 4 bytes
+	struct TexCoordHalf
+	{
+		using Storage = glm::uint32;
+		static constexpr VertexSemantic KSemantic{ VertexSemantic::TexCoord };
+		static constexpr GLint KComponents{ 2 };
+		static constexpr GLenum KType{ GL_HALF_FLOAT };
+		static constexpr GLboolean KNormalised{ GL_FALSE };
+		static constexpr bool KDequantised{ false };
+
+		static Storage Encode(const glm::vec2& uv, const MeshQuantisation&) { return glm::packHalf2x16(uv); }
+		static glm::vec2 Decode(const Storage& s, const MeshQuantisation&) { return glm::unpackHalf2x16(s); }
+	};
+
+	// 8 bit normalised colour, 4 bytes (alpha is padding)
+	struct ColourUnorm8
+	{
+		using Storage = glm::uint32;
+		static constexpr VertexSemantic KSemantic{ VertexSemantic::Colour };
+		static constexpr GLint KComponents{ 3 };
+		static constexpr GLenum KType{ GL_UNSIGNED_BYTE };
+		static constexpr GLboolean KNormalised{ GL_TRUE };
+		static constexpr bool KDequantised{ false };
+
+		static Storage Encode(const glm::vec3& c, const MeshQuantisation&) { return glm::packUnorm4x8(glm::vec4(c, 1)); }
+		static glm::vec3 Decode(const Storage& s, const MeshQuantisation&) { return glm::vec3(glm::unpackUnorm4x8(s)); }
+	};
+
+	// Source stream for each semantic
+	template<VertexSemantic S> struct SemanticSource;
+	template<> struct SemanticSource<VertexSemantic::Position> {
+		static const std::vector<glm::vec3>& Get(const Mesh& mesh) { return mesh.vertices; }
+	};
+	template<> struct SemanticSource<VertexSemantic::Normal> {
+		static const std::vector<glm::vec3>& Get(const Mesh& mesh) { return mesh.normals; }
+	};
+	template<> struct SemanticSource<VertexSemantic::Colour> {
+		static const std::vector<glm::vec3>& Get(const Mesh& mesh) { return mesh.colours; }
+	};
+	template<> struct SemanticSource<VertexSemantic::TexCoord> {
+		static const std::vector<glm::vec2>& Get(const Mesh& mesh) { return mesh.uvCoords; }
+	};
+
+	// Errors of a quantised layout measured against the float originals
+	struct QuantisationError
+	{
+		float maxPositionError{ 0 };	// world units
+		float rmsPositionError{ 0 };
+		float maxNormalErrorDegrees{ 0 };
+		float maxUVError{ 0 };
+
+		std::string ToString() const {
+			return "Pos max: " + std::to_string(maxPositionError) +
+				" rms: " + std::to_string(rmsPositionError) +
+				" Normal max deg: " + std::to_string(maxNormalErrorDegrees) +
+				" UV max: " + std::to_string(maxUVError);
+		}
+	};
+
+	// An interleaved vertex made up of the listed attribute encodings
+	// Offsets, stride, VAO setup and packing are all generated at compile time from the list
+	template<typename... Attributes>
+	class VertexLayout
+	{
+	private:
+		template<size_t I>
+		using Attribute = std::tuple_element_t<I, std::tuple<Attributes...>>;
+
+		template<size_t I>
+		static constexpr size_t OffsetOf() {
+			if constexpr (I == 0)
+				return 0;
+			else
+				return OffsetOf<I - 1>() + sizeof(typename Attribute<I - 1>::Storage);
+		}
+
+		template<size_t... I>
+		static std::vector<VertexAttribute> VertexAttributes(std::index_sequence<I...>) {
+			return { DescribeAttribute<Attribute<I>>(OffsetOf<I>())... };
+		}
+
+		template<typename A>
+		static VertexAttribute DescribeAttribute(size_t offset) {
+			return VertexAttribute{ SemanticLocation(A::KSemantic), A::KComponents, A::KType, A::KNormalised, offset };
+		}
+
+		// A stream longer than the positions is cut to them, out has room for one vertex per position
+		template<typename A>
+		static void PackAttribute(const Mesh& mesh, const MeshQuantisation& q, size_t offset, GLubyte* out) {
+			const auto& source{ SemanticSource<A::KSemantic>::Get(mesh) };
+			const size_t count{ std::min(source.size(), mesh.vertices.size()) };
+			for (size_t v = 0; v < count; v++)
+			{
+				const typename A::Storage packed{ A::Encode(source[v], q) };
+				memcpy(out + v * KStride + offset, &packed, sizeof(packed));
+			}
+		}
+
+		template<size_t... I>
+		static void PackAll(const Mesh& mesh, const MeshQuantisation& q, GLubyte* out, std::index_sequence<I...>) {
+			(PackAttribute<Attribute<I>>(mesh, q, OffsetOf<I>(), out), ...);
+		}
+
+		template<typename A>
+		static void MeasureAttribute(const Mesh& mesh, const MeshQuantisation& q, QuantisationError& err, double& sumSq) {
+			const auto& source{ SemanticSource<A::KSemantic>::Get(mesh) };
+			const size_t count{ std::min(source.size(), mesh.vertices.size()) };
+			for (size_t v = 0; v < count; v++)
+			{
+				const auto decoded{ A::Decode(A::Encode(source[v], q), q) };
+				if constexpr (A::KSemantic == VertexSemantic::Position)
+				{
+					const float e{ glm::length(decoded - source[v]) };
+					err.maxPositionError = std::max(err.maxPositionError, e);
+					sumSq += (double)e * e;
+				}
+				else if constexpr (A::KSemantic == VertexSemantic::TexCoord)
+				{
+					const glm::vec2 d{ glm::abs(decoded - source[v]) };
+					err.maxUVError = std::max(err.maxUVError, std::max(d.x, d.y));
+				}
+				else if constexpr (A::KSemantic == VertexSemantic::Normal)
+				{
+					const float cosAngle{ glm::clamp(glm::dot(glm::normalize(decoded), glm::normalize(source[v])), -1.0f, 1.0f) };
+					err.maxNormalErrorDegrees = std::max(err.maxNormalErrorDegrees, glm::degrees(std::acos(cosAngle)));
+				}
+			}
+		}
+	public:
+		// Bytes per vertex
+		static constexpr size_t KStride{ (sizeof(typename Attributes::Storage) + ...) };
+
+		// True if the shader needs the mesh dequantisation uniforms
+		static constexpr bool KNeedsDequantisation{ (Attributes::KDequantised || ...) };
+
+		// The attributes to give RenderBackend::CreateVertexArray, with KStride
+		static std::vector<VertexAttribute> VertexAttributes() { return VertexAttributes(std::index_sequence_for<Attributes...>{}); }
+
+		// Interleave and encode the mesh streams
+		static std::vector<GLubyte> Pack(const Mesh& mesh, const MeshQuantisation& q) {
+			std::vector<GLubyte> out(mesh.vertices.size() * KStride, 0);
+			PackAll(mesh, q, out.data(), std::index_sequence_for<Attributes...>{});
+			return out;
+		}
+
+		// Round trip every attribute and report the error against the float originals
+		static QuantisationError MeasureError(const Mesh& mesh, const MeshQuantisation& q) {
+			QuantisationError err;
+			double sumSq{ 0 };
+			(MeasureAttribute<Attributes>(mesh, q, err, sumSq), ...);
+			if (!mesh.vertices.empty())
+				err.rmsPositionError = (float)std::sqrt(sumSq / mesh.vertices.size());
+			return err;
+		}
+	};
+
+	// Layout used by the main textured and lit program: 16 bytes per vertex rather than 32
+	using PackedVertex = VertexLayout<PositionUnorm16, NormalOct16, TexCoordUnorm16>;
+
+	// Layout used by the coloured cube program: 16 bytes per vertex rather than 24
+	using ColouredVertex = VertexLayout<PositionFloat3, ColourUnorm8>;
+
+	// Bytes per vertex of the original non-interleaved float streams (position, normal, uv)
+	static constexpr size_t KUnpackedVertexSize{ sizeof(glm::vec3) * 2 + sizeof(glm::vec2) };
+}
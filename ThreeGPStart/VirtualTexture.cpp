@@ -0,0 +1,496 @@
+#include "VirtualTexture.h"
+
+#include <algorithm>
+#include <cmath>
+#include <random>
+
+namespace Helpers
+{
+	// Empty every slot
+	void VirtualPageCache::Initialise(size_t numSlots)
+	{
+		m_slots.assign(numSlots, Slot());
+		m_pageSlots.clear();
+	}
+
+	// The slot holding the page, KNone if it is not resident
+	GLuint VirtualPageCache::Find(GLuint page) const
+	{
+		const auto it{ m_pageSlots.find(page) };
+		return it == m_pageSlots.end() ? KNone : it->second;
+	}
+
+	// Mark the page needed in frame, false if it is not resident
+	bool VirtualPageCache::Touch(GLuint page, size_t frame)
+	{
+		const auto it{ m_pageSlots.find(page) };
+		if (it == m_pageSlots.end())
+			return false;
+		m_slots[it->second].lastUsedFrame = frame;
+		return true;
+	}
+
+	// An empty slot if there is one, otherwise the least recently used that is not pinned or needed in frame
+	GLuint VirtualPageCache::Insert(GLuint page, size_t frame, GLuint& evicted)
+	{
+		evicted = KNone;
+		const auto existing{ m_pageSlots.find(page) };
+		if (existing != m_pageSlots.end())
+		{
+			m_slots[existing->second].lastUsedFrame = frame;
+			return existing->second;
+		}
+
+		GLuint chosen{ KNone };
+		for (GLuint i = 0; i < (GLuint)m_slots.size(); i++)
+		{
+			const Slot& slot{ m_slots[i] };
+			if (!slot.occupied)
+			{
+				chosen = i;
+				break;
+			}
+			if (slot.pinned || slot.lastUsedFrame >= frame)
+				continue;
+			if (chosen == KNone || slot.lastUsedFrame < m_slots[chosen].lastUsedFrame)
+				chosen = i;
+		}
+		if (chosen == KNone)
+			return KNone;
+
+		Slot& slot{ m_slots[chosen] };
+		if (slot.occupied)
+		{
+			evicted = slot.page;
+			m_pageSlots.erase(slot.page);
+		}
+		slot.page = page;
+		slot.occupied = true;
+		slot.pinned = false;
+		slot.lastUsedFrame = frame;
+		m_pageSlots[page] = chosen;
+		return chosen;
+	}
+
+	// A pinned page is never evicted, false if it is not resident
+	bool VirtualPageCache::Pin(GLuint page)
+	{
+		const GLuint slot{ Find(page) };
+		if (slot == KNone)
+			return false;
+		m_slots[slot].pinned = true;
+		return true;
+	}
+
+	// Resident pages of each level below levels
+	std::vector<size_t> VirtualPageCache::ResidentByLevel(GLuint levels) const
+	{
+		std::vector<size_t> counts(levels, 0);
+		for (const auto& page : m_pageSlots)
+		{
+			const GLuint level{ VirtualPage::FromKey(page.first).level };
+			if (level < levels)
+				counts[level]++;
+		}
+		return counts;
+	}
+
+	// The model holds each resident page's last frame and whether it is pinned. A miss is inserted as ReadFeedback and
+	// UploadPages would, so within a frame the pages already asked for are the ones that may not be evicted.
+	VirtualPageCacheCheck CheckVirtualPageCache()
+	{
+		static constexpr size_t KSlots{ 16 };
+		static constexpr GLuint KPages{ 48 };
+		static constexpr size_t KFrames{ 2000 };
+		const GLuint root{ VirtualPage{ 7, 0, 0 }.Key() };
+
+		struct ModelPage
+		{
+			size_t lastUsedFrame{ 0 };
+			bool pinned{ false };
+		};
+		std::unordered_map<GLuint, ModelPage> model;
+
+		VirtualPageCacheCheck check;
+		VirtualPageCache cache;
+		cache.Initialise(KSlots);
+		GLuint evicted{ VirtualPageCache::KNone };
+		cache.Insert(root, 0, evicted);
+		cache.Pin(root);
+		model[root] = ModelPage{ 0, true };
+
+		std::mt19937 random(4321);
+		std::uniform_int_distribution<GLuint> pageDistribution(0, KPages - 1);
+		std::uniform_int_distribution<size_t> requestDistribution(1, KSlots + KSlots / 2);
+		for (size_t frame = 1; frame <= KFrames; frame++)
+		{
+			check.frames++;
+			const size_t requests{ requestDistribution(random) };
+			for (size_t r = 0; r < requests; r++)
+			{
+				const GLuint page{ VirtualPage{ 0, pageDistribution(random), 0 }.Key() };
+				const auto found{ model.find(page) };
+				const bool resident{ found != model.end() };
+				if (cache.Touch(page, frame) != resident || (cache.Find(page) != VirtualPageCache::KNone) != resident)
+					check.countFailures++;
+				if (resident)
+				{
+					check.hits++;
+					found->second.lastUsedFrame = frame;
+					continue;
+				}
+				check.misses++;
+
+				// The oldest page the cache may take, if it is full
+				size_t oldestFrame{ SIZE_MAX };
+				for (const auto& entry : model)
+				{
+					if (!entry.second.pinned && entry.second.lastUsedFrame < frame)
+						oldestFrame = std::min(oldestFrame, entry.second.lastUsedFrame);
+				}
+				const bool full{ model.size() == KSlots };
+				const bool shouldRefuse{ full && oldestFrame == SIZE_MAX };
+
+				const GLuint slot{ cache.Insert(page, frame, evicted) };
+				if (slot == VirtualPageCache::KNone)
+				{
+					check.refusals++;
+					if (!shouldRefuse)
+						check.refusalFailures++;
+					continue;
+				}
+				if (shouldRefuse || (full != (evicted != VirtualPageCache::KNone)))
+					check.refusalFailures++;
+
+				if (evicted != VirtualPageCache::KNone)
+				{
+					check.evictions++;
+					const auto victim{ model.find(evicted) };
+					if (victim == model.end())
+					{
+						check.countFailures++;
+					}
+					else
+					{
+						if (victim->second.pinned)
+							check.pinnedEvictions++;
+						if (victim->second.lastUsedFrame != oldestFrame)
+							check.orderFailures++;
+						model.erase(victim);
+					}
+				}
+				model[page] = ModelPage{ frame, false };
+			}
+
+			if (cache.NumResident() != model.size() || cache.Find(root) == VirtualPageCache::KNone)
+				check.countFailures++;
+		}
+		return check;
+	}
+
+	// Waits for the jobs still making pages, as they write into this
+	VirtualTexture::~VirtualTexture()
+	{
+		if (!m_jobs.empty())
+		{
+			JobSystem& jobs{ GetJobSystem() };
+			for (const std::unique_ptr<PageJob>& job : m_jobs)
+				jobs.Wait(job->done);
+		}
+
+		if (m_resources)
+		{
+			for (GLsync fence : m_feedbackFences)
+			{
+				if (fence)
+					m_resources->GetBackend().DeleteFence(fence);
+			}
+		}
+	}
+
+	// Both textures start black, the coarsest page is made and uploaded here and the page table points every page at it
+	bool VirtualTexture::Initialise(GpuResourceRegistry& resources, VirtualPageCompositor compositor)
+	{
+		m_resources = &resources;
+		m_compositor = std::move(compositor);
+		m_pageCache.Initialise((size_t)KSlotsAcross * KSlotsAcross);
+		m_feedbackFences.assign(KFeedbackFrames, nullptr);
+		m_feedbackRead.assign(KFeedbackFrames, glm::ivec2(0));
+
+		const GLsizei cacheSize{ (GLsizei)(KSlotsAcross * KSlotTexels) };
+		const std::vector<GLubyte> black((size_t)cacheSize * (size_t)cacheSize * 4, 0);
+		m_pageTable = resources.CreateTexture2D("Virtual texture page table", KPagesAcross, KPagesAcross, black.data(), GL_CLAMP_TO_EDGE);
+		m_cache = resources.CreateTexture2D("Virtual texture cache", cacheSize, cacheSize, black.data(), GL_CLAMP_TO_EDGE);
+		if (!m_pageTable || !m_cache)
+		{
+			std::cout << "ERROR: could not make the virtual texture's page table and cache" << std::endl;
+			return false;
+		}
+
+		const VirtualPage root{ KLevels - 1, 0, 0 };
+		std::vector<GLubyte> texels((size_t)KSlotTexels * KSlotTexels * 4);
+		m_compositor(root, texels.data());
+
+		VirtualTextureStats stats;
+		if (!UploadPage(root, texels.data(), stats) || !m_pageCache.Pin(root.Key()))
+		{
+			std::cout << "ERROR: could not place the virtual texture's coarsest page" << std::endl;
+			return false;
+		}
+		UpdatePageTable(stats);
+		return true;
+	}
+
+	// The buffer only grows, anything waiting to be read is dropped with the old one
+	void VirtualTexture::ResizeFeedback(const glm::ivec2& size)
+	{
+		m_feedbackSize = size;
+		const size_t bytes{ (size_t)size.x * (size_t)size.y * 4 };
+		if (bytes <= m_feedbackRegionBytes)
+			return;
+
+		RenderBackend& backend{ m_resources->GetBackend() };
+		for (size_t i = 0; i < KFeedbackFrames; i++)
+		{
+			if (m_feedbackFences[i])
+			{
+				backend.WaitFence(m_feedbackFences[i]);
+				backend.DeleteFence(m_feedbackFences[i]);
+				m_feedbackFences[i] = nullptr;
+			}
+			m_feedbackRead[i] = glm::ivec2(0);
+		}
+
+		const void* mapped{ nullptr };
+		m_feedbackBuffer = m_resources->CreateReadbackBuffer("Virtual texture feedback", bytes * KFeedbackFrames, mapped);
+		m_feedbackMapped = static_cast<const GLubyte*>(mapped);
+		m_feedbackRegionBytes = m_feedbackBuffer && m_feedbackMapped ? bytes : 0;
+		if (!m_feedbackRegionBytes)
+			std::cout << "ERROR: could not make the virtual texture's feedback readback buffer" << std::endl;
+	}
+
+	// Each pixel is the page it sampled as x, y, level and 255, or all zeros where the texture was not drawn.
+	// The requested pages that are resident are marked needed this frame so they are the last to be evicted.
+	void VirtualTexture::ReadFeedback(size_t region, VirtualTextureStats& stats)
+	{
+		m_requests.clear();
+		const glm::ivec2 size{ m_feedbackRead[region] };
+		m_feedbackRead[region] = glm::ivec2(0);
+		if (!size.x || !size.y || !m_feedbackMapped)
+			return;
+
+		const GLubyte* texels{ m_feedbackMapped + region * m_feedbackRegionBytes };
+		for (size_t i = 0; i < (size_t)size.x * (size_t)size.y; i++)
+		{
+			const GLubyte* texel{ texels + i * 4 };
+			if (!texel[3])
+				continue;
+
+			const VirtualPage page{ texel[2], texel[0], texel[1] };
+			if (page.level >= KLevels || page.x >= (KPagesAcross >> page.level) || page.y >= (KPagesAcross >> page.level))
+				continue;
+			m_requests[page.Key()]++;
+			stats.feedbackTexels++;
+		}
+
+		stats.requestedPages = m_requests.size();
+		for (const auto& request : m_requests)
+		{
+			if (m_pageCache.Touch(request.first, m_frame))
+			{
+				stats.residentPages++;
+				stats.residentTexels += request.second;
+			}
+		}
+	}
+
+	// Coarser pages first as they stand in for everything below them, then the pages covering the most pixels
+	void VirtualTexture::StartJobs(VirtualTextureStats& stats)
+	{
+		std::vector<std::pair<GLuint, size_t>> missing;
+		for (const auto& request : m_requests)
+		{
+			if (m_pageCache.Find(request.first) != VirtualPageCache::KNone)
+				continue;
+			if (std::any_of(m_jobs.begin(), m_jobs.end(), [&](const std::unique_ptr<PageJob>& job) { return job->page.Key() == request.first; }))
+				continue;
+			missing.push_back(request);
+		}
+		std::sort(missing.begin(), missing.end(), [](const std::pair<GLuint, size_t>& a, const std::pair<GLuint, size_t>& b)
+		{
+			const GLuint levelA{ VirtualPage::FromKey(a.first).level }, levelB{ VirtualPage::FromKey(b.first).level };
+			return levelA != levelB ? levelA > levelB : a.second > b.second;
+		});
+
+		JobSystem& jobs{ GetJobSystem() };
+		for (const auto& request : missing)
+		{
+			if (stats.pagesStarted >= (size_t)m_jobsPerFrame || m_jobs.size() >= KMaxJobsInFlight)
+				break;
+
+			std::unique_ptr<PageJob> job{ std::make_unique<PageJob>() };
+			job->page = VirtualPage::FromKey(request.first);
+			job->texels.resize((size_t)KSlotTexels * KSlotTexels * 4);
+			PageJob* started{ job.get() };
+			jobs.Run([this, started]()
+			{
+				m_compositor(started->page, started->texels.data());
+			}, &started->done);
+			m_jobs.push_back(std::move(job));
+			stats.pagesStarted++;
+		}
+	}
+
+	// Pages made since last frame, up to the upload limit, the rest wait for the next frame
+	void VirtualTexture::UploadPages(VirtualTextureStats& stats)
+	{
+		for (std::unique_ptr<PageJob>& job : m_jobs)
+		{
+			if (!job->done.Done())
+				continue;
+			if (stats.pagesUploaded >= (size_t)m_uploadsPerFrame)
+			{
+				stats.pagesWaiting++;
+				continue;
+			}
+			if (!UploadPage(job->page, job->texels.data(), stats))
+				stats.pagesDropped++;
+			job.reset();
+		}
+		m_jobs.erase(std::remove(m_jobs.begin(), m_jobs.end(), nullptr), m_jobs.end());
+
+		for (const std::unique_ptr<PageJob>& job : m_jobs)
+			stats.jobsInFlight += job->done.Done() ? 0 : 1;
+	}
+
+	// Into the slot the cache gives it, false if every slot is needed this frame
+	bool VirtualTexture::UploadPage(const VirtualPage& page, const GLubyte* texels, VirtualTextureStats& stats)
+	{
+		GLuint evicted{ VirtualPageCache::KNone };
+		const GLuint slot{ m_pageCache.Insert(page.Key(), m_frame, evicted) };
+		if (slot == VirtualPageCache::KNone)
+			return false;
+
+		m_resources->GetBackend().UpdateTexture2D(m_cache.Get(), 0, (GLint)((slot % KSlotsAcross) * KSlotTexels), (GLint)((slot / KSlotsAcross) * KSlotTexels),
+			KSlotTexels, KSlotTexels, texels);
+		if (evicted != VirtualPageCache::KNone)
+			stats.pagesEvicted++;
+		stats.pagesUploaded++;
+		m_totalUploaded++;
+		m_pageTableDirty = true;
+		return true;
+	}
+
+	// Every level is made again from the coarsest down, an entry is the slot's x and y, the level of the page in it
+	// and 255. A page that is not resident copies its parent's entry, so it points at the nearest resident ancestor.
+	void VirtualTexture::UpdatePageTable(VirtualTextureStats& stats)
+	{
+		std::vector<GLubyte> parents;
+		for (GLuint level = KLevels; level-- > 0;)
+		{
+			const GLuint across{ KPagesAcross >> level };
+			std::vector<GLubyte> entries((size_t)across * across * 4, 0);
+			for (GLuint y = 0; y < across; y++)
+			{
+				for (GLuint x = 0; x < across; x++)
+				{
+					GLubyte* entry{ &entries[((size_t)y * across + x) * 4] };
+					const GLuint slot{ m_pageCache.Find(VirtualPage{ level, x, y }.Key()) };
+					if (slot != VirtualPageCache::KNone)
+					{
+						entry[0] = (GLubyte)(slot % KSlotsAcross);
+						entry[1] = (GLubyte)(slot / KSlotsAcross);
+						entry[2] = (GLubyte)level;
+						entry[3] = 255;
+					}
+					else if (!parents.empty())
+					{
+						memcpy(entry, &parents[((size_t)(y / 2) * (across / 2) + x / 2) * 4], 4);
+					}
+				}
+			}
+			m_resources->GetBackend().UpdateTexture2D(m_pageTable.Get(), (GLint)level, 0, 0, across, across, entries.data());
+			stats.pageTableLevelsUploaded++;
+			parents = std::move(entries);
+		}
+		m_pageTableDirty = false;
+	}
+
+	// This frame reads its feedback into the region the frame KFeedbackFrames ago used, so that frame's is read first
+	void VirtualTexture::BeginFrame(const glm::ivec4& viewport)
+	{
+		VirtualTextureStats stats;
+		m_frame++;
+		const size_t region{ Region() };
+		if (m_feedbackFences[region])
+		{
+			RenderBackend& backend{ m_resources->GetBackend() };
+			backend.WaitFence(m_feedbackFences[region]);
+			backend.DeleteFence(m_feedbackFences[region]);
+			m_feedbackFences[region] = nullptr;
+		}
+
+		ReadFeedback(region, stats);
+		ResizeFeedback(glm::ivec2(std::max(viewport.z / KFeedbackDivisor, 1), std::max(viewport.w / KFeedbackDivisor, 1)));
+		StartJobs(stats);
+		UploadPages(stats);
+		if (m_pageTableDirty)
+			UpdatePageTable(stats);
+
+		stats.feedbackSize = m_feedbackSize;
+		m_lastStats = stats;
+	}
+
+	// Rows from the bottom, the order does not matter as every pixel is read the same way
+	void VirtualTexture::RecordFeedbackReadback(CommandList& list)
+	{
+		if (!m_feedbackRegionBytes)
+			return;
+
+		const size_t region{ Region() };
+		list.ReadPixels(glm::ivec4(0, 0, m_feedbackSize.x, m_feedbackSize.y), m_feedbackBuffer.Get(), region * m_feedbackRegionBytes);
+		m_feedbackRead[region] = m_feedbackSize;
+	}
+
+	// Fence this frame's readback once its commands have been executed
+	void VirtualTexture::EndFrame()
+	{
+		const size_t region{ Region() };
+		if (m_resources && !m_feedbackFences[region])
+			m_feedbackFences[region] = m_resources->GetBackend().InsertFence();
+	}
+
+	// The feedback's derivatives are KFeedbackDivisor times the screen's, so it picks that many levels finer to match
+	float VirtualTexture::GetFeedbackLodBias() const
+	{
+		return m_lodBias - std::log2((float)KFeedbackDivisor);
+	}
+
+	// Limits, the last frame's feedback and hit rates and the cache's pages by level
+	void VirtualTexture::DefineGUI()
+	{
+		ImGui::SliderFloat("Mip bias", &m_lodBias, -1.0f, 4.0f, "%.1f");
+		ImGui::SliderInt("Pages made a frame", &m_jobsPerFrame, 1, 64);
+		ImGui::SliderInt("Pages uploaded a frame", &m_uploadsPerFrame, 1, 64);
+
+		const VirtualTextureStats& stats{ m_lastStats };
+		ImGui::Text("Virtual %ux%u texels in %u levels, pages of %u texels plus a %u texel border", KPagesAcross * KPageTexels, KPagesAcross * KPageTexels,
+			KLevels, KPageTexels, KBorderTexels);
+		ImGui::ProgressBar(m_pageCache.NumResident() / (float)std::max<size_t>(m_pageCache.NumSlots(), 1), ImVec2(-1, 0),
+			(std::to_string(m_pageCache.NumResident()) + " of " + std::to_string(m_pageCache.NumSlots()) + " slots").c_str());
+		ImGui::Text("Feedback %dx%d, %zu pixels on the texture", stats.feedbackSize.x, stats.feedbackSize.y, stats.feedbackTexels);
+		ImGui::Text("%zu pages requested, %.1f%% resident, %.1f%% of pixels at the level they want", stats.requestedPages,
+			stats.PageHitRate() * 100.0f, stats.TexelHitRate() * 100.0f);
+		ImGui::Text("Last frame: %zu pages started, %zu uploaded (%.1f KB), %zu evicted, %zu dropped, %zu waiting, %zu jobs in flight",
+			stats.pagesStarted, stats.pagesUploaded, stats.pagesUploaded * KSlotTexels * KSlotTexels * 4 / 1024.0f, stats.pagesEvicted,
+			stats.pagesDropped, stats.pagesWaiting, stats.jobsInFlight);
+		ImGui::Text("%zu page table levels uploaded, %zu pages uploaded in all", stats.pageTableLevelsUploaded, m_totalUploaded);
+
+		const std::vector<size_t> resident{ m_pageCache.ResidentByLevel(KLevels) };
+		for (GLuint level = 0; level < KLevels; level++)
+		{
+			const size_t pages{ (size_t)(KPagesAcross >> level) * (KPagesAcross >> level) };
+			ImGui::Text("Level %u: %5zu of %5zu pages resident", level, resident[level], pages);
+		}
+	}
+}
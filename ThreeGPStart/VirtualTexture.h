@@ -0,0 +1,217 @@
+#pragma once
+// Software virtual texturing. A texture too large to keep on the GPU is split into pages, each mip level having a
+// quarter of the pages of the one below, and only the pages something on screen samples are made and kept, in the
+// slots of one fixed size cache texture. A page table texture with a level per virtual mip level maps each page to
+// the slot holding it or, until it is resident, to the slot of its nearest resident parent, so a shader always has
+// something to sample. Which pages are needed comes from a feedback pass, the scene drawn small writing the page
+// each pixel samples, read back a few frames later once the GPU has finished with it. Missing pages are made on the
+// job system by a compositor the owner supplies (decoding, or combining other images as the terrain does) and
+// uploaded a few a frame, taking the slots of the least recently needed pages. The coarsest page is made up front
+// and never evicted. Main thread only apart from the feedback readback, which may be recorded on any thread.
+
+#include "ExternalLibraryHeaders.h"
+#include "RenderBackend.h"
+#include "GpuResources.h"
+#include "JobSystem.h"
+
+#include <functional>
+#include <unordered_map>
+
+namespace Helpers
+{
+	// A page of the virtual texture, x and y count pages across its level
+	struct VirtualPage
+	{
+		GLuint level{ 0 };
+		GLuint x{ 0 };
+		GLuint y{ 0 };
+
+		// Unique for textures of up to 16384 pages across and 16 levels
+		GLuint Key() const { return (level << 28) | (y << 14) | x; }
+		static VirtualPage FromKey(GLuint key) { return VirtualPage{ key >> 28, key & 0x3FFF, (key >> 14) & 0x3FFF }; }
+	};
+
+	// Which page is in which slot of the cache, replacing the least recently used. It makes no GL calls so its
+	// decisions can be checked on the CPU alone. Pages are keys from VirtualPage::Key.
+	class VirtualPageCache
+	{
+	private:
+		struct Slot
+		{
+			GLuint page{ 0 };
+			bool occupied{ false };
+			bool pinned{ false };
+			size_t lastUsedFrame{ 0 };
+		};
+
+		std::vector<Slot> m_slots;
+		std::unordered_map<GLuint, GLuint> m_pageSlots;
+	public:
+		// No slot, or no page evicted
+		static constexpr GLuint KNone{ 0xFFFFFFFF };
+
+		// Empty every slot
+		void Initialise(size_t numSlots);
+
+		// The slot holding the page, KNone if it is not resident
+		GLuint Find(GLuint page) const;
+
+		// Mark the page needed in frame, false if it is not resident
+		bool Touch(GLuint page, size_t frame);
+
+		// A slot for the page, the least recently used one that is not pinned or needed in frame. evicted is the page
+		// that was in it, or KNone. KNone if every slot is pinned or needed in frame.
+		GLuint Insert(GLuint page, size_t frame, GLuint& evicted);
+
+		// A pinned page is never evicted, false if it is not resident
+		bool Pin(GLuint page);
+
+		size_t NumSlots() const { return m_slots.size(); }
+		size_t NumResident() const { return m_pageSlots.size(); }
+
+		// Resident pages of each level below levels
+		std::vector<size_t> ResidentByLevel(GLuint levels) const;
+	};
+
+	// Result of CheckVirtualPageCache, the failures are steps where the cache did not do what a plain model of it did
+	struct VirtualPageCacheCheck
+	{
+		size_t frames{ 0 };
+		size_t hits{ 0 };					// requests Touch found resident
+		size_t misses{ 0 };
+		size_t evictions{ 0 };
+		size_t refusals{ 0 };				// Insert returning KNone with every slot pinned or needed
+		size_t countFailures{ 0 };			// Touch or Find disagreeing with the model on what is resident
+		size_t orderFailures{ 0 };			// evicting a page used more recently than another it could have taken
+		size_t pinnedEvictions{ 0 };
+		size_t refusalFailures{ 0 };		// refusing with a slot free to take, or not refusing when it should
+
+		bool Passed() const { return !countFailures && !orderFailures && !pinnedEvictions && !refusalFailures; }
+	};
+
+	// Drive a small cache with a pinned root page through many frames of random requests, more than it holds in some,
+	// and compare every Touch, Find and Insert with a model of least recently used replacement. CPU only.
+	VirtualPageCacheCheck CheckVirtualPageCache();
+
+	// What the virtual texture did in the last BeginFrame
+	struct VirtualTextureStats
+	{
+		glm::ivec2 feedbackSize{ 0 };
+		size_t feedbackTexels{ 0 };		// pixels of the feedback that sampled the texture
+		size_t residentTexels{ 0 };		// of those, ones whose page was resident
+		size_t requestedPages{ 0 };		// distinct pages in the feedback
+		size_t residentPages{ 0 };		// of those, already in the cache
+		size_t pagesStarted{ 0 };		// composite jobs started
+		size_t pagesUploaded{ 0 };
+		size_t pagesEvicted{ 0 };
+		size_t pagesDropped{ 0 };		// made but every slot was needed this frame
+		size_t pagesWaiting{ 0 };		// made and waiting for the upload limit
+		size_t jobsInFlight{ 0 };
+		size_t pageTableLevelsUploaded{ 0 };
+
+		float PageHitRate() const { return requestedPages ? residentPages / (float)requestedPages : 1.0f; }
+		float TexelHitRate() const { return feedbackTexels ? residentTexels / (float)feedbackTexels : 1.0f; }
+	};
+
+	// Writes the KSlotTexels square RGBA8 texels of a page, the page plus its border, on a job thread
+	using VirtualPageCompositor = std::function<void(const VirtualPage& page, GLubyte* rgba)>;
+
+	class VirtualTexture
+	{
+	public:
+		// Must match the constants of terrain_vt.frag and vt_feedback.frag
+		static constexpr GLuint KPagesAcross{ 128 };	// at level 0
+		static constexpr GLuint KLevels{ 8 };			// down to a single page
+		static constexpr GLuint KPageTexels{ 128 };
+		static constexpr GLuint KBorderTexels{ 4 };		// each side, so filtering near a page's edge reads its neighbour's texels
+		static constexpr GLuint KSlotTexels{ KPageTexels + 2 * KBorderTexels };
+		static constexpr GLuint KSlotsAcross{ 16 };
+
+		// The feedback is drawn at this fraction of the screen's width and height
+		static constexpr GLsizei KFeedbackDivisor{ 8 };
+	private:
+		// Feedback is read back this many frames after it is drawn, by when the GPU has finished with it
+		static constexpr size_t KFeedbackFrames{ 3 };
+		static constexpr size_t KMaxJobsInFlight{ 64 };
+
+		struct PageJob
+		{
+			VirtualPage page;
+			std::vector<GLubyte> texels;
+			JobCounter done;
+		};
+
+		GpuResourceRegistry* m_resources{ nullptr };
+		VirtualPageCompositor m_compositor;
+		GpuTexture m_pageTable;
+		GpuTexture m_cache;
+		VirtualPageCache m_pageCache;
+		bool m_pageTableDirty{ true };
+		size_t m_frame{ 0 };
+
+		// A region of the buffer per frame in flight, each with the fence after the frame that read into it
+		// and the size read, 0 if the feedback pass did not run
+		GpuBuffer m_feedbackBuffer;
+		const GLubyte* m_feedbackMapped{ nullptr };
+		size_t m_feedbackRegionBytes{ 0 };
+		glm::ivec2 m_feedbackSize{ 0 };
+		std::vector<GLsync> m_feedbackFences;
+		std::vector<glm::ivec2> m_feedbackRead;
+
+		std::vector<std::unique_ptr<PageJob>> m_jobs;
+		std::unordered_map<GLuint, size_t> m_requests;	// pages of the last feedback and how many texels sampled each
+
+		float m_lodBias{ 0.0f };
+		int m_jobsPerFrame{ 16 };
+		int m_uploadsPerFrame{ 16 };
+
+		VirtualTextureStats m_lastStats;
+		size_t m_totalUploaded{ 0 };
+
+		size_t Region() const { return m_frame % KFeedbackFrames; }
+		void ResizeFeedback(const glm::ivec2& size);
+		void ReadFeedback(size_t region, VirtualTextureStats& stats);
+		void StartJobs(VirtualTextureStats& stats);
+		void UploadPages(VirtualTextureStats& stats);
+		bool UploadPage(const VirtualPage& page, const GLubyte* texels, VirtualTextureStats& stats);
+		void UpdatePageTable(VirtualTextureStats& stats);
+	public:
+		VirtualTexture() = default;
+		VirtualTexture(const VirtualTexture&) = delete;
+		VirtualTexture& operator=(const VirtualTexture&) = delete;
+
+		// Waits for the jobs still making pages
+		~VirtualTexture();
+
+		// The textures are made through resources, which must outlive this. The coarsest page is made now. False on error.
+		bool Initialise(GpuResourceRegistry& resources, VirtualPageCompositor compositor);
+
+		// Read the oldest feedback, start making the pages it missed, upload those made and update the page table.
+		// Before anything is recorded, viewport is the screen the feedback is drawn for.
+		void BeginFrame(const glm::ivec4& viewport);
+
+		// Size of this frame's feedback target, RGBA8 with a page to each pixel and alpha 0 where nothing sampled
+		glm::ivec2 GetFeedbackSize() const { return m_feedbackSize; }
+
+		// Record copying the feedback, bound as the read framebuffer, to this frame's region of the readback buffer
+		void RecordFeedbackReadback(CommandList& list);
+
+		// Fence this frame's readback once its commands have been executed
+		void EndFrame();
+
+		// Bound as sampler2Ds, the page table with texelFetch and the cache with textureLod at level 0
+		GLuint GetPageTable() const { return m_pageTable.Get(); }
+		GLuint GetCache() const { return m_cache.Get(); }
+
+		// Added to the mip level shaders pick, the feedback shader also makes up for its smaller size
+		float GetLodBias() const { return m_lodBias; }
+		float GetFeedbackLodBias() const;
+
+		const VirtualTextureStats& GetLastStats() const { return m_lastStats; }
+		size_t GetTotalUploaded() const { return m_totalUploaded; }
+		const VirtualPageCache& GetPageCache() const { return m_pageCache; }
+
+		// Limits, the last frame's feedback and hit rates and the cache's pages by level
+		void DefineGUI();
+	};
+}
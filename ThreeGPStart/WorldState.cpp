@@ -0,0 +1,34 @@
+#include "WorldState.h"
+
+// Advance by one fixed time step
+void WorldState::Step(float stepSeconds)
+{
+	cubeAngle += KCubeRadiansPerSecond * stepSeconds;
+	if (cubeAngle > glm::two_pi<float>())
+	{
+		cubeAngle -= glm::two_pi<float>();
+		cubeRotateY = !cubeRotateY;
+	}
+	tick++;
+}
+
+// Blend from a to b by t in [0, 1] for drawing between ticks
+// Across a change of axis both angles are close to a full turn so just take the newer one
+WorldState WorldState::Interpolate(const WorldState& a, const WorldState& b, float t)
+{
+	WorldState result{ b };
+	if (a.cubeRotateY == b.cubeRotateY)
+		result.cubeAngle = glm::mix(a.cubeAngle, b.cubeAngle, t);
+	return result;
+}
+
+// Drawing one tick behind always has the two states either side of the time drawn
+WorldState WorldSnapshot::StateAt(double time) const
+{
+	const double tickSeconds{ currentTime - previousTime };
+	if (tickSeconds <= 0.0)
+		return current;
+
+	const float t{ (float)glm::clamp((time - previousTime) / tickSeconds, 0.0, 1.0) };
+	return WorldState::Interpolate(previous, current, t);
+}
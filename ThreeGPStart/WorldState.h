@@ -0,0 +1,33 @@
+#pragma once
+// Everything the simulation thread owns, copied whole to the renderer each tick
+
+#include "ExternalLibraryHeaders.h"
+
+struct WorldState
+{
+	// The rotating cube turns about y for a full turn then about x, and so on
+	static constexpr float KCubeRadiansPerSecond{ 0.06f };	// the old 0.001 a frame at 60 fps
+	float cubeAngle{ 0 };
+	bool cubeRotateY{ true };
+
+	// Fixed ticks since the simulation started
+	unsigned int tick{ 0 };
+
+	// Advance by one fixed time step
+	void Step(float stepSeconds);
+
+	// Blend from a to b by t in [0, 1] for drawing between ticks
+	static WorldState Interpolate(const WorldState& a, const WorldState& b, float t);
+};
+
+// What the simulation thread publishes: the last two ticks and when they happened (glfwGetTime seconds)
+struct WorldSnapshot
+{
+	WorldState previous;
+	WorldState current;
+	double previousTime{ 0 };
+	double currentTime{ 0 };
+
+	// Drawing one tick behind always has the two states either side of the time drawn
+	WorldState StateAt(double time) const;
+};
@@ -30,6 +30,19 @@
 
 	Important: of the provided files you should only need to edit the renderer.cpp and simulation.cpp files (plus of course add your own).
 
+	Run with --null [frames] to render without a window or GPU through the null render backend and print the CPU cost of each frame.
+	The exit code is non zero if the backend found anything wrong with the commands or a CPU check failed (light binning, the
+	virtual texture's page cache, meshlet culling), so it can be used as a regression test.
+	Add --trace file.json to either to write a Chrome trace of CPU scopes, GPU passes, loading and counters, viewed
+	in chrome://tracing or https://ui.perfetto.dev
+	Frames slower than 33.3 ms are written around to hitch_<frame>.json, --hitch ms changes the threshold.
+	Add --capture file.cap to capture a frame, from the GL calls panel or halfway through a --null run, with every resource it uses.
+	Run with --replay file.cap [loops] to draw the captured frame over and over in a hidden window and print the time of each
+	along with the GL calls made, add --null to replay through the null backend instead. On a machine without a GPU the driver
+	can be made to render in software with LIBGL_ALWAYS_SOFTWARE=1. The GL calls made loading the frame's resources are printed
+	too, add --bind-to-edit to make them the old way rather than with direct state access to compare.
+	Run with --atlas output image1 image2 ... to pack the images into output.png, with the rect of each image in output.json.
+
 	Keith ditchburn 2021
 */
 
@@ -38,22 +51,319 @@
 
 #include "Helper.h"
 #include "Simulation.h"
+#include "Renderer.h"
+#include "NullRenderBackend.h"
+#include "GLRenderBackend.h"
+#include "GLInterceptor.h"
+#include "FrameCapture.h"
+#include "TextureAtlas.h"
+
+#include <algorithm>
+
+// Render frames from a fixed camera with the null backend and no window, timing the CPU side of each
+// A frame is captured halfway through when captureFile is given
+static int RunHeadless(int frames, const std::string& traceFile, const std::string& captureFile)
+{
+	// GLFW is only needed for its timer
+	if (!glfwInit())
+		return -1;
+	if (!traceFile.empty())
+		Helpers::GetProfiler().StartTrace(traceFile);
+
+	Helpers::Camera camera;
+	camera.Initialise(glm::vec3(0, 200, 900), glm::vec3(0));
+
+	const double loadStart{ glfwGetTime() };
+	std::unique_ptr<Helpers::RenderBackend> backend{ std::make_unique<Helpers::NullRenderBackend>(1280, 720) };
+	Helpers::CaptureRenderBackend* capture{ nullptr };
+	if (!captureFile.empty())
+	{
+		backend = std::make_unique<Helpers::CaptureRenderBackend>(std::move(backend), captureFile);
+		capture = static_cast<Helpers::CaptureRenderBackend*>(backend.get());
+	}
+	Renderer renderer(std::move(backend));
+	if (!renderer.InitialiseGeometry())
+	{
+		glfwTerminate();
+		return -1;
+	}
+	std::cout << "Headless: loaded in " << (glfwGetTime() - loadStart) * 1000.0 << " ms" << std::endl;
+
+	// Each frame's counts are ready once the next frame begins, so the first frame is not counted
+	const float KFrameSeconds{ 1.0f / 60.0f };
+	WorldState world;
+	std::vector<float> frameMilliseconds;
+	Helpers::RenderBackendStats total;
+	for (int i = 0; i < frames; i++)
+	{
+		if (capture && i == frames / 2)
+			capture->CaptureNextFrame();
+		world.Step(KFrameSeconds);
+		const double start{ glfwGetTime() };
+		renderer.Render(camera, world, KFrameSeconds);
+		frameMilliseconds.push_back((float)((glfwGetTime() - start) * 1000.0));
+		if (i > 0)
+			total += renderer.GetBackend().GetStats();
+	}
+
+	std::sort(frameMilliseconds.begin(), frameMilliseconds.end());
+	float sum{ 0 };
+	for (float ms : frameMilliseconds)
+		sum += ms;
+	const size_t counted{ std::max<size_t>(frameMilliseconds.size(), 2) - 1 };
+	std::cout << "Headless: " << frames << " frames, mean " << sum / std::max<size_t>(frameMilliseconds.size(), 1) << " ms, median "
+		<< frameMilliseconds[frameMilliseconds.size() / 2] << " ms, 99% " << frameMilliseconds[frameMilliseconds.size() * 99 / 100]
+		<< " ms, max " << frameMilliseconds.back() << " ms" << std::endl;
+	std::cout << "Headless: per frame " << total.commands / counted << " commands, " << total.draws / counted << " draws, "
+		<< total.uniforms / counted << " uniforms, " << total.bufferUploadBytes / counted << " bytes uploaded, "
+		<< total.validationErrors << " validation errors" << std::endl;
+
+	const Helpers::FrameGraphStats& graph{ renderer.GetFrameGraph().GetStats() };
+	std::cout << "Headless: frame graph " << graph.passes << " passes, " << graph.culledPasses << " culled, " << graph.barriers << " barriers, "
+		<< graph.transientTextures << " transient targets in " << graph.physicalTextures << " textures, " << graph.aliasedBytes / 1024 << " KB ("
+		<< graph.transientBytes / 1024 << " KB without aliasing)" << std::endl;
+
+	const Helpers::GpuMemoryReport memory{ renderer.GetGpuResources().Report() };
+	std::cout << "Headless: GPU memory " << memory.resources << " objects, " << memory.bytes / 1024 << " KB, peak " << memory.peakBytes / 1024 << " KB" << std::endl;
+	for (const Helpers::GpuMemoryUsage& category : memory.byCategory)
+		std::cout << "  " << category.name << ": " << category.resources << " objects, " << category.bytes / 1024 << " KB" << std::endl;
+
+	const Helpers::TextureResidencyStats& residency{ renderer.GetTextureResidency().GetLastStats() };
+	std::cout << "Headless: textures resident " << residency.residentBytes / 1024 << " KB, requested " << residency.requestedBytes / 1024
+		<< " KB, budget " << renderer.GetTextureResidency().GetBudget() / 1024 << " KB" << std::endl;
+
+	const Helpers::VirtualTexture& virtualTexture{ renderer.GetVirtualTexture() };
+	const Helpers::VirtualTextureStats& pages{ virtualTexture.GetLastStats() };
+	std::cout << "Headless: virtual texture " << pages.requestedPages << " pages requested, " << pages.PageHitRate() * 100.0f << "% resident, "
+		<< virtualTexture.GetPageCache().NumResident() << " of " << virtualTexture.GetPageCache().NumSlots() << " slots used, "
+		<< virtualTexture.GetTotalUploaded() << " pages uploaded" << std::endl;
+
+	// The run requests no pages, so the page cache's replacement is checked on the CPU against a model of it
+	const Helpers::VirtualPageCacheCheck pageCacheCheck{ Helpers::CheckVirtualPageCache() };
+	std::cout << "Headless: page cache " << (pageCacheCheck.Passed() ? "passed" : "FAILED") << ", " << pageCacheCheck.frames << " frames, "
+		<< pageCacheCheck.hits << " hits, " << pageCacheCheck.misses << " misses, " << pageCacheCheck.evictions << " evictions, "
+		<< pageCacheCheck.refusals << " refused, failures: " << pageCacheCheck.countFailures << " count, " << pageCacheCheck.orderFailures
+		<< " order, " << pageCacheCheck.pinnedEvictions << " pinned, " << pageCacheCheck.refusalFailures << " refusal" << std::endl;
+
+	// Binning is checked for the final view, a light missing from a cluster it touches fails the run
+	const bool lightBinningPassed{ renderer.BenchmarkLightBinning() };
+	const Helpers::LightBinningStats& lights{ renderer.GetLightClusters().GetLastStats() };
+	std::cout << "Headless: " << lights.lightsBinned << " of " << lights.lights << " lights in view, " << lights.clustersLit << " clusters lit, "
+		<< lights.indices << " light indices, binned in " << lights.milliseconds << " ms" << std::endl;
+
+	// The last frame's cascades, the cached ones should have been drawn once unless something invalidated them
+	for (int c = 0; c < Helpers::CascadedShadows::KNumCascades; c++)
+	{
+		const Helpers::ShadowCascadeStats& cascade{ renderer.GetShadows().GetCascadeStats(c) };
+		std::cout << "Headless: shadow cascade " << c << (cascade.cached ? " cached" : "") << " to " << cascade.splitFar << ", "
+			<< cascade.extent << " across, " << cascade.castersDrawn << " of " << cascade.casters << " casters drawn, " << cascade.triangles
+			<< " triangles, " << cascade.redraws << " redraws, fit in " << cascade.milliseconds << " ms" << std::endl;
+	}
+
+	// Meshlet culling is compared with culling each triangle from views along a path past the jeep, all looking along -z
+	// as the camera only turns with input. Views where the jeep is hidden cull no meshlets so are not counted. A visible
+	// triangle in a culled meshlet fails the run.
+	static constexpr int KMeshletCheckViews{ 32 };
+	Helpers::MeshletValidation meshletCheck;
+	int meshletViews{ 0 };
+	for (int i = 0; i < KMeshletCheckViews; i++)
+	{
+		const float t{ i / (float)(KMeshletCheckViews - 1) };
+		camera.SetPosition(glm::vec3(glm::mix(-700.0f, 700.0f, t), glm::mix(400.0f, 60.0f, t), glm::mix(1200.0f, 150.0f, t)));
+		const size_t validations{ renderer.GetMeshletValidations() };
+		renderer.ValidateMeshletsNextFrame();
+		world.Step(KFrameSeconds);
+		renderer.Render(camera, world, KFrameSeconds);
+		if (renderer.GetMeshletValidations() == validations)
+			continue;
+
+		const Helpers::MeshletValidation& result{ renderer.GetMeshletValidation() };
+		meshletCheck.trianglesVisible += result.trianglesVisible;
+		meshletCheck.trianglesEmitted += result.trianglesEmitted;
+		meshletCheck.trianglesMissing += result.trianglesMissing;
+		meshletViews++;
+	}
+	const bool meshletCheckPassed{ meshletCheck.Passed() && meshletViews > 0 };
+	std::cout << "Headless: meshlet culling " << (meshletCheckPassed ? "passed" : "FAILED") << " in " << meshletViews << " of " << KMeshletCheckViews
+		<< " views, " << meshletCheck.trianglesVisible << " visible triangles, " << meshletCheck.trianglesEmitted << " emitted, "
+		<< meshletCheck.trianglesMissing << " missing" << std::endl;
+
+	if (capture)
+		std::cout << "Headless: " << capture->CapturesWritten() << " frame captured to " << captureFile << std::endl;
+
+	Helpers::GetProfiler().StopTrace();
+	glfwTerminate();
+	return total.validationErrors || !lightBinningPassed || !pageCacheCheck.Passed() || !meshletCheckPassed ? 1 : 0;
+}
+
+// Execute a captured frame loops times, timing each from the start of the frame until the GPU has finished it
+static int RunReplay(const std::string& captureFile, int loops, bool null, bool directStateAccess)
+{
+	std::unique_ptr<Helpers::RenderBackend> backend;
+	if (null)
+	{
+		if (!glfwInit())
+			return -1;
+		backend = std::make_unique<Helpers::NullRenderBackend>(1280, 720);
+	}
+	else
+	{
+		// The window is only needed for its GL context
+		GLFWwindow* window{ Helpers::CreateGLFWWindow(1280, 720, "3GP Replay") };
+		if (!window)
+			return -1;
+		glfwHideWindow(window);
+		backend = std::make_unique<Helpers::GLRenderBackend>(directStateAccess);
+		Helpers::GetGLInterceptor().Install();
+	}
+
+	int result{ 0 };
+	{
+		Helpers::CaptureReplay replay;
+		if (!replay.Load(captureFile, *backend))
+		{
+			glfwTerminate();
+			return -1;
+		}
+		std::cout << "Replay: " << captureFile << ", " << replay.NumLists() << " lists, " << replay.NumCommands() << " commands on the "
+			<< backend->Name() << " backend" << std::endl;
+
+		// Everything so far was loading
+		if (Helpers::GetGLInterceptor().IsInstalled())
+		{
+			Helpers::GetGLInterceptor().BeginFrame();
+			const Helpers::GLFrameStats& load{ Helpers::GetGLInterceptor().GetLastFrameStats() };
+			size_t resourceCalls{ 0 };
+			for (const Helpers::GLCallCount& function : load.functions)
+			{
+				if (function.kind == Helpers::GLCallKind::Resource)
+					resourceCalls += function.calls;
+			}
+			std::cout << "Replay: loaded with " << load.calls << " GL calls, " << resourceCalls << " making objects, " << load.stateChanges
+				<< " binds and state changes, " << load.uploadBytes / 1024 << " KB uploaded" << std::endl;
+		}
+
+		// Each loop's counts are ready once the next begins, so the first loop is not counted
+		std::vector<float> frameMilliseconds;
+		Helpers::RenderBackendStats total;
+		size_t glCalls{ 0 };
+		size_t glDraws{ 0 };
+		size_t glStateChanges{ 0 };
+		for (int i = 0; i < loops; i++)
+		{
+			const double start{ glfwGetTime() };
+			backend->BeginFrame();
+			Helpers::GetGLInterceptor().BeginFrame();
+			replay.Execute();
+			backend->Finish();
+			frameMilliseconds.push_back((float)((glfwGetTime() - start) * 1000.0));
+			if (i > 0)
+			{
+				total += backend->GetStats();
+				const Helpers::GLFrameStats& gl{ Helpers::GetGLInterceptor().GetLastFrameStats() };
+				glCalls += gl.calls;
+				glDraws += gl.draws;
+				glStateChanges += gl.stateChanges;
+			}
+		}
+
+		std::sort(frameMilliseconds.begin(), frameMilliseconds.end());
+		float sum{ 0 };
+		for (float ms : frameMilliseconds)
+			sum += ms;
+		const size_t counted{ std::max<size_t>(frameMilliseconds.size(), 2) - 1 };
+		std::cout << "Replay: " << loops << " loops, mean " << sum / frameMilliseconds.size() << " ms, median "
+			<< frameMilliseconds[frameMilliseconds.size() / 2] << " ms, min " << frameMilliseconds.front() << " ms, max "
+			<< frameMilliseconds.back() << " ms" << std::endl;
+		std::cout << "Replay: per frame " << total.commands / counted << " commands, " << total.draws / counted << " draws, "
+			<< total.stateChanges / counted << " state changes, " << total.validationErrors << " validation errors" << std::endl;
+		if (Helpers::GetGLInterceptor().IsInstalled())
+		{
+			std::cout << "Replay: per frame " << glCalls / counted << " GL calls, " << glDraws / counted << " draws, "
+				<< glStateChanges / counted << " state changes" << std::endl;
+		}
+		result = total.validationErrors ? 1 : 0;
+	}
+
+	Helpers::GetGLInterceptor().Uninstall();
+	backend.reset();
+	glfwTerminate();
+	return result;
+}
+
+// Pack images into an atlas offline, writing output.png and its rect table output.json
+static int RunAtlas(const std::string& output, const std::vector<std::string>& images)
+{
+	Helpers::TextureAtlas atlas;
+	for (const std::string& filename : images)
+	{
+		Helpers::ImageLoader image;
+		if (!image.Load(filename))
+			return -1;
+		atlas.Add(filename, image.Width(), image.Height(), image.GetData());
+	}
+	if (!atlas.Build())
+		return -1;
+
+	std::cout << "Atlas: " << atlas.GetRects().size() << " images in " << atlas.Width() << "x" << atlas.Height() << ", "
+		<< atlas.Occupancy() * 100.0f << "% used, mip safe to level " << atlas.MipLevels() << std::endl;
+	if (!Helpers::SaveImage(const_cast<GLubyte*>(atlas.GetData()), atlas.Width(), atlas.Height(), output))
+	{
+		std::cout << "ERROR: could not save " << output << ".png" << std::endl;
+		return -1;
+	}
+	return atlas.WriteRectTable(output + ".json") ? 0 : -1;
+}
 
 // Note: you should not need to edit any of this
-int main()
+int main(int argc, char* argv[])
 {	
 	// Allows cout to go to the output pane in Visual Studio rather than have to open a console window
 	RedirectStandardOuput();
 
+	// --trace, --hitch and --capture can go anywhere, the rest are positional
+	std::string traceFile;
+	std::string captureFile;
+	std::vector<std::string> args;
+	for (int i = 1; i < argc; i++)
+	{
+		if (std::string(argv[i]) == "--trace" && i + 1 < argc)
+			traceFile = argv[++i];
+		else if (std::string(argv[i]) == "--hitch" && i + 1 < argc)
+			Helpers::GetProfiler().SetHitchThreshold((float)std::atof(argv[++i]));
+		else if (std::string(argv[i]) == "--capture" && i + 1 < argc)
+			captureFile = argv[++i];
+		else
+			args.push_back(argv[i]);
+	}
+
+	if (!args.empty() && args[0] == "--null")
+		return RunHeadless(args.size() > 1 ? std::max(std::atoi(args[1].c_str()), 1) : 1000, traceFile, captureFile);
+
+	if (args.size() > 2 && args[0] == "--atlas")
+		return RunAtlas(args[1], std::vector<std::string>(args.begin() + 2, args.end()));
+
+	if (args.size() > 1 && args[0] == "--replay")
+	{
+		const bool null{ std::find(args.begin(), args.end(), "--null") != args.end() };
+		const bool bindToEdit{ std::find(args.begin(), args.end(), "--bind-to-edit") != args.end() };
+		const int loops{ args.size() > 2 && args[2].compare(0, 2, "--") != 0 ? std::max(std::atoi(args[2].c_str()), 1) : 100 };
+		return RunReplay(args[1], loops, null, !bindToEdit);
+	}
+
 	// Use the provided helper function to set up GLFW, GLEW and OpenGL
 	GLFWwindow* window{ Helpers::CreateGLFWWindow(1280, 720, "3GP Framework - Andrew Hartley") };
 	if (!window)
 		return -1;
 
+	// Started before loading so it is in the trace too
+	if (!traceFile.empty())
+		Helpers::GetProfiler().StartTrace(traceFile);
+
 	// Create an instance of the simulation class and initialise it
 	// If it could not load, exit gracefully
 	Simulation simulation;	
-	if (!simulation.Initialise())
+	if (!simulation.Initialise(captureFile))
 	{
 		glfwTerminate();
 		return -1;
@@ -72,6 +382,8 @@ int main()
 		glfwPollEvents();
 	}
 
+	Helpers::GetProfiler().StopTrace();
+
 	// Close down IMGUI
 	ImGui_ImplOpenGL3_Shutdown();
 	ImGui_ImplGlfw_Shutdown();